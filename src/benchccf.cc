@@ -0,0 +1,1580 @@
+/**
+ * @file    benchccf.cc
+ * @brief   benchmarks for CCF
+ * @author  agent (agent@local)
+ * @version 1.0
+ * @date    2026-10-17
+ * @copyright agent (2026)
+ *
+ * The benchmarks are built as a separate program(benchccf) without CCFDEBUG,
+ * so the debug dump of the packets are not counted.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sched.h> // sched_yield()
+#include <new> // std::bad_alloc
+#include <fstream> // std::ofstream
+
+#include "ds3pktccf.h"
+#include "ds3pktslc.h"
+#include "ds3pktgnc.h"
+#include "testmac.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h> // __rdtsc()
+#define BENCH_HAVE_TSC 1
+#endif
+
+/** @brief get the current time in seconds */
+static double
+bench_time (void)
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec + ts.tv_nsec * 1e-9);
+}
+
+/** @brief print one line of the result */
+static void
+bench_report (const char * name, size_t num, double tmused)
+{
+    printf ("%-40s %10zu ops %10.3f ms %8.2f ns/op %10.2f Mops/s\n"
+        , name, num, tmused * 1000.0, tmused * 1e9 / num, num / tmused / 1e6);
+}
+
+/** @brief get the current CPU cycle counter, 0 if not supported */
+static uint64_t
+bench_cycles (void)
+{
+#if BENCH_HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/** @brief print one line of the result, in cycles */
+static void
+bench_report_cycles (const char * name, size_t num, double tmused, uint64_t cycles)
+{
+    printf ("%-40s %10zu ops %8.2f ns/op %8.2f cycles/op\n"
+        , name, num, tmused * 1e9 / num, (double)cycles / num);
+}
+
+/* prevent the compiler from removing the benchmark loops */
+volatile size_t g_bench_sink = 0;
+
+/* count the heap allocations of the benchmark program */
+static size_t g_bench_allocs = 0;
+
+void *
+operator new (size_t sz)
+{
+    g_bench_allocs ++;
+    void * p = malloc (sz);
+    if (NULL == p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void
+operator delete (void * p)
+{
+    free (p);
+}
+
+/**
+ * @brief compare the per-header CCF codec functions with the batch ones
+ *
+ * @param numhdr : [in] the number of headers in one batch
+ * @param rounds : [in] the number of the rounds
+ *
+ * @return 0 on success, < 0 on error
+ */
+int
+bench_ccfhdr_batch (size_t numhdr, size_t rounds)
+{
+    size_t szhdr = DS3HDR_CCF_SIZE;
+    std::vector<ds3hdr_ccf_t> hdrs(numhdr);
+    std::vector<ds3hdr_ccf_t> hdrs2(numhdr);
+    std::vector<uint8_t> buffer(szhdr * numhdr);
+    std::vector<uint8_t> buffer2(szhdr * numhdr);
+    size_t i;
+    size_t r;
+    double tmstart;
+    char name[64];
+
+    for (i = 0; i < numhdr; i ++) {
+        memset (&(hdrs[i]), 0, sizeof(hdrs[i]));
+        hdrs[i].pfi = rand() & 0x01;
+        hdrs[i].offmac = rand() & 0x3FFF;
+        hdrs[i].sequence = i & 0x1FFF;
+        hdrs[i].sc = rand() & 0x07;
+        hdrs[i].request = rand() & 0xFFFF;
+        hdrs[i].hcs = rand() & 0xFFFF;
+    }
+
+    printf ("CCF header codec, %zu headers per batch:\n", numhdr);
+    tmstart = bench_time();
+    for (r = 0; r < rounds; r ++) {
+        for (i = 0; i < numhdr; i ++) {
+            ds3hdr_ccf_to_nbs (&(buffer2[i * szhdr]), szhdr, &(hdrs[i]));
+        }
+        g_bench_sink += buffer2[r % buffer2.size()];
+    }
+    snprintf (name, sizeof(name), "  ds3hdr_ccf_to_nbs");
+    bench_report (name, numhdr * rounds, bench_time() - tmstart);
+
+    tmstart = bench_time();
+    for (r = 0; r < rounds; r ++) {
+        ds3hdr_ccf_to_nbs_batch (&(buffer[0]), buffer.size(), &(hdrs[0]), numhdr);
+        g_bench_sink += buffer[r % buffer.size()];
+    }
+    snprintf (name, sizeof(name), "  ds3hdr_ccf_to_nbs_batch");
+    bench_report (name, numhdr * rounds, bench_time() - tmstart);
+    if (0 != memcmp (&(buffer[0]), &(buffer2[0]), buffer.size())) {
+        printf ("Error: the batch encoder result differs!\n");
+        return -1;
+    }
+
+    tmstart = bench_time();
+    for (r = 0; r < rounds; r ++) {
+        for (i = 0; i < numhdr; i ++) {
+            ds3hdr_ccf_from_nbs (&(buffer[i * szhdr]), szhdr, &(hdrs2[i]));
+        }
+        g_bench_sink += hdrs2[r % numhdr].request;
+    }
+    snprintf (name, sizeof(name), "  ds3hdr_ccf_from_nbs");
+    bench_report (name, numhdr * rounds, bench_time() - tmstart);
+
+    tmstart = bench_time();
+    for (r = 0; r < rounds; r ++) {
+        ds3hdr_ccf_from_nbs_batch (&(buffer[0]), buffer.size(), &(hdrs2[0]), numhdr);
+        g_bench_sink += hdrs2[r % numhdr].request;
+    }
+    snprintf (name, sizeof(name), "  ds3hdr_ccf_from_nbs_batch");
+    bench_report (name, numhdr * rounds, bench_time() - tmstart);
+    if (0 != memcmp (&(hdrs[0]), &(hdrs2[0]), numhdr * sizeof(hdrs[0]))) {
+        printf ("Error: the batch decoder result differs!\n");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief the cost of the HCS, for both the pack(calculate) and the unpack(check) path
+ *
+ * @param numhdr : [in] the number of headers
+ * @param rounds : [in] the number of the rounds
+ *
+ * @return 0 on success, < 0 on error
+ */
+int
+bench_ccfhdr_hcs (size_t numhdr, size_t rounds)
+{
+    size_t szhdr = DS3HDR_CCF_SIZE;
+    std::vector<ds3hdr_ccf_t> hdrs(numhdr);
+    std::vector<uint8_t> buffer(szhdr * numhdr);
+    size_t i;
+    size_t r;
+    size_t numerr = 0;
+    double tmstart;
+    uint64_t cystart;
+
+    for (i = 0; i < numhdr; i ++) {
+        memset (&(hdrs[i]), 0, sizeof(hdrs[i]));
+        hdrs[i].pfi = rand() & 0x01;
+        hdrs[i].offmac = rand() & 0x3FFF;
+        hdrs[i].sequence = i & 0x1FFF;
+        hdrs[i].sc = rand() & 0x07;
+        hdrs[i].request = rand() & 0xFFFF;
+    }
+
+    printf ("CCF HCS, %zu headers:\n", numhdr);
+    tmstart = bench_time();
+    cystart = bench_cycles();
+    for (r = 0; r < rounds; r ++) {
+        for (i = 0; i < numhdr; i ++) {
+            hdrs[i].hcs = ds3hdr_ccf_calc_hcs (&(hdrs[i]));
+        }
+        g_bench_sink += hdrs[r % numhdr].hcs;
+    }
+    bench_report_cycles ("  pack: ds3hdr_ccf_calc_hcs", numhdr * rounds, bench_time() - tmstart, bench_cycles() - cystart);
+
+    for (i = 0; i < numhdr; i ++) {
+        ds3hdr_ccf_to_nbs (&(buffer[i * szhdr]), szhdr, &(hdrs[i]));
+    }
+    tmstart = bench_time();
+    cystart = bench_cycles();
+    for (r = 0; r < rounds; r ++) {
+        for (i = 0; i < numhdr; i ++) {
+            if (! ds3hdr_ccf_check_hcs (&(buffer[i * szhdr]), szhdr)) {
+                numerr ++;
+            }
+        }
+    }
+    bench_report_cycles ("  unpack: ds3hdr_ccf_check_hcs", numhdr * rounds, bench_time() - tmstart, bench_cycles() - cystart);
+    if (numerr > 0) {
+        printf ("Error: %zu HCS check failed!\n", numerr);
+        return -1;
+    }
+
+    tmstart = bench_time();
+    cystart = bench_cycles();
+    for (r = 0; r < rounds; r ++) {
+        for (i = 0; i < numhdr; i ++) {
+            g_bench_sink += ds3_crc16_ccitt (&(buffer[i * szhdr]), 6);
+        }
+    }
+    bench_report_cycles ("  ds3_crc16_ccitt(6 bytes)", numhdr * rounds, bench_time() - tmstart, bench_cycles() - cystart);
+    return 0;
+}
+
+/**
+ * @brief move a MAC frame split over 3 grants through the buffers, as the pack and the unpack do
+ *
+ * the frame is inserted to the pack buffer of each grant, set to the segment content,
+ * inserted to the unpack buffer, and then converted to the network byte sequence.
+ *
+ * @param name : [in] the name of the buffer type
+ * @param szframe : [in] the size of the MAC frame
+ * @param rounds : [in] the number of the rounds
+ *
+ * @return 0 on success, < 0 on error
+ */
+template <class T> int
+bench_buffer_chain (const char * name, size_t szframe, size_t rounds)
+{
+    std::vector<uint8_t> frame(szframe);
+    std::vector<uint8_t> output(szframe);
+    size_t r;
+    size_t i;
+    double tmstart;
+    char title[64];
+
+    for (i = 0; i < szframe; i ++) {
+        frame[i] = i;
+    }
+    T src;
+    src.append (&frame[0], frame.size());
+
+    tmstart = bench_time();
+    for (r = 0; r < rounds; r ++) {
+        ds3_packet_buffer_t hdrbuf;
+        for (i = 0; i < 3; i ++) {
+            size_t b = szframe * i / 3;
+            size_t e = szframe * (i + 1) / 3;
+            ds3_packet_buffer_t grantbuf;
+            ds3_packet_buffer_t segcnt;
+            grantbuf.insert (0, &src, b, e);
+            segcnt.insert (0, &grantbuf, 0, grantbuf.size());
+            hdrbuf.insert (hdrbuf.size(), &segcnt, 0, segcnt.size());
+        }
+        hdrbuf.to_nbs (&output[0], output.size());
+        g_bench_sink += output[r % szframe];
+    }
+    snprintf (title, sizeof(title), "  %s", name);
+    bench_report (title, rounds, bench_time() - tmstart);
+    if (0 != memcmp (&frame[0], &output[0], szframe)) {
+        printf ("Error: the %s result differs!\n", name);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief the position lookup in ds3_packet_buffer_gpkt_t with numpkt packets
+ *
+ * append numpkt generic packets, and then get the block size at the start of each packet.
+ *
+ * @param numpkt : [in] the number of the packets in the buffer
+ * @param rounds : [in] the number of the rounds
+ *
+ * @return 0 on success, < 0 on error
+ */
+static int
+bench_gpkt_index (size_t numpkt, size_t rounds)
+{
+    const size_t szpkt = 100;
+    size_t r;
+    size_t i;
+    double tmappend = 0;
+    double tmlookup = 0;
+    double tmstart;
+    char title[64];
+
+    for (r = 0; r < rounds; r ++) {
+        ds3_packet_buffer_gpkt_t buf;
+        tmstart = bench_time();
+        for (i = 0; i < numpkt; i ++) {
+            buf.insert_gpkt (i * szpkt, (ds3_packet_generic_t)(i + 1), 0, szpkt);
+        }
+        tmappend += bench_time() - tmstart;
+
+        tmstart = bench_time();
+        for (i = 0; i < numpkt; i ++) {
+            g_bench_sink += buf.block_size_at (i * szpkt);
+        }
+        tmlookup += bench_time() - tmstart;
+        if ((ssize_t)(numpkt * szpkt) != buf.size()) {
+            printf ("Error: the gpkt size differs!\n");
+            return -1;
+        }
+    }
+    snprintf (title, sizeof(title), "  insert_gpkt, %zu packets", numpkt);
+    bench_report (title, numpkt * rounds, tmappend);
+    snprintf (title, sizeof(title), "  block_size_at, %zu packets", numpkt);
+    bench_report (title, numpkt * rounds, tmlookup);
+    return 0;
+}
+
+/**
+ * @brief use ds3_packet_buffer_gpkt_t as a FIFO with numpkt packets
+ *
+ * each operation appends a packet to the end, removes a part of the packet at the front
+ * and gets the block size of the next one, as the CCF engines consume the buffers.
+ *
+ * @param numpkt : [in] the number of the packets in the buffer
+ * @param numops : [in] the number of the operations
+ *
+ * @return 0 on success, < 0 on error
+ */
+static int
+bench_gpkt_fifo (size_t numpkt, size_t numops)
+{
+    const size_t szpkt = 100;
+    size_t i;
+    double tmstart;
+    char title[64];
+    ds3_packet_buffer_gpkt_t buf;
+
+    for (i = 0; i < numpkt; i ++) {
+        buf.insert_gpkt (i * szpkt, (ds3_packet_generic_t)(i + 1), 0, szpkt);
+    }
+    tmstart = bench_time();
+    for (i = 0; i < numops; i ++) {
+        buf.insert_gpkt (buf.size(), (ds3_packet_generic_t)(numpkt + i + 1), 0, szpkt);
+        // remove the packet at the front in two steps
+        buf.erase (0, szpkt / 2);
+        buf.erase (0, szpkt - szpkt / 2);
+        g_bench_sink += buf.block_size_at (0);
+    }
+    snprintf (title, sizeof(title), "  front erase, %zu packets", numpkt);
+    bench_report (title, numops, bench_time() - tmstart);
+    if ((ssize_t)(numpkt * szpkt) != buf.size()) {
+        printf ("Error: the gpkt size differs!\n");
+        return -1;
+    }
+    return 0;
+}
+
+/** @brief the unpack engine of the benchmark, counts the MAC packets */
+class bench_ccf_unpack_t : public ds3_ccf_unpack_t {
+public:
+    bench_ccf_unpack_t() : num_mac(0), sz_mac(0), tmnow(0) {}
+    size_t num_mac; /**< the number of the MAC packets unpacked */
+    size_t sz_mac; /**< the bytes of the MAC packets unpacked */
+    double tmnow; /**< the current time of the unpack engine */
+protected:
+    virtual void recycle_packet (ds3packet_t *p) { this->recycle_segment (static_cast<ds3packet_ccf_t *>(p)); }
+    virtual void drop_packet (ds3packet_t *p) { this->recycle_segment (static_cast<ds3packet_ccf_t *>(p)); }
+    virtual int signify_packet (ds3_packet_buffer_t & macbuffer) { this->num_mac ++; this->sz_mac += macbuffer.size(); return 0; }
+    virtual int signify_piggyback (int sc, size_t request) { return 0; }
+    virtual double current_time (void) { return this->tmnow; }
+};
+
+/** @brief the pack engine of the benchmark, the segments are sent to the unpack engine directly, or saved to a list */
+class bench_ccf_pack_t : public ds3_ccf_pack_t {
+public:
+    bench_ccf_pack_t(ds3_ccf_unpack_t * u, std::vector<ds3packet_t *> * out = NULL) : num_seg(0), unpak(u), segout(out) {}
+    size_t num_seg; /**< the number of the segments packed */
+protected:
+    ds3_ccf_unpack_t * unpak;
+    std::vector<ds3packet_t *> * segout; /**< the list to save the segments */
+    virtual void recycle_packet (ds3packet_t *p) { delete p; }
+    virtual void drop_packet (ds3packet_t *p) { delete p; }
+    virtual int start_sndpkt_timer (double abs_time, ds3event_t evt, ds3packet_t * p, size_t channel_id)
+        {
+            this->num_seg ++;
+            if (NULL != this->segout) {
+                this->segout->push_back (p);
+                return 0;
+            }
+            if (NULL == this->unpak) {
+                this->recycle_segment (static_cast<ds3packet_ccf_t *>(p));
+                return 0;
+            }
+            this->unpak->process_packet (p);
+            return 0;
+        }
+    virtual double current_time (void) { return 0.0; }
+};
+
+/**
+ * @brief the throughput of pack and unpack
+ *
+ * the grants are added as the MAC packets arrive, and the segments are unpacked in order.
+ *
+ * @param szpkt : [in] the size of the MAC packet content
+ * @param szgrant : [in] the size of each grant
+ * @param numpkt : [in] the number of the MAC packets
+ * @param flg_unpack : [in] if unpack the segments
+ *
+ * @return 0 on success, < 0 on error
+ */
+int
+bench_pack_unpack (size_t szpkt, size_t szgrant, size_t numpkt, bool flg_unpack)
+{
+    bench_ccf_unpack_t unpak;
+    bench_ccf_pack_t pak(flg_unpack ? &unpak : NULL);
+    // the segments unpacked are reused by the pack engine
+    pak.share_segpool (unpak);
+    ds3_packet_buffer_nbs_t nbscnt;
+    std::vector<uint8_t> content(szpkt);
+    ds3_grant_t gt;
+    size_t i;
+    size_t szgrants = 0;
+    size_t szpkts = 0;
+    double tmused;
+    char name[64];
+
+    memset (&content[0], 0x5A, content.size());
+    nbscnt.append (&content[0], content.size());
+    gt.set_channel_id (1);
+    gt.set_time (1.0);
+    gt.set_size (szgrant);
+
+    // the engines report the events by std::cout/std::cerr
+    std::cout.setstate (std::ios::badbit);
+    std::cerr.setstate (std::ios::badbit);
+    size_t numalloc = g_bench_allocs;
+    double tmstart = bench_time();
+    for (i = 0; i < numpkt; i ++) {
+        ds3packet_nbsmac_t * pktmac = new ds3packet_nbsmac_t ();
+        pktmac->set_content (&nbscnt);
+        pktmac->sethdr_sequence (i);
+        szpkts += pktmac->get_size();
+        pak.process_packet (pktmac);
+        for (; szgrants < szpkts; szgrants += szgrant - DS3HDR_CCF_SIZE) {
+            pak.add_grant (gt);
+        }
+    }
+    tmused = bench_time() - tmstart;
+    numalloc = g_bench_allocs - numalloc;
+    std::cout.clear ();
+    std::cerr.clear ();
+
+    snprintf (name, sizeof(name), "  %s %zu/%zu", (flg_unpack ? "pack+unpack" : "pack"), szpkt, szgrant);
+    bench_report (name, numpkt, tmused);
+    printf ("%-40s %10zu segs %10.2f MB/s %8.2f allocs/op\n", "", pak.num_seg, szpkts / tmused / 1e6, (double)numalloc / numpkt);
+    printf ("%-40s %10zu hits %10zu misses\n", "  segment pool", pak.get_segpool().get_hits(), pak.get_segpool().get_misses());
+    // the last packet may wait for the next grant
+    if (flg_unpack && (unpak.num_mac + 1 < numpkt)) {
+        printf ("Error: only %zu of %zu packets unpacked!\n", unpak.num_mac, numpkt);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief the unpack of the segments received out of order
+ *
+ * the segments are shuffled in each window of the sequence numbers before they are unpacked
+ *
+ * @param szpkt : [in] the size of the MAC packet content
+ * @param szgrant : [in] the size of each grant
+ * @param numpkt : [in] the number of the MAC packets
+ * @param window : [in] the number of the segments shuffled together, 1 for in order
+ *
+ * @return 0 on success, < 0 on error
+ */
+int
+bench_unpack_reorder (size_t szpkt, size_t szgrant, size_t numpkt, size_t window)
+{
+    std::vector<ds3packet_t *> seglst;
+    bench_ccf_unpack_t unpak;
+    bench_ccf_pack_t pak(NULL, &seglst);
+    ds3_packet_buffer_nbs_t nbscnt;
+    std::vector<uint8_t> content(szpkt);
+    ds3_grant_t gt;
+    size_t i;
+    size_t j;
+    size_t szgrants = 0;
+    size_t szpkts = 0;
+    char name[64];
+
+    memset (&content[0], 0x5A, content.size());
+    nbscnt.append (&content[0], content.size());
+    gt.set_channel_id (1);
+    gt.set_time (1.0);
+    gt.set_size (szgrant);
+    std::cout.setstate (std::ios::badbit);
+    std::cerr.setstate (std::ios::badbit);
+    for (i = 0; i < numpkt; i ++) {
+        ds3packet_nbsmac_t * pktmac = new ds3packet_nbsmac_t ();
+        pktmac->set_content (&nbscnt);
+        szpkts += pktmac->get_size();
+        pak.process_packet (pktmac);
+    }
+    for (; szgrants < szpkts; szgrants += szgrant - DS3HDR_CCF_SIZE) {
+        pak.add_grant (gt);
+    }
+    for (i = 0; i + 1 < seglst.size(); i ++) {
+        j = i + rand () % (window - (i % window));
+        if (j < seglst.size()) {
+            std::swap (seglst[i], seglst[j]);
+        }
+    }
+    double tmstart = bench_time();
+    for (i = 0; i < seglst.size(); i ++) {
+        unpak.process_packet (seglst[i]);
+    }
+    double tmused = bench_time() - tmstart;
+    std::cout.clear ();
+    std::cerr.clear ();
+
+    snprintf (name, sizeof(name), "  %zu/%zu, window %zu", szpkt, szgrant, window);
+    bench_report (name, seglst.size(), tmused);
+    if (unpak.num_mac != numpkt) {
+        printf ("Error: only %zu of %zu packets unpacked!\n", unpak.num_mac, numpkt);
+        return -1;
+    }
+    return 0;
+}
+
+/** @brief the unpack engine of the benchmark, the MAC packets are signified by the frame views */
+class bench_ccf_unpack_view_t : public bench_ccf_unpack_t {
+public:
+    bench_ccf_unpack_view_t() { this->set_frame_view (true); }
+protected:
+    virtual int signify_frame (ds3_frame_view_t * view) { this->num_mac ++; this->sz_mac += view->size(); this->release_frame (view); return 0; }
+};
+
+/**
+ * @brief the unpack of the MAC packets signified by the copies or the frame views
+ *
+ * @param szpkt : [in] the size of the MAC packet content
+ * @param szgrant : [in] the size of each grant
+ * @param numpkt : [in] the number of the MAC packets
+ * @param flg_view : [in] the MAC packets are signified by the frame views
+ *
+ * @return 0 on success, < 0 on error
+ */
+int
+bench_unpack_view (size_t szpkt, size_t szgrant, size_t numpkt, bool flg_view)
+{
+    std::vector<ds3packet_t *> seglst;
+    bench_ccf_unpack_t unpakcopy;
+    bench_ccf_unpack_view_t unpakview;
+    bench_ccf_unpack_t & unpak = (flg_view ? unpakview : unpakcopy);
+    bench_ccf_pack_t pak(NULL, &seglst);
+    ds3_packet_buffer_nbs_t nbscnt;
+    std::vector<uint8_t> content(szpkt);
+    ds3_grant_t gt;
+    size_t i;
+    size_t szgrants = 0;
+    size_t szpkts = 0;
+    char name[64];
+
+    memset (&content[0], 0x5A, content.size());
+    nbscnt.append (&content[0], content.size());
+    gt.set_channel_id (1);
+    gt.set_time (1.0);
+    gt.set_size (szgrant);
+    std::cout.setstate (std::ios::badbit);
+    std::cerr.setstate (std::ios::badbit);
+    for (i = 0; i < numpkt; i ++) {
+        ds3packet_nbsmac_t * pktmac = new ds3packet_nbsmac_t ();
+        pktmac->set_content (&nbscnt);
+        szpkts += pktmac->get_size();
+        pak.process_packet (pktmac);
+    }
+    for (; szgrants < szpkts; szgrants += szgrant - DS3HDR_CCF_SIZE) {
+        pak.add_grant (gt);
+    }
+    double tmstart = bench_time();
+    for (i = 0; i < seglst.size(); i ++) {
+        unpak.process_packet (seglst[i]);
+    }
+    double tmused = bench_time() - tmstart;
+    std::cout.clear ();
+    std::cerr.clear ();
+
+    snprintf (name, sizeof(name), "  %zu/%zu, %s", szpkt, szgrant, (flg_view ? "view" : "copy"));
+    bench_report (name, numpkt, tmused);
+    if (unpak.num_mac != numpkt) {
+        printf ("Error: only %zu of %zu packets unpacked!\n", unpak.num_mac, numpkt);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief the unpack of the segments with some of them lost
+ *
+ * one of each numloss segments is not received, the segments are received 1 us apart
+ *
+ * @param szpkt : [in] the size of the MAC packet content
+ * @param szgrant : [in] the size of each grant
+ * @param numpkt : [in] the number of the MAC packets
+ * @param numloss : [in] one segment is lost in each numloss segments
+ * @param timeout : [in] the reassembly timeout, 0 to disable
+ *
+ * @return 0 on success, < 0 on error
+ */
+int
+bench_unpack_loss (size_t szpkt, size_t szgrant, size_t numpkt, size_t numloss, double timeout)
+{
+    std::vector<ds3packet_t *> seglst;
+    bench_ccf_unpack_t unpak;
+    bench_ccf_pack_t pak(NULL, &seglst);
+    ds3_packet_buffer_nbs_t nbscnt;
+    std::vector<uint8_t> content(szpkt);
+    ds3_grant_t gt;
+    size_t i;
+    size_t szgrants = 0;
+    size_t szpkts = 0;
+    size_t maxseg = 0;
+    char name[64];
+
+    memset (&content[0], 0x5A, content.size());
+    nbscnt.append (&content[0], content.size());
+    gt.set_channel_id (1);
+    gt.set_time (1.0);
+    gt.set_size (szgrant);
+    unpak.set_timeout (timeout);
+    std::cout.setstate (std::ios::badbit);
+    std::cerr.setstate (std::ios::badbit);
+    for (i = 0; i < numpkt; i ++) {
+        ds3packet_nbsmac_t * pktmac = new ds3packet_nbsmac_t ();
+        pktmac->set_content (&nbscnt);
+        szpkts += pktmac->get_size();
+        pak.process_packet (pktmac);
+    }
+    for (; szgrants < szpkts; szgrants += szgrant - DS3HDR_CCF_SIZE) {
+        pak.add_grant (gt);
+    }
+    double tmstart = bench_time();
+    for (i = 0; i < seglst.size(); i ++) {
+        unpak.tmnow = i * 1e-6;
+        if (0 == (i + 1) % numloss) {
+            delete seglst[i];
+            continue;
+        }
+        unpak.process_packet (seglst[i]);
+        if (unpak.get_num_segments() > maxseg) {
+            maxseg = unpak.get_num_segments();
+        }
+    }
+    double tmused = bench_time() - tmstart;
+    std::cout.clear ();
+    std::cerr.clear ();
+
+    snprintf (name, sizeof(name), "  %zu/%zu, 1/%zu lost, timeout %gus", szpkt, szgrant, numloss, timeout * 1e6);
+    bench_report (name, seglst.size(), tmused);
+    printf ("%-40s %10zu segments max %10zu left %10zu timeouts %10zu dropped\n", "", maxseg
+        , unpak.get_num_segments(), unpak.get_num_timeouts(), unpak.get_num_dropped());
+    if (unpak.num_mac >= numpkt) {
+        printf ("Error: %zu of %zu packets unpacked with the segments lost!\n", unpak.num_mac, numpkt);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief the unpack of the segments by the receive thread, or by the reassembly thread of the pipelined mode
+ *
+ * the time of the receive thread and the time until all of the segments are unpacked are reported
+ *
+ * @param szpkt : [in] the size of the MAC packet content
+ * @param szgrant : [in] the size of each grant
+ * @param numpkt : [in] the number of the MAC packets
+ * @param capacity : [in] the size of the ring, 0 for the unpack by the receive thread
+ * @param batch : [in] the max number of the segments of each batch
+ * @param spins : [in] the times the reassembly thread checks the empty ring before parking
+ *
+ * @return 0 on success, < 0 on error
+ */
+int
+bench_unpack_pipe (size_t szpkt, size_t szgrant, size_t numpkt, size_t capacity, size_t batch, size_t spins)
+{
+    std::vector<ds3packet_t *> seglst;
+    bench_ccf_unpack_t unpak;
+    bench_ccf_pack_t pak(NULL, &seglst);
+    ds3_ccf_unpack_pipe_t pipe(&unpak);
+    ds3_pipe_stats_t stats;
+    ds3_packet_buffer_nbs_t nbscnt;
+    std::vector<uint8_t> content(szpkt);
+    ds3_grant_t gt;
+    size_t i;
+    size_t szgrants = 0;
+    size_t szpkts = 0;
+    char name[64];
+
+    memset (&content[0], 0x5A, content.size());
+    nbscnt.append (&content[0], content.size());
+    gt.set_channel_id (1);
+    gt.set_time (1.0);
+    gt.set_size (szgrant);
+    std::cout.setstate (std::ios::badbit);
+    std::cerr.setstate (std::ios::badbit);
+    for (i = 0; i < numpkt; i ++) {
+        ds3packet_nbsmac_t * pktmac = new ds3packet_nbsmac_t ();
+        pktmac->set_content (&nbscnt);
+        szpkts += pktmac->get_size();
+        pak.process_packet (pktmac);
+    }
+    for (; szgrants < szpkts; szgrants += szgrant - DS3HDR_CCF_SIZE) {
+        pak.add_grant (gt);
+    }
+    if ((capacity > 0) && (0 != pipe.start (capacity, batch, spins))) {
+        printf ("Error: failed to start the reassembly thread!\n");
+        return -1;
+    }
+    double tmstart = bench_time();
+    for (i = 0; i < seglst.size(); i ++) {
+        for (; 0 != pipe.push (seglst[i]); ) {
+            /* the ring is full */
+            sched_yield ();
+        }
+    }
+    double tmrecv = bench_time() - tmstart;
+    pipe.stop ();
+    double tmused = bench_time() - tmstart;
+    std::cout.clear ();
+    std::cerr.clear ();
+
+    if (capacity > 0) {
+        pipe.get_stats (stats);
+        snprintf (name, sizeof(name), "  ring %zu, batch %zu, spins %zu, recv", capacity, batch, spins);
+        bench_report (name, seglst.size(), tmrecv);
+        snprintf (name, sizeof(name), "  ring %zu, batch %zu, spins %zu, total", capacity, batch, spins);
+        bench_report (name, seglst.size(), tmused);
+        printf ("%-40s %10zu full %10zu batches %10zu parks %10zu max depth\n", "", stats.num_full
+            , stats.num_batch, stats.num_park, stats.max_depth);
+    } else {
+        bench_report ("  receive thread", seglst.size(), tmused);
+    }
+    if (unpak.num_mac != numpkt) {
+        printf ("Error: only %zu of %zu packets unpacked!\n", unpak.num_mac, numpkt);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief the pack and the unpack of the packets processed in batches
+ *
+ * the grants are added before the MAC packets, each call of process_packets() packs the MAC packets
+ * to the grants; the segments to be unpacked are packed with all of the MAC packets queued before the grants,
+ * so they are the same for all of the batch sizes
+ *
+ * @param szpkt : [in] the size of the MAC packet content
+ * @param szgrant : [in] the size of each grant
+ * @param numpkt : [in] the number of the MAC packets
+ * @param batch : [in] the number of the packets of each call
+ *
+ * @return 0 on success, < 0 on error
+ */
+int
+bench_process_batch (size_t szpkt, size_t szgrant, size_t numpkt, size_t batch)
+{
+    std::vector<ds3packet_t *> seglst;
+    std::vector<ds3packet_t *> rxlst;
+    std::vector<ds3packet_t *> pktlst;
+    bench_ccf_unpack_t unpak;
+    bench_ccf_pack_t pak(NULL, &seglst);
+    bench_ccf_pack_t pakrx(NULL, &rxlst);
+    ds3_packet_buffer_nbs_t nbscnt;
+    std::vector<uint8_t> content(szpkt);
+    std::vector<ds3_grant_t> grants;
+    ds3_grant_t gt;
+    size_t i;
+    size_t num;
+    double tmstart;
+    double tmpack;
+    double tmunpack;
+    char name[64];
+
+    memset (&content[0], 0x5A, content.size());
+    nbscnt.append (&content[0], content.size());
+    gt.set_channel_id (1);
+    gt.set_size (szgrant);
+    for (i = 0; i < numpkt * (szpkt / (szgrant - DS3HDR_CCF_SIZE) + 2); i ++) {
+        gt.set_time (1.0 + i);
+        grants.push_back (gt);
+    }
+    std::cout.setstate (std::ios::badbit);
+    std::cerr.setstate (std::ios::badbit);
+    for (i = 0; i < numpkt; i ++) {
+        ds3packet_nbsmac_t * pktmac = new ds3packet_nbsmac_t ();
+        pktmac->set_content (&nbscnt);
+        pktlst.push_back (pktmac);
+        pktmac = new ds3packet_nbsmac_t ();
+        pktmac->set_content (&nbscnt);
+        pakrx.process_packet (pktmac);
+    }
+    pakrx.add_grants (grants);
+    pak.add_grants (grants);
+    tmstart = bench_time();
+    for (i = 0; i < numpkt; i += num) {
+        num = std::min (batch, numpkt - i);
+        pak.process_packets (&pktlst[i], num);
+    }
+    tmpack = bench_time() - tmstart;
+    tmstart = bench_time();
+    for (i = 0; i < rxlst.size(); i += num) {
+        num = std::min (batch, rxlst.size() - i);
+        unpak.process_packets (&rxlst[i], num);
+    }
+    tmunpack = bench_time() - tmstart;
+    std::cout.clear ();
+    std::cerr.clear ();
+    for (i = 0; i < seglst.size(); i ++) {
+        delete seglst[i];
+    }
+
+    snprintf (name, sizeof(name), "  %zu/%zu, batch %zu, pack", szpkt, szgrant, batch);
+    bench_report (name, numpkt, tmpack);
+    snprintf (name, sizeof(name), "  %zu/%zu, batch %zu, unpack", szpkt, szgrant, batch);
+    bench_report (name, rxlst.size(), tmunpack);
+    if (unpak.num_mac != numpkt) {
+        printf ("Error: only %zu of %zu packets unpacked!\n", unpak.num_mac, numpkt);
+        return -1;
+    }
+    return 0;
+}
+
+/** @brief the unpack service of the benchmark, counts the MAC packets of each shard */
+class bench_ccf_unpack_svc_t : public ds3_ccf_unpack_svc_t {
+public:
+    bench_ccf_unpack_svc_t(size_t numshards) : ds3_ccf_unpack_svc_t(numshards), num_mac(numshards * 8, 0) {}
+    std::vector<size_t> num_mac; /**< the MAC packets of each shard, the counters are 64 bytes apart */
+protected:
+    virtual void recycle_packet (size_t shard, ds3packet_t *p) { delete p; }
+    virtual void drop_packet (size_t shard, ds3packet_t *p) { delete p; }
+    virtual int signify_packet (size_t shard, uint32_t flow, uint8_t sc, ds3_packet_buffer_t & macbuffer) { this->num_mac[shard * 8] ++; return 0; }
+    virtual int signify_piggyback (size_t shard, uint32_t flow, int sc, size_t request) { return 0; }
+    virtual double current_time (void) { return 0.0; }
+};
+
+/**
+ * @brief the unpack of the segments of many flows, by the unpack service
+ *
+ * the flows send the same segments, the segments of the flows are interleaved,
+ * and the service processes the segments received in each batch
+ *
+ * @param numflows : [in] the number of the flows
+ * @param numpkt : [in] the number of the MAC packets of each flow
+ * @param numshards : [in] the number of the shards
+ * @param numworkers : [in] the number of the worker threads
+ * @param batch : [in] the number of the segments of each call of process()
+ *
+ * @return 0 on success, < 0 on error
+ */
+int
+bench_unpack_shards (size_t numflows, size_t numpkt, size_t numshards, size_t numworkers, size_t batch)
+{
+    std::vector<ds3packet_t *> seglst;
+    std::vector<std::vector<uint8_t> > segnbs;
+    std::vector<ds3packet_t *> rxlst;
+    std::vector<uint32_t> rxflow;
+    bench_ccf_unpack_svc_t svc(numshards);
+    bench_ccf_pack_t pak(NULL, &seglst);
+    ds3_packet_buffer_nbs_t nbscnt;
+    ds3_packet_buffer_nbsmac_t refcnt;
+    std::vector<uint8_t> content(1500);
+    ds3_grant_t gt;
+    size_t i;
+    size_t j;
+    size_t nummac = 0;
+    size_t szgrants = 0;
+    size_t szpkts = 0;
+    char name[64];
+
+    if (0 != svc.set_workers (numworkers)) {
+        printf ("Error: failed to start %zu workers!\n", numworkers);
+        return -1;
+    }
+    memset (&content[0], 0x5A, content.size());
+    nbscnt.append (&content[0], content.size());
+    gt.set_channel_id (1);
+    gt.set_time (1.0);
+    gt.set_size (1000);
+    std::cout.setstate (std::ios::badbit);
+    std::cerr.setstate (std::ios::badbit);
+    for (i = 0; i < numpkt; i ++) {
+        ds3packet_nbsmac_t * pktmac = new ds3packet_nbsmac_t ();
+        pktmac->set_content (&nbscnt);
+        szpkts += pktmac->get_size();
+        pak.process_packet (pktmac);
+    }
+    for (; szgrants < szpkts; szgrants += 1000 - DS3HDR_CCF_SIZE) {
+        pak.add_grant (gt);
+    }
+    segnbs.resize (seglst.size());
+    for (i = 0; i < seglst.size(); i ++) {
+        segnbs[i].resize (seglst[i]->get_size());
+        seglst[i]->to_nbs (&(segnbs[i][0]), segnbs[i].size());
+        delete seglst[i];
+    }
+    /* the segments received from all of the flows, the contents refer to the same bytes */
+    for (i = 0; i < segnbs.size(); i ++) {
+        for (j = 0; j < numflows; j ++) {
+            ds3packet_ccf_t * pktccf = new ds3packet_ccf_t ();
+            pktccf->from_nbs_ref (&(segnbs[i][0]), segnbs[i].size(), &refcnt);
+            rxlst.push_back (pktccf);
+            rxflow.push_back (j);
+        }
+    }
+    double tmstart = bench_time();
+    for (i = 0; i < rxlst.size(); i ++) {
+        svc.add_packet (rxflow[i], rxlst[i]);
+        if ((i + 1) % batch == 0) {
+            svc.process ();
+        }
+    }
+    svc.process ();
+    double tmused = bench_time() - tmstart;
+    std::cout.clear ();
+    std::cerr.clear ();
+
+    for (i = 0; i < numshards; i ++) {
+        nummac += svc.num_mac[i * 8];
+    }
+    svc.clear ();
+    snprintf (name, sizeof(name), "  %zu flows, %zu shards, %zu workers", numflows, numshards, numworkers);
+    bench_report (name, rxlst.size(), tmused);
+    if (nummac != numpkt * numflows) {
+        printf ("Error: only %zu of %zu packets unpacked!\n", nummac, numpkt * numflows);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief the heap allocations of the pack engine for each segment
+ *
+ * The MAC packets are created before the measurement, so only the allocations of the segment
+ * construction are counted. The first round starts with the empty engine, the second round
+ * reuses the engine's buffers and segments.
+ *
+ * @param szpkt : [in] the size of the MAC packet content
+ * @param szgrant : [in] the size of each grant
+ * @param numpkt : [in] the number of the MAC packets of each round
+ * @param numreserve : [in] the number of the segments allocated in the pool before the rounds
+ *
+ * @return 0 on success, < 0 on error
+ */
+int
+bench_pack_allocs (size_t szpkt, size_t szgrant, size_t numpkt, size_t numreserve)
+{
+    bench_ccf_pack_t pak(NULL);
+    ds3_packet_buffer_nbs_t nbscnt;
+    std::vector<uint8_t> content(szpkt);
+    std::vector<ds3packet_t *> pktlst(numpkt);
+    ds3_grant_t gt;
+    size_t i;
+    size_t r;
+    size_t szgrants = 0;
+    size_t szpkts = 0;
+    char name[64];
+
+    memset (&content[0], 0x5A, content.size());
+    nbscnt.append (&content[0], content.size());
+    gt.set_channel_id (1);
+    gt.set_time (1.0);
+    gt.set_size (szgrant);
+    pak.get_segpool().set_capacity (numpkt * szpkt / (szgrant - DS3HDR_CCF_SIZE) + 2);
+    pak.get_segpool().reserve (numreserve);
+
+    for (r = 0; r < 2; r ++) {
+        for (i = 0; i < numpkt; i ++) {
+            ds3packet_nbsmac_t * pktmac = new ds3packet_nbsmac_t ();
+            pktmac->set_content (&nbscnt);
+            pktmac->sethdr_sequence (i);
+            pktlst[i] = pktmac;
+        }
+        std::cout.setstate (std::ios::badbit);
+        std::cerr.setstate (std::ios::badbit);
+        size_t numseg = pak.num_seg;
+        size_t numalloc = g_bench_allocs;
+        double tmstart = bench_time();
+        for (i = 0; i < numpkt; i ++) {
+            szpkts += pktlst[i]->get_size();
+            pak.process_packet (pktlst[i]);
+            for (; szgrants < szpkts; szgrants += szgrant - DS3HDR_CCF_SIZE) {
+                pak.add_grant (gt);
+            }
+        }
+        double tmused = bench_time() - tmstart;
+        numalloc = g_bench_allocs - numalloc;
+        numseg = pak.num_seg - numseg;
+        std::cout.clear ();
+        std::cerr.clear ();
+
+        snprintf (name, sizeof(name), "  pack %zu/%zu, %zu reserved, %s", szpkt, szgrant, numreserve, (r ? "warm" : "cold"));
+        bench_report (name, numseg, tmused);
+        printf ("%-40s %10zu segs %10zu allocs %8.3f allocs/seg\n", "", numseg, numalloc, (double)numalloc / numseg);
+    }
+    std::cout.setstate (std::ios::badbit);
+    pak.get_segpool().set_capacity (0);
+    std::cout.clear ();
+    return 0;
+}
+
+/**
+ * @brief the pack of a deep queue of the MAC packets
+ *
+ * all of the MAC packets are queued before the grants, and each grant takes one packet.
+ *
+ * @param szpkt : [in] the size of the MAC packet content
+ * @param numpkt : [in] the number of the MAC packets queued
+ *
+ * @return 0 on success, < 0 on error
+ */
+int
+bench_pack_queue (size_t szpkt, size_t numpkt)
+{
+    bench_ccf_pack_t pak(NULL);
+    ds3_packet_buffer_nbs_t nbscnt;
+    std::vector<uint8_t> content(szpkt);
+    ds3_grant_t gt;
+    size_t i;
+    char name[64];
+
+    memset (&content[0], 0x5A, content.size());
+    nbscnt.append (&content[0], content.size());
+    std::cout.setstate (std::ios::badbit);
+    std::cerr.setstate (std::ios::badbit);
+    for (i = 0; i < numpkt; i ++) {
+        ds3packet_nbsmac_t * pktmac = new ds3packet_nbsmac_t ();
+        pktmac->set_content (&nbscnt);
+        pktmac->sethdr_sequence (i);
+        gt.set_size (DS3HDR_CCF_SIZE + pktmac->get_size());
+        pak.process_packet (pktmac);
+    }
+    gt.set_channel_id (1);
+    gt.set_time (1.0);
+    double tmstart = bench_time();
+    for (i = 0; i < numpkt; i ++) {
+        pak.add_grant (gt);
+    }
+    double tmused = bench_time() - tmstart;
+    std::cout.clear ();
+    std::cerr.clear ();
+
+    snprintf (name, sizeof(name), "  pack %zu queued %zu/%zu", numpkt, szpkt, gt.get_size());
+    bench_report (name, numpkt, tmused);
+    if (pak.num_seg != numpkt) {
+        printf ("Error: %zu segments for %zu packets!\n", pak.num_seg, numpkt);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief add the grants of the MAPs and use them
+ *
+ * the grants are added before the MAC packets arrive, in random time order, then each MAC packet uses one grant.
+ *
+ * @param numgrant : [in] the number of the grants
+ * @param szmap : [in] the number of the grants in each MAP
+ *
+ * @return 0 on success, < 0 on error
+ */
+int
+bench_pack_grants (size_t numgrant, size_t szmap)
+{
+    bench_ccf_pack_t pak(NULL);
+    ds3_packet_buffer_nbs_t nbscnt;
+    std::vector<uint8_t> content(64);
+    std::vector<ds3_grant_t> grants;
+    ds3_grant_t gt;
+    size_t i;
+    size_t szpkt;
+    char name[64];
+
+    memset (&content[0], 0x5A, content.size());
+    nbscnt.append (&content[0], content.size());
+    {
+        ds3packet_nbsmac_t pktmac;
+        pktmac.set_content (&nbscnt);
+        szpkt = pktmac.get_size();
+    }
+    gt.set_size (DS3HDR_CCF_SIZE + szpkt);
+    std::cout.setstate (std::ios::badbit);
+    std::cerr.setstate (std::ios::badbit);
+    double tmstart = bench_time();
+    for (i = 0; i < numgrant; i ++) {
+        gt.set_time (1.0 + (rand () % 100000) / 1000.0);
+        gt.set_channel_id (i % 4);
+        grants.push_back (gt);
+        if (grants.size() >= szmap) {
+            pak.add_grants (grants);
+            grants.resize (0);
+        }
+    }
+    if (grants.size() > 0) {
+        pak.add_grants (grants);
+    }
+    double tmadd = bench_time() - tmstart;
+    tmstart = bench_time();
+    for (i = 0; i < numgrant; i ++) {
+        ds3packet_nbsmac_t * pktmac = new ds3packet_nbsmac_t ();
+        pktmac->set_content (&nbscnt);
+        pktmac->sethdr_sequence (i);
+        pak.process_packet (pktmac);
+    }
+    double tmuse = bench_time() - tmstart;
+    std::cout.clear ();
+    std::cerr.clear ();
+
+    snprintf (name, sizeof(name), "  add %zu grants, %zu per MAP", numgrant, szmap);
+    bench_report (name, numgrant, tmadd);
+    snprintf (name, sizeof(name), "  use %zu grants", numgrant);
+    bench_report (name, numgrant, tmuse);
+    if (pak.num_seg != numgrant) {
+        printf ("Error: %zu segments for %zu grants!\n", pak.num_seg, numgrant);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief the pack of the bonded grants, with the payload copied by the worker threads or not
+ *
+ * each MAP has one large grant for each channel, the MAC packets of a MAP are queued before the MAP
+ *
+ * @param szpkt : [in] the size of the MAC packet content
+ * @param szgrant : [in] the size of each grant
+ * @param numch : [in] the number of the grants in each MAP
+ * @param nummap : [in] the number of the MAPs
+ * @param numworkers : [in] the number of the worker threads, 0 for the serial pack
+ *
+ * @return 0 on success, < 0 on error
+ */
+int
+bench_pack_bonded (size_t szpkt, size_t szgrant, size_t numch, size_t nummap, size_t numworkers)
+{
+    bench_ccf_pack_t pak(NULL);
+    ds3_packet_buffer_nbs_t nbscnt;
+    std::vector<uint8_t> content(szpkt);
+    std::vector<ds3_grant_t> grants;
+    ds3_grant_t gt;
+    size_t i;
+    size_t j;
+    size_t numseg = 0;
+    size_t szmac;
+    double tmused = 0;
+    double tmstart;
+    char name[64];
+
+    if (0 != pak.set_workers (numworkers)) {
+        printf ("Error: failed to start %zu workers!\n", numworkers);
+        return -1;
+    }
+    pak.get_segpool().reserve (numch);
+    memset (&content[0], 0x5A, content.size());
+    nbscnt.append (&content[0], content.size());
+    {
+        ds3packet_nbsmac_t pktmac;
+        pktmac.set_content (&nbscnt);
+        szmac = pktmac.get_size();
+    }
+    gt.set_size (szgrant);
+    std::cout.setstate (std::ios::badbit);
+    std::cerr.setstate (std::ios::badbit);
+    for (i = 0; i < nummap; i ++) {
+        for (j = 0; pak.get_pktlst_bytes() < numch * (szgrant - DS3HDR_CCF_SIZE); j ++) {
+            ds3packet_nbsmac_t * pktmac = new ds3packet_nbsmac_t ();
+            pktmac->set_content (&nbscnt);
+            pktmac->sethdr_sequence (j);
+            pak.process_packet (pktmac);
+        }
+        grants.resize (0);
+        for (j = 0; j < numch; j ++) {
+            gt.set_time (1.0 + i);
+            gt.set_channel_id (j);
+            grants.push_back (gt);
+        }
+        tmstart = bench_time();
+        pak.add_grants (grants);
+        tmused += bench_time() - tmstart;
+    }
+    std::cout.clear ();
+    std::cerr.clear ();
+    numseg = pak.num_seg;
+
+    snprintf (name, sizeof(name), "  %zu/%zu x%zu, %zu workers", szmac, szgrant, numch, numworkers);
+    bench_report (name, numseg, tmused);
+    if (numseg != numch * nummap) {
+        printf ("Error: %zu segments for %zu grants!\n", numseg, numch * nummap);
+        return -1;
+    }
+    return 0;
+}
+
+/** @brief the pack manager of the benchmark, the segments are returned to its pool */
+class bench_ccf_pack_mgr_t : public ds3_ccf_pack_mgr_t {
+public:
+    bench_ccf_pack_mgr_t(size_t numflows) : ds3_ccf_pack_mgr_t(numflows), num_seg(0) {}
+    size_t num_seg; /**< the number of the segments packed */
+protected:
+    virtual void recycle_packet (ds3packet_t *p) { delete p; }
+    virtual int start_sndpkt_timer (size_t flow, double abs_time, ds3event_t evt, ds3packet_t * p, size_t channel_id)
+        { this->num_seg ++; this->get_segpool().put ((ds3packet_ccf_t *)p); return 0; }
+    virtual double current_time (void) { return 0.0; }
+};
+
+/**
+ * @brief the service flows packed by one pack engine for each flow, or by the pack manager
+ *
+ * in each round, each flow gets the MAC packets and one grant for all of them
+ *
+ * @param numflows : [in] the number of the flows
+ * @param numpkt : [in] the number of the MAC packets of each flow in each round
+ * @param rounds : [in] the number of the rounds
+ *
+ * @return 0 on success, < 0 on error
+ */
+int
+bench_pack_flows (size_t numflows, size_t numpkt, size_t rounds)
+{
+    std::vector<bench_ccf_pack_t *> engines;
+    ds3_packet_buffer_nbs_t nbscnt;
+    std::vector<uint8_t> content(64);
+    std::vector<ds3_grant_t> grants;
+    ds3_grant_t gt;
+    size_t numalloc;
+    size_t numseg;
+    size_t szmac;
+    size_t i;
+    size_t j;
+    size_t r;
+    double tmstart;
+    double tmused;
+    char name[64];
+
+    memset (&content[0], 0x5A, content.size());
+    nbscnt.append (&content[0], content.size());
+    {
+        ds3packet_nbsmac_t pktmac;
+        pktmac.set_content (&nbscnt);
+        szmac = pktmac.get_size();
+    }
+    gt.set_size (DS3HDR_CCF_SIZE + numpkt * szmac);
+    gt.set_time (1.0);
+    gt.set_channel_id (0);
+    grants.push_back (gt);
+
+    printf ("  %zu flows, the state of each flow: engine %zu bytes, manager %zu bytes\n"
+        , numflows, sizeof(bench_ccf_pack_t), sizeof(ds3_pack_flow_t));
+    std::cout.setstate (std::ios::badbit);
+    std::cerr.setstate (std::ios::badbit);
+
+    /* one engine for each flow */
+    numalloc = g_bench_allocs;
+    for (i = 0; i < numflows; i ++) {
+        engines.push_back (new bench_ccf_pack_t(NULL));
+    }
+    numalloc = g_bench_allocs - numalloc;
+    tmstart = bench_time();
+    for (r = 0; r < rounds; r ++) {
+        for (i = 0; i < numflows; i ++) {
+            for (j = 0; j < numpkt; j ++) {
+                ds3packet_nbsmac_t * pktmac = new ds3packet_nbsmac_t ();
+                pktmac->set_content (&nbscnt);
+                engines[i]->process_packet (pktmac);
+            }
+        }
+        for (i = 0; i < numflows; i ++) {
+            engines[i]->add_grants (grants);
+        }
+    }
+    tmused = bench_time() - tmstart;
+    numseg = 0;
+    for (i = 0; i < numflows; i ++) {
+        numseg += engines[i]->num_seg;
+        delete engines[i];
+    }
+    std::cout.clear ();
+    std::cerr.clear ();
+    snprintf (name, sizeof(name), "  engines, %zu allocs to create", numalloc);
+    bench_report (name, numflows * numpkt * rounds, tmused);
+    if (numseg != numflows * rounds) {
+        printf ("Error: %zu segments for %zu grants!\n", numseg, numflows * rounds);
+        return -1;
+    }
+
+    /* the manager */
+    std::cout.setstate (std::ios::badbit);
+    std::cerr.setstate (std::ios::badbit);
+    numalloc = g_bench_allocs;
+    bench_ccf_pack_mgr_t mgr(numflows);
+    numalloc = g_bench_allocs - numalloc;
+    tmstart = bench_time();
+    for (r = 0; r < rounds; r ++) {
+        for (i = 0; i < numflows; i ++) {
+            for (j = 0; j < numpkt; j ++) {
+                ds3packet_nbsmac_t * pktmac = new ds3packet_nbsmac_t ();
+                pktmac->set_content (&nbscnt);
+                mgr.add_packet (i, pktmac);
+            }
+        }
+        for (i = 0; i < numflows; i ++) {
+            mgr.add_grant (i, gt);
+        }
+        mgr.process ();
+    }
+    tmused = bench_time() - tmstart;
+    std::cout.clear ();
+    std::cerr.clear ();
+    snprintf (name, sizeof(name), "  manager, %zu allocs to create", numalloc);
+    bench_report (name, numflows * numpkt * rounds, tmused);
+    if (mgr.num_seg != numflows * rounds) {
+        printf ("Error: %zu segments for %zu grants!\n", mgr.num_seg, numflows * rounds);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief the cost of a trace point on the data path
+ *
+ * the disabled and the enabled trace points, compared with formatting the same fields to a stream
+ *
+ * @param rounds : [in] the number of the trace points
+ *
+ * @return 0 on success, < 0 on error
+ */
+int
+bench_trace (size_t rounds)
+{
+    std::ofstream ofs ("/dev/null");
+    ds3_grant_t gt;
+    size_t i;
+    double tmstart;
+    uint64_t cystart;
+    int lvlorig = g_ds3trace_level;
+
+    gt.set_channel_id (1);
+    gt.set_time (1.0);
+    gt.set_size (1000);
+
+    printf ("trace point of a grant:\n");
+    ds3trace_set_level (DS3TRACE_LVL_WARN);
+    tmstart = bench_time();
+    cystart = bench_cycles();
+    for (i = 0; i < rounds; i ++) {
+        DS3TRACE (DS3TRACE_LVL_INFO, DS3TRE_PACK_GRANT, DS3TRACE_TIME_US(gt.get_time()), gt.get_size() + i, gt.get_channel_id(), 0);
+    }
+    bench_report_cycles ("  disabled", rounds, bench_time() - tmstart, bench_cycles() - cystart);
+
+    ds3trace_set_level (DS3TRACE_LVL_INFO);
+    tmstart = bench_time();
+    cystart = bench_cycles();
+    for (i = 0; i < rounds; i ++) {
+        DS3TRACE (DS3TRACE_LVL_INFO, DS3TRE_PACK_GRANT, DS3TRACE_TIME_US(gt.get_time()), gt.get_size() + i, gt.get_channel_id(), 0);
+    }
+    bench_report_cycles ("  ring", rounds, bench_time() - tmstart, bench_cycles() - cystart);
+    ds3trace_set_level (lvlorig);
+    ds3trace_reset ();
+
+    tmstart = bench_time();
+    cystart = bench_cycles();
+    for (i = 0; i < rounds; i ++) {
+        ofs << "ds3ccf: process grant: time=" << gt.get_time()
+            << ", size=" << (gt.get_size() + i)
+            << ", channel=" << gt.get_channel_id()
+            << std::endl;
+    }
+    bench_report_cycles ("  std::ostream to /dev/null", rounds, bench_time() - tmstart, bench_cycles() - cystart);
+    return 0;
+}
+
+#if BENCHCCF
+int
+main (void)
+{
+    srand (0);
+    if (0 != bench_ccfhdr_batch (64, 200000)) {
+        return 1;
+    }
+    if (0 != bench_ccfhdr_batch (8192, 2000)) {
+        return 1;
+    }
+    if (0 != bench_ccfhdr_hcs (8192, 1000)) {
+        return 1;
+    }
+    if (0 != bench_trace (1000000)) {
+        return 1;
+    }
+    printf ("pack/unpack throughput, MAC packet size/grant size:\n");
+    if (0 != bench_pack_unpack (1500, 1000, 100000, false)) {
+        return 1;
+    }
+    if (0 != bench_pack_unpack (1500, 1514, 100000, true)) {
+        return 1;
+    }
+    if (0 != bench_pack_unpack (64, 148, 100000, true)) {
+        return 1;
+    }
+    if (0 != bench_pack_queue (64, 1000)) {
+        return 1;
+    }
+    if (0 != bench_pack_queue (64, 100000)) {
+        return 1;
+    }
+    printf ("grants of the MAPs, used by 64 bytes MAC packets:\n");
+    if (0 != bench_pack_grants (1000, 1)) {
+        return 1;
+    }
+    if (0 != bench_pack_grants (20000, 1)) {
+        return 1;
+    }
+    if (0 != bench_pack_grants (20000, 64)) {
+        return 1;
+    }
+    printf ("bonded pack, per segment, MAC packet size/grant size x grants per MAP:\n");
+    if (0 != bench_pack_bonded (1500, 16000, 8, 2000, 0)) {
+        return 1;
+    }
+    if (0 != bench_pack_bonded (1500, 16000, 8, 2000, 3)) {
+        return 1;
+    }
+    if (0 != bench_pack_bonded (1500, 1000, 8, 2000, 0)) {
+        return 1;
+    }
+    if (0 != bench_pack_bonded (1500, 1000, 8, 2000, 3)) {
+        return 1;
+    }
+    printf ("unpack of the segments out of order, per segment, MAC packet size/grant size:\n");
+    if (0 != bench_unpack_reorder (1500, 1514, 20000, 1)) {
+        return 1;
+    }
+    if (0 != bench_unpack_reorder (1500, 1514, 20000, 64)) {
+        return 1;
+    }
+    if (0 != bench_unpack_reorder (1500, 1514, 20000, 4096)) {
+        return 1;
+    }
+    if (0 != bench_unpack_reorder (1500, 1000, 20000, 64)) {
+        return 1;
+    }
+    if (0 != bench_unpack_reorder (1500, 1000, 20000, 4096)) {
+        return 1;
+    }
+    printf ("delineation of the MAC packets, per segment, MAC packet size/grant size:\n");
+    if (0 != bench_unpack_reorder (64, 1500, 100000, 1)) {
+        return 1;
+    }
+    if (0 != bench_unpack_reorder (1500, 100, 2000, 1)) {
+        return 1;
+    }
+    if (0 != bench_unpack_reorder (1500, 20, 200, 1)) {
+        return 1;
+    }
+    printf ("delivery of the MAC packets, per MAC packet, MAC packet size/grant size:\n");
+    if (0 != bench_unpack_view (64, 1500, 100000, false)) {
+        return 1;
+    }
+    if (0 != bench_unpack_view (64, 1500, 100000, true)) {
+        return 1;
+    }
+    if (0 != bench_unpack_view (1500, 1514, 20000, false)) {
+        return 1;
+    }
+    if (0 != bench_unpack_view (1500, 1514, 20000, true)) {
+        return 1;
+    }
+    if (0 != bench_unpack_view (9000, 1000, 5000, false)) {
+        return 1;
+    }
+    if (0 != bench_unpack_view (9000, 1000, 5000, true)) {
+        return 1;
+    }
+    printf ("unpack of the segments with loss, per segment, MAC packet size/grant size:\n");
+    if (0 != bench_unpack_loss (1500, 1000, 20000, 100, 0)) {
+        return 1;
+    }
+    if (0 != bench_unpack_loss (1500, 1000, 20000, 100, 0.0005)) {
+        return 1;
+    }
+    printf ("batch process, per MAC packet (pack) or segment (unpack), MAC packet size/grant size:\n");
+    for (size_t batch = 1; batch <= 256; batch *= 4) {
+        if (0 != bench_process_batch (64, 1000, 20000, batch)) {
+            return 1;
+        }
+    }
+    for (size_t batch = 1; batch <= 256; batch *= 4) {
+        if (0 != bench_process_batch (1500, 1000, 20000, batch)) {
+            return 1;
+        }
+    }
+    printf ("pipelined unpack, per segment, MAC packet 1500 bytes/grant 1000 bytes:\n");
+    if (0 != bench_unpack_pipe (1500, 1000, 20000, 0, 0, 0)) {
+        return 1;
+    }
+    if (0 != bench_unpack_pipe (1500, 1000, 20000, 1024, 32, 1000)) {
+        return 1;
+    }
+    if (0 != bench_unpack_pipe (1500, 1000, 20000, 1024, 32, 0)) {
+        return 1;
+    }
+    printf ("unpack service of the flows, per segment, MAC packet 1500 bytes/grant 1000 bytes:\n");
+    if (0 != bench_unpack_shards (256, 200, 1, 0, 256)) {
+        return 1;
+    }
+    if (0 != bench_unpack_shards (256, 200, 16, 0, 256)) {
+        return 1;
+    }
+    if (0 != bench_unpack_shards (256, 200, 16, 3, 256)) {
+        return 1;
+    }
+    printf ("service flows, per MAC packet of 64 bytes:\n");
+    if (0 != bench_pack_flows (10000, 4, 4)) {
+        return 1;
+    }
+    printf ("heap allocations of the segment construction, MAC packet size/grant size:\n");
+    if (0 != bench_pack_allocs (1500, 1000, 1000, 0)) {
+        return 1;
+    }
+    if (0 != bench_pack_allocs (1500, 1000, 1000, 2)) {
+        return 1;
+    }
+    if (0 != bench_pack_allocs (64, 148, 1000, 2)) {
+        return 1;
+    }
+    printf ("generic packet buffer, per packet:\n");
+    if (0 != bench_gpkt_index (10, 20000)) {
+        return 1;
+    }
+    if (0 != bench_gpkt_index (100, 2000)) {
+        return 1;
+    }
+    if (0 != bench_gpkt_index (1000, 200)) {
+        return 1;
+    }
+    if (0 != bench_gpkt_index (10000, 20)) {
+        return 1;
+    }
+    if (0 != bench_gpkt_fifo (100, 200000)) {
+        return 1;
+    }
+    if (0 != bench_gpkt_fifo (10000, 200000)) {
+        return 1;
+    }
+    printf ("1500 bytes MAC frame over 3 grants:\n");
+    if (0 != bench_buffer_chain<ds3_packet_buffer_nbs_t> ("ds3_packet_buffer_nbs_t", 1500, 200000)) {
+        return 1;
+    }
+    if (0 != bench_buffer_chain<ds3_packet_buffer_slice_t> ("ds3_packet_buffer_slice_t", 1500, 200000)) {
+        return 1;
+    }
+    return 0;
+}
+#endif
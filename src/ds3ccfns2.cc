@@ -22,6 +22,8 @@
 
 int hdr_docsisccf::offset_;
 
+DS3_PKTCNT_IMPLEMENT_BUFTYPE(ds3_packet_buffer_ns2_t, ds3_packet_buffer_gpkt_t);
+
 static class MacDocsisCcfHeaderClass : public PacketHeaderClass
 {
 public:
@@ -194,9 +196,7 @@ ns2timer_sending_t::expire_task (void)
         /*if (curtime > this->pktlist[0].time + 0.0000001) {
             assert (0);
         }*/
-        std::cerr.precision(10);
-        std::cout.precision(10);
-        std::cerr << "ds3ns2: curtime=" << curtime << ", send packet tm=" << this->pktlist[0].time << " at channel " << this->pktlist[0].channel_id << std::endl;
+        DS3TRACE (DS3TRACE_LVL_DEBUG, DS3TRE_NS2_SEND, DS3TRACE_TIME_US(curtime), DS3TRACE_TIME_US(this->pktlist[0].time), this->pktlist[0].channel_id, 0);
         this->t_->MacSendFrame0 (this->pktlist[0].pkt, this->pktlist[0].channel_id);
 
         std::pop_heap (this->pktlist.begin(), this->pktlist.end(), compare_sndpktp);
@@ -255,8 +255,7 @@ ns2timer_sending_t::expire (Event* evt)
 int
 ds3_ccf_pack_ns2_t::start_sndpkt_timer (double abs_time, ds3event_t evt, ds3packet_t * p, size_t channel_id)
 {
-    std::cout << "Got a packed CCF segment: " << std::endl;
-    std::cout << "  -- start timer: tm=" << abs_time << ", event=" << ds3_event2desc(evt) << ", pkt.size=" << p->get_size() << ", channelId=" << channel_id << std::endl;
+    DS3TRACE (DS3TRACE_LVL_DEBUG, DS3TRE_NS2_SNDTIMER, DS3TRACE_TIME_US(abs_time), evt, p->get_size(), channel_id);
 
     ds3packet_ccf_t * ccfp = dynamic_cast<ds3packet_ccf_t * >(p);
     assert (NULL != ccfp);
@@ -288,8 +287,7 @@ ds3_ccf_unpack_ns2_t::process_packet (Packet * ns2pkt)
 {
     hdr_cmn * chdr = HDR_CMN(ns2pkt);
     assert (chdr->ptype() == PT_DOCSISCCF);
-    // debug:
-    std::cerr << __func__ << " recv ns2pkt " << ( (hdr_cmn::DOWN == chdr->direction()) ? "cmn::DOWN" : "cmn::UP" ) << std::endl;
+    DS3TRACE (DS3TRACE_LVL_DEBUG, DS3TRE_NS2_RECV, chdr->direction(), 0, 0, 0);
 
     ns2_ds3pkt_info_t * pinfo = (ns2_ds3pkt_info_t * )ns2pkt->accessdata();
     assert (pinfo->ccfmagic == CCFMAGIC);
@@ -307,12 +305,12 @@ ds3_ccf_unpack_ns2_t::signify_packet (ds3_packet_buffer_t & macbuffer)
     assert (macbuffer.size() > 0);
 #define USE_DS3NS2_BUF 0
 #if USE_DS3NS2_BUF
-    ds3_packet_buffer_ns2_t *p = dynamic_cast<ds3_packet_buffer_ns2_t *>(macbuffer.get_buffer());
-    ds3_packet_buffer_gpkt_t *p0 = dynamic_cast<ds3_packet_buffer_gpkt_t *>(macbuffer.get_buffer());
+    ds3_packet_buffer_ns2_t *p = ds3_buffer_cast<ds3_packet_buffer_ns2_t>(macbuffer.get_buffer());
+    ds3_packet_buffer_gpkt_t *p0 = ds3_buffer_cast<ds3_packet_buffer_gpkt_t>(macbuffer.get_buffer());
     assert (NULL != p0);
 #else
-    ds3_packet_buffer_gpkt_t *p = dynamic_cast<ds3_packet_buffer_gpkt_t *>(macbuffer.get_buffer());
-    ds3_packet_buffer_ns2_t *p0 = dynamic_cast<ds3_packet_buffer_ns2_t *>(macbuffer.get_buffer());
+    ds3_packet_buffer_gpkt_t *p = ds3_buffer_cast<ds3_packet_buffer_gpkt_t>(macbuffer.get_buffer());
+    ds3_packet_buffer_ns2_t *p0 = ds3_buffer_cast<ds3_packet_buffer_ns2_t>(macbuffer.get_buffer());
     assert (NULL == p0);
 #endif
     assert (NULL != p);
@@ -345,7 +343,7 @@ ds3_ccf_unpack_ns2_t::signify_packet (ds3_packet_buffer_t & macbuffer)
 int
 ds3_ccf_unpack_ns2_t::signify_piggyback (int sc, size_t request)
 {
-    std::cout << "Got a unpacked piggyback request: sc=" << sc << ", request=" << request << std::endl;
+    DS3TRACE (DS3TRACE_LVL_INFO, DS3TRE_NS2_PIGGYBACK, sc, request, 0, 0);
     assert (NULL != this->cmts);
     this->cmts->process_piggyback (sc, request);
     return 0;
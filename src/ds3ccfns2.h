@@ -97,17 +97,20 @@ private:
 /** @brief the ccf unpack class for NS2 */
 class ds3_ccf_unpack_ns2_t : public ds3_ccf_unpack_t {
 public:
-    ds3_ccf_unpack_ns2_t(MacDocsisCMTS * cmts1 = NULL, size_t pbmul = PBMULTIPLIER_DEFAULT) : ds3_ccf_unpack_t(pbmul), cmts(cmts1) {}
+    ds3_ccf_unpack_ns2_t(MacDocsisCMTS * cmts1 = NULL, size_t pbmul = PBMULTIPLIER_DEFAULT) : ds3_ccf_unpack_t(pbmul), cmts(cmts1), num_drop(0) {}
     int process_packet (Packet *p);
+    size_t get_num_drops (void) const { return this->num_drop; } /**< the number of the segments dropped */
 
 protected:
     virtual void recycle_packet (ds3packet_t *p);
     virtual void drop_packet (ds3packet_t *p);
     virtual int signify_packet (ds3_packet_buffer_t & macbuffer);
     virtual int signify_piggyback (int sc, size_t request);
+    virtual double current_time (void);
 
 private:
     MacDocsisCMTS *cmts;
+    size_t num_drop; /**< the number of the segments dropped */
 };
 
 inline double
@@ -116,6 +119,12 @@ ds3_ccf_pack_ns2_t::current_time (void)
     return Scheduler::instance().clock();
 }
 
+inline double
+ds3_ccf_unpack_ns2_t::current_time (void)
+{
+    return Scheduler::instance().clock();
+}
+
 inline void
 ds3_ccf_pack_ns2_t::recycle_packet (ds3packet_t *p)
 {
@@ -137,19 +146,18 @@ ds3_ccf_pack_ns2_t::drop_packet (ds3packet_t *p)
 inline void
 ds3_ccf_unpack_ns2_t::recycle_packet (ds3packet_t *p)
 {
-    ds3packet_ccf_t *pc = dynamic_cast<ds3packet_ccf_t *>(p);
-    assert (NULL != pc); // it should be ds3packet_ccf_t
-    ds3packet_gpkt_t *pn = dynamic_cast<ds3packet_gpkt_t *>(p);
-    assert (NULL == pn); // it should NOT be ds3packet_gpkt_t
-    delete p;
+    // the unpack engine passes only the CCF segments, return it to the pool
+    this->recycle_segment (static_cast<ds3packet_ccf_t *>(p));
 }
 
 inline void
 ds3_ccf_unpack_ns2_t::drop_packet (ds3packet_t *p)
 {
-    // fatal error!
-    assert (0);
-    this->recycle_packet (p);
+    // the segment replaced, corrupted or timeout in the simulation, count it and go on
+    ds3packet_ccf_t * pc = static_cast<ds3packet_ccf_t *>(p);
+    this->num_drop ++;
+    DS3TRACE (DS3TRACE_LVL_WARN, DS3TRE_NS2_DROP, pc->get_header().sequence, pc->get_content_ref().size(), this->num_drop, 0);
+    this->recycle_segment (pc);
 }
 
 size_t ns2pkt_get_size (Packet *p);
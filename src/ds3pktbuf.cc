@@ -12,6 +12,10 @@
 
 #include "ds3pktbuf.h"
 
+/* the type ids of the content classes */
+const ds3_buftype_t ds3_packet_buffer_t::buftype_self = { NULL, "ds3_packet_buffer_t" };
+DS3_PKTCNT_IMPLEMENT_BUFTYPE(ds3_packet_buffer_nbs_t, ds3_packet_buffer_t);
+
 /**
  * @brief convert struct to network byte sequence
  *
@@ -133,6 +137,251 @@ ds3hdr_ccf_from_nbs (uint8_t *nbsbuf, size_t szbuf, ds3hdr_ccf_t * rethdr)
     return ret;
 }
 
+/* the batch codec use the SWAR kernel below, set it to 0 to use the scalar functions for each header */
+#ifndef USE_DS3HDR_CCF_SWAR
+#define USE_DS3HDR_CCF_SWAR 1
+#endif
+
+#if USE_DS3HDR_CCF_SWAR
+/* the four 16-bit fields of a CCF header are kept in one 64-bit word, the first field on the wire is lane 0 (bits 0-15) */
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define DS3HDR_CCF_LANE(v, i) ((uint64_t)(v) << (48 - 16 * (i)))
+#define DS3HDR_CCF_GETLANE(w, i) ((uint16_t)((w) >> (48 - 16 * (i))))
+#define DS3HDR_CCF_SWAP16X4(w) (w)
+#else
+#define DS3HDR_CCF_LANE(v, i) ((uint64_t)(v) << (16 * (i)))
+#define DS3HDR_CCF_GETLANE(w, i) ((uint16_t)((w) >> (16 * (i))))
+/* swap the bytes of all of the four 16-bit lanes at once */
+#define DS3HDR_CCF_SWAP16X4(w) ((((w) & 0x00FF00FF00FF00FFULL) << 8) | (((w) >> 8) & 0x00FF00FF00FF00FFULL))
+#endif
+
+/** pack one header to the wire format, returned as a 64-bit word in memory order */
+static inline uint64_t
+ds3hdr_ccf_pack_u64 (const ds3hdr_ccf_t * refhdr)
+{
+    uint64_t w;
+    w  = DS3HDR_CCF_LANE ((refhdr->pfi ? 0x8000 : 0) | (refhdr->r ? 0x4000 : 0) | refhdr->offmac, 0);
+    w |= DS3HDR_CCF_LANE ((uint16_t)(refhdr->sequence << 3) | (refhdr->sc & 0x07), 1);
+    w |= DS3HDR_CCF_LANE (refhdr->request, 2);
+    w |= DS3HDR_CCF_LANE (refhdr->hcs, 3);
+    return DS3HDR_CCF_SWAP16X4 (w);
+}
+
+/** unpack one header from a 64-bit word read from the wire (memory order) */
+static inline void
+ds3hdr_ccf_unpack_u64 (uint64_t w, ds3hdr_ccf_t * rethdr)
+{
+    uint16_t v16;
+    w = DS3HDR_CCF_SWAP16X4 (w);
+    v16 = DS3HDR_CCF_GETLANE (w, 0);
+    rethdr->pfi = (v16 >> 15) & 0x01;
+    rethdr->r = (v16 >> 14) & 0x01;
+    rethdr->offmac = v16 & 0x3FFF;
+    v16 = DS3HDR_CCF_GETLANE (w, 1);
+    rethdr->sequence = (v16 >> 3);
+    rethdr->sc = v16 & 0x07;
+    rethdr->request = DS3HDR_CCF_GETLANE (w, 2);
+    rethdr->hcs = DS3HDR_CCF_GETLANE (w, 3);
+}
+#endif /* USE_DS3HDR_CCF_SWAR */
+
+/**
+ * @brief convert an array of structures to network byte sequence
+ *
+ * @param nbsbuf : [in,out] the buffer to be filled by this function, the headers are stored one after another
+ * @param szbuf : [in] the size of the buffer passed in
+ * @param refhdrs : [in] the array of the structures
+ * @param numhdr : [in] the number of the structures in the array
+ *
+ * @return the byte size of the headers processed, >=0 on success, < 0 on error
+ *
+ * convert an array of structures to network byte sequence, it is the same as calling ds3hdr_ccf_to_nbs() for each header,
+ * but the fields of a header are byte-swapped in one 64-bit word instead of four htons()/memmove() calls.
+ * If szbuf == 0, return the size of buffer required for numhdr headers.
+ */
+ssize_t
+ds3hdr_ccf_to_nbs_batch (uint8_t *nbsbuf, size_t szbuf, ds3hdr_ccf_t * refhdrs, size_t numhdr)
+{
+    size_t szhdr = sizeof(uint16_t) * 4;
+    size_t i;
+
+    if (szbuf == 0) {
+        return (szhdr * numhdr);
+    }
+    if ((NULL == nbsbuf) || (NULL == refhdrs)) {
+        return -1;
+    }
+    if (szbuf < szhdr * numhdr) {
+        return -1;
+    }
+#if USE_DS3HDR_CCF_SWAR
+    uint64_t w;
+    for (i = 0; i < numhdr; i ++) {
+        w = ds3hdr_ccf_pack_u64 (&(refhdrs[i]));
+        memcpy (nbsbuf + i * szhdr, &w, sizeof (w));
+    }
+#else
+    for (i = 0; i < numhdr; i ++) {
+        if (ds3hdr_ccf_to_nbs (nbsbuf + i * szhdr, szhdr, &(refhdrs[i])) < 0) {
+            return -1;
+        }
+    }
+#endif
+    return (szhdr * numhdr);
+}
+
+/**
+ * @brief convert network byte sequence to an array of structures
+ *
+ * @param nbsbuf : [in] the buffer contains the headers stored one after another, in network byte sequence
+ * @param szbuf : [in] the size of the buffer passed in
+ * @param rethdrs : [out] the array of the structures to be filled by this function
+ * @param numhdr : [in] the number of the structures in the array
+ *
+ * @return the byte size of the headers processed, >=0 on success, < 0 on error
+ *
+ * convert network byte sequence to an array of structures, the reverse of ds3hdr_ccf_to_nbs_batch().
+ * If szbuf == 0, return the size of buffer required for numhdr headers.
+ */
+ssize_t
+ds3hdr_ccf_from_nbs_batch (uint8_t *nbsbuf, size_t szbuf, ds3hdr_ccf_t * rethdrs, size_t numhdr)
+{
+    size_t szhdr = sizeof(uint16_t) * 4;
+    size_t i;
+
+    if (szbuf == 0) {
+        return (szhdr * numhdr);
+    }
+    if ((NULL == nbsbuf) || (NULL == rethdrs)) {
+        return -1;
+    }
+    if (szbuf < szhdr * numhdr) {
+        return -1;
+    }
+#if USE_DS3HDR_CCF_SWAR
+    uint64_t w;
+    for (i = 0; i < numhdr; i ++) {
+        memcpy (&w, nbsbuf + i * szhdr, sizeof (w));
+        ds3hdr_ccf_unpack_u64 (w, &(rethdrs[i]));
+    }
+#else
+    for (i = 0; i < numhdr; i ++) {
+        if (ds3hdr_ccf_from_nbs (nbsbuf + i * szhdr, szhdr, &(rethdrs[i])) < 0) {
+            return -1;
+        }
+    }
+#endif
+    return (szhdr * numhdr);
+}
+
+/* CRC-CCITT (x^16 + x^12 + x^5 + 1) as the ITU-T X.25 FCS: reflected, init 0xFFFF, xor out 0xFFFF */
+#define DS3_CRC16_POLY_REFLECTED 0x8408
+#define DS3_CRC16_SLICES 8
+static uint16_t g_ds3_crc16_table[DS3_CRC16_SLICES][256]; /**< the slice-by-8 tables, [k][b] is the CRC of b followed by k zero bytes */
+
+static void
+ds3_crc16_init_table (void)
+{
+    size_t i;
+    size_t k;
+    uint16_t crc;
+    for (i = 0; i < 256; i ++) {
+        crc = i;
+        for (k = 0; k < 8; k ++) {
+            crc = (crc & 0x01) ? ((crc >> 1) ^ DS3_CRC16_POLY_REFLECTED) : (crc >> 1);
+        }
+        g_ds3_crc16_table[0][i] = crc;
+    }
+    for (k = 1; k < DS3_CRC16_SLICES; k ++) {
+        for (i = 0; i < 256; i ++) {
+            crc = g_ds3_crc16_table[k - 1][i];
+            g_ds3_crc16_table[k][i] = (crc >> 8) ^ g_ds3_crc16_table[0][crc & 0xFF];
+        }
+    }
+}
+
+/* fill the tables before main(), so there's no check in the hot path */
+static class ds3_crc16_table_init_t {
+public:
+    ds3_crc16_table_init_t() { ds3_crc16_init_table(); }
+} g_ds3_crc16_table_init;
+
+/**
+ * @brief calculate the CRC-CCITT of the buffer
+ *
+ * @param buf : [in] the data
+ * @param szbuf : [in] the size of the data
+ *
+ * @return the CRC value
+ *
+ * calculate the CRC-CCITT of the buffer, 8 bytes a time with the slice-by-8 tables
+ */
+uint16_t
+ds3_crc16_ccitt (uint8_t *buf, size_t szbuf)
+{
+    uint16_t crc = 0xFFFF;
+    uint16_t (* t)[256] = g_ds3_crc16_table;
+    uint8_t * p = buf;
+    for (; szbuf >= 8; szbuf -= 8, p += 8) {
+        crc = t[7][p[0] ^ (crc & 0xFF)] ^ t[6][p[1] ^ (crc >> 8)]
+            ^ t[5][p[2]] ^ t[4][p[3]] ^ t[3][p[4]] ^ t[2][p[5]] ^ t[1][p[6]] ^ t[0][p[7]];
+    }
+    for (; szbuf > 0; szbuf --, p ++) {
+        crc = (crc >> 8) ^ t[0][(crc ^ *p) & 0xFF];
+    }
+    return (crc ^ 0xFFFF);
+}
+
+/* the HCS covers the CCF header except the HCS field itself, which is 6 bytes */
+#define DS3HDR_CCF_SZHCSDATA (sizeof(uint16_t) * 3)
+
+/** the HCS of the 6 bytes header data, one lookup for each byte */
+static inline uint16_t
+ds3hdr_ccf_hcs_nbs (uint8_t *p)
+{
+    uint16_t (* t)[256] = g_ds3_crc16_table;
+    uint16_t crc;
+    crc = t[5][p[0] ^ 0xFF] ^ t[4][p[1] ^ 0xFF] ^ t[3][p[2]] ^ t[2][p[3]] ^ t[1][p[4]] ^ t[0][p[5]];
+    return (crc ^ 0xFFFF);
+}
+
+/**
+ * @brief calculate the HCS of the CCF header
+ *
+ * @param refhdr : [in] the pointer of the structure, the field hcs is ignored
+ *
+ * @return the HCS value
+ */
+uint16_t
+ds3hdr_ccf_calc_hcs (ds3hdr_ccf_t * refhdr)
+{
+    uint8_t buf[sizeof(uint16_t) * 4];
+    assert (NULL != refhdr);
+    ds3hdr_ccf_to_nbs (buf, sizeof(buf), refhdr);
+    return ds3hdr_ccf_hcs_nbs (buf);
+}
+
+/**
+ * @brief check the HCS of the CCF header in network byte sequence
+ *
+ * @param nbsbuf : [in] the buffer pointer contains the network byte sequence of the header
+ * @param szbuf : [in] the size  of the buffer passed in
+ *
+ * @return true if the HCS is correct, false otherwise
+ */
+bool
+ds3hdr_ccf_check_hcs (uint8_t *nbsbuf, size_t szbuf)
+{
+    if (NULL == nbsbuf) {
+        return false;
+    }
+    if (szbuf < sizeof(uint16_t) * 4) {
+        return false;
+    }
+    uint16_t hcs = ((uint16_t)nbsbuf[DS3HDR_CCF_SZHCSDATA] << 8) | nbsbuf[DS3HDR_CCF_SZHCSDATA + 1];
+    return (hcs == ds3hdr_ccf_hcs_nbs (nbsbuf));
+}
+
 /**
  * @brief copy the content from peer.
  *
@@ -165,11 +414,70 @@ ds3_packet_buffer_t::insert (size_t pos_self, ds3_packet_buffer_t *peer, size_t
     return (end_peer - begin_peer);
 }
 
-ssize_t ds3_packet_buffer_nbs_t::size(void) const { return this->buffer.size(); }
+ssize_t ds3_packet_buffer_nbs_t::size(void) const { return (this->refbuf ? this->szref : this->buffer.size()); }
+
+/**
+ * @brief use the external bytes as the content, without copying them
+ *
+ * @param nbsbuf : [in] the bytes, in network byte sequence
+ * @param szbuf : [in] the size of the bytes
+ *
+ * @return 0 on success, < 0 on error
+ *
+ * The bytes (such as a receive buffer) are not owned by this class, and have to be kept
+ * until this buffer is released. They are copied to the internal buffer when the content
+ * is modified(append, insert, copy, grow) or accessed by at(); the buffers created from it
+ * have their own copy.
+ */
+int
+ds3_packet_buffer_nbs_t::set_ref (uint8_t *nbsbuf, size_t szbuf)
+{
+    if ((NULL == nbsbuf) && (szbuf > 0)) {
+        return -1;
+    }
+    this->buffer.resize(0);
+    this->refbuf = nbsbuf;
+    this->szref = szbuf;
+    if (0 == szbuf) {
+        this->refbuf = NULL;
+    }
+    return 0;
+}
+
+ssize_t
+ds3_packet_buffer_nbs_t::to_iovec (struct iovec *iov, size_t numiov)
+{
+    if (0 == this->size()) {
+        return 0;
+    }
+    if (0 == numiov) {
+        return 1;
+    }
+    if (NULL == iov) {
+        return -1;
+    }
+    iov[0].iov_base = this->get_data();
+    iov[0].iov_len = this->size();
+    return 1;
+}
+
+/** @brief copy the external bytes to the internal buffer, before modifying the content */
+void
+ds3_packet_buffer_nbs_t::own (void)
+{
+    if (NULL == this->refbuf) {
+        return;
+    }
+    this->buffer.resize(0);
+    this->buffer.insert(this->buffer.begin(), this->refbuf, this->refbuf + this->szref);
+    this->refbuf = NULL;
+    this->szref = 0;
+}
 
 ssize_t
 ds3_packet_buffer_nbs_t::append (std::vector<uint8_t>::iterator & begin1, std::vector<uint8_t>::iterator & end1)
 {
+    this->own ();
     this->buffer.insert(this->buffer.end(), begin1, end1);
     return (end1 - begin1);
 }
@@ -177,45 +485,84 @@ ds3_packet_buffer_nbs_t::append (std::vector<uint8_t>::iterator & begin1, std::v
 ssize_t
 ds3_packet_buffer_nbs_t::append (uint8_t *buf, size_t sz)
 {
+    this->own ();
     this->buffer.insert(this->buffer.end(), buf, buf + sz);
     return (sz);
 }
 
+/**
+ * @brief append the bytes of a scatter-gather array
+ *
+ * @param iov : [in] the items
+ * @param numiov : [in] the number of the items
+ *
+ * @return the size of the bytes appended
+ *
+ * The storage is allocated once for the external bytes referred and all of the items,
+ * so each byte is copied once.
+ */
+ssize_t
+ds3_packet_buffer_nbs_t::append_iovec (const struct iovec *iov, size_t numiov)
+{
+    size_t szall = 0;
+    size_t i;
+    for (i = 0; i < numiov; i ++) {
+        szall += iov[i].iov_len;
+    }
+    if (this->refbuf) {
+        this->buffer.resize (0);
+        this->buffer.reserve (this->szref + szall);
+        this->buffer.insert (this->buffer.end(), this->refbuf, this->refbuf + this->szref);
+        this->refbuf = NULL;
+        this->szref = 0;
+    } else {
+        this->buffer.reserve (this->buffer.size() + szall);
+    }
+    for (i = 0; i < numiov; i ++) {
+        this->buffer.insert (this->buffer.end(), (uint8_t *)(iov[i].iov_base), (uint8_t *)(iov[i].iov_base) + iov[i].iov_len);
+    }
+    return szall;
+}
+
 ds3_packet_buffer_nbs_t::ds3_packet_buffer_nbs_t(ds3_packet_buffer_t *arg_peer, size_t begin, size_t end)
+    : refbuf(NULL), szref(0)
 {
-    ds3_packet_buffer_nbs_t * peer = dynamic_cast<ds3_packet_buffer_nbs_t *> (arg_peer);
+    ds3_packet_buffer_nbs_t * peer = ds3_buffer_cast<ds3_packet_buffer_nbs_t> (arg_peer);
     assert (NULL != peer);
     if (end < begin) {
         return;
     }
-    if (begin >= (peer->buffer).size()) {
+    if ((ssize_t)begin >= peer->size()) {
         return;
     }
-    if (end > (peer->buffer).size()) {
-        end = (peer->buffer).size();
+    if ((ssize_t)end > peer->size()) {
+        end = peer->size();
     }
+    // the bytes are copied, even if the peer refers to the external bytes
     this->buffer.resize (0);
     //std::copy (peer->buffer.begin() + begin, peer->buffer.begin() + end, this->buffer.begin());
-    this->buffer.insert (this->buffer.begin(), peer->buffer.begin() + begin, peer->buffer.begin() + end);
+    this->buffer.insert (this->buffer.begin(), peer->get_data() + begin, peer->get_data() + end);
 }
 
 ssize_t
 ds3_packet_buffer_nbs_t::to_nbs (uint8_t *nbsbuf, size_t szbuf)
 {
     if (0 == szbuf) {
-        return this->buffer.size();
+        return this->size();
     }
-    assert (szbuf >= this->buffer.size());
-    if (szbuf > this->buffer.size()) {
-        szbuf = this->buffer.size();
+    assert ((ssize_t)szbuf >= this->size());
+    if ((ssize_t)szbuf > this->size()) {
+        szbuf = this->size();
     }
-    std::copy (this->buffer.begin(), this->buffer.begin() + szbuf, nbsbuf);
+    std::copy (this->get_data(), this->get_data() + szbuf, nbsbuf);
     return szbuf;
 }
 
 ssize_t
 ds3_packet_buffer_nbs_t::from_nbs (uint8_t *nbsbuf, size_t szbuf)
 {
+    this->refbuf = NULL;
+    this->szref = 0;
     this->buffer.resize(szbuf);
     std::copy (nbsbuf, nbsbuf + szbuf, this->buffer.begin());
     return szbuf;
@@ -236,7 +583,7 @@ ds3_packet_buffer_nbs_t::insert_to (size_t pos_peer, ds3_packet_buffer_t *arg_pe
         ds3_packet_buffer_t * newpkt = this->create (this, begin_self, end_self);
         return newpkt;
     }
-    ds3_real_type *peer = dynamic_cast<ds3_real_type *>(arg_peer);
+    ds3_real_type *peer = ds3_buffer_cast<ds3_real_type>(arg_peer);
     if (NULL == peer) {
         assert (0);
         return NULL;
@@ -255,7 +602,8 @@ ds3_packet_buffer_nbs_t::insert_to (size_t pos_peer, ds3_packet_buffer_t *arg_pe
     assert (NULL != peer);
     // add the content between [begin_self, end_self) to peer
     // peer has to be the same typs as this
-    peer->buffer.insert(peer->buffer.begin() + pos_peer, buffer.begin() + begin_self, buffer.begin() + end_self);
+    peer->own ();
+    peer->buffer.insert(peer->buffer.begin() + pos_peer, this->get_data() + begin_self, this->get_data() + end_self);
     return arg_peer;
 }
 
@@ -264,10 +612,20 @@ ds3_packet_buffer_nbs_t::copy_to (size_t pos_peer, ds3_packet_buffer_t *arg_peer
 {
     DS3_DYNCST_CHKRET_CONTENT_POINTER(ds3_packet_buffer_nbs_t, arg_peer);
     assert (NULL != peer);
-    // add the content between [begin_self, end_self) to peer
-    // peer has to be the same typs as this
-    peer->buffer.insert(peer->buffer.begin() + pos_peer, buffer.begin() + begin_self, buffer.begin() + end_self);
-    std::copy(this->buffer.begin() + begin_self, this->buffer.begin() + end_self, peer->buffer.begin() + pos_peer);
+    // overwrite the content of peer from pos_peer by the content between [begin_self, end_self)
+    // peer has to be the same typs as this, and is extended if the content exceeds its end
+    assert (begin_self <= end_self);
+    assert ((ssize_t)pos_peer <= peer->size());
+    size_t n = end_self - begin_self;
+    if (n < 1) {
+        return arg_peer;
+    }
+    peer->own ();
+    if ((ssize_t)(pos_peer + n) > peer->size()) {
+        peer->resize (pos_peer + n);
+    }
+    // get the pointers after resize(), peer may be this
+    memmove (peer->get_data() + pos_peer, this->get_data() + begin_self, n);
     return arg_peer;
 }
 
@@ -276,10 +634,9 @@ void
 ds3_packet_buffer_nbs_t::dump (void)
 {
     std::cout << "   content: " ;// << std::endl;
-    std::vector<uint8_t>::iterator itb = this->buffer.begin();
-    std::vector<uint8_t>::iterator ite = this->buffer.end();
-    for (; itb != ite; itb ++ ) {
-        printf (" %02X", *itb);
+    uint8_t * p = this->get_data();
+    for (ssize_t i = 0; i < this->size(); i ++ ) {
+        printf (" %02X", p[i]);
     }
     std::cout << std::endl;
 }
@@ -326,6 +683,192 @@ test_ccfhdr (void)
 #undef  MYCHK1
 }
 
+int
+test_ccfhdr_batch (void)
+{
+#define NUM_HDR 37
+    ds3hdr_ccf_t hdrs[NUM_HDR];
+    ds3hdr_ccf_t hdrs2[NUM_HDR];
+    uint8_t buffer[8 * NUM_HDR];
+    uint8_t buffer2[8 * NUM_HDR];
+    size_t szhdr = DS3HDR_CCF_SIZE;
+    size_t i;
+
+    memset (hdrs, 0, sizeof(hdrs));
+    memset (hdrs2, 0, sizeof(hdrs2));
+    for (i = 0; i < NUM_HDR; i ++) {
+        hdrs[i].pfi = (i & 0x01);
+        hdrs[i].r = ((i >> 1) & 0x01);
+        hdrs[i].offmac = (i * 997) & 0x3FFF;
+        hdrs[i].sequence = (8191 - i * 131) & 0x1FFF;
+        hdrs[i].sc = i & 0x07;
+        hdrs[i].request = i * 1777;
+        hdrs[i].hcs = 0xFFFF - i * 3;
+        ds3hdr_ccf_to_nbs (buffer2 + i * szhdr, szhdr, &(hdrs[i]));
+    }
+    REQUIRE ((ssize_t)sizeof(buffer) == ds3hdr_ccf_to_nbs_batch (NULL, 0, NULL, NUM_HDR));
+    REQUIRE (-1 == ds3hdr_ccf_to_nbs_batch (buffer, sizeof(buffer) - 1, hdrs, NUM_HDR));
+    REQUIRE ((ssize_t)sizeof(buffer) == ds3hdr_ccf_to_nbs_batch (buffer, sizeof(buffer), hdrs, NUM_HDR));
+    // the batch result should be the same as the one of the single header function
+    REQUIRE (0 == memcmp (buffer, buffer2, sizeof(buffer)));
+
+    REQUIRE ((ssize_t)sizeof(buffer) == ds3hdr_ccf_from_nbs_batch (buffer, sizeof(buffer), hdrs2, NUM_HDR));
+    REQUIRE (0 == memcmp (hdrs, hdrs2, sizeof(hdrs)));
+    printf ("[%s()] Passed !\n", __func__);
+    return 0;
+#undef NUM_HDR
+}
+
+/* the reference CRC-CCITT, one bit a time */
+static uint16_t
+ds3_crc16_ccitt_bitwise (uint8_t *buf, size_t szbuf)
+{
+    uint16_t crc = 0xFFFF;
+    size_t i;
+    size_t k;
+    for (i = 0; i < szbuf; i ++) {
+        crc ^= buf[i];
+        for (k = 0; k < 8; k ++) {
+            crc = (crc & 0x01) ? ((crc >> 1) ^ 0x8408) : (crc >> 1);
+        }
+    }
+    return (crc ^ 0xFFFF);
+}
+
+int
+test_ccfhdr_hcs (void)
+{
+    uint8_t buf[64];
+    uint8_t buffer[8];
+    ds3hdr_ccf_t ccfhdr;
+    size_t i;
+
+    // the check value of CRC-16/X-25
+    memcpy (buf, "123456789", 9);
+    REQUIRE (0x906E == ds3_crc16_ccitt (buf, 9));
+    for (i = 0; i < sizeof(buf); i ++) {
+        buf[i] = (uint8_t)(i * 37 + 11);
+    }
+    for (i = 0; i <= sizeof(buf); i ++) {
+        REQUIRE (ds3_crc16_ccitt_bitwise (buf, i) == ds3_crc16_ccitt (buf, i));
+    }
+
+    memset (&ccfhdr, 0, sizeof(ccfhdr));
+    ccfhdr.pfi = 1;
+    ccfhdr.offmac = 50;
+    ccfhdr.sequence = 8191;
+    ccfhdr.sc = 5;
+    ccfhdr.request = 3922;
+    ccfhdr.hcs = ds3hdr_ccf_calc_hcs (&ccfhdr);
+    ds3hdr_ccf_to_nbs (buffer, sizeof (buffer), &ccfhdr);
+    REQUIRE (ccfhdr.hcs == ds3_crc16_ccitt (buffer, 6));
+    REQUIRE (ds3hdr_ccf_check_hcs (buffer, sizeof(buffer)));
+    REQUIRE (! ds3hdr_ccf_check_hcs (buffer, sizeof(buffer) - 1));
+    for (i = 0; i < sizeof(buffer) * 8; i ++) {
+        // any single bit error should be detected
+        buffer[i / 8] ^= (0x01 << (i % 8));
+        REQUIRE (! ds3hdr_ccf_check_hcs (buffer, sizeof(buffer)));
+        buffer[i / 8] ^= (0x01 << (i % 8));
+    }
+    printf ("[%s()] Passed !\n", __func__);
+    return 0;
+}
+
+int
+test_ccfhdr_view (void)
+{
+    ds3hdr_ccf_t ccfhdr, ccfhdr2;
+    uint8_t buffer[DS3HDR_CCF_SIZE + 16];
+    ds3hdr_ccf_view_t hdrview;
+    ds3_packet_buffer_nbs_t cntref;
+    ds3_packet_buffer_nbs_t cntcpy;
+    ds3_packet_buffer_t cntnew;
+    size_t i;
+
+    memset (&ccfhdr, 0, sizeof(ccfhdr));
+    ccfhdr.pfi = 1;
+    ccfhdr.offmac = 0x2A5B;
+    ccfhdr.sequence = 0x1ACE;
+    ccfhdr.sc = 5;
+    ccfhdr.request = 0xBEEF;
+    ccfhdr.hcs = ds3hdr_ccf_calc_hcs (&ccfhdr);
+    for (i = 0; i < sizeof(buffer); i ++) {
+        buffer[i] = i;
+    }
+    REQUIRE (DS3HDR_CCF_SIZE == ds3hdr_ccf_to_nbs (NULL, 0, NULL));
+    REQUIRE (DS3HDR_CCF_SIZE == ds3hdr_ccf_to_nbs (buffer, sizeof(buffer), &ccfhdr));
+
+    REQUIRE (0 > hdrview.attach (buffer, DS3HDR_CCF_SIZE - 1));
+    REQUIRE (DS3HDR_CCF_SIZE == hdrview.attach (buffer, sizeof(buffer)));
+    REQUIRE (ccfhdr.pfi == hdrview.pfi());
+    REQUIRE (ccfhdr.r == hdrview.r());
+    REQUIRE (ccfhdr.offmac == hdrview.offmac());
+    REQUIRE (ccfhdr.sequence == hdrview.sequence());
+    REQUIRE (ccfhdr.sc == hdrview.sc());
+    REQUIRE (ccfhdr.request == hdrview.request());
+    REQUIRE (ccfhdr.hcs == hdrview.hcs());
+    REQUIRE (hdrview.check_hcs());
+    REQUIRE (DS3HDR_CCF_SIZE == hdrview.to_header (&ccfhdr2));
+    REQUIRE (0 == memcmp (&ccfhdr, &ccfhdr2, sizeof(ccfhdr)));
+    // the view reads the bytes in place
+    buffer[4] ^= 0x80;
+    REQUIRE (ccfhdr.request != hdrview.request());
+    REQUIRE (! hdrview.check_hcs());
+    buffer[4] ^= 0x80;
+
+    // patch the fields in place, the other fields are kept
+    hdrview.set_request (0x1234);
+    hdrview.set_sequence (0x0F0F);
+    hdrview.set_sc (2);
+    REQUIRE (! hdrview.check_hcs());
+    hdrview.update_hcs ();
+    REQUIRE (hdrview.check_hcs());
+    REQUIRE (DS3HDR_CCF_SIZE == hdrview.to_header (&ccfhdr2));
+    REQUIRE (0x1234 == ccfhdr2.request);
+    REQUIRE (0x0F0F == ccfhdr2.sequence);
+    REQUIRE (2 == ccfhdr2.sc);
+    REQUIRE (ccfhdr.pfi == ccfhdr2.pfi);
+    REQUIRE (ccfhdr.offmac == ccfhdr2.offmac);
+    REQUIRE (ds3hdr_ccf_calc_hcs (&ccfhdr2) == ccfhdr2.hcs);
+    REQUIRE (DS3HDR_CCF_SIZE == ds3hdr_ccf_to_nbs (buffer, sizeof(buffer), &ccfhdr));
+
+    // the content refers to the bytes after the header
+    REQUIRE (0 == cntref.set_ref (buffer + DS3HDR_CCF_SIZE, sizeof(buffer) - DS3HDR_CCF_SIZE));
+    REQUIRE (cntref.is_ref());
+    REQUIRE (sizeof(buffer) - DS3HDR_CCF_SIZE == (size_t)cntref.size());
+    REQUIRE (cntref.contiguous_span (0, 1) == buffer + DS3HDR_CCF_SIZE);
+    // shrinking keeps the reference
+    REQUIRE (0 == cntref.resize (10));
+    REQUIRE (cntref.is_ref());
+    REQUIRE (10 == cntref.size());
+    // the content created from the reference has its own copy
+    REQUIRE (10 == cntnew.insert (0, &cntref, 0, cntref.size()));
+    REQUIRE (NULL != cntnew.contiguous_span (0, 10));
+    REQUIRE (cntnew.contiguous_span (0, 1) != buffer + DS3HDR_CCF_SIZE);
+    REQUIRE (0 == memcmp (cntnew.contiguous_span (0, 10), buffer + DS3HDR_CCF_SIZE, 10));
+    // the bytes inserted are copied, even to an empty buffer
+    REQUIRE (10 == cntcpy.insert (0, &cntref, 0, cntref.size()));
+    REQUIRE (! cntcpy.is_ref());
+    REQUIRE (1 == cntcpy.insert (cntcpy.size(), &cntref, 0, 1));
+    REQUIRE (11 == cntcpy.size());
+    for (i = 0; i < 10; i ++) {
+        REQUIRE (cntcpy.at(i) == buffer[DS3HDR_CCF_SIZE + i]);
+    }
+    // modifying the content copies the bytes
+    REQUIRE (1 == cntref.append (buffer, 1));
+    REQUIRE (! cntref.is_ref());
+    REQUIRE (11 == cntref.size());
+    REQUIRE (&(cntref.at(0)) != buffer + DS3HDR_CCF_SIZE);
+    REQUIRE (cntref.at(9) == buffer[DS3HDR_CCF_SIZE + 9]);
+    REQUIRE (cntref.at(10) == buffer[0]);
+    // the byte returned by at() may be changed, the bytes are copied first
+    REQUIRE (0 == cntref.set_ref (buffer + DS3HDR_CCF_SIZE, 10));
+    cntref.at(0) ^= 0xFF;
+    REQUIRE (! cntref.is_ref());
+    REQUIRE (cntref.at(0) != buffer[DS3HDR_CCF_SIZE]);
+    return 0;
+}
+
 int
 test_pktcnt (void)
 {
@@ -344,6 +887,76 @@ test_pktcnt (void)
     REQUIRE (cnt1.size() == sizeof(buf1) + sizeof(buf2));
     std::cout << "cnt1.dump():" << std::endl;
     cnt1.dump();
+
+    /* the type id of the content */
+    REQUIRE (&cntnbs == ds3_buffer_cast<ds3_packet_buffer_nbs_t>(&cntnbs));
+    REQUIRE (&cntnbs == ds3_buffer_cast<ds3_packet_buffer_t>(&cntnbs));
+    REQUIRE (NULL == ds3_buffer_cast<ds3_packet_buffer_nbs_t>(&cnt1));
+    REQUIRE (cnt1.get_buffer() == ds3_buffer_cast_content<ds3_packet_buffer_nbs_t>(&cnt1));
+    REQUIRE (NULL == ds3_buffer_cast_content<ds3_packet_buffer_nbs_t>(NULL));
+
+    /* read the bytes by the base class */
+    uint8_t tmpbuf[8];
+    REQUIRE (NULL != cnt1.contiguous_span (130, 4));
+    REQUIRE (NULL == cnt1.contiguous_span (162, 4));
+    REQUIRE (0x11 == cnt1.peek_span (130, 4, tmpbuf)[1]);
+    REQUIRE (0x22 == cnt1.peek_span (130, 4, tmpbuf)[2]);
+    REQUIRE (4 == cnt1.peek (160, tmpbuf, sizeof(tmpbuf)));
+    REQUIRE (0 == cnt1.peek (164, tmpbuf, sizeof(tmpbuf)));
+    ds3_packet_buffer_t cnt0;
+    REQUIRE (0 == cnt0.peek (0, tmpbuf, sizeof(tmpbuf)));
+    REQUIRE (NULL == cnt0.peek_span (0, 4, tmpbuf));
+
+    /* consume from the front, both the owned and the referenced bytes */
+    REQUIRE (130 == cnt1.consume_front (130));
+    REQUIRE (34 == cnt1.size());
+    REQUIRE (0x11 == cnt1[1]);
+    REQUIRE (0x22 == cnt1[2]);
+    ds3_packet_buffer_nbs_t cntref;
+    cntref.set_ref (buf2, sizeof(buf2));
+    REQUIRE (10 == cntref.consume_front (10));
+    REQUIRE (22 == cntref.size());
+    REQUIRE (cntref.contiguous_span (0, 1) == buf2 + 10);
+
+    /* the external bytes inserted to an empty buffer are copied */
+    ds3_packet_buffer_nbs_t cntdst;
+    REQUIRE (6 == cntdst.insert (0, &cntref, 2, 8));
+    REQUIRE (! cntdst.is_ref());
+    REQUIRE (cntdst.contiguous_span (0, 1) != buf2 + 12);
+    REQUIRE (0x22 == cntdst[0]);
+    REQUIRE (4 == cntdst.insert (cntdst.size(), &cntref, 0, 4));
+    REQUIRE (! cntdst.is_ref());
+    REQUIRE (10 == cntdst.size());
+    REQUIRE (0x22 == cntdst[9]);
+
+    /* copy() overwrites the content, and only grows the buffer at the end */
+    uint8_t buf3[8];
+    for (size_t i = 0; i < sizeof(buf3); i ++) {
+        buf3[i] = 0x30 + i;
+    }
+    ds3_packet_buffer_nbs_t cntovr;
+    cntovr.append (buf3, sizeof(buf3));
+    REQUIRE (3 == cntovr.copy (2, &cntdst, 0, 3));
+    REQUIRE (8 == cntovr.size());
+    REQUIRE (0x31 == cntovr[1]);
+    REQUIRE (0x22 == cntovr[2]);
+    REQUIRE (0x22 == cntovr[4]);
+    REQUIRE (0x35 == cntovr[5]);
+    REQUIRE (4 == cntovr.copy (6, &cntdst, 0, 4));
+    REQUIRE (10 == cntovr.size());
+    REQUIRE (0x35 == cntovr[5]);
+    REQUIRE (0x22 == cntovr[9]);
+    // the overlapped range in the same buffer
+    REQUIRE (4 == cntovr.copy (1, &cntovr, 0, 4));
+    REQUIRE (10 == cntovr.size());
+    REQUIRE (0x30 == cntovr[0]);
+    REQUIRE (0x30 == cntovr[1]);
+    REQUIRE (0x31 == cntovr[2]);
+    REQUIRE (0x22 == cntovr[3]);
+    REQUIRE (0x35 == cntovr[5]);
+    REQUIRE (22 == cntref.consume_front (100));
+    REQUIRE (0 == cntref.size());
+    REQUIRE (0 == cnt0.consume_front (10));
     return 0;
 }
 #endif
@@ -28,6 +28,7 @@
 #include <stdint.h> // uint16_t
 #include <string.h> // memcmp
 #include <assert.h>
+#include <sys/uio.h> // struct iovec
 
 #include <iostream>
 #include <vector>
@@ -52,8 +53,60 @@ typedef struct _ds3hdr_ccf_t {
     uint16_t hcs;             /**< HCS */
 } ds3hdr_ccf_t;
 
+#define DS3HDR_CCF_SIZE 8 /**< the byte size of the CCF segment header in network byte sequence */
+
 ssize_t ds3hdr_ccf_from_nbs (uint8_t *nbsbuf, size_t szbuf, ds3hdr_ccf_t * rethdr);
 ssize_t ds3hdr_ccf_to_nbs (uint8_t *nbsbuf, size_t szbuf, ds3hdr_ccf_t * refhdr);
+ssize_t ds3hdr_ccf_from_nbs_batch (uint8_t *nbsbuf, size_t szbuf, ds3hdr_ccf_t * rethdrs, size_t numhdr);
+ssize_t ds3hdr_ccf_to_nbs_batch (uint8_t *nbsbuf, size_t szbuf, ds3hdr_ccf_t * refhdrs, size_t numhdr);
+
+uint16_t ds3_crc16_ccitt (uint8_t *buf, size_t szbuf);
+uint16_t ds3hdr_ccf_calc_hcs (ds3hdr_ccf_t * refhdr);
+bool ds3hdr_ccf_check_hcs (uint8_t *nbsbuf, size_t szbuf);
+
+/**
+ * @brief read the fields of a CCF segment header in place, from the received bytes
+ *
+ * The view doesn't copy or decode the header, each field is read from the bytes (network byte sequence)
+ * when it's accessed, so the receiver can check the HCS and the sequence before creating a segment.
+ * The bytes have to be kept while the view is used.
+ */
+class ds3hdr_ccf_view_t {
+public:
+    ds3hdr_ccf_view_t() : nbsbuf(NULL) {}
+    ds3hdr_ccf_view_t(uint8_t *buf) : nbsbuf(buf) {}
+
+    /**
+     * @brief attach the view to the bytes
+     * @param buf : [in] the bytes of the header
+     * @param szbuf : [in] the size of the bytes
+     * @return the byte size of the header on success, < 0 on error(no enough data)
+     */
+    ssize_t attach (uint8_t *buf, size_t szbuf) { if ((NULL == buf) || (szbuf < DS3HDR_CCF_SIZE)) { this->nbsbuf = NULL; return -1; } this->nbsbuf = buf; return DS3HDR_CCF_SIZE; }
+    uint8_t * data (void) const { return this->nbsbuf; } /**< the bytes of the header */
+
+    uint16_t pfi (void) const { return (this->nbsbuf[0] >> 7); } /**< PFI */
+    uint16_t r (void) const { return ((this->nbsbuf[0] >> 6) & 0x01); } /**< Reserved */
+    uint16_t offmac (void) const { return (this->get16(0) & 0x3FFF); } /**< Pointer to MAC header */
+    uint16_t sequence (void) const { return (this->get16(2) >> 3); } /**< Sequence # */
+    uint16_t sc (void) const { return (this->nbsbuf[3] & 0x07); } /**< SID Cluster ID */
+    uint16_t request (void) const { return this->get16(4); } /**< Request */
+    uint16_t hcs (void) const { return this->get16(6); } /**< HCS */
+
+    bool check_hcs (void) const { return ds3hdr_ccf_check_hcs (this->nbsbuf, DS3HDR_CCF_SIZE); } /**< check the HCS of the header */
+    ssize_t to_header (ds3hdr_ccf_t * rethdr) const { return ds3hdr_ccf_from_nbs (this->nbsbuf, DS3HDR_CCF_SIZE, rethdr); } /**< decode all of the fields */
+
+    /* patch the fields of a serialized header, the HCS is not changed until update_hcs() is called */
+    void set_sequence (uint16_t v) { this->set16(2, (uint16_t)((v << 3) | (this->nbsbuf[3] & 0x07))); } /**< set Sequence #, keep the SID Cluster ID */
+    void set_sc (uint16_t v) { this->nbsbuf[3] = (uint8_t)((this->nbsbuf[3] & 0xF8) | (v & 0x07)); } /**< set SID Cluster ID */
+    void set_request (uint16_t v) { this->set16(4, v); } /**< set Request */
+    void update_hcs (void) { this->set16(6, ds3_crc16_ccitt (this->nbsbuf, DS3HDR_CCF_SIZE - 2)); } /**< re-calculate the HCS from the other fields */
+
+private:
+    uint16_t get16 (size_t pos) const { return (((uint16_t)(this->nbsbuf[pos]) << 8) | this->nbsbuf[pos + 1]); }
+    void set16 (size_t pos, uint16_t v) { this->nbsbuf[pos] = (uint8_t)(v >> 8); this->nbsbuf[pos + 1] = (uint8_t)(v & 0xFF); }
+    uint8_t * nbsbuf; /**< the bytes of the header, not owned */
+};
 
 #define DS3_WRONGFUNC_EXECEPTION() { \
     std::cout << "[" __FILE__ ":" << __LINE__ << "] wrong " << typeid(this).name() << "::" << __func__ << "() ! should never reach to this function, it should be a abstract function!" << std::endl; \
@@ -73,6 +126,22 @@ ssize_t ds3hdr_ccf_to_nbs (uint8_t *nbsbuf, size_t szbuf, ds3hdr_ccf_t * refhdr)
     return (val); \
     }
 
+/**
+ * @brief the type id of the packet content classes
+ *
+ * The insert/copy between the content classes need to know the real type of the peer.
+ * Each class has a static type id which points to the id of its parent class,
+ * so ds3_buffer_cast() checks the type by comparing the pointers, without RTTI(dynamic_cast).
+ */
+typedef struct _ds3_buftype_t {
+    const struct _ds3_buftype_t * parent; /**< the type id of the parent class, NULL for ds3_packet_buffer_t */
+    const char * name; /**< the class name */
+} ds3_buftype_t;
+
+/** define the type id of a content class, in the source file of the class */
+#define DS3_PKTCNT_IMPLEMENT_BUFTYPE(ds3_real_type, ds3_parent_type) \
+    const ds3_buftype_t ds3_real_type::buftype_self = { &(ds3_parent_type::buftype_self), #ds3_real_type }
+
 /**
  * @brief The base class for all types of the packet content
  *
@@ -95,6 +164,10 @@ public:
         }
 #endif
 
+    static const ds3_buftype_t buftype_self; /**< the type id of this class */
+    /** @brief the type id of the real class of this object */
+    virtual const ds3_buftype_t * get_buftype (void) const { return &(ds3_packet_buffer_t::buftype_self); }
+
     virtual ~ds3_packet_buffer_t()
         {
             if (this->contents_buffer) {
@@ -221,9 +294,107 @@ public:
             DS3_WRONGFUNC_RETVAL(-1);
         }
 
+    /**
+     * @brief export the content as a scatter-gather array without copying, such as for writev()
+     * @param iov : the array to be filled, the items point to the data of this buffer
+     * @param numiov : the size of the array, 0 to get the number of the items required
+     *
+     * @return the number of the items filled(or required), >=0 on success, < 0 on error(the array is too small or the content can't be exported)
+     *
+     * The items are valid until this buffer is modified or released.
+     */
+    virtual ssize_t to_iovec (struct iovec *iov, size_t numiov)
+        {
+            if (this->contents_buffer) {
+                return this->contents_buffer->to_iovec(iov, numiov);
+            }
+            if (0 == this->size()) {
+                return 0;
+            }
+            // the content isn't stored as bytes
+            return -1;
+        }
+
+    /**
+     * @brief remove the content from the front
+     * @param sz : [in] the size to be removed
+     *
+     * @return the size removed, it's less than sz if there's no enough data; < 0 on error
+     *
+     * The CCF buffers are always consumed from the front, the content classes may do it without moving the rest.
+     */
+    virtual ssize_t consume_front (size_t sz)
+        {
+            if (this->contents_buffer) {
+                return this->contents_buffer->consume_front(sz);
+            }
+            return 0;
+        }
+
+    /**
+     * @brief get the pointer to the bytes [pos, pos + len) if they are stored contiguously
+     * @param pos : [in] the position of the content
+     * @param len : [in] the number of the bytes
+     *
+     * @return the pointer to the bytes, valid until this buffer is modified or released;
+     *         NULL if the bytes cross the chunks, are out of range, or the content isn't stored as bytes
+     */
+    virtual const uint8_t * contiguous_span (size_t pos, size_t len)
+        {
+            if (this->contents_buffer) {
+                return this->contents_buffer->contiguous_span(pos, len);
+            }
+            return NULL;
+        }
+
+    /**
+     * @brief copy the bytes at pos to nbsbuf
+     * @param pos : [in] the position of the content
+     * @param nbsbuf : [out] the buffer to be filled
+     * @param szbuf : [in] the size of the buffer
+     *
+     * @return the size of data copied, it's less than szbuf if there's no enough data; < 0 if the content isn't stored as bytes
+     */
+    virtual ssize_t peek (size_t pos, uint8_t *nbsbuf, size_t szbuf)
+        {
+            if (this->contents_buffer) {
+                return this->contents_buffer->peek(pos, nbsbuf, szbuf);
+            }
+            if ((ssize_t)pos >= this->size()) {
+                return 0;
+            }
+            return -1;
+        }
+
+    /**
+     * @brief get the bytes [pos, pos + len), they are copied to tmpbuf only if they are not contiguous
+     * @param pos : [in] the position of the content
+     * @param len : [in] the number of the bytes
+     * @param tmpbuf : [in] the buffer with at least len bytes, used when the bytes cross the chunks
+     *
+     * @return the pointer to the bytes (the content or tmpbuf), NULL if there's no enough data
+     */
+    const uint8_t * peek_span (size_t pos, size_t len, uint8_t *tmpbuf)
+        {
+            const uint8_t * p = this->contiguous_span (pos, len);
+            if (NULL != p) {
+                return p;
+            }
+            if ((ssize_t)len != this->peek (pos, tmpbuf, len)) {
+                return NULL;
+            }
+            return tmpbuf;
+        }
+
      /** @brief get the packet content, only for derived class */
     virtual ds3_packet_buffer_t * get_buffer (void) { return this->contents_buffer; }
 
+    /**
+     * @brief exchange the contents of the two buffers without copying
+     * @param peer : [in,out] the other buffer, both of them are the objects of this class (not the derived classes)
+     */
+    void swap (ds3_packet_buffer_t & peer) { std::swap (this->contents_buffer, peer.contents_buffer); }
+
 protected:
     /**
      * @brief insert content to peer
@@ -279,19 +450,49 @@ ds3_packet_buffer_t::at(size_t i)
     DS3_WRONGFUNC_EXECEPTION();
 }
 
+/**
+ * @brief cast the content class pointer to the class T, without RTTI
+ * @param p : [in] the pointer to the content
+ * @return the pointer of class T if p is a T or derived from T, NULL otherwise
+ */
+template <class T> inline T *
+ds3_buffer_cast (ds3_packet_buffer_t * p)
+{
+    if (NULL == p) {
+        return NULL;
+    }
+    const ds3_buftype_t * t = p->get_buftype();
+    for (; NULL != t; t = t->parent) {
+        if (t == &(T::buftype_self)) {
+            return static_cast<T *>(p);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief cast the content class pointer to the class T; if it's a base class, cast its child content
+ * @param p : [in] the pointer to the content
+ * @return the pointer of class T, NULL if the types are mismatch
+ */
+template <class T> inline T *
+ds3_buffer_cast_content (ds3_packet_buffer_t * p)
+{
+    T * ret = ds3_buffer_cast<T>(p);
+    if ((NULL == ret) && (NULL != p) && (&(ds3_packet_buffer_t::buftype_self) == p->get_buftype())) {
+        /* it's a base class, and it stored the content from other content */
+        ret = ds3_buffer_cast<T>(p->get_buffer());
+    }
+    return ret;
+}
+
 /**
  * in a derived class, the accepted peer is type of either the same class
  * or base(with the same type of class pointer contents_buffer) class.
  */
 #define DS3_PKTCNT_IMPLEMENT_CHILD_COPY(ds3_real_type, pos_self, arg_peer, begin_peer, end_peer) \
     assert (NULL != (arg_peer)); \
-    ds3_real_type *peer = dynamic_cast<ds3_real_type *>(arg_peer); \
-    if (NULL == peer) { \
-        if (NULL != (arg_peer)->get_buffer()) { \
-            /* it's a base class, and it stored the content from other ns2 content */ \
-            peer = dynamic_cast<ds3_real_type *>((arg_peer)->get_buffer()); \
-        } \
-    } \
+    ds3_real_type *peer = ds3_buffer_cast_content<ds3_real_type>(arg_peer); \
     if (NULL == peer) { \
         return -1; \
     } \
@@ -313,12 +514,7 @@ ds3_packet_buffer_t::at(size_t i)
 
 #define DS3_PKTCNT_IMPLEMENT_CHILD_INSERT(ds3_real_type, pos_self, arg_peer, begin_peer, end_peer) \
     assert (NULL != (arg_peer)); \
-    ds3_real_type *peer = dynamic_cast<ds3_real_type *>(arg_peer); \
-    if (NULL == peer) { \
-        if (NULL != (arg_peer)->get_buffer()) { \
-            peer = dynamic_cast<ds3_real_type *>((arg_peer)->get_buffer()); \
-        } \
-    } \
+    ds3_real_type *peer = ds3_buffer_cast_content<ds3_real_type>(arg_peer); \
     if (NULL == peer) { \
         return -1; \
     } \
@@ -334,6 +530,8 @@ ds3_packet_buffer_t::at(size_t i)
 
 #define DS3_PKTCNT_DECLARE_MEMBER_FUNCTIONS_MINI(ds3_real_type) \
   public: \
+    static const ds3_buftype_t buftype_self; \
+    virtual const ds3_buftype_t * get_buftype (void) const { return &(ds3_real_type::buftype_self); } \
     virtual ds3_packet_buffer_t * create(void) { return new ds3_real_type(); } \
     virtual ds3_packet_buffer_t * create(ds3_packet_buffer_t * peer, size_t begin, size_t end) { return new ds3_real_type(peer, begin, end); } \
     ds3_real_type(ds3_packet_buffer_t *peer, size_t begin, size_t end); \
@@ -364,11 +562,25 @@ ds3_packet_buffer_t::at(size_t i)
 class ds3_packet_buffer_nbs_t : public ds3_packet_buffer_t {
 protected:
     std::vector<uint8_t> buffer; /**< the content buffer */
+    uint8_t * refbuf; /**< the external bytes used instead of buffer (not owned), NULL if the content is in buffer */
+    size_t szref; /**< the size of the external bytes */
+
+    /** @brief the pointer to the bytes of the content */
+    uint8_t * get_data (void) { return (this->refbuf ? this->refbuf : (this->buffer.size() > 0 ? &(this->buffer[0]) : NULL)); }
+    void own (void);
 public:
-    ds3_packet_buffer_nbs_t() {}
+    ds3_packet_buffer_nbs_t() : refbuf(NULL), szref(0) {}
+
+    int set_ref (uint8_t *nbsbuf, size_t szbuf);
+    virtual ssize_t to_iovec (struct iovec *iov, size_t numiov);
+    virtual const uint8_t * contiguous_span (size_t pos, size_t len);
+    virtual ssize_t peek (size_t pos, uint8_t *nbsbuf, size_t szbuf);
+    virtual ssize_t consume_front (size_t sz);
+    bool is_ref (void) const { return (NULL != this->refbuf); } /**< if the content is the external bytes */
 
     ssize_t append (std::vector<uint8_t>::iterator &begin1, std::vector<uint8_t>::iterator &end1);
     ssize_t append (uint8_t *buf, size_t sz);
+    ssize_t append_iovec (const struct iovec *iov, size_t numiov);
     int append_to (std::vector<uint8_t> & buffer1);
 
 #if CCFDEBUG
@@ -382,8 +594,57 @@ public:
 
 inline ds3_packet_buffer_nbs_t::~ds3_packet_buffer_nbs_t() {}
 
-inline int ds3_packet_buffer_nbs_t::resize(size_t sznew) { this->buffer.resize(sznew); return 0; }
-inline uint8_t & ds3_packet_buffer_nbs_t::at(size_t i) { return this->buffer[i]; }
+inline int
+ds3_packet_buffer_nbs_t::resize(size_t sznew)
+{
+    if (this->refbuf && (sznew <= this->szref)) {
+        // shrink the view, no copy
+        this->szref = sznew;
+        return 0;
+    }
+    this->own ();
+    this->buffer.resize(sznew);
+    return 0;
+}
+inline uint8_t & ds3_packet_buffer_nbs_t::at(size_t i) { this->own (); return this->get_data()[i]; } // the byte may be changed by the caller
+
+inline ssize_t
+ds3_packet_buffer_nbs_t::consume_front (size_t sz)
+{
+    if ((ssize_t)sz > this->size()) {
+        sz = this->size();
+    }
+    if (this->refbuf) {
+        // the external bytes are not owned, just move the start
+        this->refbuf += sz;
+        this->szref -= sz;
+        return sz;
+    }
+    this->buffer.erase (this->buffer.begin(), this->buffer.begin() + sz);
+    return sz;
+}
+
+inline const uint8_t *
+ds3_packet_buffer_nbs_t::contiguous_span (size_t pos, size_t len)
+{
+    if ((ssize_t)(pos + len) > this->size()) {
+        return NULL;
+    }
+    return this->get_data() + pos;
+}
+
+inline ssize_t
+ds3_packet_buffer_nbs_t::peek (size_t pos, uint8_t *nbsbuf, size_t szbuf)
+{
+    if ((ssize_t)pos >= this->size()) {
+        return 0;
+    }
+    if ((ssize_t)(pos + szbuf) > this->size()) {
+        szbuf = this->size() - pos;
+    }
+    memmove (nbsbuf, this->get_data() + pos, szbuf);
+    return szbuf;
+}
 
 /* the real packet is stored in peer which is created by this micro, for ds3_packet_buffer_t::insert_to() and copy_to() */
 #define DS3_DYNCST_CHKRET_CONTENT_POINTER(ds3_real_type, arg_peer) \
@@ -392,7 +653,7 @@ inline uint8_t & ds3_packet_buffer_nbs_t::at(size_t i) { return this->buffer[i];
         ds3_packet_buffer_t * newpkt = this->create (this, begin_self, end_self); \
         return newpkt; \
     } \
-    ds3_real_type *peer = dynamic_cast<ds3_real_type *>(arg_peer); \
+    ds3_real_type *peer = ds3_buffer_cast<ds3_real_type>(arg_peer); \
     if (NULL == peer) { \
         assert (0); \
         return NULL; \
@@ -415,6 +676,9 @@ inline uint8_t & ds3_packet_buffer_nbs_t::at(size_t i) { return this->buffer[i];
 #endif
 
 int test_ccfhdr (void);
+int test_ccfhdr_batch (void);
+int test_ccfhdr_hcs (void);
+int test_ccfhdr_view (void);
 int test_pktcnt (void);
 #endif
 
@@ -8,10 +8,12 @@
  */
 
 #include <stdio.h>
+#include <time.h> // clock_gettime()
 
 #include "ds3pktccf.h"
 
 #define USE_DS3_LATESNDPIG 1
+#define USE_DS3_HCS 1 /**< fill the HCS of the segments at pack, and drop the segments with bad HCS at unpack */
 
 const char *
 ds3_event2desc (ds3event_t e)
@@ -57,12 +59,12 @@ ssize_t
 ds3packet_ccf_t::to_nbs (uint8_t *nbsbuf, size_t szbuf)
 {
     if (0 == szbuf) {
-        return (ds3hdr_ccf_to_nbs(NULL, 0, &(this->ccfhdr)) + this->buffer.size());
+        return (DS3HDR_CCF_SIZE + this->buffer.size());
     }
     if (NULL == nbsbuf) {
         return -1;
     }
-    assert ( (ssize_t)szbuf >= (ds3hdr_ccf_to_nbs(NULL, 0, &(this->ccfhdr)) + this->buffer.size()) );
+    assert ( (ssize_t)szbuf >= (DS3HDR_CCF_SIZE + this->buffer.size()) );
     size_t sz;
     sz = ds3hdr_ccf_to_nbs(nbsbuf, szbuf, &(this->ccfhdr));
     if (sz > 0) {
@@ -94,6 +96,190 @@ ds3packet_ccf_t::from_nbs (uint8_t *nbsbuf, size_t szbuf)
     return szbuf;
 }
 
+/**
+ * @brief set the content to refer to the external bytes without copying them
+ *
+ * @param refcnt : [in,out] a buffer of the content type (such as ds3_packet_buffer_nbsmac_t), it's emptied
+ * @param nbsbuf : [in] the bytes of the content
+ * @param szbuf : [in] the size of the bytes
+ *
+ * @return 0 on success, < 0 on error
+ *
+ * Only the content of the segment refers to the bytes, the buffers created or copied from it have their own copy.
+ */
+int
+ds3packet_ccf_t::set_content_ref (ds3_packet_buffer_nbs_t * refcnt, uint8_t *nbsbuf, size_t szbuf)
+{
+    refcnt->set_ref (NULL, 0);
+    if (this->set_content (refcnt) < 0) {
+        return -1;
+    }
+    ds3_packet_buffer_nbs_t * cnt = ds3_buffer_cast_content<ds3_packet_buffer_nbs_t> (&(this->get_content_ref()));
+    if (NULL == cnt) {
+        return -1;
+    }
+    return cnt->set_ref (nbsbuf, szbuf);
+}
+
+/**
+ * @brief read the segment from the received bytes, the content stays in the receive buffer
+ *
+ * @param nbsbuf : [in] the received bytes of the segment, including the CCF header
+ * @param szbuf : [in] the size of the bytes
+ * @param refcnt : [in,out] a buffer of the content type (such as ds3_packet_buffer_nbsmac_t), it's emptied
+ *
+ * @return the size of data processed, >0 on success, < 0 on error
+ *
+ * The header is read by a ds3hdr_ccf_view_t, and the content of a new segment refers to the bytes after the header
+ * without copying. The received bytes have to be kept until the segment is recycled or dropped,
+ * and the ds3_ccf_unpack_t::process_packet() returned.
+ */
+ssize_t
+ds3packet_ccf_t::from_nbs_ref (uint8_t *nbsbuf, size_t szbuf, ds3_packet_buffer_nbs_t * refcnt)
+{
+    ds3hdr_ccf_view_t hdrview;
+    if (NULL == refcnt) {
+        return -1;
+    }
+    if (hdrview.attach (nbsbuf, szbuf) < 0) {
+        return -1;
+    }
+    if (hdrview.to_header (&(this->ccfhdr)) < 0) {
+        return -1;
+    }
+    if (this->set_content_ref (refcnt, nbsbuf + DS3HDR_CCF_SIZE, szbuf - DS3HDR_CCF_SIZE) < 0) {
+        return -1;
+    }
+    return szbuf;
+}
+
+/**
+ * @brief export the segment as a scatter-gather array without copying, such as for writev()
+ *
+ * @param iov : [out] the array to be filled, the first item is the CCF header
+ * @param numiov : [in] the size of the array, 0 to get the number of the items required
+ *
+ * @return the number of the items filled(or required), >0 on success, < 0 on error
+ *
+ * The items are valid until the segment is changed or released.
+ */
+ssize_t
+ds3packet_ccf_t::to_iovec (struct iovec *iov, size_t numiov)
+{
+    ssize_t ret;
+    ret = this->buffer.to_iovec (NULL, 0);
+    if (ret < 0) {
+        return -1;
+    }
+    if (0 == numiov) {
+        return ret + 1;
+    }
+    if ((NULL == iov) || ((ssize_t)numiov < ret + 1)) {
+        return -1;
+    }
+    ret = this->buffer.to_iovec (iov + 1, numiov - 1);
+    if (ret < 0) {
+        return -1;
+    }
+    this->hdr_to_nbs (this->ccfhdrbuf, sizeof(this->ccfhdrbuf));
+    iov[0].iov_base = this->ccfhdrbuf;
+    iov[0].iov_len = DS3HDR_CCF_SIZE;
+    return ret + 1;
+}
+
+/**
+ * @brief rewrite the request, sequence and SC fields of a built segment
+ *
+ * @param request : [in] the piggyback request
+ * @param sequence : [in] the sequence number
+ * @param sc : [in] the SID Cluster ID
+ *
+ * The HCS is refreshed, and the header bytes exported by to_iovec() are patched in place,
+ * so a late decision (such as the piggyback request) doesn't need to rebuild the segment.
+ */
+void
+ds3packet_ccf_t::patch_header (uint16_t request, uint16_t sequence, uint8_t sc)
+{
+    this->ccfhdr.request = request;
+    this->ccfhdr.sequence = sequence;
+    this->ccfhdr.sc = sc;
+#if USE_DS3_HCS
+    this->ccfhdr.hcs = ds3hdr_ccf_calc_hcs (&(this->ccfhdr));
+#endif
+    this->hdr_to_nbs (this->ccfhdrbuf, sizeof(this->ccfhdrbuf));
+}
+
+/**
+ * @brief read the segment from the gathered received bytes
+ *
+ * @param iov : [in] the received bytes of the segment, including the CCF header
+ * @param numiov : [in] the size of the array
+ * @param refcnt : [in,out] a buffer of the content type (such as ds3_packet_buffer_nbsmac_t)
+ *
+ * @return the size of data processed, >0 on success, < 0 on error
+ *
+ * The header may be split in several items. The content refers to the first item of the content without
+ * copying (see from_nbs_ref()); if the content is in several items, it's then gathered into the storage
+ * of the segment content by one copy of the bytes.
+ */
+ssize_t
+ds3packet_ccf_t::from_iovec (const struct iovec *iov, size_t numiov, ds3_packet_buffer_nbs_t * refcnt)
+{
+    uint8_t hdrbuf[DS3HDR_CCF_SIZE];
+    size_t szhdr = 0;
+    size_t szall = 0;
+    size_t i;
+    size_t off = 0;
+    size_t idxcnt = numiov;
+    size_t numcnt = 0;
+
+    if ((NULL == iov) || (NULL == refcnt)) {
+        return -1;
+    }
+    // gather the header
+    for (i = 0; i < numiov; i ++) {
+        uint8_t * p = (uint8_t *)(iov[i].iov_base);
+        size_t szcpy = 0;
+        if (szhdr < DS3HDR_CCF_SIZE) {
+            szcpy = DS3HDR_CCF_SIZE - szhdr;
+            if (szcpy > iov[i].iov_len) {
+                szcpy = iov[i].iov_len;
+            }
+            memmove (hdrbuf + szhdr, p, szcpy);
+            szhdr += szcpy;
+        }
+        if ((szcpy < iov[i].iov_len) && (szhdr >= DS3HDR_CCF_SIZE)) {
+            if (idxcnt >= numiov) {
+                idxcnt = i;
+                off = szcpy;
+            }
+            numcnt ++;
+        }
+        szall += iov[i].iov_len;
+    }
+    if (szhdr < DS3HDR_CCF_SIZE) {
+        return -1;
+    }
+    if (ds3hdr_ccf_from_nbs (hdrbuf, sizeof(hdrbuf), &(this->ccfhdr)) < 0) {
+        return -1;
+    }
+    if (numcnt > 0) {
+        if (this->set_content_ref (refcnt, (uint8_t *)(iov[idxcnt].iov_base) + off, iov[idxcnt].iov_len - off) < 0) {
+            return -1;
+        }
+    } else if (this->set_content_ref (refcnt, NULL, 0) < 0) {
+        return -1;
+    }
+    if (numcnt > 1) {
+        ds3_packet_buffer_nbs_t * cnt = ds3_buffer_cast_content<ds3_packet_buffer_nbs_t> (&(this->get_content_ref()));
+        if (NULL == cnt) {
+            return -1;
+        }
+        cnt->append_iovec (iov + idxcnt + 1, numiov - idxcnt - 1);
+    }
+    return szall;
+}
+
 #if CCFDEBUG
 void
 ds3packet_ccf_t::dump (void)
@@ -115,13 +301,13 @@ ds3packet_ccf_t::dump (void)
 uint8_t &
 ds3packet_ccf_t::at(size_t i)
 {
-    assert ((ssize_t)sizeof (this->ccfhdrbuf) >= ds3hdr_ccf_to_nbs (NULL, 0, &(this->ccfhdr)));
-    if ((ssize_t)i < ds3hdr_ccf_to_nbs (NULL, 0, &(this->ccfhdr))) {
+    assert ((ssize_t)sizeof (this->ccfhdrbuf) >= DS3HDR_CCF_SIZE);
+    if ((ssize_t)i < DS3HDR_CCF_SIZE) {
         this->hdr_to_nbs (this->ccfhdrbuf, sizeof(this->ccfhdrbuf));
         return this->ccfhdrbuf[i];
     }
-    assert ((ssize_t)i >= ds3hdr_ccf_to_nbs (NULL, 0, &(this->ccfhdr)));
-    return (this->get_content_ref().at(i - ds3hdr_ccf_to_nbs (NULL, 0, &(this->ccfhdr))));
+    assert ((ssize_t)i >= DS3HDR_CCF_SIZE);
+    return (this->get_content_ref().at(i - DS3HDR_CCF_SIZE));
 }
 
 uint8_t &
@@ -133,736 +319,2739 @@ ds3packet_t::at(size_t i)
 #endif
 
 /**
- * @brief check if (i < j)
- * @param i : the left hand of the value
- * @param j : the right hand of the value
- * @return true if (i < j), false otherwise
+ * @brief count the continual segments from the position up
+ *
+ * @param start : [in] the start position
+ * @param maxlen : [in] the max number of the positions to be checked
+ *
+ * @return the number of the continual positions which have segments, start included
+ */
+size_t
+ds3_ccf_reorder_t::scan_up (size_t start, size_t maxlen) const
+{
+    size_t num = 0;
+    size_t pos = start & DS3_CCF_SEQ_MASK;
+    size_t avail;
+    size_t ones;
+    uint64_t inv;
+    for (; num < maxlen; ) {
+        /* the bits from pos to the end of the word, the zeros shifted in stop the scan */
+        inv = ~(this->bitmap[pos >> 6] >> (pos & 63));
+        avail = 64 - (pos & 63);
+        ones = (0 == inv) ? 64 : __builtin_ctzll (inv);
+        if (ones > avail) {
+            ones = avail;
+        }
+        num += ones;
+        if (ones < avail) {
+            break;
+        }
+        pos = (pos + ones) & DS3_CCF_SEQ_MASK;
+    }
+    return (num < maxlen) ? num : maxlen;
+}
+
+/**
+ * @brief count the continual segments from the position down
+ *
+ * @param start : [in] the start position
+ * @param maxlen : [in] the max number of the positions to be checked
+ *
+ * @return the number of the continual positions which have segments, start included
  */
-static bool
-compare_ccfpktp (ds3packet_ccf_t * i, ds3packet_ccf_t * j)
+size_t
+ds3_ccf_reorder_t::scan_down (size_t start, size_t maxlen) const
 {
-    return (i->get_header().sequence < j->get_header().sequence);
+    size_t num = 0;
+    size_t pos = start & DS3_CCF_SEQ_MASK;
+    size_t avail;
+    size_t ones;
+    uint64_t inv;
+    for (; num < maxlen; ) {
+        /* the bits from the start of the word to pos, moved to the top */
+        inv = ~(this->bitmap[pos >> 6] << (63 - (pos & 63)));
+        avail = (pos & 63) + 1;
+        ones = (0 == inv) ? 64 : __builtin_clzll (inv);
+        if (ones > avail) {
+            ones = avail;
+        }
+        num += ones;
+        if (ones < avail) {
+            break;
+        }
+        pos = (pos - ones) & DS3_CCF_SEQ_MASK;
+    }
+    return (num < maxlen) ? num : maxlen;
 }
 
 /**
- * @brief find the next node of a continual sequence in a loop list
+ * @brief put a segment to the slot of its sequence #
  *
- * @param pkglst: the list
- * @param itins: the current node
+ * @param p : [in] the segment
  *
- * @return the first node, end() on error
+ * @return the segment in the slot before, NULL if the slot is empty
  */
-std::vector<ds3packet_ccf_t *>::iterator
-ds3pktlstccf_next (std::vector<ds3packet_ccf_t *> & pkglst, std::vector<ds3packet_ccf_t *>::iterator & itins)
+ds3packet_ccf_t *
+ds3_ccf_reorder_t::put (ds3packet_ccf_t * p)
 {
-    std::vector<ds3packet_ccf_t *>::iterator itnext = itins;
-    if (itins == pkglst.end()) {
-        return pkglst.end();
+    assert (NULL != p);
+    size_t seq = p->get_header().sequence & DS3_CCF_SEQ_MASK;
+    ds3_reorder_page_t * pg = this->pages[seq / DS3_CCF_PAGE_SLOTS];
+    if (NULL == pg) {
+        pg = this->spare;
+        this->spare = NULL;
+        if (NULL == pg) {
+            pg = new ds3_reorder_page_t;
+        }
+        memset (pg, 0, sizeof(*pg));
+        this->pages[seq / DS3_CCF_PAGE_SLOTS] = pg;
+        this->numpage ++;
     }
-    itnext ++;
-    if (itnext == pkglst.end()) {
-        itnext = pkglst.begin ();
+    ds3packet_ccf_t * pold = pg->slots[seq % DS3_CCF_PAGE_SLOTS];
+    pg->slots[seq % DS3_CCF_PAGE_SLOTS] = p;
+    if (NULL == pold) {
+        this->bitmap[seq >> 6] |= ((uint64_t)1 << (seq & 63));
+        this->numseg ++;
+    }
+    return pold;
+}
+
+/**
+ * @brief remove the segment of the sequence #
+ *
+ * @param seq : [in] the sequence #
+ *
+ * @return the segment removed, NULL if the slot is empty
+ */
+ds3packet_ccf_t *
+ds3_ccf_reorder_t::remove (size_t seq)
+{
+    seq &= DS3_CCF_SEQ_MASK;
+    ds3_reorder_page_t * pg = this->pages[seq / DS3_CCF_PAGE_SLOTS];
+    if (NULL == pg) {
+        return NULL;
     }
-    if (itnext == itins) {
-        return pkglst.end();
+    ds3packet_ccf_t * p = pg->slots[seq % DS3_CCF_PAGE_SLOTS];
+    if (NULL != p) {
+        pg->slots[seq % DS3_CCF_PAGE_SLOTS] = NULL;
+        this->bitmap[seq >> 6] &= ~((uint64_t)1 << (seq & 63));
+        this->numseg --;
+        if (0 == this->bitmap[seq >> 6]) {
+            /* the last segment of the page */
+            this->pages[seq / DS3_CCF_PAGE_SLOTS] = NULL;
+            this->numpage --;
+            if (NULL == this->spare) {
+                this->spare = pg;
+            } else {
+                delete pg;
+            }
+        }
     }
-    return itnext;
+    return p;
 }
 
-std::vector<ds3packet_ccf_t *>::iterator
-ds3pktlstccf_next_pivot (std::vector<ds3packet_ccf_t *> & pkglst
-    , std::vector<ds3packet_ccf_t *>::iterator & itins
-    , std::vector<ds3packet_ccf_t *>::iterator & itp)
+/** the segments left are not released, they're owned by the unpack engine */
+ds3_ccf_reorder_t::~ds3_ccf_reorder_t ()
 {
-    std::vector<ds3packet_ccf_t *>::iterator itnext = ds3pktlstccf_next(pkglst, itins);
-    if (itnext == itp) {
-        return pkglst.end();
+    size_t i;
+    for (i = 0; i < DS3_CCF_SEQ_NUM / DS3_CCF_PAGE_SLOTS; i ++) {
+        if (NULL != this->pages[i]) {
+            delete this->pages[i];
+        }
+    }
+    if (NULL != this->spare) {
+        delete this->spare;
     }
-    return itnext;
 }
 
 /**
- * @brief find the prev node of a continual sequence in a loop list
+ * @brief find the continual segments which include the sequence #
  *
- * @param pkglst: the list
- * @param itins: the current node
+ * @param seq : [in] the sequence #
+ * @param retbegin : [out] the sequence # of the first segment
  *
- * @return the first node, end() on error
+ * @return the number of the continual segments, 0 if there's no segment of seq
+ *
+ * if all of the slots are used, the segments start from the one after seq
  */
-std::vector<ds3packet_ccf_t *>::iterator
-ds3pktlstccf_prev (std::vector<ds3packet_ccf_t *> & pkglst, std::vector<ds3packet_ccf_t *>::iterator & itins)
+size_t
+ds3_ccf_reorder_t::find_run (size_t seq, size_t & retbegin) const
 {
-    std::vector<ds3packet_ccf_t *>::iterator itnext = itins;
-    if (itins == pkglst.end()) {
-        return pkglst.end();
-    }
-    if (itins == pkglst.begin()) {
-        itnext = pkglst.end();
+    size_t numdown;
+    seq &= DS3_CCF_SEQ_MASK;
+    if (! this->test (seq)) {
+        return 0;
     }
-    itnext --;
-    if (itnext == itins) {
-        return pkglst.end();
+    numdown = this->scan_down (seq, DS3_CCF_SEQ_NUM);
+    if (numdown >= DS3_CCF_SEQ_NUM) {
+        retbegin = (seq + 1) & DS3_CCF_SEQ_MASK;
+        return DS3_CCF_SEQ_NUM;
     }
-    return itnext;
+    retbegin = (seq + DS3_CCF_SEQ_NUM + 1 - numdown) & DS3_CCF_SEQ_MASK;
+    return this->scan_up (retbegin, DS3_CCF_SEQ_NUM);
 }
 
+/**
+ * @brief start a MAC packet
+ *
+ * @param seq : [in] the sequence # of the segment of the MAC header
+ * @param off : [in] the position of the MAC header in the segment
+ */
+void
+ds3_mac_delin_t::start (size_t seq, size_t off)
+{
+    this->reset ();
+    this->seqhead = (seq & DS3_CCF_SEQ_MASK);
+    this->offhead = off;
+}
 
-        //if ((*itins)->get_header().sequence >= 8191) {
-            /* ccf.sequence only has 13bits! = 8192 */
+/** @brief drop the MAC packet, the storage is kept for the next one */
+void
+ds3_mac_delin_t::reset (void)
+{
+    this->numseg = 0;
+    this->szframe = -1;
+    this->szseen = 0;
+    this->hdrpart.resize (0);
+    this->pieces.resize (0);
+}
 
 /**
- * @brief find the first node of a continual sequence in a loop list
+ * @brief feed the data of the next segment
  *
- * @param pkglst: the list
- * @param itins: the current node
+ * @param seg : [in] the segment
+ * @param off : [in] the start position of the data in the content of the segment
+ * @param len : [in] the size of the data
  *
- * @return the first node, end() on error
+ * @return the bytes of the data belong to the MAC packet, less than len if the MAC packet ends in the data,
+ *   or the MAC header is not found in DS3_MAC_HDR_MAX bytes
  */
-std::vector<ds3packet_ccf_t *>::iterator
-ds3pktlstccf_find_first (std::vector<ds3packet_ccf_t *> & pkglst, std::vector<ds3packet_ccf_t *>::iterator & itins)
+size_t
+ds3_mac_delin_t::feed (ds3packet_ccf_t * seg, size_t off, size_t len)
 {
-    // find the left most and right most positions which have continual sequence number
-    std::vector<ds3packet_ccf_t *>::iterator itprev = itins;
-    std::vector<ds3packet_ccf_t *>::iterator itleft = itins;
-
-    itprev = ds3pktlstccf_prev (pkglst, itins);
-    if (pkglst.end() == itprev) {
-        assert(pkglst.size() == 1);
-        return itins;
-    }
-    for (; (itleft != itins) && (itleft != pkglst.end()); itleft = ds3pktlstccf_prev (pkglst, itleft)) {
-        if ((*itleft)->get_header().sequence + 1 != (*itprev)->get_header().sequence) {
-            break;
+    ds3_packet_buffer_t & cnt = seg->get_content_ref();
+    size_t szuse = len;
+    this->numseg ++;
+    if (this->szframe <= 0) {
+        if (this->szseen < 1) {
+            // the data start from the MAC header, no copy if the header is in this segment
+            this->szframe = cnt.block_size_at (off);
         }
-        itprev = itleft;
-    }
-    if (itleft != pkglst.end()) {
-        itleft = ds3pktlstccf_next (pkglst, itleft);
-    } else {
-        if (itprev != itleft) {
-            if ((*itleft)->get_header().sequence + 1 != (*itprev)->get_header().sequence) {
-                itleft = itprev;
+        if (this->szframe <= 0) {
+            // the header is split, the bytes fed are copied contiguously until the header is complete
+            assert ((size_t)this->hdrpart.size() == this->szseen);
+            size_t szcpy = 0;
+            if (this->szseen < DS3_MAC_HDR_MAX) {
+                szcpy = std::min (len, DS3_MAC_HDR_MAX - this->szseen);
+                this->hdrpart.insert (this->hdrpart.size(), &cnt, off, off + szcpy);
+            }
+            if ((this->szseen > 0) && (szcpy > 0)) {
+                this->szframe = this->hdrpart.block_size_at (0);
             }
+            if (this->szframe <= 0) {
+                // only the bytes copied are used, see is_corrupted()
+                szuse = szcpy;
+            }
+        }
+    }
+    if (this->szframe > 0) {
+        size_t szleft = 0;
+        if ((size_t)(this->szframe) > this->szseen) {
+            szleft = this->szframe - this->szseen;
         }
+        szuse = std::min (szuse, szleft);
+    }
+    if (szuse > 0) {
+        ds3_frame_piece_t piece;
+        piece.seg = seg;
+        piece.off = off;
+        piece.sz = szuse;
+        this->pieces.push_back (piece);
+        this->szseen += szuse;
     }
-    return itleft;
+    return szuse;
 }
 
 /**
- * @brief find the first node of a continual sequence in a loop list
+ * @brief copy the pieces of a MAC packet to a buffer
  *
- * @param pkglst: the list
- * @param itins: the current node
+ * @param pieces : [in] the pieces of the MAC packet
+ * @param retbuf : [out] the buffer, the content is replaced
  *
- * @return the first node, end() on error
+ * @return the size of the MAC packet, < 0 on error
  */
-std::vector<ds3packet_ccf_t *>::iterator
-ds3pktlstccf_find_last (std::vector<ds3packet_ccf_t *> & pkglst, std::vector<ds3packet_ccf_t *>::iterator & itins)
+static ssize_t
+ds3_frame_pieces_copy (std::vector<ds3_frame_piece_t> & pieces, ds3_packet_buffer_t & retbuf)
 {
-    // find the left most and right most positions which have continual sequence number
-    std::vector<ds3packet_ccf_t *>::iterator itprev = itins;
-    std::vector<ds3packet_ccf_t *>::iterator itright = itins;
-    itprev = itright;
-    itright = ds3pktlstccf_next (pkglst, itright);
-    for (; (itright != itins) && (itright != pkglst.end()); ) {
-        if ((*itprev)->get_header().sequence + 1 != (*itright)->get_header().sequence) {
-            break;
+    std::vector<ds3_frame_piece_t>::iterator it;
+    retbuf.resize (0);
+    for (it = pieces.begin(); it != pieces.end(); it ++) {
+        if (retbuf.insert (retbuf.size(), &(it->seg->get_content_ref()), it->off, it->off + it->sz) < 0) {
+            return -1;
         }
-        itprev = itright;
-        itright = ds3pktlstccf_next (pkglst, itright);
     }
+    return retbuf.size();
+}
 
-    return itright;
+/** @brief copy the pieces of the MAC packet to a buffer, see ds3_frame_pieces_copy() */
+ssize_t
+ds3_mac_delin_t::to_buffer (ds3_packet_buffer_t & retbuf)
+{
+    return ds3_frame_pieces_copy (this->pieces, retbuf);
 }
 
-std::vector<ds3packet_ccf_t *>::iterator
-ds3pktlstccf_erase (std::vector<ds3packet_ccf_t *> & pkglst, std::vector<ds3packet_ccf_t *>::iterator & itins)
+/** @brief copy the MAC packet to a buffer, see ds3_frame_pieces_copy() */
+ssize_t
+ds3_frame_view_t::to_buffer (ds3_packet_buffer_t & retbuf)
 {
-    std::vector<ds3packet_ccf_t *>::iterator itret;
-    itret = pkglst.erase(itins);
-    if (pkglst.end() == itret) {
-        if (pkglst.size() > 0) {
-            itret = pkglst.begin();
-        }
-    }
-    return itret;
+    return ds3_frame_pieces_copy (this->pieces, retbuf);
 }
 
-// erase the nodes between [itb, ite)
-std::vector<ds3packet_ccf_t *>::iterator
-ds3pktlstccf_erase (std::vector<ds3packet_ccf_t *> & pkglst
-    , std::vector<ds3packet_ccf_t *>::iterator & itb
-    , std::vector<ds3packet_ccf_t *>::iterator & ite)
+/**
+ * @brief copy the bytes of the MAC packet
+ *
+ * @param pos : [in] the start position in the MAC packet
+ * @param nbsbuf : [out] the buffer
+ * @param szbuf : [in] the size of the buffer
+ *
+ * @return the size of the bytes copied, < 0 on error
+ */
+ssize_t
+ds3_frame_view_t::peek (size_t pos, uint8_t *nbsbuf, size_t szbuf)
 {
-    std::vector<ds3packet_ccf_t *>::iterator itret;
-    itret = pkglst.erase(itb);
-    itb = itret;
-    for ( ; (pkglst.end() == itret) && (itret != ite); ) {
-        itret = pkglst.erase(itret);
-    }
-    if (pkglst.end() == itret) {
-        if (pkglst.size() > 0) {
-            itret = pkglst.begin();
+    std::vector<ds3_frame_piece_t>::iterator it;
+    size_t szret = 0;
+    ssize_t ret;
+    for (it = this->pieces.begin(); (it != this->pieces.end()) && (szret < szbuf); it ++) {
+        if (pos >= it->sz) {
+            pos -= it->sz;
+            continue;
+        }
+        size_t szcpy = std::min (it->sz - pos, szbuf - szret);
+        ret = it->seg->get_content_ref().peek (it->off + pos, nbsbuf + szret, szcpy);
+        if (ret != (ssize_t)szcpy) {
+            return -1;
         }
+        szret += szcpy;
+        pos = 0;
     }
-    return itret;
+    return szret;
 }
 
-// the item between [itleft, itright)
+/**
+ * @brief export the MAC packet as a scatter-gather array, one item for each piece
+ *
+ * @param iov : [out] the array to be filled
+ * @param numiov : [in] the size of the array, 0 to get the number of the items required
+ *
+ * @return the number of the items filled(or required), < 0 on error or if a piece isn't contiguous
+ *   in the content of its segment, peek() or to_buffer() can be used for such content
+ */
 ssize_t
-ds3pktlstccf_distance (std::vector<ds3packet_ccf_t *> & pkglst
-    , std::vector<ds3packet_ccf_t *>::iterator itleft
-    , std::vector<ds3packet_ccf_t *>::iterator itright)
+ds3_frame_view_t::to_iovec (struct iovec *iov, size_t numiov)
 {
-    size_t off1 = (itleft - pkglst.begin());
-    size_t off2 = (itright - pkglst.begin());
-    if (off1 <= off2) {
-        return off2 - off1;
+    size_t i;
+    if (0 == numiov) {
+        return this->pieces.size();
     }
-    return (off1 + (pkglst.size() - off2));
+    if (numiov < this->pieces.size()) {
+        return -1;
+    }
+    for (i = 0; i < this->pieces.size(); i ++) {
+        ds3_frame_piece_t & piece = this->pieces[i];
+        const uint8_t * p = piece.seg->get_content_ref().contiguous_span (piece.off, piece.sz);
+        if (NULL == p) {
+            return -1;
+        }
+        iov[i].iov_base = (void *)p;
+        iov[i].iov_len = piece.sz;
+    }
+    return this->pieces.size();
 }
 
+/**
+ * @brief clear the timers and set the slots of the wheel
+ *
+ * @param numslots : [in] the number of the slots
+ * @param tick : [in] the time of each slot
+ */
+void
+ds3_timer_wheel_t::reset (size_t numslots, double tick)
+{
+    assert (numslots > 0);
+    assert (tick > 0);
+    this->slots.resize (0);
+    this->slots.resize (numslots);
+    this->tick = tick;
+    this->curtick = 0;
+    this->numtimer = 0;
+}
 
-// erase the node between it1st and itleft, then update the value of these itxxx
+/**
+ * @brief add a timer
+ *
+ * @param id : [in] the id of the object
+ * @param tmexpire : [in] the time the timer expires
+ */
 void
-ds3pktlstccf_erase_update (std::vector<ds3packet_ccf_t *> & pkglst
-    , std::vector<ds3packet_ccf_t *>::iterator & it1st
-    , std::vector<ds3packet_ccf_t *>::iterator & itleft
-    , std::vector<ds3packet_ccf_t *>::iterator & itright
-    )
+ds3_timer_wheel_t::add (size_t id, double tmexpire)
 {
-    std::cout << "pkg end-begin=" << (pkglst.end() - pkglst.begin()) << std::endl;
-    size_t off1 = (itleft - pkglst.begin());
-    size_t off2 = (itright - pkglst.begin());
-    size_t off3 = (it1st - pkglst.begin());
-    size_t numrm = 0;
-    if (pkglst.size() > 0) {
-        if (off2 >= off3) {
-            /* | -- 1st XXX left -- right -- |  */
-            numrm = (off1 - off3);
-            assert (numrm == ds3pktlstccf_distance(pkglst, it1st, itleft));
-        } else {
-            if (off1 >= off3) {
-                /* | -- right -- 1st XXX left -- |  */
-                numrm = (off1 - off3);
-                assert (numrm == ds3pktlstccf_distance(pkglst, it1st, itleft));
-            } else {
-                /* | XX left -- right -- 1st XX |  */
-                numrm = (off1 + (pkglst.size() - off3));
-                assert (numrm == ds3pktlstccf_distance(pkglst, pkglst.begin(), itleft) + ds3pktlstccf_distance(pkglst, itright, pkglst.end()));
-            }
-        }
+    ds3_timer_entry_t ent;
+    uint64_t t = this->tick_of (tmexpire);
+    if (t < this->curtick) {
+        /* passed, it's expired by the next call of expire() */
+        t = this->curtick;
     }
-    ds3pktlstccf_erase (pkglst, it1st, itleft);
-    if (pkglst.size() < 1) {
-        assert (pkglst.begin() == pkglst.end());
-        itleft = itright = pkglst.end();
-    } else {
-        if (off2 >= off3) {
-            /* | -- 1st XXX left -- right -- |  */
-            numrm = (off1 - off3);
-            itleft = pkglst.begin() + (off1 - numrm);
-            itright = pkglst.begin() + (off2 - numrm);
-        } else {
-            if (off1 >= off3) {
-                /* | -- right -- 1st XXX left -- |  */
-                numrm = (off1 - off3);
-                itleft = pkglst.begin() + (off3 - numrm);
-                itright = pkglst.begin() + off2;
+    ent.id = id;
+    ent.tmexpire = tmexpire;
+    this->slots[t % this->slots.size()].push_back (ent);
+    this->numtimer ++;
+}
+
+/**
+ * @brief remove the timers expired
+ *
+ * @param tm : [in] the current time
+ * @param retlst : [out] the timers expired are appended to the list, in the order of the slots
+ *
+ * @return the number of the timers expired
+ */
+size_t
+ds3_timer_wheel_t::expire (double tm, std::vector<ds3_timer_entry_t> & retlst)
+{
+    uint64_t nowtick = this->tick_of (tm);
+    size_t num = 0;
+    size_t cnt;
+    size_t i;
+    size_t j;
+    size_t k;
+    if (nowtick < this->curtick) {
+        return 0;
+    }
+    if (this->numtimer < 1) {
+        this->curtick = nowtick;
+        return 0;
+    }
+    /* the slots of the ticks passed, the slot of nowtick is checked again by the next call */
+    cnt = nowtick - this->curtick + 1;
+    if (cnt > this->slots.size()) {
+        cnt = this->slots.size();
+    }
+    for (i = 0; i < cnt; i ++) {
+        std::vector<ds3_timer_entry_t> & slot = this->slots[(this->curtick + i) % this->slots.size()];
+        for (j = 0, k = 0; j < slot.size(); j ++) {
+            if (slot[j].tmexpire <= tm) {
+                retlst.push_back (slot[j]);
+                num ++;
             } else {
-                /* | XX left -- right -- 1st XX |  */
-                numrm = (off1 + (pkglst.size() - off3));
-                assert (off3 >= pkglst.size());
-                itleft = pkglst.begin() + (off3 - pkglst.size());
-                itright = pkglst.begin() + (off2 - (off3 - pkglst.size()));
+                /* the timer of the later rounds of the wheel */
+                slot[k ++] = slot[j];
             }
         }
+        slot.resize (k);
+    }
+    this->curtick = nowtick;
+    this->numtimer -= num;
+    return num;
+}
+
+ds3_ccf_segpool_t::~ds3_ccf_segpool_t ()
+{
+    std::vector<ds3packet_ccf_t *>::iterator it;
+    for (it = this->freelst.begin(); it != this->freelst.end(); it ++) {
+        delete (*it);
     }
+    this->freelst.resize (0);
 }
 
 /**
- * @brief push a segment received for unpacking, try to extract DOCSIS MAC packet(s) from CCF segments
+ * @brief get a segment from the pool
  *
- * @param p : [in] a CCF segment be pushed into the queue
+ * @return the segment with an empty header and content, NULL on error
  *
- * @return the number of segments to be sent, >0 on success, < 0 on error
+ * a new segment is allocated if the free list is empty
+ */
+ds3packet_ccf_t *
+ds3_ccf_segpool_t::get (void)
+{
+    ds3packet_ccf_t * p;
+    if (this->freelst.size() > 0) {
+        p = this->freelst.back();
+        this->freelst.pop_back();
+        this->num_hit ++;
+        return p;
+    }
+    this->num_miss ++;
+    return new ds3packet_ccf_t();
+}
+
+/**
+ * @brief put a segment back to the pool
  *
- * push a segment received for unpacking, try to extract DOCSIS MAC packet(s) from CCF segments
+ * @param p : [in] the segment, it's owned by the pool after the call
  *
- * In this function, we use the segment header's field offmax as the pointer to process MAC header,
- * we also use it as a pointer to indicate if the data before the 1st MAC hdr is processed or not;
- * there's another data pointer ds3packet_t.pos_next to indicate the next MAC hdr.
+ * the segment is reset, its content keeps the storage for the next use
  */
-int
-ds3_ccf_unpack_t::process_packet (ds3packet_t *p)
+void
+ds3_ccf_segpool_t::put (ds3packet_ccf_t * p)
 {
-#if CCFDEBUG
-    std::cout << "ds3_ccf_unpack_t::process_packet got packet:" << std::endl;
-    p->dump();
-#endif
-
-    ds3packet_ccf_t* pktin = dynamic_cast<ds3packet_ccf_t *>(p);
-    assert (NULL != pktin);
-#if CCFDEBUG
-    if (pktin->get_header().sequence == 8191) {
-        std::cout << "got seq 8191!" << std::endl;
+    if (NULL == p) {
+        return;
     }
-#endif
-    // add p to sortedPackets
-    std::vector<ds3packet_ccf_t *>::iterator itins = pkglst.begin();
-    if (NULL != p) {
-        // get the piggyback request
-        ds3hdr_ccf_t & ccfhdr = pktin->get_header();
-        if (ccfhdr.request > 0) {
-            this->signify_piggyback (ccfhdr.sc, ccfhdr.request * this->get_pbmultiplier());
-        }
-
-        pktin->set_procpos_next(0);
-        pktin->set_procpos_prev(0);
-        if (ccfhdr.pfi == 1) {
-            pktin->set_procpos_prev(ccfhdr.offmac);
-            pktin->set_procpos_next(ccfhdr.offmac);
-        }
-        std::vector<ds3packet_ccf_t *>::iterator itup = pkglst.begin();
-        itup = std::upper_bound (pkglst.begin(), pkglst.end(), pktin, compare_ccfpktp);
-        itins = pkglst.insert(itup, pktin);
+    if (this->freelst.size() >= this->capacity) {
+        delete p;
+        return;
     }
+    memset (&(p->get_header()), 0, sizeof(p->get_header()));
+    p->get_content_ref().resize (0);
+    p->reset_procpos ();
+    this->freelst.push_back (p);
+}
 
-    // find the left most and right most positions which have continual sequence number
-    std::vector<ds3packet_ccf_t *>::iterator itleft = itins;
-    std::vector<ds3packet_ccf_t *>::iterator itright = itins;
-    itleft = ds3pktlstccf_find_first (pkglst, itins);
-    itright = ds3pktlstccf_find_last (pkglst, itins);
-
-    // debug:
-    //assert (itright == pkglst.end());
-
-    size_t off;
-    ds3_packet_buffer_t hdrbuf; //std::vector<uint8_t> hdrbuf; /* buffer for MAC header and/or content */
-    std::vector<ds3packet_ccf_t *>::iterator it1st = itleft; /* record the first segment position that is the begin of MAC header */
-
-#define USE_DS3_MICRO 0
-/** set the ccfhdr.offmac to 0 to indicate that the data before the first MAC hdr is processed */
-//#define DS3PKGLST_SET_PROCESSED_OFFMAC(itleft)
-/** remove the processed/corrupted segments */
-//#define DS3PKGLST_REMOVE()
+/**
+ * @brief set the max number of the free segments
+ *
+ * @param cap : [in] the capacity
+ *
+ * the free segments exceed the new capacity are deleted
+ */
+void
+ds3_ccf_segpool_t::set_capacity (size_t cap)
+{
+    this->capacity = cap;
+    for (; this->freelst.size() > cap;) {
+        delete this->freelst.back();
+        this->freelst.pop_back();
+    }
+}
 
-    ssize_t szmhdr = -1; /* the size of next sub-block, (header+content) */
-    //ds3hdr_mac_t machdr; memset (&machdr, 0, sizeof (machdr));
-    bool flg_data_left = false; /* use the left data of procpos_prev to fill hdrbuf */
-    bool flg_data_right = false;  /* use the right data of procpos_next to fill hdrbuf */
-
-    // find the first segment contains the MAC header
-    for (; (itleft != pkglst.end()) /* && (itleft != itright)*/; ) {
-
-        if ((*itleft)->get_header().pfi == 1) {
-            // find the next unprocessed MAC header
-            assert ((*itleft)->get_header().pfi == 1);
-            off = (*itleft)->get_header().offmac;
-            assert (off <= (*itleft)->get_procpos_next());
-            assert (off >= (*itleft)->get_procpos_prev());
-            if (off > (*itleft)->get_procpos_next()) {
-                (*itleft)->set_procpos_next(off);
-            }
-        }
-        off = (*itleft)->get_procpos_next();
-        //std::vector<uint8_t> & cntbufref = (*itleft)->get_content_ref();
-        ds3_packet_buffer_t & cntbufref = (*itleft)->get_content_ref();
-
-		// check if the CCF segment was complete processed.
-        if ((ssize_t)off >= cntbufref.size()) {
-            // this segment is processed from the start of offmac to the end
-            assert ((ssize_t)off == (*itleft)->get_content_ref().size());
-            if ((*itleft)->get_procpos_prev() < 1) {
-                // there's no data before the first MAC header, or no MAC header
-                assert ((*itleft)->get_procpos_prev() == 0);
-
-                this->recycle_packet( *itleft );
-
-                ssize_t dis = ds3pktlstccf_distance (pkglst, itleft, itright);
-                itleft = ds3pktlstccf_erase (pkglst, itleft);
-                itright = itleft;
-                for (size_t i = 0; i + 1 < dis; i ++) {
-                    itright = ds3pktlstccf_next_pivot (pkglst, itright, itleft);
-                }
-                continue;
-            }
-        }
+/**
+ * @brief allocate the free segments before the engine starts
+ *
+ * @param num : [in] the number of the free segments, limited by the capacity
+ *
+ * so the first grants don't allocate the segments either
+ */
+void
+ds3_ccf_segpool_t::reserve (size_t num)
 {
-        // check if we can get MAC header
-        szmhdr = -1; /* the size of next sub-block, (header+content) */
-        //ds3hdr_mac_t machdr; memset (&machdr, 0, sizeof (machdr));
-        flg_data_left = false; /* use the left data of procpos_prev to fill hdrbuf */
-        flg_data_right = false;  /* use the right data of procpos_next to fill hdrbuf */
+    if (num > this->capacity) {
+        num = this->capacity;
+    }
+    this->freelst.reserve (this->capacity);
+    for (; this->freelst.size() < num;) {
+        this->freelst.push_back (new ds3packet_ccf_t());
+    }
+}
 
-        if (hdrbuf.size() <= 0) {
-            // this is the first segment of a MAC packet
+/**
+ * @brief add a grant
+ *
+ * @param grant : [in] the grant
+ */
+void
+ds3_grant_queue_t::push (const ds3_grant_t & grant)
+{
+    item_t item;
+    item.grant = grant;
+    item.order = this->numadded ++;
+    this->heap.push_back (item);
+    std::push_heap (this->heap.begin(), this->heap.end());
+}
 
-            // make sure this segment has MAC header!!
-            if ((*itleft)->get_header().pfi == 0) {
-                // the whole segment is part of packet, not MAC header!
-                // we should skip to next one!
-                itleft = ds3pktlstccf_next_pivot (pkglst, itleft, itright);
-                continue;
-            }
+/**
+ * @brief add the grants of a MAP
+ *
+ * @param grants : [in] the grants, in any order
+ *
+ * the heap is rebuilt in O(n) if the grants added are more than the grants in the queue
+ */
+void
+ds3_grant_queue_t::push (const std::vector<ds3_grant_t> & grants)
+{
+    std::vector<ds3_grant_t>::const_iterator it;
+    size_t szorig = this->heap.size();
+    item_t item;
+    if (grants.size() <= szorig) {
+        for (it = grants.begin(); it != grants.end(); it ++) {
+            this->push (*it);
+        }
+        return;
+    }
+    this->heap.reserve (szorig + grants.size());
+    for (it = grants.begin(); it != grants.end(); it ++) {
+        item.grant = *it;
+        item.order = this->numadded ++;
+        this->heap.push_back (item);
+    }
+    std::make_heap (this->heap.begin(), this->heap.end());
+}
 
-            assert (hdrbuf.size() == 0);
-            it1st = itleft;
+/** @brief remove the grant with the earliest time */
+void
+ds3_grant_queue_t::pop (void)
+{
+    assert (this->heap.size() > 0);
+    std::pop_heap (this->heap.begin(), this->heap.end());
+    this->heap.pop_back();
+}
 
-            // hdrbuf.insert (hdrbuf.end(), cntbufref.begin() + off, cntbufref.end());
-            hdrbuf.insert (hdrbuf.end(), &cntbufref, cntbufref.begin() + off, cntbufref.end());
+/**
+ * @brief remove the grants passed
+ *
+ * @param tm : [in] the current time, the grants earlier than it can't be used
+ *
+ * @return the number of the grants removed
+ */
+size_t
+ds3_grant_queue_t::expire (double tm)
+{
+    size_t num = 0;
+    for (; (this->heap.size() > 0) && (tm > this->top().get_time()); num ++) {
+        /* invalid grant, delete it */
+        DS3TRACE (DS3TRACE_LVL_WARN, DS3TRE_PACK_GRANT_LATE, DS3TRACE_TIME_US(tm), DS3TRACE_TIME_US(this->top().get_time()), this->top().get_size(), this->top().get_channel_id());
+        this->pop();
+    }
+    return num;
+}
 
-            flg_data_right = true;
-            // try to find a new MAC header
+ds3_parallel_t::ds3_parallel_t ()
+    : func(NULL), arg(NULL), num(0), next(0), numbusy(0), round(0), flg_quit(false)
+{
+    pthread_mutex_init (&(this->mutex), NULL);
+    pthread_cond_init (&(this->cond_start), NULL);
+    pthread_cond_init (&(this->cond_done), NULL);
+}
 
-            //szmhdr = ds3hdr_mac_from_nbs (&hdrbuf[0], hdrbuf.size(), &machdr); if (szmhdr > 0) { szmhdr += machdr.length; }
-            szmhdr = hdrbuf.block_size_at (0); // the size of hdr+content
+ds3_parallel_t::~ds3_parallel_t ()
+{
+    this->stop ();
+    pthread_cond_destroy (&(this->cond_done));
+    pthread_cond_destroy (&(this->cond_start));
+    pthread_mutex_destroy (&(this->mutex));
+}
 
-            if (szmhdr <= 0) {
-                // no enough header bytes
-                // wait for next one?
-                itleft = ds3pktlstccf_next_pivot (pkglst, itleft, itright);
-                continue;
-            } else {
-                // get the header successfully
-                if (hdrbuf.size() < (szmhdr)) {
-                    itleft = ds3pktlstccf_next_pivot (pkglst, itleft, itright);
-                    continue;
-                }
-            }
+/**
+ * @brief start the worker threads
+ *
+ * @param numthreads : [in] the number of the worker threads, 0 to process the items in the calling thread only
+ *
+ * @return 0 on success, < 0 on error
+ *
+ * the worker threads started before are stopped first
+ */
+int
+ds3_parallel_t::start (size_t numthreads)
+{
+    size_t i;
+    pthread_t thd;
+    this->stop ();
+    if (numthreads < 1) {
+        return 0;
+    }
+    pthread_mutex_lock (&(this->mutex));
+    this->flg_quit = false;
+    this->numbusy = 0;
+    for (i = 0; i < numthreads; i ++) {
+        if (0 != pthread_create (&thd, NULL, ds3_parallel_t::thread_main, this)) {
+            break;
+        }
+        this->threads.push_back (thd);
+        this->numbusy ++;
+    }
+    /* wait for the threads to get the current round, so they don't miss the first batch */
+    for (; this->numbusy > 0; ) {
+        pthread_cond_wait (&(this->cond_done), &(this->mutex));
+    }
+    pthread_mutex_unlock (&(this->mutex));
+    if (i < numthreads) {
+        this->stop ();
+        return -1;
+    }
+    return 0;
+}
+
+/** @brief stop the worker threads */
+void
+ds3_parallel_t::stop (void)
+{
+    std::vector<pthread_t>::iterator it;
+    if (this->threads.size() < 1) {
+        return;
+    }
+    pthread_mutex_lock (&(this->mutex));
+    this->flg_quit = true;
+    pthread_cond_broadcast (&(this->cond_start));
+    pthread_mutex_unlock (&(this->mutex));
+    for (it = this->threads.begin(); it != this->threads.end(); it ++) {
+        pthread_join (*it, NULL);
+    }
+    this->threads.resize (0);
+}
+
+/** @brief process the items of the current batch until all of them are claimed */
+void
+ds3_parallel_t::run_items (void)
+{
+    size_t idx;
+    for (;;) {
+        idx = __sync_fetch_and_add (&(this->next), 1);
+        if (idx >= this->num) {
+            break;
+        }
+        this->func (this->arg, idx);
+    }
+}
+
+void *
+ds3_parallel_t::thread_main (void *arg)
+{
+    ds3_parallel_t * self = (ds3_parallel_t *)arg;
+    uint64_t myround;
+
+    pthread_mutex_lock (&(self->mutex));
+    myround = self->round;
+    self->numbusy --;
+    if (self->numbusy < 1) {
+        pthread_cond_signal (&(self->cond_done));
+    }
+    for (;;) {
+        for (; (! self->flg_quit) && (myround == self->round); ) {
+            pthread_cond_wait (&(self->cond_start), &(self->mutex));
+        }
+        if (self->flg_quit) {
+            break;
+        }
+        myround = self->round;
+        pthread_mutex_unlock (&(self->mutex));
+
+        self->run_items ();
+
+        pthread_mutex_lock (&(self->mutex));
+        self->numbusy --;
+        if (self->numbusy < 1) {
+            pthread_cond_signal (&(self->cond_done));
+        }
+    }
+    pthread_mutex_unlock (&(self->mutex));
+    return NULL;
+}
+
+/**
+ * @brief call the function for each item of a batch, in the calling thread and the worker threads
+ *
+ * @param func : [in] the function, called once for each of the index [0, num)
+ * @param arg : [in] the argument passed to func
+ * @param num : [in] the number of the items
+ *
+ * the items are claimed in the index order, but they may be finished in any order;
+ * the function returns after all of the items are finished.
+ */
+void
+ds3_parallel_t::run (void (*func)(void *arg, size_t idx), void *arg, size_t num)
+{
+    size_t i;
+    if ((this->threads.size() < 1) || (num < 2)) {
+        for (i = 0; i < num; i ++) {
+            func (arg, i);
+        }
+        return;
+    }
+    pthread_mutex_lock (&(this->mutex));
+    this->func = func;
+    this->arg = arg;
+    this->num = num;
+    this->next = 0;
+    this->numbusy = this->threads.size();
+    this->round ++;
+    pthread_cond_broadcast (&(this->cond_start));
+    pthread_mutex_unlock (&(this->mutex));
+
+    this->run_items ();
+
+    pthread_mutex_lock (&(this->mutex));
+    for (; this->numbusy > 0; ) {
+        pthread_cond_wait (&(this->cond_done), &(this->mutex));
+    }
+    pthread_mutex_unlock (&(this->mutex));
+}
 
+/**
+ * @brief add the new packets and process, the default calls process_packet() for each
+ *
+ * @param pkts : [in] the packets
+ * @param num : [in] the number of the packets
+ *
+ * @return the sum of the values returned by process_packet(), < 0 if any of them failed
+ */
+int
+ds3_ccf_base_t::process_packets (ds3packet_t ** pkts, size_t num)
+{
+    size_t i;
+    int sum = 0;
+    int ret;
+    bool flg_err = false;
+    for (i = 0; i < num; i ++) {
+        ret = this->process_packet (pkts[i]);
+        if (ret < 0) {
+            flg_err = true;
         } else {
-            // there's incomplete MAC header in previous segment
-            bool flg_corrupted = false;
-            bool flg_continue = false;
-            if ((*itleft)->get_header().pfi == 1) {
-                // this should be the last segment of the packet
-                // attach the content from the buffer to hdrbuf by size of offmac
-                assert ((*itleft)->get_header().offmac > 0);
-                assert ((*itleft)->get_header().offmac == (*itleft)->get_procpos_prev ());
-                hdrbuf.insert (hdrbuf.end(), &cntbufref, cntbufref.begin(), cntbufref.begin() + (*itleft)->get_procpos_prev()); //hdrbuf.insert (hdrbuf.end(), cntbufref.begin(), cntbufref.begin() + (*itleft)->get_procpos_prev());
-                flg_data_left = true;
-            } else {
-                // this whole segment is a part of the packet
-                assert ((*itleft)->get_procpos_next() == 0);
-                assert (off == (*itleft)->get_procpos_next ());
-                hdrbuf.insert (hdrbuf.end(), &cntbufref, cntbufref.begin() + off, cntbufref.end()); // hdrbuf.insert (hdrbuf.end(), cntbufref.begin() + off, cntbufref.end());
-                flg_data_right = true;
-            }
-            //szmhdr = ds3hdr_mac_from_nbs (&hdrbuf[0], hdrbuf.size(), &machdr); if (szmhdr > 0) { szmhdr += machdr.length; }
-            szmhdr = hdrbuf.block_size_at (0); // the size of hdr+content
-            if (szmhdr <= 0) {
-                if ((*itleft)->get_header().pfi == 1) {
-                    // Error: impossible to here! or there's error in the packet
-                    flg_corrupted = true;
-#if CCFDEBUG
-std::cout << "Error, corrupted CCF found: hdrbuf.size(=" << hdrbuf.size() << ", szmhdr=" << szmhdr << " <=0, and pfi=1" << std::endl;
-#endif
-                } else {
-                    // no enough header bytes
-                    // wait for next one?
-                    flg_continue = true;
-                }
-            } else {
-                // get the header successfully
-                if (hdrbuf.size() < (szmhdr)) {
-                    if ((*itleft)->get_header().pfi == 1) {
-                        // Error: corrupted packet
-                        flg_corrupted = true;
-#if CCFDEBUG
-std::cout << "Error, corrupted CCF found: hdrbuf.size(=" << hdrbuf.size() << ") < szmhdr=" << szmhdr
-    << ", and pfi=1"
-    << ", read offset =" << (*itleft)->get_procpos_next()
-    << std::endl;
-assert (0);
-#endif
-                    } else {
-                        // no enough header bytes
-                        // wait for next one?
-                    }
-                    szmhdr = 0; // reset the header so that it continues
-                    // no enough content bytes
-                    // wait for next one?
-                    flg_continue = true;
-                } else {
-                    // data is enough to extract,
-                    // the data will be throw away after extraction in spit of success of fail
-                    assert (szmhdr > 0);
-                }
-            }
-            if (flg_corrupted) {
-                // skip this packet and continue
-                hdrbuf.resize(0);
-#if USE_DS3_MICRO // 2
-                DS3PKGLST_REMOVE_FAIL ();
-#else // 2
-                if (it1st != itleft) {
-                    /* delete nodes in a loop list */
-                    if ((*it1st)->get_procpos_prev () > 0) {
-                        (*it1st)->set_procpos_next ((*it1st)->get_content_ref ().size()); // (*it1st)->set_procpos_next((*it1st)->size());
-                        it1st = ds3pktlstccf_next_pivot (pkglst, it1st, itleft);
-                    }
-                    if ((it1st != itleft) && (it1st != pkglst.begin())) { /*FIXME: delete nodes in a loop list!*/
-                        std::vector<ds3packet_ccf_t *>::iterator ittmp = it1st;
-                        for (; ittmp != itleft; ittmp = ds3pktlstccf_next_pivot (pkglst, ittmp, itright)) {
-#if CCFDEBUG
-std::cout << "Error, corrupted CCF dropped!!!" << std::endl;
-#endif
-                            this->drop_packet( *ittmp );
-                        }
-                        ds3pktlstccf_erase_update (pkglst, it1st, itleft, itright);
-                    }
-                }
-                it1st = itleft;
-#if USE_DS3_MICRO // 3
-                DS3PKGLST_SET_PROCESSED_OFFMAC (itleft);
-#else // 3
-                /* we also set the procpos_prev to 0 to indicate that the data before the first MAC hdr is processed */
-                if ( (*itleft)->get_procpos_next() < (*itleft)->get_header().offmac ) {
-                    assert ((*itleft)->get_procpos_prev () == (*itleft)->get_header().offmac);
-                    (*itleft)->set_procpos_next ((*itleft)->get_header().offmac);
-                }
-                if (flg_data_left) {
-                    (*itleft)->set_procpos_prev (0);
-                }
-#endif // 3
-#endif // 2
-            }
-            if (flg_continue) {
-                itleft = ds3pktlstccf_next_pivot (pkglst, itleft, itright);
-                continue;
-            }
+            sum += ret;
         }
-        if (szmhdr > 0) {
-            // got a mac header
-#if USE_DS3_MICRO // 1
-            DS3PKGLST_PROCESS_BODY();
-#else // 1
-            if (hdrbuf.size() >= (szmhdr)) {
-                assert (hdrbuf.size() >= (szmhdr));
-                if (flg_data_left) {
-                    // do nothing
-                }
-                if (flg_data_right) {
-                    size_t szbk = (hdrbuf.size() - (size_t)(szmhdr));
-                    size_t szrest = (cntbufref.end() - (cntbufref.begin() + off));
-                    size_t szadd = szrest - szbk;
-                    /* resize the buffer according to machdr.length */
-                    std::cout << "the size of data in the buffer NOT belonging to the packet: " << szbk << std::endl;
-                    std::cout << "the size of data were read in current segment: " << szrest << std::endl;
-                    std::cout << "set the next offset from " << off << " to " << (off + szadd) << std::endl;
-                    (*itleft)->set_procpos_next (off + szadd);
-                }
+    }
+    return (flg_err ? -1 : sum);
+}
 
-                hdrbuf.resize((size_t)(szmhdr));
-                /* extract the packet */
-                this->signify_packet (hdrbuf);
-                hdrbuf.resize(0);
-                /* remove the processed segments */
-#if USE_DS3_MICRO // 2
-                DS3PKGLST_REMOVE_OK ();
-#else // 2
-                if (it1st != itleft) {
-                    if ((*it1st)->get_procpos_prev() > 0) {
-                        // this is the start of segment, and it has other content at the begining,
-                        // so we just set the last position to max position:
-                        (*it1st)->set_procpos_next ((*it1st)->get_content_ref ().size()); // (*it1st)->set_procpos_next ((*it1st)->size());
-                        it1st = ds3pktlstccf_next_pivot (pkglst, it1st, itleft);
-                    }
-                    if ((it1st != itleft) && (it1st != pkglst.end())) {
-                        /* delete nodes in a loop list! */
-                        std::vector<ds3packet_ccf_t *>::iterator ittmp = it1st;
-                        for (; ittmp != itleft; ittmp ++) {
-                            this->recycle_packet( *ittmp );
-                        }
-
-                        ds3pktlstccf_erase_update (pkglst, it1st, itleft, itright);
-                    }
-                }
-                it1st = itleft;
-#if USE_DS3_MICRO // 3
-                DS3PKGLST_SET_PROCESSED_OFFMAC (itleft);
-#else // 3
-                /* we also set the ccfhdr.offmac to 0 to indicate that the data before the first MAC hdr is processed */
-                if ( (*itleft)->get_procpos_next () < (*itleft)->get_header().offmac ) {
-                    assert ((*itleft)->get_procpos_prev() == (*itleft)->get_header().offmac);
-                    (*itleft)->set_procpos_next ((*itleft)->get_header().offmac);
-                }
-                if (flg_data_left) {
-                    (*itleft)->set_procpos_prev(0);
-                }
-#endif // 3
-#endif // 2
-            } else {
-                /* no enough content data bytes */
-                /* wait for next one? */
-                assert (0); /* we have already process the exceptions */
-            }
-#endif // 1
-        } /* if (szmhdr > 0) */
+/**
+ * @brief remove a segment from the reorder ring, and recycle or drop it
+ *
+ * @param seq : [in] the sequence # of the segment
+ * @param flg_drop : [in] drop the segment if it contains corrupted data
+ */
+void
+ds3_ccf_unpack_t::release_segment (size_t seq, bool flg_drop)
+{
+    ds3packet_ccf_t * p = this->reorder.remove (seq);
+    assert (NULL != p);
+    if (this->delin.has_segment (seq)) {
+        this->delin.reset ();
+    }
+    DS3TRACE (DS3TRACE_LVL_DEBUG, DS3TRE_UNPACK_ERASE, seq, this->reorder.size(), 0, 0);
+    this->free_segment (p, flg_drop);
 }
-    } /* itleft loop */
 
-    // TODO: remove the timeout packets in the sortedPackets
+/**
+ * @brief recycle or drop a segment removed from the reorder ring, or keep it until its frame views are released
+ *
+ * @param p : [in] the segment
+ * @param flg_drop : [in] drop the segment if it contains corrupted data
+ */
+void
+ds3_ccf_unpack_t::free_segment (ds3packet_ccf_t * p, bool flg_drop)
+{
+    if (p->get_numhold() > 0) {
+        /* the content is referred by the frame views, released by release_frame() */
+        p->set_relhold (flg_drop ? DS3_SEG_HOLD_DROP : DS3_SEG_HOLD_RECYCLE);
+        this->numheld ++;
+        return;
+    }
+    if (flg_drop) {
+        this->drop_packet (p);
+    } else {
+        this->recycle_packet (p);
+    }
+}
 
+/**
+ * @brief push a segment received for unpacking, try to extract DOCSIS MAC packet(s) from CCF segments
+ *
+ * @param p : [in] a CCF segment be pushed into the queue
+ *
+ * @return 0 on success, < 0 on error
+ *
+ * push a segment received for unpacking, try to extract DOCSIS MAC packet(s) from CCF segments
+ *
+ * The segment is put to the slot of its sequence #, then the continual segments around it are processed
+ * from the first one. In each segment, ds3packet_t.pos_prev is the size of the data before the first MAC
+ * header (ccfhdr.offmac) not processed yet, it's set to 0 after the data is appended to the MAC packet
+ * started in the previous segments; ds3packet_t.pos_next is the position of the next MAC header.
+ * A segment is released when both of the data are processed.
+ * The MAC packet waiting for the next segment is kept by the delineator, so the segments received later
+ * continue it instead of parsing it again from the MAC header.
+ * If the reassembly timeout is set, the segments waiting for the lost segments are dropped by expire().
+ */
+int
+ds3_ccf_unpack_t::process_packet (ds3packet_t *p)
+{
+    ssize_t seq;
+    if (this->timeout > 0) {
+        this->expire ();
+    }
+    seq = this->put_segment (p);
+    if (seq < 0) {
+        return -1;
+    }
+    this->process_run (seq);
     return 0;
 }
 
 /**
- * @brief push a new packet to the sending list, and send segment(s) according current grants
+ * @brief push the segments received for unpacking, extract the MAC packets after all of them are added
  *
- * @param p : [in] the packet
- *
- * @return the number of segments to be sent, >0 on success, < 0 on error
+ * @param pkts : [in] the CCF segments
+ * @param num : [in] the number of the segments
  *
- * push a new packet to the sending list, and send segment(s) according current grants.
+ * @return 0 on success, < 0 if any of the segments is dropped
  *
- * It's assumed that the grants are exist for the packets in the list,
- * so the size of grants are always larger than(>=) the ``requested packet'' size.
+ * The continual segments of the batch are processed once, and the MAC packets are signified together
+ * by signify_packets(). The MAC packets are copied from the segments, the frame views (set_frame_view())
+ * refer to the received bytes without copying.
  */
 int
-ds3_ccf_pack_t::process_packet (ds3packet_t *p)
+ds3_ccf_unpack_t::process_packets (ds3packet_t ** pkts, size_t num)
+{
+    ssize_t seq;
+    size_t runbegin = 0;
+    size_t runlen = 0;
+    size_t i;
+    int ret = 0;
+    if (this->timeout > 0) {
+        this->expire ();
+    }
+    this->seqlst.resize (0);
+    for (i = 0; i < num; i ++) {
+        seq = this->put_segment (pkts[i]);
+        if (seq < 0) {
+            ret = -1;
+            continue;
+        }
+        this->seqlst.push_back (seq);
+    }
+    this->flg_batch = true;
+    for (i = 0; i < this->seqlst.size(); i ++) {
+        seq = this->seqlst[i];
+        if (! this->reorder.test (seq)) {
+            // released by the run processed before
+            continue;
+        }
+        if ((runlen > 0) && (((seq - runbegin) & DS3_CCF_SEQ_MASK) < runlen)) {
+            // waiting in the run processed before
+            continue;
+        }
+        runlen = this->reorder.find_run (seq, runbegin);
+        this->process_run (seq);
+    }
+    this->flg_batch = false;
+    this->flush_packets ();
+    return ret;
+}
+
+/**
+ * @brief check a segment received and put it to the reorder ring
+ *
+ * @param p : [in] the CCF segment
+ *
+ * @return the sequence # of the segment, < 0 if it's dropped
+ */
+ssize_t
+ds3_ccf_unpack_t::put_segment (ds3packet_t *p)
 {
-    if (NULL != p) {
 #if CCFDEBUG
-        std::cout << "ds3_ccf_pack_t::process_packet got packet:" << std::endl;
-        p->dump();
+    std::cout << "ds3_ccf_unpack_t::process_packet got packet:" << std::endl;
+    p->dump();
 #endif
-        p->reset_procpos(); /* reset the processed position to 0 */
-        this->pktlst.push_back (p);
+
+    ds3packet_ccf_t* pktin = dynamic_cast<ds3packet_ccf_t *>(p);
+    assert (NULL != pktin);
+    if (NULL == pktin) {
+        return -1;
     }
-    size_t numSeg = 0;
-    size_t szMax = 0;
-    size_t szCur = 0;
-    size_t szNext = 0;
-    ds3hdr_ccf_t ccfhdr;
-    ds3_packet_buffer_t buffer; //std::vector<uint8_t> buffer;
-    // remove the timeout grants
-    std::vector<ds3_grant_t>::iterator itg;
-    double tmcur = this->current_time();
-    for (itg = this->grantlst.begin(); itg != this->grantlst.end(); itg ++) {
-        if (tmcur > itg->get_time()) {
-            /* invalid grant, delete it */
-            std::cerr << "ds3ccf: Error invalid grant: current time=" << this->current_time()
-                << ", time=" << (*itg).get_time()
-                << ", size=" << (*itg).get_size()
-                << ", channel=" << (*itg).get_channel_id()
-                << std::endl;
-            continue;
+#if USE_DS3_HCS
+    if (pktin->get_header().hcs != ds3hdr_ccf_calc_hcs (&(pktin->get_header()))) {
+        /* the header is corrupted, don't put it to the list */
+#if CCFDEBUG
+        std::cout << "Error, CCF segment HCS mismatch, dropped!" << std::endl;
+#endif
+        this->drop_packet (p);
+        return -1;
+    }
+#endif
+    // get the piggyback request
+    ds3hdr_ccf_t & ccfhdr = pktin->get_header();
+    if (ccfhdr.request > 0) {
+        this->signify_piggyback (ccfhdr.sc, ccfhdr.request * this->get_pbmultiplier());
+    }
+    pktin->set_procpos_next(0);
+    pktin->set_procpos_prev(0);
+    if (ccfhdr.pfi == 1) {
+        pktin->set_procpos_prev(ccfhdr.offmac);
+        pktin->set_procpos_next(ccfhdr.offmac);
+    }
+    ds3packet_ccf_t * pktold = this->reorder.put (pktin);
+    if (NULL != pktold) {
+        /* the segment of the previous round of the sequence # was not processed */
+        if (this->delin.has_segment (ccfhdr.sequence)) {
+            this->delin.reset ();
         }
-        if (pktlst.size() < 1) {
-            // empty
-            break;
+        DS3TRACE (DS3TRACE_LVL_WARN, DS3TRE_UNPACK_REPLACE, ccfhdr.sequence, this->reorder.size(), 0, 0);
+        this->free_segment (pktold, true);
+    }
+    if (this->timeout > 0) {
+        double tm = this->current_time() + this->timeout;
+        this->reorder.set_expire (ccfhdr.sequence, tm);
+        this->timers.add (ccfhdr.sequence & DS3_CCF_SEQ_MASK, tm);
+    }
+    return (ccfhdr.sequence & DS3_CCF_SEQ_MASK);
+}
+
+/**
+ * @brief extract the MAC packets from the continual segments around a sequence #
+ *
+ * @param seq : [in] the sequence # of a segment in the reorder ring
+ *
+ * The segments are processed from the first one of the continual segments, the segments processed are released.
+ */
+void
+ds3_ccf_unpack_t::process_run (size_t seq)
+{
+    size_t seqbegin = 0;
+    size_t len = this->reorder.find_run (seq, seqbegin);
+    size_t k;
+    size_t j;
+    size_t m;
+    size_t off;
+    size_t szuse;
+    ssize_t szmhdr = -1; /* the size of next sub-block, (header+content) */
+    ds3_packet_buffer_t & hdrbuf = this->hdrbuf; /* buffer for the MAC packet in one segment */
+    ds3_mac_delin_t & delin = this->delin; /* the MAC packet spanning the segments */
+
+    for (k = 0; k < len; ) {
+        size_t seqcur = (seqbegin + k) & DS3_CCF_SEQ_MASK;
+        ds3packet_ccf_t * seg = this->reorder.get (seqcur);
+        assert (NULL != seg);
+        if (seg->get_header().pfi == 0) {
+            // the whole segment is part of packet, it's processed with the segment which has the MAC header,
+            // or the segment has not been received
+            k ++;
+            continue;
         }
-        std::cerr << "ds3ccf: process grant: time=" << (*itg).get_time()
-            << ", size=" << (*itg).get_size()
-            << ", channel=" << (*itg).get_channel_id()
-            << std::endl;
-        szMax = itg->get_size();
-        assert (szMax >= (size_t)ds3hdr_ccf_to_nbs(NULL, 0, NULL));
-        szCur = ds3hdr_ccf_to_nbs(NULL, 0, NULL);
-        buffer.resize (0);
-        memset (&ccfhdr, 0, sizeof(ccfhdr));
-        for (; szCur < szMax;) {
-            assert (pktlst.size() > 0);
-            assert (NULL != pktlst[0]);
-            assert (pktlst[0]->get_size() > 0);
-            if (0 == pktlst[0]->get_procpos_next()) {
-                /* It's the beginning of the packet */
-                if (0 == ccfhdr.pfi) {
-                    ccfhdr.pfi = 1;
-                    assert (szCur >= (size_t)ds3hdr_ccf_to_nbs(NULL, 0, NULL));
-                    ccfhdr.offmac = (szCur - ds3hdr_ccf_to_nbs(NULL, 0, NULL));
+        ds3_packet_buffer_t & cntbufref = seg->get_content_ref();
+        j = k + 1;
+        for (; (ssize_t)seg->get_procpos_next() < cntbufref.size(); ) {
+            off = seg->get_procpos_next();
+            szmhdr = cntbufref.block_size_at (off); // the size of hdr+content
+            if ((szmhdr > 0) && (off + szmhdr <= (size_t)cntbufref.size())) {
+                // the MAC packet is in this segment
+                DS3TRACE (DS3TRACE_LVL_DEBUG, DS3TRE_UNPACK_NEXTOFF, seqcur, off, (off + szmhdr), 0);
+                seg->set_procpos_next (off + szmhdr);
+                if (this->flg_view) {
+                    this->deliver_view (seg, off, szmhdr);
+                    continue;
                 }
+                hdrbuf.resize (0);
+                hdrbuf.insert (0, &cntbufref, off, off + szmhdr);
+                this->deliver_packet (hdrbuf);
+                continue;
             }
-            assert (pktlst[0]->get_size() > pktlst[0]->get_procpos_next());
-            szNext = pktlst[0]->get_size() - pktlst[0]->get_procpos_next();
-            if (szCur + szNext > szMax) {
-                szNext = szMax - szCur;
+            if (delin.is_pending (seqcur, off)) {
+                // continue the MAC packet waiting for this run, from the segment after the ones fed before
+                j = k + delin.get_numseg();
+            } else {
+                delin.start (seqcur, off);
+                delin.feed (seg, off, cntbufref.size() - off);
+                j = k + 1;
             }
-
-            /* fill the buffer */
-            //ssize_t ret1 = pktlst[0]->get_pkt_bytes (pktlst[0]->get_procpos(), buffer, szNext);
-            //assert ((size_t)ret1 == szNext);
-            assert (buffer.size() >= 0);
-            size_t szorig1 = buffer.size();
-            ds3_packet_buffer_t * retbuf = pktlst[0]->insert_to (buffer.size(), &buffer, pktlst[0]->get_procpos_next(), pktlst[0]->get_procpos_next() + szNext);
-            if (NULL == retbuf) {
-                // error, break;
-                break;
+            // the rest of the MAC packet is in the following segments
+            bool flg_end = false; /* the packet ends at the end of the segment j - 1 */
+            bool flg_corrupted = delin.is_corrupted();
+            for (; (! flg_corrupted) && (j < len) && (0 == this->reorder.get (seqbegin + j)->get_header().pfi); ) {
+                ds3packet_ccf_t * segmid = this->reorder.get (seqbegin + j);
+                size_t szmid = segmid->get_content_ref().size();
+                szuse = delin.feed (segmid, 0, szmid);
+                j ++;
+                if (delin.is_done()) {
+                    // no MAC header in the segment, the packet has to end at the end of it
+                    flg_end = true;
+                    flg_corrupted = (szuse != szmid);
+                    break;
+                }
+                flg_corrupted = delin.is_corrupted();
+            }
+            if (flg_corrupted) {
+                // the MAC header is not found, drop the segments fed
+                flg_end = true;
             }
-            assert (retbuf == &buffer);
-            assert ((ssize_t)(szorig1 + szNext) == buffer.size());
-
-            szCur += szNext;
-            pktlst[0]->set_procpos_next (pktlst[0]->get_procpos_next () + szNext);
-            if (pktlst[0]->get_procpos_next () >= pktlst[0]->get_size()) {
-                /* all of the contents of the front packet(pktlst[0]) in the queue are in sending buffer */
-                this->recycle_packet (pktlst[0]); // delete pktlst[0];
-                pktlst.erase (pktlst.begin());
-                if (pktlst.size() < 1) {
+            ds3packet_ccf_t * seglast = NULL;
+            if (! flg_end) {
+                if (j >= len) {
+                    // wait for next one, the delineator keeps the segments fed
                     break;
                 }
+                // the data before the first MAC header of the segment j is the end of the packet
+                seglast = this->reorder.get (seqbegin + j);
+                szuse = delin.feed (seglast, 0, seglast->get_header().offmac);
+                flg_corrupted = ((! delin.is_done()) || (szuse != seglast->get_header().offmac));
             }
-        }
-        if (szCur > (size_t)ds3hdr_ccf_to_nbs(NULL, 0, NULL)) {
-            /* It's time to send the segment, and continue to next grant */
-            if ( (this->piggyback_inc > 0)
-#if USE_DS3_LATESNDPIG
-                 && (itg == this->grantlst.end())
+            if (flg_corrupted) {
+                DS3TRACE (DS3TRACE_LVL_WARN, DS3TRE_UNPACK_CORRUPT, seqcur, delin.get_seen(), delin.get_size(), 0);
+#if CCFDEBUG
+                std::cout << "Error, corrupted CCF found: delineated size(=" << delin.get_seen() << ") != szmhdr=" << delin.get_size() << std::endl;
 #endif
-                )
-            {
-                ccfhdr.request = this->piggyback_inc / this->get_pbmultiplier();
-                this->piggyback_inc = 0;
+                delin.reset ();
+            } else {
+                this->deliver_frame ();
             }
-            ccfhdr.sequence = this->get_next_sequence();
-            ccfhdr.sc = this->scid;
-            /* set the CCF header */
-            ds3packet_ccf_t * ccfpkt = new ds3packet_ccf_t();
-            assert (NULL != ccfpkt);
-            ccfpkt->set_header(&ccfhdr);
-            ccfpkt->set_content(&buffer);
-            /* send the CCF segment */
-            this->start_sndpkt_timer(itg->get_time(), DS3EVT_TMRPKT, ccfpkt, itg->get_channel_id() );
-            numSeg ++;
+            /* remove the processed segments */
+            seg->set_procpos_next (cntbufref.size());
+            for (m = k + 1; m < j; m ++) {
+                this->release_segment (seqbegin + m, flg_corrupted);
+            }
+            if (NULL != seglast) {
+                seglast->set_procpos_prev (0);
+            }
+            break;
         }
+        if (((ssize_t)seg->get_procpos_next() >= cntbufref.size()) && (seg->get_procpos_prev() < 1)) {
+            // the data before and after the first MAC header are processed
+            this->release_segment (seqcur, false);
+        }
+        k = j;
     }
-    if (itg != this->grantlst.begin()) {
-        /* delete invalid or used grants */
-        this->grantlst.erase (this->grantlst.begin(), itg);
-    }
+}
 
-    return numSeg;
+/** @brief signify the MAC packet delineated, by a frame view or a copy in hdrbuf */
+int
+ds3_ccf_unpack_t::deliver_frame (void)
+{
+    if (this->flg_view) {
+        return this->deliver_view (NULL, 0, 0);
+    }
+    ssize_t ret = this->delin.to_buffer (this->hdrbuf);
+    this->delin.reset ();
+    if (ret < 0) {
+        return -1;
+    }
+    return this->deliver_packet (this->hdrbuf);
 }
 
 /**
- * @brief add grants and piggyback request
+ * @brief signify a MAC packet by a frame view, the segments of the view are held until it's released
  *
- * @param grants : [in] the grants list
- * @param piggyback : [in] the piggyback request value
+ * @param seg : [in] the segment of the MAC packet in one segment, NULL for the MAC packet delineated
+ * @param off : [in] the position of the MAC packet in the segment
+ * @param sz : [in] the size of the MAC packet
  *
  * @return 0 on success, < 0 on error
- *
- * add grants and piggyback request
- *
- * This function will also process the MAC packets for all of the added grants
  */
 int
-ds3_ccf_pack_t::add_grants (std::vector<ds3_grant_t> & grants)
+ds3_ccf_unpack_t::deliver_view (ds3packet_ccf_t * seg, size_t off, size_t sz)
 {
-    grantlst.insert (grantlst.end(), grants.begin(), grants.end());
-    std::sort (grantlst.begin(), grantlst.end());
-
-    process_packet (NULL);
-    return 0;
+    ds3_frame_view_t * view = this->new_view ();
+    std::vector<ds3_frame_piece_t>::iterator it;
+    if (NULL == seg) {
+        view->szframe = this->delin.get_seen();
+        this->delin.take_pieces (view->pieces);
+        this->delin.reset ();
+    } else {
+        ds3_frame_piece_t piece;
+        piece.seg = seg;
+        piece.off = off;
+        piece.sz = sz;
+        view->pieces.push_back (piece);
+        view->szframe = sz;
+    }
+    for (it = view->pieces.begin(); it != view->pieces.end(); it ++) {
+        it->seg->hold ();
+    }
+    return this->signify_frame (view);
 }
 
-int
-ds3_ccf_pack_t::add_grant (ds3_grant_t & grant)
+/** @brief get a frame view from the free list, or allocate one */
+ds3_frame_view_t *
+ds3_ccf_unpack_t::new_view (void)
 {
-    grantlst.insert (grantlst.end(), grant);
-    std::sort (grantlst.begin(), grantlst.end());
-    process_packet (NULL);
-    return 0;
+    ds3_frame_view_t * view;
+    if (this->viewfree.size() > 0) {
+        view = this->viewfree.back();
+        this->viewfree.pop_back();
+    } else {
+        view = new ds3_frame_view_t ();
+        this->viewall.push_back (view);
+    }
+    this->numviews ++;
+    return view;
+}
+
+/**
+ * @brief release a frame view signified by signify_frame()
+ *
+ * @param view : [in] the frame view
+ *
+ * The segments released by the engine when the view was held are recycled or dropped
+ * after their last view is released. It has to be called in the thread of the engine.
+ */
+void
+ds3_ccf_unpack_t::release_frame (ds3_frame_view_t * view)
+{
+    std::vector<ds3_frame_piece_t>::iterator it;
+    assert (NULL != view);
+    assert (this->numviews > 0);
+    for (it = view->pieces.begin(); it != view->pieces.end(); it ++) {
+        ds3packet_ccf_t * seg = it->seg;
+        int relhold = seg->get_relhold();
+        if ((seg->unhold() > 0) || (DS3_SEG_HOLD_NONE == relhold)) {
+            continue;
+        }
+        seg->set_relhold (DS3_SEG_HOLD_NONE);
+        this->numheld --;
+        if (DS3_SEG_HOLD_DROP == relhold) {
+            this->drop_packet (seg);
+        } else {
+            this->recycle_packet (seg);
+        }
+    }
+    view->pieces.resize (0);
+    view->szframe = 0;
+    this->viewfree.push_back (view);
+    this->numviews --;
+}
+
+/** @brief copy the MAC packet of the view and signify it by signify_packet(), the view is released */
+int
+ds3_ccf_unpack_t::signify_frame (ds3_frame_view_t * view)
+{
+    ssize_t ret = view->to_buffer (this->hdrbuf);
+    this->release_frame (view);
+    if (ret < 0) {
+        return -1;
+    }
+    return this->deliver_packet (this->hdrbuf);
+}
+
+/**
+ * @brief signify a MAC packet extracted, or keep it until the end of process_packets()
+ *
+ * @param macbuffer : [in,out] the MAC packet, it's exchanged with an empty buffer if it's kept
+ *
+ * @return 0 on success, < 0 on error
+ */
+int
+ds3_ccf_unpack_t::deliver_packet (ds3_packet_buffer_t & macbuffer)
+{
+    if (! this->flg_batch) {
+        return this->signify_packet (macbuffer);
+    }
+    if (this->numframes >= this->frames.size()) {
+        this->frames.push_back (new ds3_packet_buffer_t ());
+    }
+    /* no copy, the storage of the buffer kept before is reused by the next MAC packet */
+    this->frames[this->numframes]->swap (macbuffer);
+    this->numframes ++;
+    if (this->numframes >= DS3_UNPACK_BATCH_FRAMES) {
+        return this->flush_packets ();
+    }
+    return 0;
+}
+
+/** @brief signify the MAC packets kept by process_packets() */
+int
+ds3_ccf_unpack_t::flush_packets (void)
+{
+    size_t num = this->numframes;
+    if (num < 1) {
+        return 0;
+    }
+    this->numframes = 0;
+    return this->signify_packets (&(this->frames[0]), num);
+}
+
+int
+ds3_ccf_unpack_t::signify_packets (ds3_packet_buffer_t ** macbuffers, size_t num)
+{
+    size_t i;
+    int ret = 0;
+    for (i = 0; i < num; i ++) {
+        if (this->signify_packet (*(macbuffers[i])) < 0) {
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+ds3_ccf_unpack_t::~ds3_ccf_unpack_t ()
+{
+    std::vector<ds3_packet_buffer_t *>::iterator it;
+    std::vector<ds3_frame_view_t *>::iterator itv;
+    for (it = this->frames.begin(); it != this->frames.end(); it ++) {
+        delete (*it);
+    }
+    /* the frame views have to be released before the engine is destroyed */
+    assert (0 == this->numviews);
+    for (itv = this->viewall.begin(); itv != this->viewall.end(); itv ++) {
+        delete (*itv);
+    }
+}
+
+/**
+ * @brief set the reassembly timeout of the segments
+ *
+ * @param tm : [in] the time a segment can wait for the other segments, 0 to disable the timeout
+ * @param tick : [in] the resolution of the timers, 0 for 1/16 of the timeout
+ *
+ * The timeout applies to the segments received after the call.
+ */
+void
+ds3_ccf_unpack_t::set_timeout (double tm, double tick)
+{
+    this->timeout = (tm > 0) ? tm : 0;
+    if (this->timeout <= 0) {
+        this->timers.reset (1, 1.0);
+        return;
+    }
+    if (tick <= 0) {
+        tick = this->timeout / 16;
+    }
+    /* the wheel covers the timeout in one round */
+    this->timers.reset ((size_t)(this->timeout / tick) + 2, tick);
+}
+
+/**
+ * @brief drop the segments which waited the lost segments longer than the timeout
+ *
+ * @return the number of the segments dropped
+ *
+ * It's called by process_packet(), and can be called by a timer of the owner when there's no segment received.
+ */
+size_t
+ds3_ccf_unpack_t::expire (void)
+{
+    size_t numdrop = this->num_segdrop;
+    size_t i;
+    if (this->timeout <= 0) {
+        return 0;
+    }
+    this->expired.resize (0);
+    if (this->timers.expire (this->current_time(), this->expired) < 1) {
+        return 0;
+    }
+    for (i = 0; i < this->expired.size(); i ++) {
+        size_t seq = this->expired[i].id;
+        if ((! this->reorder.test (seq)) || (this->reorder.get_expire (seq) != this->expired[i].tmexpire)) {
+            /* the segment was released, or the slot is used by another segment */
+            continue;
+        }
+        this->flush_run (seq);
+    }
+    return this->num_segdrop - numdrop;
+}
+
+/**
+ * @brief drop the continual segments around a segment timeout
+ *
+ * @param seq : [in] the sequence # of the segment timeout
+ *
+ * All of the MAC packets ended in the continual segments were signified by process_run(),
+ * so the data left are the parts of the MAC packets waiting for the lost segments before or after them.
+ * The data before the first MAC header of the first pfi=1 segment and after the last one are discarded,
+ * the unpack continues from the MAC headers of the segments received later.
+ */
+void
+ds3_ccf_unpack_t::flush_run (size_t seq)
+{
+    size_t seqbegin = 0;
+    size_t len = this->reorder.find_run (seq, seqbegin);
+    size_t szdrop = 0;
+    size_t k;
+    for (k = 0; k < len; k ++) {
+        ds3packet_ccf_t * seg = this->reorder.get (seqbegin + k);
+        assert (NULL != seg);
+        size_t szcnt = seg->get_content_ref().size();
+        if (seg->get_header().pfi == 0) {
+            szdrop += szcnt;
+        } else {
+            szdrop += seg->get_procpos_prev();
+            if (seg->get_procpos_next() < szcnt) {
+                szdrop += szcnt - seg->get_procpos_next();
+            }
+        }
+        this->release_segment (seqbegin + k, true);
+    }
+    DS3TRACE (DS3TRACE_LVL_WARN, DS3TRE_UNPACK_EXPIRE, seq, len, szdrop, 0);
+#if CCFDEBUG
+    std::cout << "Warning, CCF reassembly timeout, dropped " << len << " segments, " << szdrop << " bytes" << std::endl;
+#endif
+    this->num_timeout ++;
+    this->num_segdrop += len;
+    this->sz_segdrop += szdrop;
+}
+
+/**
+ * @brief drop all of the segments waiting for the other segments
+ *
+ * @return the number of the segments dropped
+ *
+ * It's called before the engine of a flow removed is deleted, the segments are passed to drop_packet().
+ */
+size_t
+ds3_ccf_unpack_t::clear (void)
+{
+    size_t num = this->reorder.size();
+    size_t seq;
+    for (seq = 0; (seq < DS3_CCF_SEQ_NUM) && (this->reorder.size() > 0); seq ++) {
+        if (this->reorder.test (seq)) {
+            this->release_segment (seq, true);
+        }
+    }
+    this->delin.reset ();
+    if (num > 0) {
+        DS3TRACE (DS3TRACE_LVL_WARN, DS3TRE_UNPACK_CLEAR, num, 0, 0, 0);
+    }
+    return num;
+}
+
+/**
+ * @brief the MAC packets queued in ds3_ccf_pack_t, for ds3_pack_segment_t::fill()
+ *
+ * The packets packed completely are recycled, or kept in the done list if their contents are copied later.
+ */
+class ds3_pack_queue_t {
+public:
+    ds3_pack_queue_t (ds3_ccf_pack_t * self1, bool flg_defer1) : self(self1), flg_defer(flg_defer1) {}
+    bool empty (void) const { return this->self->pktlst.empty(); } /**< if no packet is queued */
+    ds3packet_t * front (size_t & retsize) { retsize = this->self->pktlst.front().size; return this->self->pktlst.front().pkt; } /**< the first packet and its size */
+    /** @brief the bytes of the first packet are packed, flg_done is true if it's packed completely */
+    void take (ds3packet_t * pkt, size_t sz, bool flg_done) {
+        this->self->szpktlst -= sz;
+        if (! flg_done) {
+            return;
+        }
+        this->self->pktlst.pop_front ();
+        if (this->flg_defer) {
+            this->self->donelst.push_back (pkt);
+        } else {
+            this->self->recycle_packet (pkt);
+        }
+    }
+
+private:
+    ds3_ccf_pack_t * self; /**< the pack engine */
+    bool flg_defer; /**< the packets packed are recycled after the contents are copied */
+};
+
+/** @brief the MAC packets queued in a flow of ds3_ccf_pack_mgr_t, for ds3_pack_segment_t::fill() */
+class ds3_pack_flowq_t {
+public:
+    ds3_pack_flowq_t (ds3_ccf_pack_mgr_t * self1, ds3_pack_flow_t & fl1) : self(self1), fl(fl1) {}
+    bool empty (void) const { return DS3_PACK_NIL == this->fl.pkthead; } /**< if no packet is queued */
+    ds3packet_t * front (size_t & retsize) { ds3_pack_item_t & item = this->self->pktnodes[this->fl.pkthead].item; retsize = item.size; return item.pkt; } /**< the first packet and its size */
+    /** @brief the bytes of the first packet are packed, flg_done is true if it's packed completely */
+    void take (ds3packet_t * pkt, size_t sz, bool flg_done) {
+        uint32_t idx = this->fl.pkthead;
+        this->fl.szpktlst -= sz;
+        if (! flg_done) {
+            return;
+        }
+        this->fl.pkthead = this->self->pktnodes[idx].next;
+        if (DS3_PACK_NIL == this->fl.pkthead) {
+            this->fl.pkttail = DS3_PACK_NIL;
+        }
+        this->self->pktnodes[idx].next = this->self->pktfree;
+        this->self->pktfree = idx;
+        this->self->recycle_packet (pkt);
+    }
+
+private:
+    ds3_ccf_pack_mgr_t * self; /**< the pack manager */
+    ds3_pack_flow_t & fl; /**< the flow */
+};
+
+/** @brief copy the bytes packed to the content of the segment */
+class ds3_pack_sink_copy_t {
+public:
+    ds3_pack_sink_copy_t (ds3_packet_buffer_t & content1) : content(content1) {}
+    bool put (ds3packet_t * pkt, size_t begin, size_t end) { return NULL != pkt->insert_to (this->content.size(), &(this->content), begin, end); } /**< append the bytes of the packet */
+
+private:
+    ds3_packet_buffer_t & content; /**< the content of the segment */
+};
+
+/** @brief record the bytes packed as the pieces, they're copied later by the worker threads */
+class ds3_pack_sink_plan_t {
+public:
+    ds3_pack_sink_plan_t (std::vector<ds3_pack_piece_t> & pieces1) : pieces(pieces1) {}
+    bool put (ds3packet_t * pkt, size_t begin, size_t end) { ds3_pack_piece_t piece; piece.pkt = pkt; piece.begin = begin; piece.end = end; this->pieces.push_back (piece); return true; } /**< add a piece */
+
+private:
+    std::vector<ds3_pack_piece_t> & pieces; /**< the pieces of the segments planned */
+};
+
+/**
+ * @brief take the bytes of the MAC packets in the front of the queue for a grant
+ *
+ * @param szgrant : [in] the size of the grant, including the CCF header
+ * @param queue : [in,out] the MAC packets, provides empty(), front() and take()
+ * @param sink : [in,out] the content of the segment, provides put()
+ *
+ * @return the size of the content of the segment, 0 if nothing is packed
+ *
+ * the PFI and the MAC offset of the header are set if a MAC packet starts in the segment
+ */
+template <class Q, class S> size_t
+ds3_pack_segment_t::fill (size_t szgrant, Q & queue, S & sink)
+{
+    size_t szpkt = 0;
+    size_t begin;
+    size_t szNext;
+    assert (szgrant >= DS3HDR_CCF_SIZE);
+    this->szmax = szgrant;
+    this->szcur = DS3HDR_CCF_SIZE;
+    memset (&(this->ccfhdr), 0, sizeof(this->ccfhdr));
+    for (; (this->szcur < this->szmax) && (! queue.empty()); ) {
+        ds3packet_t * pkt = queue.front (szpkt);
+        assert (NULL != pkt);
+        begin = pkt->get_procpos_next();
+        assert (szpkt > begin);
+        szNext = szpkt - begin;
+        if (this->szcur + szNext > this->szmax) {
+            szNext = this->szmax - this->szcur;
+        }
+        if (! sink.put (pkt, begin, begin + szNext)) {
+            // error, break;
+            break;
+        }
+        if ((0 == begin) && (0 == this->ccfhdr.pfi)) {
+            /* It's the beginning of the packet */
+            this->ccfhdr.pfi = 1;
+            this->ccfhdr.offmac = (this->szcur - DS3HDR_CCF_SIZE);
+        }
+        this->szcur += szNext;
+        pkt->set_procpos_next (begin + szNext);
+        queue.take (pkt, szNext, (begin + szNext >= szpkt));
+    }
+    return this->szcur - DS3HDR_CCF_SIZE;
+}
+
+/**
+ * @brief set the rest of the CCF header of the segment filled
+ *
+ * @param sequence : [in] the sequence # of the segment
+ * @param sc : [in] SID Cluster ID
+ * @param piggyback_inc : [in,out] the piggyback request value, cleared if it's carried by the segment
+ * @param pbmul : [in] the Multiplier to Number of Bytes Requested
+ */
+void
+ds3_pack_segment_t::seal (uint16_t sequence, uint8_t sc, size_t & piggyback_inc, size_t pbmul)
+{
+#if ! USE_DS3_LATESNDPIG
+    if (piggyback_inc > 0) {
+        this->ccfhdr.request = piggyback_inc / pbmul;
+        piggyback_inc = 0;
+    }
+#endif
+    this->ccfhdr.sequence = sequence;
+    this->ccfhdr.sc = sc;
+#if USE_DS3_HCS
+    this->ccfhdr.hcs = ds3hdr_ccf_calc_hcs (&(this->ccfhdr));
+#endif
+}
+
+/**
+ * @brief pass a segment to be sent in the grant order
+ *
+ * @param ccfpkt : [in] the segment sealed
+ * @param grant : [in] the grant of the segment
+ * @param retgrant : [out] the grant of the segment returned
+ *
+ * @return the segment to be sent in retgrant, NULL if none
+ *
+ * if USE_DS3_LATESNDPIG, the segment is held to carry the piggyback request, and the one held before is returned
+ */
+ds3packet_ccf_t *
+ds3_pack_segment_t::send (ds3packet_ccf_t * ccfpkt, const ds3_grant_t & grant, ds3_grant_t & retgrant)
+{
+#if USE_DS3_LATESNDPIG
+    ds3packet_ccf_t * ret = this->held;
+    retgrant = this->grantheld;
+    this->held = ccfpkt;
+    this->grantheld = grant;
+    return ret;
+#else
+    retgrant = grant;
+    return ccfpkt;
+#endif
+}
+
+/**
+ * @brief release the last segment held by send() after all of the grants are processed
+ *
+ * @param piggyback_inc : [in,out] the piggyback request value, cleared if it's carried by the segment
+ * @param pbmul : [in] the Multiplier to Number of Bytes Requested
+ * @param retgrant : [out] the grant of the segment returned
+ *
+ * @return the segment to be sent in retgrant, NULL if none
+ *
+ * the request of the segment is patched in place
+ */
+ds3packet_ccf_t *
+ds3_pack_segment_t::finish (size_t & piggyback_inc, size_t pbmul, ds3_grant_t & retgrant)
+{
+#if USE_DS3_LATESNDPIG
+    ds3packet_ccf_t * ret = this->held;
+    if (NULL == ret) {
+        return NULL;
+    }
+    if (piggyback_inc > 0) {
+        ds3hdr_ccf_t & lasthdr = ret->get_header();
+        ret->patch_header (piggyback_inc / pbmul, lasthdr.sequence, lasthdr.sc);
+        piggyback_inc = 0;
+    }
+    retgrant = this->grantheld;
+    this->held = NULL;
+    return ret;
+#else
+    return NULL;
+#endif
+}
+
+/** @brief add a MAC packet to the sending list */
+void
+ds3_ccf_pack_t::push_packet (ds3packet_t *p)
+{
+#if CCFDEBUG
+    std::cout << "ds3_ccf_pack_t::process_packet got packet:" << std::endl;
+    p->dump();
+#endif
+    p->reset_procpos(); /* reset the processed position to 0 */
+    ds3_pack_item_t item;
+    item.pkt = p;
+    item.size = p->get_size();
+    this->pktlst.push_back (item);
+    this->szpktlst += item.size;
+}
+
+/**
+ * @brief push the new packets to the sending list, and send segment(s) according current grants
+ *
+ * @param pkts : [in] the packets
+ * @param num : [in] the number of the packets
+ *
+ * @return the number of segments to be sent, >0 on success, < 0 on error
+ *
+ * the grants are processed once for all of the packets
+ */
+int
+ds3_ccf_pack_t::process_packets (ds3packet_t ** pkts, size_t num)
+{
+    size_t i;
+    for (i = 0; i < num; i ++) {
+        if (NULL != pkts[i]) {
+            this->push_packet (pkts[i]);
+        }
+    }
+    return this->process_packet (NULL);
+}
+
+/**
+ * @brief push a new packet to the sending list, and send segment(s) according current grants
+ *
+ * @param p : [in] the packet
+ *
+ * @return the number of segments to be sent, >0 on success, < 0 on error
+ *
+ * push a new packet to the sending list, and send segment(s) according current grants.
+ *
+ * It's assumed that the grants are exist for the packets in the list,
+ * so the size of grants are always larger than(>=) the ``requested packet'' size.
+ */
+int
+ds3_ccf_pack_t::process_packet (ds3packet_t *p)
+{
+    if (NULL != p) {
+        this->push_packet (p);
+    }
+    if (this->workers.size() > 0) {
+        return this->process_packet_bonded ();
+    }
+    size_t numSeg = 0;
+    ds3_pack_segment_t seg;
+    ds3_pack_queue_t queue(this, false);
+    ds3_grant_t grant;
+    ds3_grant_t grantsnd;
+    ds3packet_ccf_t * ccfpkt;
+    // remove the timeout grants
+    this->grantlst.expire (this->current_time());
+    for (; (! this->grantlst.empty()) && (! queue.empty()); ) {
+        grant = this->grantlst.top();
+        this->grantlst.pop();
+        DS3TRACE (DS3TRACE_LVL_DEBUG, DS3TRE_PACK_GRANT, DS3TRACE_TIME_US(grant.get_time()), grant.get_size(), grant.get_channel_id(), 0);
+        ccfpkt = this->segpool->get();
+        assert (NULL != ccfpkt);
+        ds3_pack_sink_copy_t sink(ccfpkt->get_content_ref());
+        if (seg.fill (grant.get_size(), queue, sink) < 1) {
+            this->segpool->put (ccfpkt);
+            continue;
+        }
+        /* It's time to send the segment, and continue to next grant */
+        seg.seal (this->get_next_sequence(), this->scid, this->piggyback_inc, this->get_pbmultiplier());
+        ccfpkt->set_header (&(seg.get_header()));
+        ccfpkt = seg.send (ccfpkt, grant, grantsnd);
+        if (NULL != ccfpkt) {
+            /* send the CCF segment */
+            this->start_sndpkt_timer (grantsnd.get_time(), DS3EVT_TMRPKT, ccfpkt, grantsnd.get_channel_id());
+        }
+        numSeg ++;
+    }
+    ccfpkt = seg.finish (this->piggyback_inc, this->get_pbmultiplier(), grantsnd);
+    if (NULL != ccfpkt) {
+        this->start_sndpkt_timer (grantsnd.get_time(), DS3EVT_TMRPKT, ccfpkt, grantsnd.get_channel_id());
+    }
+    return numSeg;
+}
+
+/**
+ * @brief set the number of the worker threads of the bonded pack
+ *
+ * @param num : [in] the number of the worker threads, 0 to pack the segments one by one (the default)
+ *
+ * @return 0 on success, < 0 on error
+ *
+ * In the bonded pack, the segments of all of the grants are planned first, then the payload of the
+ * segments are copied by the worker threads in parallel. So the insert_to() of the MAC packets
+ * have to be read-only to the MAC packets, such as the ds3_packet_buffer_nbs_t contents.
+ */
+int
+ds3_ccf_pack_t::set_workers (size_t num)
+{
+    return this->workers.start (num);
+}
+
+void
+ds3_ccf_pack_t::fill_segment (void *arg, size_t idx)
+{
+    ds3_ccf_pack_t * self = (ds3_ccf_pack_t *)arg;
+    ds3_pack_plan_t & plan = self->plans[idx];
+    ds3_packet_buffer_t & content = plan.ccfpkt->get_content_ref();
+    size_t i;
+    for (i = plan.idxpiece; i < plan.idxpiece + plan.numpiece; i ++) {
+        ds3_pack_piece_t & piece = self->pieces[i];
+        if (NULL == piece.pkt->insert_to (content.size(), &content, piece.begin, piece.end)) {
+            plan.flg_err = true;
+            return;
+        }
+    }
+}
+
+/**
+ * @brief cancel the planned segments from the one failed to copy its content
+ *
+ * @param idxplan : [in] the first segment failed
+ *
+ * The segments after it are cancelled too, since their bytes follow the ones failed. The bytes of the
+ * MAC packets are put back to the front of the queue, the sequence #s, the grants and the piggyback
+ * request are returned, so the bytes are packed again in order by the next grants, as the serial pack does.
+ */
+void
+ds3_ccf_pack_t::cancel_plans (size_t idxplan)
+{
+    ds3_pack_plan_t & first = this->plans[idxplan];
+    ds3_pack_item_t item;
+    size_t sz = 0;
+    size_t i;
+    for (i = this->pieces.size(); i > first.idxpiece; i --) {
+        ds3_pack_piece_t & piece = this->pieces[i - 1];
+        sz += piece.end - piece.begin;
+        piece.pkt->set_procpos_next (piece.begin);
+        if ((! this->donelst.empty()) && (this->donelst.back() == piece.pkt)) {
+            /* the last piece of the packet packed completely, put it back to the queue */
+            item.pkt = piece.pkt;
+            item.size = piece.end;
+            this->pktlst.push_front (item);
+            this->donelst.pop_back ();
+        }
+    }
+    this->szpktlst += sz;
+    this->sequence = first.ccfpkt->get_header().sequence;
+    DS3TRACE (DS3TRACE_LVL_WARN, DS3TRE_PACK_CANCEL, this->sequence, this->plans.size() - idxplan, sz, 0);
+#if CCFDEBUG
+    std::cout << "Warning, failed to copy the content of segment " << this->sequence << ", cancelled " << (this->plans.size() - idxplan) << " segments, " << sz << " bytes" << std::endl;
+#endif
+    for (i = idxplan; i < this->plans.size(); i ++) {
+        this->piggyback_inc += this->plans[i].ccfpkt->get_header().request * this->get_pbmultiplier();
+        this->grantlst.push (this->plans[i].grant);
+        this->segpool->put (this->plans[i].ccfpkt);
+    }
+    this->pieces.resize (first.idxpiece);
+    this->plans.resize (idxplan);
+    this->num_cancel ++;
+}
+
+/**
+ * @brief pack the MAC packets to the segments of the grants, the payload is copied by the worker threads
+ *
+ * @return the number of segments to be sent, >0 on success, < 0 on error
+ *
+ * The byte stream is divided across the sorted grants, the sequence numbers are reserved in the grant order
+ * before the copy, and the segments are passed to start_sndpkt_timer() in the same order as process_packet().
+ * If a segment fails to copy its content, it and the ones after it are cancelled by cancel_plans().
+ */
+int
+ds3_ccf_pack_t::process_packet_bonded (void)
+{
+    size_t numSeg = 0;
+    ds3_pack_segment_t seg;
+    ds3_pack_queue_t queue(this, true);
+    ds3_pack_sink_plan_t sink(this->pieces);
+    ds3_pack_plan_t plan;
+    ds3_grant_t grantsnd;
+    ds3packet_ccf_t * ccfpkt;
+    std::vector<ds3_pack_plan_t>::iterator itp;
+    std::vector<ds3packet_t *>::iterator itd;
+    size_t i;
+
+    this->plans.resize (0);
+    this->pieces.resize (0);
+    this->donelst.resize (0);
+    // remove the timeout grants
+    this->grantlst.expire (this->current_time());
+    /* plan the segments */
+    for (; (! this->grantlst.empty()) && (! queue.empty()); ) {
+        plan.grant = this->grantlst.top();
+        this->grantlst.pop();
+        DS3TRACE (DS3TRACE_LVL_DEBUG, DS3TRE_PACK_GRANT, DS3TRACE_TIME_US(plan.grant.get_time()), plan.grant.get_size(), plan.grant.get_channel_id(), 0);
+        plan.idxpiece = this->pieces.size();
+        plan.flg_err = false;
+        if (seg.fill (plan.grant.get_size(), queue, sink) < 1) {
+            continue;
+        }
+        plan.numpiece = this->pieces.size() - plan.idxpiece;
+        seg.seal (this->get_next_sequence(), this->scid, this->piggyback_inc, this->get_pbmultiplier());
+        plan.ccfpkt = this->segpool->get();
+        assert (NULL != plan.ccfpkt);
+        plan.ccfpkt->set_header (&(seg.get_header()));
+        this->plans.push_back (plan);
+    }
+
+    /* copy the payload */
+    this->workers.run (ds3_ccf_pack_t::fill_segment, this, this->plans.size());
+    for (i = 0; i < this->plans.size(); i ++) {
+        if (this->plans[i].flg_err) {
+            this->cancel_plans (i);
+            break;
+        }
+    }
+
+    /* send the CCF segments in the order of the sequence numbers */
+    for (itp = this->plans.begin(); itp != this->plans.end(); itp ++) {
+        ccfpkt = seg.send (itp->ccfpkt, itp->grant, grantsnd);
+        if (NULL != ccfpkt) {
+            this->start_sndpkt_timer (grantsnd.get_time(), DS3EVT_TMRPKT, ccfpkt, grantsnd.get_channel_id());
+        }
+        numSeg ++;
+    }
+    this->plans.resize (0);
+    /* the last segment carries the piggyback request */
+    ccfpkt = seg.finish (this->piggyback_inc, this->get_pbmultiplier(), grantsnd);
+    if (NULL != ccfpkt) {
+        this->start_sndpkt_timer (grantsnd.get_time(), DS3EVT_TMRPKT, ccfpkt, grantsnd.get_channel_id());
+    }
+
+    for (itd = this->donelst.begin(); itd != this->donelst.end(); itd ++) {
+        this->recycle_packet (*itd);
+    }
+    this->donelst.resize (0);
+    return numSeg;
+}
+
+/**
+ * @brief add grants and piggyback request
+ *
+ * @param grants : [in] the grants list
+ * @param piggyback : [in] the piggyback request value
+ *
+ * @return 0 on success, < 0 on error
+ *
+ * add grants and piggyback request
+ *
+ * This function will also process the MAC packets for all of the added grants
+ */
+int
+ds3_ccf_pack_t::add_grants (std::vector<ds3_grant_t> & grants)
+{
+    grantlst.push (grants);
+
+    process_packet (NULL);
+    return 0;
+}
+
+int
+ds3_ccf_pack_t::add_grant (ds3_grant_t & grant)
+{
+    grantlst.push (grant);
+    process_packet (NULL);
+    return 0;
+}
+
+ds3_ccf_pack_mgr_t::ds3_ccf_pack_mgr_t (size_t numflows, size_t pbmul)
+    : pktfree(DS3_PACK_NIL), grantfree(DS3_PACK_NIL), multiplier_piggyback(pbmul), segpool(&segpool_own)
+{
+    this->set_num_flows (numflows);
+}
+
+/* the MAC packets not packed are deleted */
+ds3_ccf_pack_mgr_t::~ds3_ccf_pack_mgr_t ()
+{
+    std::vector<ds3_pack_flow_t>::iterator it;
+    uint32_t idx;
+    for (it = this->flows.begin(); it != this->flows.end(); it ++) {
+        for (idx = it->pkthead; DS3_PACK_NIL != idx; idx = this->pktnodes[idx].next) {
+            delete this->pktnodes[idx].item.pkt;
+        }
+    }
+}
+
+/**
+ * @brief set the number of the flows
+ *
+ * @param numflows : [in] the number of the flows, the flow ids are [0, numflows)
+ *
+ * @return 0 on success, < 0 on error
+ *
+ * the flow table only grows, and it should not be changed in the callbacks of process()
+ */
+int
+ds3_ccf_pack_mgr_t::set_num_flows (size_t numflows)
+{
+    ds3_pack_flow_t flow;
+    if ((numflows < this->flows.size()) || (numflows >= DS3_PACK_NIL)) {
+        return -1;
+    }
+    memset (&flow, 0, sizeof(flow));
+    flow.pkthead = DS3_PACK_NIL;
+    flow.pkttail = DS3_PACK_NIL;
+    flow.granthead = DS3_PACK_NIL;
+    flow.granttail = DS3_PACK_NIL;
+    this->flows.resize (numflows, flow);
+    return 0;
+}
+
+/**
+ * @brief set the SID Cluster ID of a flow
+ *
+ * @param flow : [in] the flow id
+ * @param sc : [in] the SID Cluster ID
+ *
+ * @return 0 on success, < 0 on error
+ */
+int
+ds3_ccf_pack_mgr_t::set_sc (size_t flow, uint8_t sc)
+{
+    if (flow >= this->flows.size()) {
+        return -1;
+    }
+    this->flows[flow].sc = sc;
+    return 0;
+}
+
+/** @brief add the flow to the pending list of process() */
+void
+ds3_ccf_pack_mgr_t::set_pending (size_t flow)
+{
+    if (this->flows[flow].flg_pending) {
+        return;
+    }
+    this->flows[flow].flg_pending = 1;
+    this->pendlst.push_back (flow);
+}
+
+/**
+ * @brief queue a MAC packet to a flow
+ *
+ * @param flow : [in] the flow id
+ * @param p : [in] the MAC packet, it's owned by the manager after the call
+ *
+ * @return 0 on success, < 0 on error
+ *
+ * the packet is packed by the next process() if the flow has grants
+ */
+int
+ds3_ccf_pack_mgr_t::add_packet (size_t flow, ds3packet_t *p)
+{
+    uint32_t idx;
+    if ((flow >= this->flows.size()) || (NULL == p)) {
+        return -1;
+    }
+    ds3_pack_flow_t & fl = this->flows[flow];
+    if (DS3_PACK_NIL != this->pktfree) {
+        idx = this->pktfree;
+        this->pktfree = this->pktnodes[idx].next;
+    } else {
+        idx = this->pktnodes.size();
+        this->pktnodes.resize (idx + 1);
+    }
+    p->reset_procpos(); /* reset the processed position to 0 */
+    this->pktnodes[idx].item.pkt = p;
+    this->pktnodes[idx].item.size = p->get_size();
+    this->pktnodes[idx].next = DS3_PACK_NIL;
+    if (DS3_PACK_NIL == fl.pkttail) {
+        fl.pkthead = idx;
+    } else {
+        this->pktnodes[fl.pkttail].next = idx;
+    }
+    fl.pkttail = idx;
+    fl.szpktlst += this->pktnodes[idx].item.size;
+    if (DS3_PACK_NIL != fl.granthead) {
+        this->set_pending (flow);
+    }
+    return 0;
+}
+
+/**
+ * @brief add a grant to a flow
+ *
+ * @param flow : [in] the flow id
+ * @param grant : [in] the grant
+ *
+ * @return 0 on success, < 0 on error
+ *
+ * the grants of the flow are kept in the time order, it's O(1) if the grant is not earlier than the grants added before
+ */
+int
+ds3_ccf_pack_mgr_t::add_grant (size_t flow, const ds3_grant_t & grant)
+{
+    uint32_t idx;
+    uint32_t prev;
+    if (flow >= this->flows.size()) {
+        return -1;
+    }
+    ds3_pack_flow_t & fl = this->flows[flow];
+    if (DS3_PACK_NIL != this->grantfree) {
+        idx = this->grantfree;
+        this->grantfree = this->grantnodes[idx].next;
+    } else {
+        idx = this->grantnodes.size();
+        this->grantnodes.resize (idx + 1);
+    }
+    this->grantnodes[idx].grant = grant;
+    this->grantnodes[idx].next = DS3_PACK_NIL;
+    if (DS3_PACK_NIL == fl.granttail) {
+        fl.granthead = idx;
+        fl.granttail = idx;
+    } else if (this->grantnodes[fl.granttail].grant.get_time() <= grant.get_time()) {
+        this->grantnodes[fl.granttail].next = idx;
+        fl.granttail = idx;
+    } else if (grant.get_time() < this->grantnodes[fl.granthead].grant.get_time()) {
+        this->grantnodes[idx].next = fl.granthead;
+        fl.granthead = idx;
+    } else {
+        /* after the grants with the same time */
+        prev = fl.granthead;
+        for (; this->grantnodes[this->grantnodes[prev].next].grant.get_time() <= grant.get_time(); ) {
+            prev = this->grantnodes[prev].next;
+        }
+        this->grantnodes[idx].next = this->grantnodes[prev].next;
+        this->grantnodes[prev].next = idx;
+    }
+    if (DS3_PACK_NIL != fl.pkthead) {
+        this->set_pending (flow);
+    }
+    return 0;
+}
+
+/**
+ * @brief add the piggyback request of a flow, it's sent in the next segment of the flow
+ *
+ * @param flow : [in] the flow id
+ * @param piggyback : [in] the piggyback request value
+ *
+ * @return 0 on success, < 0 on error
+ */
+int
+ds3_ccf_pack_mgr_t::add_piggyback (size_t flow, size_t piggyback)
+{
+    if (flow >= this->flows.size()) {
+        return -1;
+    }
+    this->flows[flow].piggyback_inc += piggyback;
+    return 0;
+}
+
+/**
+ * @brief pack the MAC packets of a flow to the segments of its grants
+ *
+ * @param flow : [in] the flow id
+ *
+ * @return the number of segments to be sent
+ *
+ * the same as ds3_ccf_pack_t::process_packet(), the segments are built by ds3_pack_segment_t
+ */
+int
+ds3_ccf_pack_mgr_t::process_flow (size_t flow)
+{
+    ds3_pack_flow_t & fl = this->flows[flow];
+    size_t numSeg = 0;
+    uint32_t idx;
+    ds3_pack_segment_t seg;
+    ds3_pack_flowq_t queue(this, fl);
+    ds3_grant_t grant;
+    ds3_grant_t grantsnd;
+    ds3packet_ccf_t * ccfpkt;
+    size_t piggyback_inc;
+    double tmnow = this->current_time();
+
+    // remove the timeout grants
+    for (; (DS3_PACK_NIL != fl.granthead) && (tmnow > this->grantnodes[fl.granthead].grant.get_time()); ) {
+        idx = fl.granthead;
+        DS3TRACE (DS3TRACE_LVL_WARN, DS3TRE_PACK_GRANT_LATE, DS3TRACE_TIME_US(tmnow), DS3TRACE_TIME_US(this->grantnodes[idx].grant.get_time()), this->grantnodes[idx].grant.get_size(), this->grantnodes[idx].grant.get_channel_id());
+        fl.granthead = this->grantnodes[idx].next;
+        this->grantnodes[idx].next = this->grantfree;
+        this->grantfree = idx;
+    }
+    if (DS3_PACK_NIL == fl.granthead) {
+        fl.granttail = DS3_PACK_NIL;
+    }
+    for (; (DS3_PACK_NIL != fl.granthead) && (! queue.empty()); ) {
+        idx = fl.granthead;
+        grant = this->grantnodes[idx].grant;
+        fl.granthead = this->grantnodes[idx].next;
+        if (DS3_PACK_NIL == fl.granthead) {
+            fl.granttail = DS3_PACK_NIL;
+        }
+        this->grantnodes[idx].next = this->grantfree;
+        this->grantfree = idx;
+        DS3TRACE (DS3TRACE_LVL_DEBUG, DS3TRE_PACK_GRANT, DS3TRACE_TIME_US(grant.get_time()), grant.get_size(), grant.get_channel_id(), 0);
+
+        ccfpkt = this->segpool->get();
+        assert (NULL != ccfpkt);
+        ds3_pack_sink_copy_t sink(ccfpkt->get_content_ref());
+        if (seg.fill (grant.get_size(), queue, sink) < 1) {
+            this->segpool->put (ccfpkt);
+            continue;
+        }
+        piggyback_inc = fl.piggyback_inc;
+        seg.seal (fl.sequence, fl.sc, piggyback_inc, this->get_pbmultiplier());
+        fl.piggyback_inc = piggyback_inc;
+        fl.sequence = (fl.sequence + 1) & 0x1FFF;
+        ccfpkt->set_header (&(seg.get_header()));
+        ccfpkt = seg.send (ccfpkt, grant, grantsnd);
+        if (NULL != ccfpkt) {
+            /* send the CCF segment */
+            this->start_sndpkt_timer (flow, grantsnd.get_time(), DS3EVT_TMRPKT, ccfpkt, grantsnd.get_channel_id());
+        }
+        numSeg ++;
+    }
+    piggyback_inc = fl.piggyback_inc;
+    ccfpkt = seg.finish (piggyback_inc, this->get_pbmultiplier(), grantsnd);
+    fl.piggyback_inc = piggyback_inc;
+    if (NULL != ccfpkt) {
+        this->start_sndpkt_timer (flow, grantsnd.get_time(), DS3EVT_TMRPKT, ccfpkt, grantsnd.get_channel_id());
+    }
+    return numSeg;
+}
+
+/**
+ * @brief pack the flows which have the grants and the MAC packets
+ *
+ * @return the number of segments to be sent
+ *
+ * the flows are serviced in the order of their new grants or packets added
+ */
+int
+ds3_ccf_pack_mgr_t::process (void)
+{
+    size_t numSeg = 0;
+    size_t i;
+    size_t flow;
+    /* the callbacks may add the flows to the list again */
+    for (i = 0; i < this->pendlst.size(); i ++) {
+        flow = this->pendlst[i];
+        this->flows[flow].flg_pending = 0;
+        numSeg += this->process_flow (flow);
+    }
+    this->pendlst.resize (0);
+    return numSeg;
+}
+
+/**
+ * @brief the default hash function of the unpack service
+ *
+ * @param flow : [in] the CM/service flow id
+ * @param sc : [in] SID Cluster ID
+ *
+ * @return the hash value
+ *
+ * the flow ids are often continual, the multiplication spreads them to all of the shards
+ */
+size_t
+ds3_unpack_hash_default (uint32_t flow, uint8_t sc)
+{
+    uint64_t key = (((uint64_t)flow) << 8) | sc;
+    key *= 0x9E3779B97F4A7C15ULL;
+    return (size_t)(key >> 32);
+}
+
+void
+ds3_ccf_unpack_ctx_t::recycle_packet (ds3packet_t *p)
+{
+    this->svc->recycle_packet (this->shard, p);
+}
+
+void
+ds3_ccf_unpack_ctx_t::drop_packet (ds3packet_t *p)
+{
+    this->svc->drop_packet (this->shard, p);
+}
+
+int
+ds3_ccf_unpack_ctx_t::signify_packet (ds3_packet_buffer_t & macbuffer)
+{
+    return this->svc->signify_packet (this->shard, this->flow, this->sc, macbuffer);
+}
+
+int
+ds3_ccf_unpack_ctx_t::signify_piggyback (int sc, size_t request)
+{
+    return this->svc->signify_piggyback (this->shard, this->flow, sc, request);
+}
+
+double
+ds3_ccf_unpack_ctx_t::current_time (void)
+{
+    return this->svc->current_time ();
+}
+
+ds3_ccf_unpack_svc_t::ds3_ccf_unpack_svc_t (size_t numshards, size_t pbmul)
+    : hashfunc(ds3_unpack_hash_default), multiplier_piggyback(pbmul), timeout(0), tick(0), numfreed(0)
+{
+    this->shards.resize ((numshards > 0) ? numshards : 1);
+}
+
+/** the segments are owned by the derived class, clear() has to be called before the service is deleted */
+ds3_ccf_unpack_svc_t::~ds3_ccf_unpack_svc_t ()
+{
+    std::vector<ds3_unpack_shard_t>::iterator it;
+    std::map<uint64_t, ds3_ccf_unpack_ctx_t *>::iterator itc;
+    this->workers.stop ();
+    for (it = this->shards.begin(); it != this->shards.end(); it ++) {
+        assert (it->inlst.empty());
+        for (itc = it->ctxmap.begin(); itc != it->ctxmap.end(); itc ++) {
+            assert (itc->second->is_idle());
+            delete itc->second;
+        }
+    }
+}
+
+/**
+ * @brief drop the segments of all of the flows and delete their contexts
+ *
+ * @return the number of the segments dropped
+ *
+ * the segments added and not processed yet, and the ones waiting in the contexts, are passed to drop_packet().
+ * It's called by the thread of process(), and has to be called before the service is deleted.
+ */
+size_t
+ds3_ccf_unpack_svc_t::clear (void)
+{
+    std::map<uint64_t, ds3_ccf_unpack_ctx_t *>::iterator itc;
+    size_t num = 0;
+    size_t idx;
+    size_t i;
+    for (idx = 0; idx < this->shards.size(); idx ++) {
+        ds3_unpack_shard_t & shard = this->shards[idx];
+        for (i = 0; i < shard.inlst.size(); i ++) {
+            this->drop_packet (idx, shard.inlst[i].pkt);
+        }
+        num += shard.inlst.size();
+        shard.inlst.resize (0);
+        for (itc = shard.ctxmap.begin(); itc != shard.ctxmap.end(); itc ++) {
+            num += itc->second->clear ();
+            delete itc->second;
+        }
+        shard.ctxmap.clear ();
+    }
+    return num;
+}
+
+/**
+ * @brief set the number of the shards and the hash function
+ *
+ * @param numshards : [in] the number of the shards
+ * @param hash : [in] the hash function of (flow, sc), NULL for ds3_unpack_hash_default()
+ *
+ * @return 0 on success, < 0 on error
+ *
+ * the shards can't be changed after the segments are added
+ */
+int
+ds3_ccf_unpack_svc_t::set_shards (size_t numshards, ds3_unpack_hash_t hash)
+{
+    if (numshards < 1) {
+        return -1;
+    }
+    if ((this->get_num_contexts() > 0) || (this->get_pending() > 0)) {
+        return -1;
+    }
+    this->shards.resize (0);
+    this->shards.resize (numshards);
+    this->hashfunc = (NULL != hash) ? hash : ds3_unpack_hash_default;
+    return 0;
+}
+
+/**
+ * @brief add a segment received from a flow
+ *
+ * @param flow : [in] the CM/service flow id
+ * @param p : [in] the CCF segment, the SID Cluster is got from its header
+ *
+ * @return 0 on success, < 0 on error
+ *
+ * the segment is queued to the shard of (flow, sc), and unpacked by process()
+ */
+int
+ds3_ccf_unpack_svc_t::add_packet (uint32_t flow, ds3packet_t *p)
+{
+    ds3_unpack_input_t in;
+    in.flow = flow;
+    in.pkt = dynamic_cast<ds3packet_ccf_t *>(p);
+    assert (NULL != in.pkt);
+    if (NULL == in.pkt) {
+        return -1;
+    }
+    this->shards[this->get_shard (flow, in.pkt->get_header().sc)].inlst.push_back (in);
+    return 0;
+}
+
+size_t
+ds3_ccf_unpack_svc_t::get_pending (void) const
+{
+    std::vector<ds3_unpack_shard_t>::const_iterator it;
+    size_t num = 0;
+    for (it = this->shards.begin(); it != this->shards.end(); it ++) {
+        num += it->inlst.size();
+    }
+    return num;
+}
+
+/** @brief the number of the contexts of all of the shards */
+size_t
+ds3_ccf_unpack_svc_t::get_num_contexts (void) const
+{
+    std::vector<ds3_unpack_shard_t>::const_iterator it;
+    size_t num = 0;
+    for (it = this->shards.begin(); it != this->shards.end(); it ++) {
+        num += it->ctxmap.size();
+    }
+    return num;
+}
+
+/** @brief the number of the segments waiting for the other segments in all of the contexts */
+size_t
+ds3_ccf_unpack_svc_t::get_num_segments (void) const
+{
+    std::vector<ds3_unpack_shard_t>::const_iterator it;
+    std::map<uint64_t, ds3_ccf_unpack_ctx_t *>::const_iterator itc;
+    size_t num = 0;
+    for (it = this->shards.begin(); it != this->shards.end(); it ++) {
+        for (itc = it->ctxmap.begin(); itc != it->ctxmap.end(); itc ++) {
+            num += itc->second->get_num_segments();
+        }
+    }
+    return num;
+}
+
+/** @brief unpack the segments queued in a shard, the contexts are created for the new flows */
+void
+ds3_ccf_unpack_svc_t::process_shard (void *arg, size_t idx)
+{
+    ds3_ccf_unpack_svc_t * self = (ds3_ccf_unpack_svc_t *)arg;
+    ds3_unpack_shard_t & shard = self->shards[idx];
+    std::map<uint64_t, ds3_ccf_unpack_ctx_t *>::iterator itc;
+    ds3_ccf_unpack_ctx_t * ctx;
+    uint64_t key;
+    uint8_t sc;
+    size_t i;
+    for (i = 0; i < shard.inlst.size(); i ++) {
+        ds3_unpack_input_t & in = shard.inlst[i];
+        sc = in.pkt->get_header().sc;
+        key = (((uint64_t)in.flow) << 8) | sc;
+        itc = shard.ctxmap.find (key);
+        if (itc != shard.ctxmap.end()) {
+            ctx = itc->second;
+        } else {
+            ctx = new ds3_ccf_unpack_ctx_t (self, idx, in.flow, sc);
+            ctx->set_pbmultiplier (self->multiplier_piggyback);
+            if (self->timeout > 0) {
+                ctx->set_timeout (self->timeout, self->tick);
+            }
+            shard.ctxmap[key] = ctx;
+        }
+        ctx->process_packet (in.pkt);
+    }
+    shard.inlst.resize (0);
+}
+
+/**
+ * @brief unpack the segments added
+ *
+ * @return the number of the segments processed
+ *
+ * the shards are processed by the worker threads and the calling thread, and it returns after all of them are done.
+ */
+size_t
+ds3_ccf_unpack_svc_t::process (void)
+{
+    size_t num = this->get_pending ();
+    if (num > 0) {
+        this->workers.run (ds3_ccf_unpack_svc_t::process_shard, this, this->shards.size());
+    }
+    return num;
+}
+
+/** @brief drop the segments timeout in the contexts of a shard, and delete the contexts idle */
+void
+ds3_ccf_unpack_svc_t::expire_shard (void *arg, size_t idx)
+{
+    ds3_ccf_unpack_svc_t * self = (ds3_ccf_unpack_svc_t *)arg;
+    ds3_unpack_shard_t & shard = self->shards[idx];
+    std::map<uint64_t, ds3_ccf_unpack_ctx_t *>::iterator itc;
+    size_t num = 0;
+    size_t numfree = 0;
+    for (itc = shard.ctxmap.begin(); itc != shard.ctxmap.end(); ) {
+        num += itc->second->expire ();
+        if (itc->second->is_idle ()) {
+            /* no data is kept by the context, it's created again by the next segment of the flow */
+            delete itc->second;
+            shard.ctxmap.erase (itc ++);
+            numfree ++;
+        } else {
+            itc ++;
+        }
+    }
+    shard.numdrop = num;
+    shard.numfree = numfree;
+}
+
+/**
+ * @brief drop the segments waiting longer than the reassembly timeout in all of the contexts
+ *
+ * @return the number of the segments dropped
+ *
+ * the contexts check the timeout when they get the segments, it's for the flows which stop sending.
+ * The contexts without any segment waiting are deleted, so the flows which stop sending don't keep
+ * their reorder rings; see get_num_freed().
+ */
+size_t
+ds3_ccf_unpack_svc_t::expire (void)
+{
+    size_t num = 0;
+    size_t i;
+    this->workers.run (ds3_ccf_unpack_svc_t::expire_shard, this, this->shards.size());
+    for (i = 0; i < this->shards.size(); i ++) {
+        num += this->shards[i].numdrop;
+        this->numfreed += this->shards[i].numfree;
+    }
+    return num;
+}
+
+/**
+ * @brief remove a flow, drop its segments and delete its context
+ *
+ * @param flow : [in] the CM/service flow id
+ * @param sc : [in] SID Cluster ID
+ *
+ * @return the number of the segments dropped, >=0 on success, < 0 if the flow is not found
+ *
+ * the segments of the flow added and not processed yet are dropped too. It's called by the thread of process().
+ */
+ssize_t
+ds3_ccf_unpack_svc_t::remove_flow (uint32_t flow, uint8_t sc)
+{
+    size_t idx = this->get_shard (flow, sc);
+    ds3_unpack_shard_t & shard = this->shards[idx];
+    std::map<uint64_t, ds3_ccf_unpack_ctx_t *>::iterator itc;
+    uint64_t key = (((uint64_t)flow) << 8) | sc;
+    bool flg_found = false;
+    size_t num = 0;
+    size_t i;
+    size_t j;
+    for (i = 0, j = 0; i < shard.inlst.size(); i ++) {
+        ds3_unpack_input_t & in = shard.inlst[i];
+        if ((in.flow == flow) && (in.pkt->get_header().sc == sc)) {
+            this->drop_packet (idx, in.pkt);
+            flg_found = true;
+            num ++;
+            continue;
+        }
+        shard.inlst[j ++] = in;
+    }
+    shard.inlst.resize (j);
+    itc = shard.ctxmap.find (key);
+    if (itc != shard.ctxmap.end()) {
+        num += itc->second->clear ();
+        delete itc->second;
+        shard.ctxmap.erase (itc);
+        flg_found = true;
+    }
+    if (! flg_found) {
+        return -1;
+    }
+    return num;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#define DS3_CPU_RELAX() __builtin_ia32_pause ()
+#else
+#define DS3_CPU_RELAX() __asm__ __volatile__ ("" ::: "memory")
+#endif
+
+/** @brief increase a counter written by one thread and read by the others */
+#define DS3_STAT_ADD(field, val) __atomic_store_n (&(field), (field) + (val), __ATOMIC_RELAXED)
+
+/**
+ * @brief clear the ring and set the number of the slots
+ *
+ * @param capacity : [in] the number of the slots, rounded up to power of 2
+ *
+ * @return 0 on success, < 0 on error
+ *
+ * it's called when none of the threads uses the ring
+ */
+int
+ds3_spsc_ring_t::reset (size_t capacity)
+{
+    size_t sz = 2;
+    if (capacity < 1) {
+        return -1;
+    }
+    for (; sz < capacity; sz <<= 1) {
+    }
+    this->slots.resize (0);
+    this->slots.resize (sz, NULL);
+    this->mask = sz - 1;
+    this->tail = 0;
+    this->headcache = 0;
+    this->head = 0;
+    this->tailcache = 0;
+    return 0;
+}
+
+/**
+ * @brief add an item to the ring, called by the producer thread
+ *
+ * @param p : [in] the item
+ *
+ * @return true on success, false if the ring is full
+ */
+bool
+ds3_spsc_ring_t::push (void * p)
+{
+    size_t t = this->tail;
+    if (t - this->headcache >= this->slots.size()) {
+        this->headcache = __atomic_load_n (&(this->head), __ATOMIC_ACQUIRE);
+        if (t - this->headcache >= this->slots.size()) {
+            return false;
+        }
+    }
+    this->slots[t & this->mask] = p;
+    __atomic_store_n (&(this->tail), t + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+/**
+ * @brief remove the items from the ring, called by the consumer thread
+ *
+ * @param retlst : [out] the items removed
+ * @param num : [in] the max number of the items
+ *
+ * @return the number of the items removed
+ */
+size_t
+ds3_spsc_ring_t::pop (void ** retlst, size_t num)
+{
+    size_t h = this->head;
+    size_t avail = this->tailcache - h;
+    size_t i;
+    if (avail < num) {
+        this->tailcache = __atomic_load_n (&(this->tail), __ATOMIC_ACQUIRE);
+        avail = this->tailcache - h;
+    }
+    if (avail > num) {
+        avail = num;
+    }
+    for (i = 0; i < avail; i ++) {
+        retlst[i] = this->slots[(h + i) & this->mask];
+    }
+    if (avail > 0) {
+        __atomic_store_n (&(this->head), h + avail, __ATOMIC_RELEASE);
+    }
+    return avail;
+}
+
+ds3_ccf_unpack_pipe_t::ds3_ccf_unpack_pipe_t (ds3_ccf_unpack_t * engine1)
+    : engine(engine1), flg_parked(0), flg_quit(0), flg_running(false), batch(32), spins(1000)
+{
+    memset (&(this->stats), 0, sizeof(this->stats));
+    pthread_mutex_init (&(this->mutex), NULL);
+    pthread_cond_init (&(this->cond), NULL);
+}
+
+ds3_ccf_unpack_pipe_t::~ds3_ccf_unpack_pipe_t ()
+{
+    this->stop ();
+    pthread_cond_destroy (&(this->cond));
+    pthread_mutex_destroy (&(this->mutex));
+}
+
+/**
+ * @brief start the reassembly thread
+ *
+ * @param capacity : [in] the number of the segments the ring can hold
+ * @param batch : [in] the max number of the segments processed in each batch
+ * @param spins : [in] the times to check the empty ring before parking, 0 to park at once
+ *
+ * @return 0 on success, < 0 on error
+ */
+int
+ds3_ccf_unpack_pipe_t::start (size_t capacity, size_t batch, size_t spins)
+{
+    if (this->flg_running || (NULL == this->engine) || (batch < 1)) {
+        return -1;
+    }
+    if (this->ring.reset (capacity) < 0) {
+        return -1;
+    }
+    this->batch = batch;
+    this->spins = spins;
+    this->flg_quit = 0;
+    this->flg_parked = 0;
+    memset (&(this->stats), 0, sizeof(this->stats));
+    if (0 != pthread_create (&(this->thread), NULL, ds3_ccf_unpack_pipe_t::thread_main, this)) {
+        return -1;
+    }
+    this->flg_running = true;
+    return 0;
+}
+
+/** @brief stop the reassembly thread after the segments in the ring are processed */
+void
+ds3_ccf_unpack_pipe_t::stop (void)
+{
+    if (! this->flg_running) {
+        return;
+    }
+    pthread_mutex_lock (&(this->mutex));
+    __atomic_store_n (&(this->flg_quit), 1, __ATOMIC_RELEASE);
+    pthread_cond_signal (&(this->cond));
+    pthread_mutex_unlock (&(this->mutex));
+    pthread_join (this->thread, NULL);
+    this->flg_running = false;
+}
+
+/**
+ * @brief pass a segment received to the reassembly thread, called by the receive thread
+ *
+ * @param p : [in] the CCF segment
+ *
+ * @return 0 on success, < 0 on error
+ *
+ * if the ring is full, the segment is not taken and the caller retries or drops it;
+ * if the reassembly thread is not started, the segment is processed by the calling thread.
+ */
+int
+ds3_ccf_unpack_pipe_t::push (ds3packet_t * p)
+{
+    if (! this->flg_running) {
+        return this->engine->process_packet (p);
+    }
+    if (! this->ring.push (p)) {
+        DS3_STAT_ADD (this->stats.num_full, 1);
+        return -1;
+    }
+    DS3_STAT_ADD (this->stats.num_push, 1);
+    /* the reassembly thread sets the flag before it checks the ring at last */
+    __atomic_thread_fence (__ATOMIC_SEQ_CST);
+    if (__atomic_load_n (&(this->flg_parked), __ATOMIC_RELAXED)) {
+        pthread_mutex_lock (&(this->mutex));
+        pthread_cond_signal (&(this->cond));
+        pthread_mutex_unlock (&(this->mutex));
+        DS3_STAT_ADD (this->stats.num_wake, 1);
+    }
+    return 0;
+}
+
+/** @brief get the statistics, the fields are updated by the two threads separately */
+void
+ds3_ccf_unpack_pipe_t::get_stats (ds3_pipe_stats_t & retstats) const
+{
+    retstats.num_push = __atomic_load_n (&(this->stats.num_push), __ATOMIC_RELAXED);
+    retstats.num_full = __atomic_load_n (&(this->stats.num_full), __ATOMIC_RELAXED);
+    retstats.num_wake = __atomic_load_n (&(this->stats.num_wake), __ATOMIC_RELAXED);
+    retstats.num_pop = __atomic_load_n (&(this->stats.num_pop), __ATOMIC_RELAXED);
+    retstats.num_batch = __atomic_load_n (&(this->stats.num_batch), __ATOMIC_RELAXED);
+    retstats.num_park = __atomic_load_n (&(this->stats.num_park), __ATOMIC_RELAXED);
+    retstats.max_depth = __atomic_load_n (&(this->stats.max_depth), __ATOMIC_RELAXED);
+}
+
+void *
+ds3_ccf_unpack_pipe_t::thread_main (void *arg)
+{
+    ((ds3_ccf_unpack_pipe_t *)arg)->run ();
+    return NULL;
+}
+
+/**
+ * @brief wait for the receive thread to push a segment
+ *
+ * @return true if it waited the reassembly timeout of the engine
+ */
+bool
+ds3_ccf_unpack_pipe_t::park (void)
+{
+    double tmwait = this->engine->get_timeout ();
+    bool flg_timeout = false;
+    struct timespec ts;
+    pthread_mutex_lock (&(this->mutex));
+    __atomic_store_n (&(this->flg_parked), 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence (__ATOMIC_SEQ_CST);
+    if ((this->ring.size() < 1) && (! __atomic_load_n (&(this->flg_quit), __ATOMIC_ACQUIRE))) {
+        DS3_STAT_ADD (this->stats.num_park, 1);
+        if (tmwait > 0) {
+            clock_gettime (CLOCK_REALTIME, &ts);
+            ts.tv_sec += (time_t)tmwait;
+            ts.tv_nsec += (long)((tmwait - (time_t)tmwait) * 1e9);
+            if (ts.tv_nsec >= 1000000000L) {
+                ts.tv_sec ++;
+                ts.tv_nsec -= 1000000000L;
+            }
+            flg_timeout = (0 != pthread_cond_timedwait (&(this->cond), &(this->mutex), &ts));
+        } else {
+            pthread_cond_wait (&(this->cond), &(this->mutex));
+        }
+    }
+    __atomic_store_n (&(this->flg_parked), 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock (&(this->mutex));
+    return flg_timeout;
+}
+
+/** @brief the loop of the reassembly thread */
+void
+ds3_ccf_unpack_pipe_t::run (void)
+{
+    std::vector<void *> items (this->batch);
+    std::vector<ds3packet_t *> pkts (this->batch);
+    size_t num;
+    size_t depth;
+    size_t i;
+    for (;;) {
+        num = this->ring.pop (&(items[0]), items.size());
+        if (num > 0) {
+            depth = num + this->ring.size();
+            if (depth > this->stats.max_depth) {
+                __atomic_store_n (&(this->stats.max_depth), depth, __ATOMIC_RELAXED);
+            }
+            for (i = 0; i < num; i ++) {
+                pkts[i] = (ds3packet_t *)(items[i]);
+            }
+            this->engine->process_packets (&(pkts[0]), num);
+            DS3_STAT_ADD (this->stats.num_pop, num);
+            DS3_STAT_ADD (this->stats.num_batch, 1);
+            continue;
+        }
+        for (i = 0; (i < this->spins) && (this->ring.size() < 1); i ++) {
+            DS3_CPU_RELAX ();
+        }
+        if (this->ring.size() > 0) {
+            continue;
+        }
+        if (__atomic_load_n (&(this->flg_quit), __ATOMIC_ACQUIRE)) {
+            /* the segments pushed before stop() */
+            if (this->ring.size() > 0) {
+                continue;
+            }
+            break;
+        }
+        if (this->park ()) {
+            /* no segment received in the timeout, age the segments in the engine */
+            this->engine->expire ();
+        }
+    }
 }
@@ -12,12 +12,16 @@
 #include <stdint.h> // uint16_t
 #include <string.h> // memcmp
 #include <assert.h>
+#include <pthread.h>
 
 #include <iostream>
 #include <vector>
+#include <deque>
+#include <map>
 #include <algorithm>
 
 #include "ds3pktbuf.h"
+#include "ds3trace.h"
 
 /**
  * @brief The event type for state machine
@@ -45,7 +49,7 @@ public:
 #endif
 
     ds3packet_t() : pos_prev(0), pos_next(0) {}
-    virtual ~ds3packet_t() { std::cout << "Destroy " << __func__ << std::endl; } /**< the children class should re-implement this destructor to release resource correctly */
+    virtual ~ds3packet_t() { DS3TRACE (DS3TRACE_LVL_DEBUG, DS3TRE_PKT_DESTROY, (intptr_t)this, 0, 0, 0); } /**< the children class should re-implement this destructor to release resource correctly */
 
     size_t get_size() { return to_nbs(NULL,0); } /**< return the size of the packet, including the packet header, */
     size_t size() { return to_nbs(NULL,0); } /**< return the size of the packet, including the packet header, */
@@ -70,6 +74,14 @@ public:
      */
     virtual ssize_t to_nbs (uint8_t *nbsbuf, size_t szbuf) { DS3_WRONGFUNC_RETVAL(-1); }
 
+    /**
+     * @brief export the packet as a scatter-gather array without copying, including the packet header
+     * @param iov : the array to be filled
+     * @param numiov : the size of the array, 0 to get the number of the items required
+     * @return the number of the items filled(or required), >=0 on success, < 0 on error
+     */
+    virtual ssize_t to_iovec (struct iovec *iov, size_t numiov) { DS3_WRONGFUNC_RETVAL(-1); }
+
     /**
      * @brief read the buffer in network byte sequence and save it to structure, including the packet header
      * @param nbsbuf : the buffer to be read, in network byte sequence
@@ -174,22 +186,13 @@ private:
         (arg_peer) = peer = new ds3_real_type (); \
         flg_peer_is_new = true; \
     } else { \
-        peer = dynamic_cast<ds3_real_type *>(arg_peer); \
-        if (NULL == peer) { \
-            if (NULL != (arg_peer)->get_buffer()) { \
-                /* it's a base class, and it stored the content from other ns2 content */ \
-                peer = dynamic_cast<ds3_real_type *>((arg_peer)->get_buffer()); \
-            } \
-        } \
+        peer = ds3_buffer_cast_content<ds3_real_type>(arg_peer); \
         if (NULL == peer) { \
             /* create a new one, and try to append to the current arg_peer */ \
             ds3_real_type p; \
             assert (NULL != (arg_peer)); \
             (arg_peer)->insert(0, &p, 0, 0); \
-            if (NULL != (arg_peer)->get_buffer()) { \
-                /* it's a base class, and it stored the content from other ns2 content */ \
-                peer = dynamic_cast<ds3_real_type *>((arg_peer)->get_buffer()); \
-            } \
+            peer = ds3_buffer_cast_content<ds3_real_type>(arg_peer); \
         } \
     } \
     if (NULL == peer) { \
@@ -208,11 +211,17 @@ private:
         end_self = this->size(); \
     }
 
+#define DS3_SEG_HOLD_NONE    0 /**< the segment held by the frame views is not released by the unpack engine */
+#define DS3_SEG_HOLD_RECYCLE 1 /**< the segment is recycled after the frame views are released */
+#define DS3_SEG_HOLD_DROP    2 /**< the segment is dropped after the frame views are released */
+
 /**
  * @brief The packet class for DS3 CCF segment
  */
 class ds3packet_ccf_t : public ds3packet_t {
 public:
+    ds3packet_ccf_t () : numhold(0), relhold(DS3_SEG_HOLD_NONE) {}
+
     /**
      * @brief set the CCF segment header
      * @param chdr : the CCF header structure to be saved
@@ -220,25 +229,70 @@ public:
      */
     int set_header (ds3hdr_ccf_t * chdr) { if (NULL == chdr) {return -1;} memmove (&(this->ccfhdr), chdr, sizeof (*chdr)); return 0; }
     ds3hdr_ccf_t & get_header (void) { return ccfhdr; } /**< get a reference of the CCF segment header */
+    void patch_header (uint16_t request, uint16_t sequence, uint8_t sc);
 
 #if CCFDEBUG
     virtual void dump (void);
     virtual uint8_t & at(size_t i);
 #endif
 
-    virtual ~ds3packet_ccf_t() { std::cout << "Destroy " << __func__ << std::endl; memset (&(this->ccfhdr), 0, sizeof(this->ccfhdr)); }
+    virtual ~ds3packet_ccf_t() { memset (&(this->ccfhdr), 0, sizeof(this->ccfhdr)); }
 
     virtual ssize_t to_nbs (uint8_t *nbsbuf, size_t szbuf);
     virtual ssize_t from_nbs (uint8_t *nbsbuf, size_t szbuf);
+    ssize_t from_nbs_ref (uint8_t *nbsbuf, size_t szbuf, ds3_packet_buffer_nbs_t * refcnt);
+    virtual ssize_t to_iovec (struct iovec *iov, size_t numiov);
+    ssize_t from_iovec (const struct iovec *iov, size_t numiov, ds3_packet_buffer_nbs_t * refcnt);
 
     //virtual ds3_packet_buffer_t * insert_to (size_t pos_peer, ds3_packet_buffer_t *peer, size_t begin_self, size_t end_self);
 
+    void hold (void) { this->numhold ++; } /**< a frame view refers to the content */
+    size_t unhold (void) { assert (this->numhold > 0); return (-- this->numhold); } /**< a frame view is released, return the number of the views left */
+    size_t get_numhold (void) const { return this->numhold; } /**< the number of the frame views refer to the content */
+    int get_relhold (void) const { return this->relhold; } /**< DS3_SEG_HOLD_xxx, how the segment is released after the frame views */
+    void set_relhold (int r) { this->relhold = r; }
+
 private:
     ssize_t hdr_to_nbs (uint8_t *nbsbuf, size_t szbuf) { return ds3hdr_ccf_to_nbs (nbsbuf, szbuf, &(this->ccfhdr)); }
+    int set_content_ref (ds3_packet_buffer_nbs_t * refcnt, uint8_t *nbsbuf, size_t szbuf);
+    size_t numhold; /**< the number of the frame views refer to the content */
+    int relhold; /**< DS3_SEG_HOLD_xxx */
     ds3hdr_ccf_t ccfhdr; /**< the CCF segment header */
-#if CCFDEBUG
-    uint8_t ccfhdrbuf[8]; /**< buffer for CCF header */
-#endif
+    uint8_t ccfhdrbuf[DS3HDR_CCF_SIZE]; /**< buffer for CCF header, in network byte sequence, used by at() and to_iovec() */
+};
+
+/**
+ * @brief the pool of the CCF segments
+ *
+ * The segments put back are reset and kept with their content storage, so get() doesn't
+ * allocate a new segment until the free list is empty. The free list is bounded by the capacity,
+ * the segments exceed the capacity are deleted. The pool is not locked, it should be used by the
+ * engines of the same thread.
+ */
+class ds3_ccf_segpool_t {
+public:
+    ds3_ccf_segpool_t (size_t cap = 256) : capacity(cap), num_hit(0), num_miss(0) {}
+    ~ds3_ccf_segpool_t ();
+
+    ds3packet_ccf_t * get (void);
+    void put (ds3packet_ccf_t * p);
+
+    void set_capacity (size_t cap);
+    void reserve (size_t num);
+    size_t get_capacity (void) const { return this->capacity; } /**< the max number of the free segments */
+    size_t size (void) const { return this->freelst.size(); } /**< the number of the free segments */
+    size_t get_hits (void) const { return this->num_hit; } /**< the number of get() served by the free list */
+    size_t get_misses (void) const { return this->num_miss; } /**< the number of get() which allocated a new segment */
+
+private:
+    /* the segments are owned by the pool, don't copy the list */
+    ds3_ccf_segpool_t (const ds3_ccf_segpool_t &);
+    ds3_ccf_segpool_t & operator = (const ds3_ccf_segpool_t &);
+
+    std::vector<ds3packet_ccf_t *> freelst; /**< the free segments */
+    size_t capacity; /**< the max size of freelst */
+    size_t num_hit; /**< the counter of pool hits */
+    size_t num_miss; /**< the counter of pool misses */
 };
 
 /**
@@ -265,22 +319,163 @@ private:
 /** compare the time of the grants, for sorting the grant by time */
 inline bool operator < (const ds3_grant_t & lhs, const ds3_grant_t & rhs) { return (lhs.get_time() < rhs.get_time()); }
 
+/**
+ * @brief the queue of the grants, ordered by the time
+ *
+ * The grants are kept in a min-heap, so the next grant is accessed in O(1), and is removed or
+ * inserted in O(log n). The grants with the same time are served in the order they're added.
+ */
+class ds3_grant_queue_t {
+public:
+    ds3_grant_queue_t() : numadded(0) {}
+
+    void push (const ds3_grant_t & grant);
+    void push (const std::vector<ds3_grant_t> & grants);
+    void pop (void);
+    size_t expire (double tm);
+
+    const ds3_grant_t & top (void) const { assert (this->heap.size() > 0); return this->heap.front().grant; } /**< the grant with the earliest time */
+    bool empty (void) const { return this->heap.empty(); } /**< if there's no grant */
+    size_t size (void) const { return this->heap.size(); } /**< the number of the grants */
+
+private:
+    /** @brief the grant in the heap */
+    typedef struct _item_t {
+        ds3_grant_t grant; /**< the grant */
+        uint64_t order; /**< the order of the grant added, for the grants with the same time */
+        /** the heap of std is a max-heap, the item "less" than the other is served later */
+        bool operator < (const struct _item_t & rhs) const {
+            if (this->grant.get_time() != rhs.grant.get_time()) {
+                return (this->grant.get_time() > rhs.grant.get_time());
+            }
+            return (this->order > rhs.order);
+        }
+    } item_t;
+
+    std::vector<item_t> heap; /**< the heap of the grants */
+    uint64_t numadded; /**< the number of the grants added */
+};
+
 /**
  * @brief The base class for CCF pack/unpack algorithms
  */
 class ds3_ccf_base_t {
 public:
     virtual int process_packet (ds3packet_t *p) = 0; /**< add a new packet and process */
+    virtual int process_packets (ds3packet_t ** pkts, size_t num);
 
-    ds3_ccf_base_t(size_t pbmul = 0) : multiplier_piggyback(pbmul) {}
+    ds3_ccf_base_t(size_t pbmul = 0) : multiplier_piggyback(pbmul), segpool(&segpool_own) {}
+    virtual ~ds3_ccf_base_t() {}
     void set_pbmultiplier(size_t pbmul) { multiplier_piggyback = pbmul; } /**< set the Multiplier */
     size_t get_pbmultiplier(void) const { return multiplier_piggyback; } /**< get the Multiplier */
 
+    ds3_ccf_segpool_t & get_segpool (void) { return *(this->segpool); } /**< get the segment pool used by this engine */
+    /**
+     * @brief use the segment pool of the peer engine
+     * @param peer : [in] the engine which owns the pool, it should run in the same thread and live longer than this
+     *
+     * so the segments recycled by the unpack engine are reused by the pack engine
+     */
+    void share_segpool (ds3_ccf_base_t & peer) { this->segpool = peer.segpool; }
+
 protected:
     virtual void recycle_packet (ds3packet_t *p) = 0; /**< a processed packet need to be deleted */
     virtual void drop_packet (ds3packet_t *p) = 0; /**< a un-processed packet need to be drop (caused by corruption?) */
+    /**
+     * @brief return the CCF segment to the pool, called from recycle_packet()/drop_packet() for the segments owned
+     * @param p : [in] the segment; the unpack engine passes only the CCF segments, so the child class converts it by static_cast
+     */
+    void recycle_segment (ds3packet_ccf_t *p) { this->segpool->put (p); }
 
     size_t multiplier_piggyback; /**< the Multiplier to Number of Bytes Requested (DOCSIS 3.1 spec Annex C) */
+    ds3_ccf_segpool_t * segpool; /**< the pool of the CCF segments */
+
+private:
+    ds3_ccf_segpool_t segpool_own; /**< the pool owned by this engine */
+};
+
+/**
+ * @brief the worker threads which call a function for each item of a batch
+ *
+ * The calling thread also works on the batch, and run() returns after all of the items are done.
+ * Without the worker threads, the items are processed by the calling thread in order.
+ */
+class ds3_parallel_t {
+public:
+    ds3_parallel_t ();
+    ~ds3_parallel_t ();
+
+    int start (size_t numthreads);
+    void stop (void);
+    size_t size (void) const { return this->threads.size(); } /**< the number of the worker threads */
+    void run (void (*func)(void *arg, size_t idx), void *arg, size_t num);
+
+private:
+    static void * thread_main (void *arg);
+    void run_items (void);
+
+    /* the threads can't be copied */
+    ds3_parallel_t (const ds3_parallel_t &);
+    ds3_parallel_t & operator = (const ds3_parallel_t &);
+
+    std::vector<pthread_t> threads; /**< the worker threads */
+    pthread_mutex_t mutex; /**< protect the fields below */
+    pthread_cond_t cond_start; /**< signal the worker threads a new batch */
+    pthread_cond_t cond_done; /**< signal the calling thread the workers are done */
+    void (*func)(void *arg, size_t idx); /**< the function of the batch */
+    void * arg; /**< the argument of the function */
+    size_t num; /**< the number of the items of the batch */
+    size_t next; /**< the next item to be processed, increased atomically */
+    size_t numbusy; /**< the number of the worker threads working on the batch */
+    uint64_t round; /**< the sequence # of the batch */
+    bool flg_quit; /**< the worker threads should exit */
+};
+
+/** @brief a range of a MAC packet to be copied to a segment */
+typedef struct _ds3_pack_piece_t {
+    ds3packet_t * pkt; /**< the MAC packet */
+    size_t begin; /**< the start position in the MAC packet */
+    size_t end; /**< the end position in the MAC packet */
+} ds3_pack_piece_t;
+
+/** @brief the segment planned for a grant in the bonded pack */
+typedef struct _ds3_pack_plan_t {
+    ds3_grant_t grant; /**< the grant */
+    ds3packet_ccf_t * ccfpkt; /**< the segment, with the header filled */
+    size_t idxpiece; /**< the first piece of the content */
+    size_t numpiece; /**< the number of the pieces */
+    bool flg_err; /**< failed to copy the content */
+} ds3_pack_plan_t;
+
+/** @brief a MAC packet waiting in the pack engine */
+typedef struct _ds3_pack_item_t {
+    ds3packet_t * pkt; /**< the MAC packet */
+    size_t size; /**< the byte size of the packet including the header, cached when it's queued */
+} ds3_pack_item_t;
+
+/**
+ * @brief build the segments of the grants, shared by the serial, the bonded and the multi-flow pack
+ *
+ * fill() takes the bytes of the MAC packets in the front of a queue for a grant and sets the PFI and the
+ * MAC offset, seal() sets the rest of the CCF header. send() returns the segment to be sent in the grant
+ * order; if USE_DS3_LATESNDPIG, the last segment is held until finish(), which patches the piggyback request.
+ */
+class ds3_pack_segment_t {
+public:
+    ds3_pack_segment_t () : szmax(0), szcur(0), held(NULL) { memset (&(this->ccfhdr), 0, sizeof(this->ccfhdr)); }
+
+    template <class Q, class S> size_t fill (size_t szgrant, Q & queue, S & sink);
+    void seal (uint16_t sequence, uint8_t sc, size_t & piggyback_inc, size_t pbmul);
+    ds3hdr_ccf_t & get_header (void) { return this->ccfhdr; } /**< the CCF header of the segment */
+    ds3packet_ccf_t * send (ds3packet_ccf_t * ccfpkt, const ds3_grant_t & grant, ds3_grant_t & retgrant);
+    ds3packet_ccf_t * finish (size_t & piggyback_inc, size_t pbmul, ds3_grant_t & retgrant);
+
+private:
+    size_t szmax; /**< the size of the grant */
+    size_t szcur; /**< the bytes filled, including the CCF header */
+    ds3hdr_ccf_t ccfhdr; /**< the CCF header of the segment */
+    ds3packet_ccf_t * held; /**< the last segment held to carry the piggyback request */
+    ds3_grant_t grantheld; /**< the grant of the segment held */
 };
 
 /**
@@ -289,9 +484,14 @@ protected:
 class ds3_ccf_pack_t : public ds3_ccf_base_t {
 public:
     virtual int process_packet (ds3packet_t *p);
+    virtual int process_packets (ds3packet_t ** pkts, size_t num);
 
-    ds3_ccf_pack_t (size_t pbmul = 0) : ds3_ccf_base_t(pbmul), sequence(0), piggyback_inc(0) {}
+    ds3_ccf_pack_t (size_t pbmul = 0) : ds3_ccf_base_t(pbmul), sequence(0), szpktlst(0), piggyback_inc(0), scid(0), num_cancel(0) {}
     void add_piggyback (size_t piggyback) { this->piggyback_inc += piggyback; }
+    size_t get_pktlst_bytes(void) const { return this->szpktlst; } /**< the bytes of the MAC packets not packed yet */
+    int set_workers (size_t num);
+    size_t get_workers (void) const { return this->workers.size(); } /**< the number of the worker threads of the bonded pack */
+    size_t get_num_cancels (void) const { return this->num_cancel; } /**< the number of the times the bonded pack cancelled the segments failed to copy the content */
     int add_grants (std::vector<ds3_grant_t> & grants);
     int add_grant (ds3_grant_t & grants);
     void set_sc (uint8_t sc) { this->scid = sc;} /**< set the SID Cluster ID */
@@ -314,27 +514,330 @@ private:
     uint16_t get_next_sequence (void) { uint16_t ret = this->sequence; this->sequence ++; this->sequence &= 0x1FFF; return ret; } /**< get next sequence number and increase the # for next request */
     uint16_t sequence; /**< a 13-bit length counter */
 
-    std::vector<ds3packet_t *> pktlst; /**< the list of all MAC packets will be packed to CCF segments */
-    std::vector<ds3_grant_t>   grantlst; /**< the list of all grants */
+    void push_packet (ds3packet_t *p);
+    int process_packet_bonded (void);
+    static void fill_segment (void *arg, size_t idx); /**< copy the content of the planned segment idx */
+    void cancel_plans (size_t idxplan);
+
+    friend class ds3_pack_queue_t;
+    std::deque<ds3_pack_item_t> pktlst; /**< the queue of all MAC packets will be packed to CCF segments */
+    size_t szpktlst; /**< the bytes in pktlst not packed yet */
+    ds3_grant_queue_t grantlst; /**< the grants not used yet */
     size_t piggyback_inc; /**< the piggyback request value */
     uint8_t scid; /**< SID Cluster ID */
+
+    ds3_parallel_t workers; /**< the worker threads of the bonded pack */
+    std::vector<ds3_pack_plan_t> plans; /**< the segments planned in the bonded pack */
+    std::vector<ds3_pack_piece_t> pieces; /**< the contents of the planned segments */
+    std::vector<ds3packet_t *> donelst; /**< the MAC packets to be recycled after the contents are copied */
+    size_t num_cancel; /**< the number of the times the bonded pack cancelled the segments */
+};
+
+#define DS3_PACK_NIL 0xFFFFFFFF /**< the end of the lists in the node tables of the pack manager */
+
+/** @brief the state of a service flow in the pack manager */
+typedef struct _ds3_pack_flow_t {
+    uint32_t pkthead;   /**< the first MAC packet queued, the index in the packet node table */
+    uint32_t pkttail;   /**< the last MAC packet queued */
+    uint32_t granthead; /**< the earliest grant, the index in the grant node table */
+    uint32_t granttail; /**< the latest grant */
+    uint32_t piggyback_inc; /**< the piggyback request value */
+    uint16_t sequence;  /**< the 13-bit sequence # of the next segment */
+    uint8_t sc;         /**< SID Cluster ID */
+    uint8_t flg_pending; /**< the flow is in the pending list */
+    size_t szpktlst;    /**< the bytes of the MAC packets not packed yet */
+} ds3_pack_flow_t;
+
+/** @brief a MAC packet queued in a flow of the pack manager */
+typedef struct _ds3_pack_pktnode_t {
+    ds3_pack_item_t item; /**< the MAC packet */
+    uint32_t next; /**< the next node of the flow, or the next free node */
+} ds3_pack_pktnode_t;
+
+/** @brief a grant queued in a flow of the pack manager */
+typedef struct _ds3_pack_grantnode_t {
+    ds3_grant_t grant; /**< the grant */
+    uint32_t next; /**< the next node of the flow, or the next free node */
+} ds3_pack_grantnode_t;
+
+/**
+ * @brief pack the MAC packets of many service flows
+ *
+ * The state of each flow is one entry of a table indexed by the flow id, the MAC packets and the grants
+ * of all of the flows are linked in the two shared node tables. So adding a packet or a grant to a flow
+ * is O(1) (the grants of a flow are expected to be added in the time order), and process() packs the
+ * flows which have new grants or new packets for the grants in the same way as ds3_ccf_pack_t.
+ */
+class ds3_ccf_pack_mgr_t {
+public:
+    ds3_ccf_pack_mgr_t (size_t numflows = 0, size_t pbmul = 0);
+    virtual ~ds3_ccf_pack_mgr_t ();
+
+    int set_num_flows (size_t numflows);
+    size_t get_num_flows (void) const { return this->flows.size(); } /**< the number of the flows */
+    void set_pbmultiplier(size_t pbmul) { multiplier_piggyback = pbmul; } /**< set the Multiplier */
+    size_t get_pbmultiplier(void) const { return multiplier_piggyback; } /**< get the Multiplier */
+    ds3_ccf_segpool_t & get_segpool (void) { return *(this->segpool); } /**< get the segment pool used by the manager */
+    void share_segpool (ds3_ccf_base_t & peer) { this->segpool = &(peer.get_segpool()); } /**< use the segment pool of the peer engine, see ds3_ccf_base_t::share_segpool() */
+
+    int set_sc (size_t flow, uint8_t sc);
+    int add_packet (size_t flow, ds3packet_t *p);
+    int add_grant (size_t flow, const ds3_grant_t & grant);
+    int add_piggyback (size_t flow, size_t piggyback);
+    size_t get_pktlst_bytes (size_t flow) const { assert (flow < this->flows.size()); return this->flows[flow].szpktlst; } /**< the bytes of the MAC packets of the flow not packed yet */
+    size_t get_pending (void) const { return this->pendlst.size(); } /**< the number of the flows to be serviced by process() */
+    int process (void);
+
+protected:
+    virtual void recycle_packet (ds3packet_t *p) = 0; /**< a processed packet need to be deleted */
+    /**
+     * @brief start a timer for sending packet once timeout
+     * @param flow : the flow id of the segment
+     * @param abs_time : the abstruct time that the event should fire
+     * @param evt : the event fired when timeout
+     * @param p : the packet that should be passed in for processing event evt
+     * @param channel_id : the channel id that the packet be transfered
+     * @return 0 on success, < 0 on error
+     */
+    virtual int start_sndpkt_timer (size_t flow, double abs_time, ds3event_t evt, ds3packet_t * p, size_t channel_id) = 0;
+    virtual double current_time (void) = 0; /**< get the current time */
+
+private:
+    void set_pending (size_t flow);
+    int process_flow (size_t flow);
+
+    /* the flows hold the indexes of the node tables */
+    ds3_ccf_pack_mgr_t (const ds3_ccf_pack_mgr_t &);
+    ds3_ccf_pack_mgr_t & operator = (const ds3_ccf_pack_mgr_t &);
+
+    friend class ds3_pack_flowq_t;
+    std::vector<ds3_pack_flow_t> flows; /**< the flow table, indexed by the flow id */
+    std::vector<ds3_pack_pktnode_t> pktnodes; /**< the MAC packets of all of the flows */
+    std::vector<ds3_pack_grantnode_t> grantnodes; /**< the grants of all of the flows */
+    uint32_t pktfree; /**< the free list of pktnodes */
+    uint32_t grantfree; /**< the free list of grantnodes */
+    std::vector<uint32_t> pendlst; /**< the flows to be serviced by process() */
+    size_t multiplier_piggyback; /**< the Multiplier to Number of Bytes Requested */
+    ds3_ccf_segpool_t * segpool; /**< the pool of the CCF segments */
+    ds3_ccf_segpool_t segpool_own; /**< the pool owned by the manager */
+};
+
+#define DS3_CCF_SEQ_NUM  8192 /**< the number of the 13-bit sequence numbers of the segments */
+#define DS3_CCF_SEQ_MASK 0x1FFF /**< the mask of the sequence number */
+
+#define DS3_CCF_PAGE_SLOTS 64 /**< the number of the slots of a page of the reorder ring, the slots of a word of the bitmap */
+
+/** @brief a page of the slots of the reorder ring */
+typedef struct _ds3_reorder_page_t {
+    ds3packet_ccf_t * slots[DS3_CCF_PAGE_SLOTS]; /**< the segments */
+    double tmexpire[DS3_CCF_PAGE_SLOTS]; /**< the time the segment expires, see ds3_ccf_unpack_t::set_timeout() */
+} ds3_reorder_page_t;
+
+/**
+ * @brief the segments received, in the slots indexed by the sequence numbers
+ *
+ * A bitmap marks the slots used, so put()/remove() are O(1) and the continual segments are found
+ * by scanning the bitmap a word (64 slots) at a time. The slots of a word are allocated as a page
+ * when the first segment is put to them, and the page is released when its last segment is removed
+ * (one page is kept for the next one), so the segments received in order use one page.
+ * An empty ring is about 2 KB, and each page used is 1 KB.
+ */
+class ds3_ccf_reorder_t {
+public:
+    ds3_ccf_reorder_t () : numseg(0), numpage(0), spare(NULL) { memset (this->pages, 0, sizeof(this->pages)); memset (this->bitmap, 0, sizeof(this->bitmap)); }
+    ~ds3_ccf_reorder_t ();
+
+    ds3packet_ccf_t * put (ds3packet_ccf_t * p);
+    ds3packet_ccf_t * remove (size_t seq);
+    ds3packet_ccf_t * get (size_t seq) const { seq &= DS3_CCF_SEQ_MASK; ds3_reorder_page_t * pg = this->pages[seq / DS3_CCF_PAGE_SLOTS]; return (NULL == pg) ? NULL : pg->slots[seq % DS3_CCF_PAGE_SLOTS]; } /**< the segment of the sequence #, NULL if not received */
+    bool test (size_t seq) const { seq &= DS3_CCF_SEQ_MASK; return (0 != (this->bitmap[seq >> 6] & ((uint64_t)1 << (seq & 63)))); } /**< if the segment of the sequence # is received */
+    size_t size (void) const { return this->numseg; } /**< the number of the segments */
+    size_t get_num_pages (void) const { return this->numpage; } /**< the number of the pages used */
+    size_t find_run (size_t seq, size_t & retbegin) const;
+    void set_expire (size_t seq, double tm) { assert (this->test (seq)); seq &= DS3_CCF_SEQ_MASK; this->pages[seq / DS3_CCF_PAGE_SLOTS]->tmexpire[seq % DS3_CCF_PAGE_SLOTS] = tm; } /**< set the expire time of the segment of the sequence # */
+    double get_expire (size_t seq) const { assert (this->test (seq)); seq &= DS3_CCF_SEQ_MASK; return this->pages[seq / DS3_CCF_PAGE_SLOTS]->tmexpire[seq % DS3_CCF_PAGE_SLOTS]; } /**< the expire time of the segment of the sequence # */
+
+private:
+    size_t scan_up (size_t start, size_t maxlen) const;
+    size_t scan_down (size_t start, size_t maxlen) const;
+
+    /* the slots hold the pointers of the segments */
+    ds3_ccf_reorder_t (const ds3_ccf_reorder_t &);
+    ds3_ccf_reorder_t & operator = (const ds3_ccf_reorder_t &);
+
+    ds3_reorder_page_t * pages[DS3_CCF_SEQ_NUM / DS3_CCF_PAGE_SLOTS]; /**< the pages of the slots indexed by the sequence #, NULL if the slots are empty */
+    uint64_t bitmap[DS3_CCF_SEQ_NUM / 64]; /**< the bit of the slot is set if the slot has a segment */
+    size_t numseg; /**< the number of the segments in the slots */
+    size_t numpage; /**< the number of the pages used */
+    ds3_reorder_page_t * spare; /**< a page released, kept for the next one */
 };
 
+#define DS3_MAC_HDR_MAX (6 + 255) /**< the max bytes of a MAC header split across the segments copied to get the size of the MAC packet, the DOCSIS MAC header with the largest extended header */
+
+/** @brief a piece of a MAC packet in a segment */
+typedef struct _ds3_frame_piece_t {
+    ds3packet_ccf_t * seg; /**< the segment */
+    size_t off; /**< the start position in the content of the segment */
+    size_t sz;  /**< the size of the piece */
+} ds3_frame_piece_t;
+
+/**
+ * @brief the incremental delineator of the MAC packet spanning the segments
+ *
+ * The segments are fed in sequence order. The size of the MAC packet is got once from the MAC header,
+ * in place if the header is in one segment, or from the bytes copied to a small buffer if the header is split,
+ * until the header is complete; then the rest bytes are counted down. If no header is found in the first
+ * DS3_MAC_HDR_MAX bytes, the MAC packet is corrupted. The bytes of the MAC packet are
+ * recorded as the pieces of the segments, they're copied only by to_buffer().
+ */
+class ds3_mac_delin_t {
+public:
+    ds3_mac_delin_t () : seqhead(0), offhead(0), numseg(0), szframe(-1), szseen(0) {}
+
+    void start (size_t seq, size_t off);
+    void reset (void);
+    size_t feed (ds3packet_ccf_t * seg, size_t off, size_t len);
+    ssize_t to_buffer (ds3_packet_buffer_t & retbuf);
+    void take_pieces (std::vector<ds3_frame_piece_t> & retlst) { retlst.swap (this->pieces); } /**< move the pieces to retlst, the delineator has to be reset after it */
+
+    bool is_pending (size_t seq, size_t off) const { return (this->numseg > 0) && (this->seqhead == (seq & DS3_CCF_SEQ_MASK)) && (this->offhead == off); } /**< if the MAC packet started at the position of the segment is being delineated */
+    bool has_segment (size_t seq) const { return (this->numseg > 0) && (((seq - this->seqhead) & DS3_CCF_SEQ_MASK) < this->numseg); } /**< if the segment was fed */
+    bool is_done (void) const { return (this->szframe > 0) && (this->szseen >= (size_t)(this->szframe)); } /**< if all of the bytes of the MAC packet were fed */
+    bool is_corrupted (void) const { return (this->szframe <= 0) && (this->szseen >= DS3_MAC_HDR_MAX); } /**< if the MAC header is not found in the max bytes of a header */
+    ssize_t get_size (void) const { return this->szframe; } /**< the size of the MAC packet, < 0 if the MAC header is not complete */
+    size_t get_seen (void) const { return this->szseen; } /**< the bytes of the MAC packet fed */
+    size_t get_numseg (void) const { return this->numseg; } /**< the number of the segments fed */
+    const std::vector<ds3_frame_piece_t> & get_pieces (void) const { return this->pieces; } /**< the pieces of the MAC packet */
+
+private:
+    /* the pieces refer to the segments of the owner */
+    ds3_mac_delin_t (const ds3_mac_delin_t &);
+    ds3_mac_delin_t & operator = (const ds3_mac_delin_t &);
+
+    size_t seqhead; /**< the sequence # of the segment of the MAC header */
+    size_t offhead; /**< the position of the MAC header in the segment */
+    size_t numseg; /**< the number of the segments fed, 0 if not started */
+    ssize_t szframe; /**< the size of the MAC packet, < 0 if unknown */
+    size_t szseen; /**< the bytes of the MAC packet fed */
+    ds3_packet_buffer_t hdrpart; /**< the bytes of the MAC header split across the segments, all of the bytes fed until the size is known */
+    std::vector<ds3_frame_piece_t> pieces; /**< the pieces of the MAC packet */
+};
+
+class ds3_ccf_unpack_t;
+
+/**
+ * @brief the read-only view of a MAC packet unpacked, without copying the bytes out of the segments
+ *
+ * The segments of the pieces are held by the unpack engine until the view is released by
+ * ds3_ccf_unpack_t::release_frame(), in the thread of the engine.
+ */
+class ds3_frame_view_t {
+public:
+    ds3_frame_view_t () : szframe(0) {}
+
+    size_t size (void) const { return this->szframe; } /**< the size of the MAC packet */
+    size_t num_pieces (void) const { return this->pieces.size(); } /**< the number of the pieces */
+    const ds3_frame_piece_t & piece (size_t i) const { return this->pieces[i]; } /**< the piece i, in the order of the bytes */
+    ssize_t peek (size_t pos, uint8_t *nbsbuf, size_t szbuf);
+    ssize_t to_iovec (struct iovec *iov, size_t numiov);
+    ssize_t to_buffer (ds3_packet_buffer_t & retbuf);
+
+private:
+    friend class ds3_ccf_unpack_t;
+    /* the view is owned by the unpack engine */
+    ds3_frame_view_t (const ds3_frame_view_t &);
+    ds3_frame_view_t & operator = (const ds3_frame_view_t &);
+
+    std::vector<ds3_frame_piece_t> pieces; /**< the pieces of the MAC packet */
+    size_t szframe; /**< the size of the MAC packet */
+};
+
+/** @brief the timer of the timing wheel */
+typedef struct _ds3_timer_entry_t {
+    size_t id; /**< the id of the object */
+    double tmexpire; /**< the time the timer expires */
+} ds3_timer_entry_t;
+
+/**
+ * @brief the hashed timing wheel
+ *
+ * The timers are hashed to the slots by the tick of their expire time, so add() is O(1), and expire()
+ * only checks the slots of the ticks passed since last call. The timers can't be cancelled, the owner
+ * checks if the object of the timer expired is still valid.
+ */
+class ds3_timer_wheel_t {
+public:
+    ds3_timer_wheel_t (size_t numslots = 256, double tick = 0.001) : curtick(0), numtimer(0) { this->reset (numslots, tick); }
+
+    void reset (size_t numslots, double tick);
+    void add (size_t id, double tmexpire);
+    size_t expire (double tm, std::vector<ds3_timer_entry_t> & retlst);
+    size_t size (void) const { return this->numtimer; } /**< the number of the timers */
+    double get_tick (void) const { return this->tick; } /**< the time of each slot */
+
+private:
+    uint64_t tick_of (double tm) const { return (tm > 0) ? (uint64_t)(tm / this->tick) : 0; } /**< the tick of the time */
+
+    std::vector<std::vector<ds3_timer_entry_t> > slots; /**< the timers, indexed by the tick of the expire time */
+    double tick; /**< the time of each slot */
+    uint64_t curtick; /**< the first tick not checked by expire() */
+    size_t numtimer; /**< the number of the timers in the slots */
+};
+
+#define DS3_UNPACK_BATCH_FRAMES 256 /**< the max number of the MAC packets signified together by process_packets() */
+
 /**
  * @brief The class for CCF unpack algorithms
  */
 class ds3_ccf_unpack_t : public ds3_ccf_base_t {
 public:
-    ds3_ccf_unpack_t (size_t pbmul = 0) : ds3_ccf_base_t(pbmul) {}
+    ds3_ccf_unpack_t (size_t pbmul = 0) : ds3_ccf_base_t(pbmul), timeout(0), num_timeout(0), num_segdrop(0), sz_segdrop(0), flg_batch(false), numframes(0), flg_view(false), numviews(0), numheld(0) {}
+    ~ds3_ccf_unpack_t ();
     virtual int process_packet (ds3packet_t *p);
+    virtual int process_packets (ds3packet_t ** pkts, size_t num);
+    size_t get_num_segments (void) const { return this->reorder.size(); } /**< the number of the segments waiting for the other segments */
+    bool is_idle (void) const { return (0 == this->reorder.size()) && (0 == this->numviews); } /**< if no segment is waiting and no frame view is held, the engine can be deleted */
+    size_t clear (void);
+
+    void set_timeout (double tm, double tick = 0);
+    double get_timeout (void) const { return this->timeout; } /**< the reassembly timeout, 0 if disabled */
+    size_t expire (void);
+    size_t get_num_timeouts (void) const { return this->num_timeout; } /**< the number of the reassembly timeouts */
+    size_t get_num_dropped (void) const { return this->num_segdrop; } /**< the number of the segments dropped by the timeouts */
+    size_t get_bytes_dropped (void) const { return this->sz_segdrop; } /**< the bytes not unpacked in the segments dropped by the timeouts */
+
+    void set_frame_view (bool flg) { this->flg_view = flg; } /**< signify the MAC packets by signify_frame() instead of copying them */
+    bool get_frame_view (void) const { return this->flg_view; } /**< if the MAC packets are signified by signify_frame() */
+    void release_frame (ds3_frame_view_t * view);
+    size_t get_num_views (void) const { return this->numviews; } /**< the number of the frame views not released */
+    size_t get_num_held (void) const { return this->numheld; } /**< the number of the segments processed and held by the frame views */
 
 protected:
+    /**
+     * @brief get the current time, the same time source of the pack engine
+     * @return the current time in seconds
+     */
+    virtual double current_time (void) = 0;
     /**
      * @brief signify that a new MAC packet was extracted from the segments received
      * @param macbuffer : the MAC packet raw data
      * @return 0 on success, < 0 on error
      */
     virtual int signify_packet (ds3_packet_buffer_t & macbuffer) = 0;
+    /**
+     * @brief signify the MAC packets extracted by process_packets(), the default calls signify_packet() for each
+     * @param macbuffers : the MAC packets raw data, the buffers are reused after the call
+     * @param num : the number of the MAC packets
+     * @return 0 on success, < 0 on error
+     */
+    virtual int signify_packets (ds3_packet_buffer_t ** macbuffers, size_t num);
+    /**
+     * @brief signify a MAC packet extracted as a view of the segments, if set_frame_view() is enabled;
+     *   the default copies the bytes and signifies them by signify_packet()
+     * @param view : the MAC packet, the owner releases it by release_frame() after it's consumed
+     * @return 0 on success, < 0 on error
+     */
+    virtual int signify_frame (ds3_frame_view_t * view);
     /**
      * @brief signify that a piggyback request was extracted from the segments received
      * @param sc : SID Cluster ID
@@ -344,7 +847,252 @@ protected:
     virtual int signify_piggyback (int sc, size_t request) = 0;
 
 private:
-    std::vector<ds3packet_ccf_t *> pkglst;
+    ssize_t put_segment (ds3packet_t *p);
+    void release_segment (size_t seq, bool flg_drop);
+    void free_segment (ds3packet_ccf_t * p, bool flg_drop);
+    void process_run (size_t seq);
+    void flush_run (size_t seq);
+    int deliver_packet (ds3_packet_buffer_t & macbuffer);
+    int deliver_frame (void);
+    int deliver_view (ds3packet_ccf_t * seg, size_t off, size_t sz);
+    ds3_frame_view_t * new_view (void);
+    int flush_packets (void);
+
+    ds3_ccf_reorder_t reorder; /**< the segments received and not processed */
+    ds3_mac_delin_t delin; /**< the MAC packet being delineated, kept for the segments received later */
+    ds3_packet_buffer_t hdrbuf; /**< the MAC packet reassembled, kept with its storage for the next one */
+    double timeout; /**< the reassembly timeout, 0 if disabled */
+    ds3_timer_wheel_t timers; /**< the reassembly timers of the segments */
+    std::vector<ds3_timer_entry_t> expired; /**< the timers expired, kept with its storage */
+    size_t num_timeout; /**< the number of the reassembly timeouts */
+    size_t num_segdrop; /**< the number of the segments dropped by the timeouts */
+    size_t sz_segdrop; /**< the bytes not unpacked in the segments dropped by the timeouts */
+    bool flg_batch; /**< the MAC packets are signified at the end of process_packets() */
+    std::vector<size_t> seqlst; /**< the sequence # of the segments of the batch */
+    std::vector<ds3_packet_buffer_t *> frames; /**< the MAC packets of the batch, kept with their storage */
+    size_t numframes; /**< the number of the MAC packets in frames */
+    bool flg_view; /**< the MAC packets are signified by signify_frame() */
+    std::vector<ds3_frame_view_t *> viewall; /**< all of the frame views allocated */
+    std::vector<ds3_frame_view_t *> viewfree; /**< the frame views released, kept with their storage */
+    size_t numviews; /**< the number of the frame views not released */
+    size_t numheld; /**< the number of the segments processed and held by the frame views */
+};
+
+/**
+ * @brief the hash function of the unpack service to select the shard of a flow
+ * @param flow : [in] the CM/service flow id
+ * @param sc : [in] SID Cluster ID
+ * @return the hash value, the shard is the value modulo the number of the shards
+ */
+typedef size_t (* ds3_unpack_hash_t) (uint32_t flow, uint8_t sc);
+size_t ds3_unpack_hash_default (uint32_t flow, uint8_t sc);
+
+class ds3_ccf_unpack_svc_t;
+
+/**
+ * @brief the unpack context of a flow in the unpack service, the events are passed to the service
+ *
+ * A context is about 2.5 KB, mostly the page table and the bitmap of the reorder ring, plus 1 KB for each page
+ * of 64 slots in use: one page for the segments received in order, more only for the segments out of order.
+ * The expire times of the segments are kept in the pages, the reassembly timeout adds only the timing wheel.
+ */
+class ds3_ccf_unpack_ctx_t : public ds3_ccf_unpack_t {
+public:
+    ds3_ccf_unpack_ctx_t (ds3_ccf_unpack_svc_t * svc1, size_t shard1, uint32_t flow1, uint8_t sc1)
+        : svc(svc1), shard(shard1), flow(flow1), sc(sc1) {}
+    size_t get_shard (void) const { return this->shard; } /**< the shard of the context */
+
+protected:
+    virtual void recycle_packet (ds3packet_t *p);
+    virtual void drop_packet (ds3packet_t *p);
+    virtual int signify_packet (ds3_packet_buffer_t & macbuffer);
+    virtual int signify_piggyback (int sc, size_t request);
+    virtual double current_time (void);
+
+private:
+    ds3_ccf_unpack_svc_t * svc; /**< the service of the context */
+    size_t shard; /**< the shard of the context */
+    uint32_t flow; /**< the CM/service flow id */
+    uint8_t sc; /**< SID Cluster ID */
+};
+
+/** @brief a segment received by the unpack service */
+typedef struct _ds3_unpack_input_t {
+    uint32_t flow; /**< the CM/service flow id */
+    ds3packet_ccf_t * pkt; /**< the segment */
+} ds3_unpack_input_t;
+
+/** @brief a shard of the unpack service, it's processed by one thread at a time */
+typedef struct _ds3_unpack_shard_t {
+    std::map<uint64_t, ds3_ccf_unpack_ctx_t *> ctxmap; /**< the contexts, indexed by the key of (flow, sc) */
+    std::vector<ds3_unpack_input_t> inlst; /**< the segments to be processed by process() */
+    size_t numdrop; /**< the segments dropped by the last expire() */
+    size_t numfree; /**< the idle contexts deleted by the last expire() */
+} ds3_unpack_shard_t;
+
+/**
+ * @brief unpack the segments of many CMs and SID Clusters
+ *
+ * Each (flow, sc) has its own unpack context, the contexts are distributed to the shards by the hash of
+ * (flow, sc), and the shards are processed in parallel by the worker threads. A shard is processed by one
+ * thread at a time, so the events of the contexts of the same shard are never called concurrently;
+ * the events of the different shards are called concurrently if there are worker threads.
+ *
+ * add_packet() and process() are called by the same thread. The segments are owned by the derived class,
+ * they're returned by recycle_packet() or drop_packet(); clear() is called to drop the segments left before
+ * the service is deleted, such as in the destructor of the derived class.
+ */
+class ds3_ccf_unpack_svc_t {
+public:
+    ds3_ccf_unpack_svc_t (size_t numshards = 1, size_t pbmul = 0);
+    virtual ~ds3_ccf_unpack_svc_t ();
+
+    int set_shards (size_t numshards, ds3_unpack_hash_t hash = NULL);
+    size_t get_num_shards (void) const { return this->shards.size(); } /**< the number of the shards */
+    size_t get_shard (uint32_t flow, uint8_t sc) const { return this->hashfunc (flow, sc) % this->shards.size(); } /**< the shard of the flow */
+    int set_workers (size_t num) { return this->workers.start (num); } /**< set the number of the worker threads, 0 to process the shards in the calling thread */
+    size_t get_workers (void) const { return this->workers.size(); } /**< the number of the worker threads */
+    void set_pbmultiplier(size_t pbmul) { multiplier_piggyback = pbmul; } /**< set the Multiplier of the contexts created later */
+    size_t get_pbmultiplier(void) const { return multiplier_piggyback; } /**< get the Multiplier */
+    void set_timeout (double tm, double tick = 0) { this->timeout = tm; this->tick = tick; } /**< set the reassembly timeout of the contexts created later, see ds3_ccf_unpack_t::set_timeout() */
+
+    int add_packet (uint32_t flow, ds3packet_t *p);
+    size_t get_pending (void) const; /**< the number of the segments to be processed by process() */
+    size_t process (void);
+    size_t expire (void);
+    ssize_t remove_flow (uint32_t flow, uint8_t sc);
+    size_t clear (void);
+    size_t get_num_contexts (void) const;
+    size_t get_num_segments (void) const;
+    size_t get_num_freed (void) const { return this->numfreed; } /**< the number of the idle contexts deleted by expire() */
+
+protected:
+    friend class ds3_ccf_unpack_ctx_t;
+    /* the events of the contexts, called by the thread processing the shard */
+    virtual void recycle_packet (size_t shard, ds3packet_t *p) = 0; /**< a processed segment need to be deleted */
+    virtual void drop_packet (size_t shard, ds3packet_t *p) = 0; /**< a un-processed segment need to be drop */
+    /**
+     * @brief signify that a new MAC packet was extracted from the segments received
+     * @param shard : the shard of the flow
+     * @param flow : the CM/service flow id
+     * @param sc : SID Cluster ID
+     * @param macbuffer : the MAC packet raw data
+     * @return 0 on success, < 0 on error
+     */
+    virtual int signify_packet (size_t shard, uint32_t flow, uint8_t sc, ds3_packet_buffer_t & macbuffer) = 0;
+    /**
+     * @brief signify that a piggyback request was extracted from the segments received
+     * @param shard : the shard of the flow
+     * @param flow : the CM/service flow id
+     * @param sc : SID Cluster ID
+     * @param request : the piggyback request value
+     * @return 0 on success, < 0 on error
+     */
+    virtual int signify_piggyback (size_t shard, uint32_t flow, int sc, size_t request) = 0;
+    virtual double current_time (void) = 0; /**< get the current time, called by the threads concurrently */
+
+private:
+    static void process_shard (void *arg, size_t idx);
+    static void expire_shard (void *arg, size_t idx);
+
+    /* the shards hold the contexts */
+    ds3_ccf_unpack_svc_t (const ds3_ccf_unpack_svc_t &);
+    ds3_ccf_unpack_svc_t & operator = (const ds3_ccf_unpack_svc_t &);
+
+    std::vector<ds3_unpack_shard_t> shards; /**< the shards */
+    ds3_unpack_hash_t hashfunc; /**< the hash function of (flow, sc) */
+    ds3_parallel_t workers; /**< the threads processing the shards */
+    size_t multiplier_piggyback; /**< the Multiplier to Number of Bytes Requested */
+    double timeout; /**< the reassembly timeout of the contexts */
+    double tick; /**< the resolution of the reassembly timers */
+    size_t numfreed; /**< the number of the idle contexts deleted by expire() */
+};
+
+#define DS3_CACHE_LINE 64 /**< the size of the CPU cache line */
+
+/**
+ * @brief the bounded single producer single consumer ring of pointers
+ *
+ * push() is called by one thread and pop() by another one, both are wait-free. The indexes of the two sides
+ * are in their own cache lines, each side keeps a copy of the other side's index and reads the shared one
+ * only when the copy shows the ring full (or empty).
+ */
+class ds3_spsc_ring_t {
+public:
+    ds3_spsc_ring_t () : mask(0), tail(0), headcache(0), head(0), tailcache(0) {}
+
+    int reset (size_t capacity);
+    size_t capacity (void) const { return this->slots.size(); } /**< the number of the slots */
+    bool push (void * p);
+    size_t pop (void ** retlst, size_t num);
+    size_t size (void) const { return __atomic_load_n (&(this->tail), __ATOMIC_ACQUIRE) - __atomic_load_n (&(this->head), __ATOMIC_ACQUIRE); } /**< the number of the items, approximate if called by the other threads */
+
+private:
+    /* the slots are shared by the two threads */
+    ds3_spsc_ring_t (const ds3_spsc_ring_t &);
+    ds3_spsc_ring_t & operator = (const ds3_spsc_ring_t &);
+
+    std::vector<void *> slots; /**< the items, the size is power of 2 */
+    size_t mask; /**< the mask of the index of the slots */
+    char pad0[DS3_CACHE_LINE];
+    size_t tail; /**< the index of the next item pushed, written by the producer */
+    size_t headcache; /**< the copy of head for the producer */
+    char pad1[DS3_CACHE_LINE];
+    size_t head; /**< the index of the next item popped, written by the consumer */
+    size_t tailcache; /**< the copy of tail for the consumer */
+    char pad2[DS3_CACHE_LINE];
+};
+
+/** @brief the statistics of the pipelined unpack */
+typedef struct _ds3_pipe_stats_t {
+    size_t num_push; /**< the segments pushed to the ring */
+    size_t num_full; /**< the segments rejected since the ring is full */
+    size_t num_wake; /**< the times the receive thread woke up the reassembly thread */
+    size_t num_pop; /**< the segments processed by the reassembly thread */
+    size_t num_batch; /**< the batches processed by the reassembly thread */
+    size_t num_park; /**< the times the reassembly thread parked */
+    size_t max_depth; /**< the max number of the segments found in the ring by the reassembly thread */
+} ds3_pipe_stats_t;
+
+/**
+ * @brief the pipelined unpack, the receive thread passes the segments to a reassembly thread
+ *
+ * The receive thread calls push(), the segments are passed through a ds3_spsc_ring_t, and the reassembly thread
+ * calls process_packets() of the unpack engine for the segments in batches. So all of the events of the engine are
+ * called by the reassembly thread. When the ring is empty, the reassembly thread spins a while, then parks until
+ * the receive thread pushes a segment, or the reassembly timeout of the engine.
+ */
+class ds3_ccf_unpack_pipe_t {
+public:
+    ds3_ccf_unpack_pipe_t (ds3_ccf_unpack_t * engine1);
+    ~ds3_ccf_unpack_pipe_t ();
+
+    int start (size_t capacity = 1024, size_t batch = 32, size_t spins = 1000);
+    void stop (void);
+    bool is_running (void) const { return this->flg_running; } /**< if the reassembly thread is running */
+    int push (ds3packet_t * p);
+    void get_stats (ds3_pipe_stats_t & retstats) const;
+
+private:
+    static void * thread_main (void *arg);
+    void run (void);
+    bool park (void);
+
+    /* the thread refers to this object */
+    ds3_ccf_unpack_pipe_t (const ds3_ccf_unpack_pipe_t &);
+    ds3_ccf_unpack_pipe_t & operator = (const ds3_ccf_unpack_pipe_t &);
+
+    ds3_ccf_unpack_t * engine; /**< the unpack engine, used by the reassembly thread only after start() */
+    ds3_spsc_ring_t ring; /**< the segments from the receive thread */
+    pthread_t thread; /**< the reassembly thread */
+    pthread_mutex_t mutex; /**< protect the parking */
+    pthread_cond_t cond; /**< wake up the reassembly thread */
+    int flg_parked; /**< the reassembly thread is parked or going to park */
+    int flg_quit; /**< the reassembly thread should exit after the ring is empty */
+    bool flg_running; /**< the reassembly thread is started */
+    size_t batch; /**< the max number of the segments of each batch */
+    size_t spins; /**< the times to check the ring before parking */
+    ds3_pipe_stats_t stats; /**< the statistics, each field is written by one of the threads */
 };
 
 #endif // _DS3PKGCCF_H
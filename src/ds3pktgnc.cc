@@ -10,15 +10,176 @@
 #include <iostream>     // std::cout, std::endl
 #include "ds3pktgnc.h"
 
+DS3_PKTCNT_IMPLEMENT_BUFTYPE(ds3_packet_buffer_gpkt_t, ds3_packet_buffer_t);
+
+#define DS3_LOWBIT(j) ((j) & (~(j) + 1))
+
+/** @brief drop all of the index nodes, they are built again when searching */
+void
+ds3_packet_buffer_gpkt_t::index_reset (void)
+{
+    this->idxsum.resize (0);
+    this->idxbase = 0;
+    this->szbase = 0;
+    this->sztrim = 0;
+}
+
+/**
+ * @brief drop the index nodes which cover the items from i
+ *
+ * @param i : [in] the index of the first item inserted or removed
+ */
+void
+ds3_packet_buffer_gpkt_t::index_invalidate (size_t i)
+{
+    if (i < 1) {
+        // the size of the front item in the index includes sztrim
+        this->index_reset ();
+        return;
+    }
+    if (this->idxsum.size() > this->idxbase + i + 1) {
+        this->idxsum.resize (this->idxbase + i + 1);
+    }
+}
+
+/**
+ * @brief update the index nodes after the size of the item i is changed
+ *
+ * @param i : [in] the index of the item
+ * @param delta : [in] the size changed
+ */
+void
+ds3_packet_buffer_gpkt_t::index_update (size_t i, ssize_t delta)
+{
+    size_t j;
+    for (j = this->idxbase + i + 1; j < this->idxsum.size(); j += DS3_LOWBIT(j)) {
+        this->idxsum[j] += delta;
+    }
+}
+
+/**
+ * @brief build the index nodes for the items not indexed yet
+ *
+ * Appending items costs O(log n) each, because a node only depends on the items before it.
+ */
+void
+ds3_packet_buffer_gpkt_t::index_build (void)
+{
+    size_t j;
+    size_t k;
+    if (this->idxsum.size() < 1) {
+        this->idxsum.push_back (0);
+    }
+    // the removed items should be in the index
+    assert (this->idxsum.size() > this->idxbase);
+    assert ((0 == this->sztrim) || (this->idxsum.size() > this->idxbase + 1));
+    for (j = this->idxsum.size(); j <= this->idxbase + this->pktlist.size(); j ++) {
+        // the node j = item j-1 + the child nodes j-1, j-2, j-4, ... within (j - lowbit(j), j-1]
+        size_t sum = this->pktlist[j - 1 - this->idxbase].sz;
+        for (k = j - 1; k > j - DS3_LOWBIT(j); k -= DS3_LOWBIT(k)) {
+            sum += this->idxsum[k];
+        }
+        this->idxsum.push_back (sum);
+    }
+}
+
+/**
+ * @brief find the first item that the total size of the items before it is >= pos
+ *
+ * @param pos : [in] the position of the content
+ * @param ret_szcur : [out] the total size of the items before the returned one
+ *
+ * @return the index of the item, pktlist.size() if the pos is larger than the size of the content
+ *
+ * It's the same as summing pktlist[].sz from the item 0 until reaching pos, but in O(log n).
+ */
+size_t
+ds3_packet_buffer_gpkt_t::index_lower_bound (size_t pos, size_t & ret_szcur)
+{
+    ret_szcur = 0;
+    if (pos < 1) {
+        return 0;
+    }
+    this->index_build ();
+    // find the last item k that the total size of items [0, k) < pos, the removed items are counted in the index
+    size_t n = this->idxbase + this->pktlist.size();
+    size_t target = pos + this->szbase + this->sztrim;
+    size_t k = 0;
+    size_t szcur = 0;
+    size_t step = 1;
+    while ((step << 1) <= n) {
+        step <<= 1;
+    }
+    for (; step > 0; step >>= 1) {
+        if ((k + step <= n) && (szcur + this->idxsum[k + step] < target)) {
+            k += step;
+            szcur += this->idxsum[k];
+        }
+    }
+    assert (k >= this->idxbase);
+    if (k < n) {
+        // the item k is the one reach to the pos
+        szcur += this->pktlist[k - this->idxbase].sz;
+        if (k == this->idxbase) {
+            szcur += this->sztrim;
+        }
+        k ++;
+    }
+    ret_szcur = szcur - (this->szbase + this->sztrim);
+    return (k - this->idxbase);
+}
+
+/**
+ * @brief remove the content from the front
+ *
+ * @param sz : [in] the size to be removed
+ *
+ * @return the size removed
+ *
+ * The removed packets are poped from the front of the list, and they are left in the position index,
+ * the index is dropped only if it's mostly consist of the removed packets.
+ */
+ssize_t
+ds3_packet_buffer_gpkt_t::consume_front (size_t sz)
+{
+    if ((ssize_t)sz > this->size()) {
+        sz = this->size();
+    }
+    size_t szrest = sz;
+    while (szrest > 0) {
+        assert (this->pktlist.size() > 0);
+        ds3pktbufns2_info_t & pi = this->pktlist.front();
+        if (pi.sz <= szrest) {
+            // remove the whole packet
+            szrest -= pi.sz;
+            this->szbase += pi.sz + this->sztrim;
+            this->sztrim = 0;
+            this->pktlist.pop_front ();
+            this->idxbase ++;
+        } else {
+            // remove the left part
+            pi.pos += szrest;
+            pi.sz -= szrest;
+            this->sztrim += szrest;
+            szrest = 0;
+        }
+    }
+    assert (this->szpkt >= sz);
+    this->szpkt -= sz;
+    if ((this->idxsum.size() < this->idxbase + 2) || (this->idxbase > this->pktlist.size() + 64)) {
+        // the removed or trimmed packets are not in the index yet, or the index is mostly the removed ones
+        this->index_reset ();
+    }
+    return sz;
+}
+
 bool
 ds3_packet_buffer_gpkt_t::get_gpkt_info (size_t pos /* IN */, ds3_packet_generic_t & ret_pkt /* OUT */, size_t & ret_begin /* OUT */, size_t & ret_end /* OUT */)
 {
     size_t szcur = 0;
     size_t i = 0;
     // find the the position in the packet list that the total size of the previous packets is <= the required position.
-    for (i = 0; (szcur < pos)  && (i < this->pktlist.size()); i ++) {
-        szcur += this->pktlist[i].sz;
-    }
+    i = this->index_lower_bound (pos, szcur);
     if (szcur < pos) {
         return NULL;
     }
@@ -42,9 +203,7 @@ ds3_packet_buffer_gpkt_t::extract_gpkt (size_t pos)
 {
     size_t szcur = 0;
     size_t i = 0;
-    for (i = 0; (szcur < pos)  && (i < this->pktlist.size()); i ++) {
-        szcur += this->pktlist[i].sz;
-    }
+    i = this->index_lower_bound (pos, szcur);
     if (szcur < pos) {
         return NULL;
     }
@@ -76,11 +235,12 @@ ds3_packet_buffer_gpkt_t::erase (size_t begin_self, size_t end_self)
     if (begin_self == end_self) {
         return true;
     }
+    if (0 == begin_self) {
+        return (this->consume_front (end_self) >= 0);
+    }
     size_t szcur = 0;
     size_t i = 0;
-    for (i = 0; (szcur < begin_self)  && (i < this->pktlist.size()); i ++) {
-        szcur += this->pktlist[i].sz;
-    }
+    i = this->index_lower_bound (begin_self, szcur);
     if (szcur != begin_self) {
         assert (szcur > begin_self);
         i --;
@@ -106,7 +266,9 @@ ds3_packet_buffer_gpkt_t::erase (size_t begin_self, size_t end_self)
             if (this->pktlist[i].sz < 1) {
                 // remove the whole packet
                 this->pktlist.erase(this->pktlist.begin() + i);
+                this->index_invalidate (i);
             } else {
+                this->index_update (i, -(ssize_t)pi.sz);
                 i ++;
             }
         } else {
@@ -116,6 +278,7 @@ ds3_packet_buffer_gpkt_t::erase (size_t begin_self, size_t end_self)
                 // remove the left part
                 this->pktlist[i].sz -= pi.sz;
                 this->pktlist[i].pos += pi.sz;
+                this->index_update (i, -(ssize_t)pi.sz);
             } else {
                 assert (pi.pos > this->pktlist[i].pos);
                 ds3pktbufns2_info_t pi2;
@@ -124,8 +287,9 @@ ds3_packet_buffer_gpkt_t::erase (size_t begin_self, size_t end_self)
                 assert ((this->pktlist[i].pos + this->pktlist[i].sz) >= (pi.pos + pi.sz));
                 this->pktlist[i].sz = (this->pktlist[i].pos + this->pktlist[i].sz) - (pi.pos + pi.sz);
                 this->pktlist[i].pos = pi.pos + pi.sz;
-                std::vector<ds3pktbufns2_info_t>::iterator it = this->pktlist.begin() + i;
+                std::deque<ds3pktbufns2_info_t>::iterator it = this->pktlist.begin() + i;
                 this->pktlist.insert(it, pi2);
+                this->index_invalidate (i);
                 i ++;
             }
             assert (szcur + this_pktlist_i_sz > pos_cur + pi.sz);
@@ -173,6 +337,7 @@ ds3_packet_buffer_gpkt_t::insert_gpkt_idx (size_t i, size_t szcur, size_t pos_se
                     return false;
                 } else if (this->pktlist[i-1].pos + this->pktlist[i-1].sz == pi.pos) {
                     this->pktlist[i-1].sz += pi.sz;
+                    this->index_update (i - 1, pi.sz);
                     flg_merged = true;
 #if CCFDEBUG
                     idx_merge = i - 1;
@@ -191,14 +356,16 @@ ds3_packet_buffer_gpkt_t::insert_gpkt_idx (size_t i, size_t szcur, size_t pos_se
                         // we already merged with previous one, then merge [i-1] and [i]
                         assert (i > 0);
                         this->pktlist[i-1].sz += this->pktlist[i].sz;
-                        std::vector<ds3pktbufns2_info_t>::iterator it = pktlist.begin() + i;
+                        std::deque<ds3pktbufns2_info_t>::iterator it = pktlist.begin() + i;
                         this->pktlist.erase(it);
+                        this->index_invalidate (i - 1);
 #if CCFDEBUG
                         this->pktlist[i-1].flg_extracted = (this->pktlist[i-1].flg_extracted | this->pktlist[i].flg_extracted);
 #endif
                     } else {
                         this->pktlist[i].sz += pi.sz;
                         this->pktlist[i].pos = pi.pos;
+                        this->index_update (i, pi.sz);
 #if CCFDEBUG
                         idx_merge = i;
 #endif
@@ -208,9 +375,10 @@ ds3_packet_buffer_gpkt_t::insert_gpkt_idx (size_t i, size_t szcur, size_t pos_se
             }
         }
         if (! flg_merged) {
-            std::vector<ds3pktbufns2_info_t>::iterator it = pktlist.begin() + i;
+            std::deque<ds3pktbufns2_info_t>::iterator it = pktlist.begin() + i;
             assert (NULL != pi.pkt);
             this->pktlist.insert(it, pi);
+            this->index_invalidate (i);
         }
 #if CCFDEBUG
         else if (this->pktlist[idx_merge].flg_extracted) {
@@ -240,9 +408,10 @@ ds3_packet_buffer_gpkt_t::insert_gpkt_idx (size_t i, size_t szcur, size_t pos_se
             this->pktlist[i].pos += ((pos_self - szcur) + sz_pi_bak);
             this->pktlist[i].sz -= (pos_self - szcur);
 
-            std::vector<ds3pktbufns2_info_t>::iterator it = pktlist.begin() + i;
+            std::deque<ds3pktbufns2_info_t>::iterator it = pktlist.begin() + i;
             assert (NULL != pi.pkt);
             this->pktlist.insert(it, pi);
+            this->index_invalidate (i);
             this->szpkt += pi.sz;
             return true;
         }
@@ -255,11 +424,12 @@ ds3_packet_buffer_gpkt_t::insert_gpkt_idx (size_t i, size_t szcur, size_t pos_se
     pi2.sz  = (pos_self - szcur);
     this->pktlist[i].pos += (pos_self - szcur);
     this->pktlist[i].sz -= (pos_self - szcur);
-    std::vector<ds3pktbufns2_info_t>::iterator it = pktlist.begin() + i;
+    std::deque<ds3pktbufns2_info_t>::iterator it = pktlist.begin() + i;
     assert (NULL != pi.pkt);
     this->pktlist.insert(it, pi);
     it = pktlist.begin() + i;
     this->pktlist.insert(it, pi2);
+    this->index_invalidate (i);
 
     this->szpkt += pi.sz;
     return true;
@@ -277,10 +447,7 @@ ds3_packet_buffer_gpkt_t::insert_gpkt (size_t pos_self, ds3_packet_generic_t pkt
     }
 
     assert (pos_self <= this->szpkt);
-    for (i = 0; (szcur < pos_self)  && (i < this->pktlist.size()); i ++) {
-        assert (NULL != this->pktlist[i].pkt);
-        szcur += this->pktlist[i].sz;
-    }
+    i = this->index_lower_bound (pos_self, szcur);
     return this->insert_gpkt_idx (i, szcur, pos_self, pkt, begin_peer, end_peer);
 }
 
@@ -311,19 +478,13 @@ ds3_packet_buffer_gpkt_t::insert_to_base (size_t pos_peer, ds3_packet_buffer_gpk
     size_t j = 0;
 
     assert (begin_self <= this->szpkt);
-    szcurj = 0;
-    for (j = 0; (szcur < begin_self)  && (j < this->pktlist.size()); j ++) {
-        szcurj += this->pktlist[j].sz;
-    }
+    j = this->index_lower_bound (begin_self, szcurj);
     if (szcurj > begin_self) {
         assert (j > 0);
         j --;
         szcurj -= this->pktlist[j].sz;
     }
-    szcur = 0;
-    for (i = 0; (szcur < pos_peer)  && (i < peer->pktlist.size()); i ++) {
-        szcur += peer->pktlist[i].sz;
-    }
+    i = peer->index_lower_bound (pos_peer, szcur);
     size_t pos_cur = begin_self;
     for (; szcurj < end_self;) {
         assert (pos_cur >= szcurj);
@@ -386,9 +547,9 @@ ds3_packet_buffer_gpkt_t::copy_to_base (size_t pos_peer, ds3_packet_buffer_gpkt_
 
 #if 1
 ds3_packet_buffer_gpkt_t::ds3_packet_buffer_gpkt_t(ds3_packet_buffer_t *arg_peer, size_t begin, size_t end)
-: szpkt(0)
+: szpkt(0), idxbase(0), szbase(0), sztrim(0)
 {
-    ds3_packet_buffer_gpkt_t * peer = dynamic_cast<ds3_packet_buffer_gpkt_t *> (arg_peer);
+    ds3_packet_buffer_gpkt_t * peer = ds3_buffer_cast<ds3_packet_buffer_gpkt_t> (arg_peer);
     assert (NULL != peer);
     ds3_packet_buffer_t * ret = peer->insert_to(0, this, begin, end);
     assert (ret == this);
@@ -397,7 +558,7 @@ ds3_packet_buffer_gpkt_t::ds3_packet_buffer_gpkt_t(ds3_packet_buffer_t *arg_peer
 #else
 ds3_packet_buffer_gpkt_t::ds3_packet_buffer_gpkt_t(ds3_packet_buffer_t *arg_peer, size_t begin, size_t end)
 {
-    ds3_packet_buffer_gpkt_t * peer = dynamic_cast<ds3_packet_buffer_gpkt_t *> (arg_peer);
+    ds3_packet_buffer_gpkt_t * peer = ds3_buffer_cast<ds3_packet_buffer_gpkt_t> (arg_peer);
     assert (NULL != peer);
     if (end < begin) {
         return;
@@ -451,9 +612,7 @@ ds3_packet_buffer_gpkt_t::block_size_at (size_t pos)
     // size of sub-block (including header+content)
     size_t szcur = 0;
     size_t i = 0;
-    for (i = 0; (szcur < pos)  && (i < this->pktlist.size()); i ++) {
-        szcur += this->pktlist[i].sz;
-    }
+    i = this->index_lower_bound (pos, szcur);
     if (szcur == pos) {
         return (this->pktlist[i].sz);
     }
@@ -549,6 +708,7 @@ inline ds3_packet_buffer_test_t::ds3_packet_buffer_test_t(ds3_packet_buffer_t *p
     : ds3_packet_buffer_gpkt_t (peer, begin, end) { }
 
 inline ds3_packet_buffer_test_t::~ds3_packet_buffer_test_t() {}
+DS3_PKTCNT_IMPLEMENT_BUFTYPE(ds3_packet_buffer_test_t, ds3_packet_buffer_gpkt_t);
 
 /** @brief test packet class for ds3packet_nbsmac_t */
 class ds3packet_testmac_t : public ds3packet_gpkt_t {
@@ -1146,6 +1306,64 @@ test_pktgnc_random (void)
     return test_pktgnc_gp (NULL, nump);
 }
 
+/**
+ * @brief check the position index of ds3_packet_buffer_gpkt_t against a byte list
+ *
+ * Each byte of the model is recorded as (packet, offset in the packet),
+ * a new block starts where the packet changes or the offset isn't continuous.
+ */
+int
+test_pktgnc_index (void)
+{
+    std::vector<std::pair<size_t, size_t> > model;
+    ds3_packet_buffer_gpkt_t buf;
+    size_t idpkt = 1;
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < 3000; i ++) {
+        if ((model.size() > 0) && (rand () % 4 == 0)) {
+            // consume from the front, the index is kept
+            size_t sz = 1 + rand () % 80;
+            if (sz > model.size()) {
+                sz = model.size();
+            }
+            REQUIRE ((ssize_t)sz == buf.consume_front (sz));
+            model.erase (model.begin(), model.begin() + sz);
+        } else if ((model.size() < 100) || (rand () % 3 > 0)) {
+            // insert a new packet at any position
+            size_t pos = rand () % (model.size() + 1);
+            size_t sz = 1 + rand () % 50;
+            REQUIRE (buf.insert_gpkt (pos, (ds3_packet_generic_t)idpkt, 0, sz));
+            for (j = 0; j < sz; j ++) {
+                model.insert (model.begin() + pos + j, std::make_pair (idpkt, j));
+            }
+            idpkt ++;
+        } else {
+            // erase a range
+            size_t b = rand () % model.size();
+            size_t e = b + 1 + rand () % 80;
+            if (e > model.size()) {
+                e = model.size();
+            }
+            REQUIRE (buf.erase (b, e));
+            model.erase (model.begin() + b, model.begin() + e);
+        }
+        REQUIRE ((ssize_t)model.size() == buf.size());
+        if (i % 50 > 0) {
+            continue;
+        }
+        for (j = 0; j < model.size(); ) {
+            size_t k = j + 1;
+            for (; (k < model.size()) && (model[k].first == model[j].first) && (model[k].second == model[k - 1].second + 1); k ++) {
+            }
+            REQUIRE ((ssize_t)(k - j) == buf.block_size_at (j));
+            j = k;
+        }
+    }
+    return 0;
+}
+
 int
 test_pktgnc (void)
 {
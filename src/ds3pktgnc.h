@@ -10,6 +10,8 @@
 #ifndef _DS3PKTGNC_H
 #define _DS3PKTGNC_H
 
+#include <deque>
+
 #include "ds3pktccf.h"
 
 /* To support generic packet type (which's desclared as void * here),
@@ -39,7 +41,20 @@ typedef struct _ds3pktbufns2_info_t {
 class ds3_packet_buffer_gpkt_t : public ds3_packet_buffer_t {
 private:
     size_t szpkt;
-    std::vector<ds3pktbufns2_info_t> pktlist; /**< the packet list of content */
+    std::deque<ds3pktbufns2_info_t> pktlist; /**< the packet list of content, the front is removed in O(1) by consume_front() */
+    /* the Fenwick tree of pktlist[].sz, idxsum[j] is the sum of the items (j - lowbit(j), j]
+     * (1-based, to pktlist[j-1-idxbase]); only the nodes for the first (idxsum.size() - 1) items are built,
+     * the rest are built by index_build() when searching.
+     * The items removed by consume_front() are kept in idxsum, so the positions are shifted by szbase + sztrim. */
+    std::vector<size_t> idxsum;
+    size_t idxbase; /**< the number of the items removed from the front, which are still in idxsum */
+    size_t szbase;  /**< the size of the items removed from the front, which are still in idxsum */
+    size_t sztrim;  /**< the size trimmed from the front item, which is still in idxsum */
+    void index_reset (void);
+    void index_invalidate (size_t i); /**< the items from i are inserted or removed */
+    void index_update (size_t i, ssize_t delta); /**< the size of the item i is changed by delta */
+    void index_build (void);
+    size_t index_lower_bound (size_t pos, size_t & ret_szcur); /**< get the first item that the total size of the items before it is >= pos */
     bool insert_gpkt_idx (size_t i, size_t szcur, size_t pos_self, ds3_packet_generic_t pkt, size_t begin_peer, size_t end_peer);
 protected:
     bool get_gpkt_info (size_t pos /* IN */, ds3_packet_generic_t &ret_pkt /* OUT */, size_t & ret_begin /* OUT */, size_t & ret_end /* OUT */); /**< get the packet info at the position pos */
@@ -48,13 +63,14 @@ public:
 #if CCFDEBUG
     virtual void dump (void);
 #endif
-    ds3_packet_buffer_gpkt_t() : szpkt(0) {}
+    ds3_packet_buffer_gpkt_t() : szpkt(0), idxbase(0), szbase(0), sztrim(0) {}
 
     /* IN */
     bool insert_gpkt (size_t pos_self, ds3_packet_generic_t peer_pkt, size_t begin_peer, size_t end_peer);
     /* OUT */
     ds3_packet_generic_t extract_gpkt (size_t pos); // extract a Packet at the position pos,
     bool erase (size_t begin_self, size_t end_self); /**< erase the content */
+    virtual ssize_t consume_front (size_t sz); /**< remove the content from the front, O(1) for each packet */
     ds3_packet_buffer_t * insert_to_base (size_t pos_peer, ds3_packet_buffer_gpkt_t *peer, size_t begin_self, size_t end_self); /**< generic insert_to function for gpkt and its child class */
     ds3_packet_buffer_t * copy_to_base (size_t pos_peer, ds3_packet_buffer_gpkt_t * peer, size_t begin_self, size_t end_self); /**< generic copy_to function for gpkt and its child class */
 
@@ -114,7 +130,7 @@ public:
 #if CCFDEBUG
     virtual void dump (void);
 #endif
-    virtual ~ds3packet_gpkt_t() { std::cout << "Destroy " << __func__ << std::endl;}
+    virtual ~ds3packet_gpkt_t() {}
     ds3packet_gpkt_t() : pkt(0) {}
 
     /* OUT */
@@ -145,6 +161,7 @@ protected:
 
 #if CCFDEBUG
 int test_pktgnc (void);
+int test_pktgnc_index (void);
 #endif
 
 #endif /* _DS3PKTGNC_H */
@@ -0,0 +1,509 @@
+/**
+ * @file    ds3pktslc.cc
+ * @brief   reference counted slice buffer for ds3packet
+ * @author  agent (agent@local)
+ * @version 1.0
+ * @date    2026-10-17
+ * @copyright agent (2026)
+ */
+
+#include <stdio.h>
+
+#include "ds3pktslc.h"
+
+DS3_PKTCNT_IMPLEMENT_BUFTYPE(ds3_packet_buffer_slice_t, ds3_packet_buffer_t);
+
+/**
+ * @brief create a new chunk by copying the bytes
+ *
+ * @param nbsbuf : [in] the bytes, NULL to fill zeros
+ * @param szbuf : [in] the size of the bytes
+ *
+ * @return the chunk with reference count 1
+ */
+ds3_buffer_chunk_t *
+ds3_buffer_chunk_new (uint8_t *nbsbuf, size_t szbuf)
+{
+    ds3_buffer_chunk_t * chunk = new ds3_buffer_chunk_t;
+    assert (NULL != chunk);
+    chunk->refcnt = 1;
+    if (NULL == nbsbuf) {
+        chunk->data.resize (szbuf, 0);
+    } else {
+        chunk->data.insert (chunk->data.end(), nbsbuf, nbsbuf + szbuf);
+    }
+    return chunk;
+}
+
+/** @brief add a reference to the chunk */
+void
+ds3_buffer_chunk_ref (ds3_buffer_chunk_t * chunk)
+{
+    assert (NULL != chunk);
+    assert (chunk->refcnt > 0);
+    chunk->refcnt ++;
+}
+
+/** @brief release a reference of the chunk, the chunk is freed when no one refer to it */
+void
+ds3_buffer_chunk_unref (ds3_buffer_chunk_t * chunk)
+{
+    assert (NULL != chunk);
+    assert (chunk->refcnt > 0);
+    chunk->refcnt --;
+    if (chunk->refcnt < 1) {
+        delete chunk;
+    }
+}
+
+ds3_packet_buffer_slice_t::ds3_packet_buffer_slice_t(ds3_packet_buffer_t *arg_peer, size_t begin, size_t end)
+    : szall(0)
+{
+    ds3_packet_buffer_slice_t * peer = ds3_buffer_cast<ds3_packet_buffer_slice_t> (arg_peer);
+    assert (NULL != peer);
+    if (end < begin) {
+        return;
+    }
+    if (end > peer->szall) {
+        end = peer->szall;
+    }
+    if (begin >= end) {
+        return;
+    }
+    peer->get_slices (begin, end, this->slicelist);
+    this->szall = end - begin;
+}
+
+ds3_packet_buffer_slice_t::~ds3_packet_buffer_slice_t()
+{
+    std::vector<ds3_buffer_slice_t>::iterator it;
+    for (it = this->slicelist.begin(); it != this->slicelist.end(); it ++) {
+        ds3_buffer_chunk_unref (it->chunk);
+    }
+    this->slicelist.resize(0);
+    this->szall = 0;
+}
+
+ssize_t ds3_packet_buffer_slice_t::size(void) const { return this->szall; }
+
+/**
+ * @brief get the slice at the position pos
+ *
+ * @param pos : [in] the position of the content
+ * @param ret_idx : [out] the index of the slice
+ * @param ret_off : [out] the offset of pos in the slice
+ *
+ * @return true on success, false if pos is out of the content
+ */
+bool
+ds3_packet_buffer_slice_t::find_slice (size_t pos, size_t & ret_idx, size_t & ret_off)
+{
+    size_t i;
+    size_t szcur = 0;
+    if (pos >= this->szall) {
+        return false;
+    }
+    for (i = 0; i < this->slicelist.size(); i ++) {
+        if (pos < szcur + this->slicelist[i].sz) {
+            ret_idx = i;
+            ret_off = pos - szcur;
+            return true;
+        }
+        szcur += this->slicelist[i].sz;
+    }
+    assert (0);
+    return false;
+}
+
+/**
+ * @brief split the slice at the position pos
+ *
+ * @param pos : [in] the position of the content
+ *
+ * @return the index of the slice which start from pos, or the number of the slices if pos is at the end
+ */
+size_t
+ds3_packet_buffer_slice_t::split_at (size_t pos)
+{
+    size_t idx = 0;
+    size_t off = 0;
+    if (false == this->find_slice (pos, idx, off)) {
+        return this->slicelist.size();
+    }
+    if (0 == off) {
+        return idx;
+    }
+    ds3_buffer_slice_t right = this->slicelist[idx];
+    right.off += off;
+    right.sz -= off;
+    ds3_buffer_chunk_ref (right.chunk);
+    this->slicelist[idx].sz = off;
+    this->slicelist.insert (this->slicelist.begin() + idx + 1, right);
+    return idx + 1;
+}
+
+/**
+ * @brief get the slices of the content [begin_self, end_self), the chunks are referenced
+ *
+ * @param begin_self : [in] the start position of the content
+ * @param end_self : [in] the end position of the content
+ * @param retlist : [out] the slices are appended to this list
+ */
+void
+ds3_packet_buffer_slice_t::get_slices (size_t begin_self, size_t end_self, std::vector<ds3_buffer_slice_t> & retlist)
+{
+    size_t idx = 0;
+    size_t off = 0;
+    size_t szleft;
+    if (end_self > this->szall) {
+        end_self = this->szall;
+    }
+    if (begin_self >= end_self) {
+        return;
+    }
+    if (false == this->find_slice (begin_self, idx, off)) {
+        return;
+    }
+    szleft = end_self - begin_self;
+    for (; (szleft > 0) && (idx < this->slicelist.size()); idx ++) {
+        ds3_buffer_slice_t sl = this->slicelist[idx];
+        sl.off += off;
+        sl.sz -= off;
+        off = 0;
+        if (sl.sz > szleft) {
+            sl.sz = szleft;
+        }
+        szleft -= sl.sz;
+        ds3_buffer_chunk_ref (sl.chunk);
+        retlist.push_back (sl);
+    }
+    assert (0 == szleft);
+}
+
+/**
+ * @brief insert the referenced slices at pos_self, the references are moved to this buffer
+ *
+ * @param pos_self : [in] the insert position(self)
+ * @param reflist : [in] the slices got by get_slices()
+ * @param szlist : [in] the total size of the slices
+ */
+void
+ds3_packet_buffer_slice_t::put_slices (size_t pos_self, std::vector<ds3_buffer_slice_t> & reflist, size_t szlist)
+{
+    assert (pos_self <= this->szall);
+    size_t idx = this->split_at (pos_self);
+    this->slicelist.insert (this->slicelist.begin() + idx, reflist.begin(), reflist.end());
+    this->szall += szlist;
+}
+
+ssize_t
+ds3_packet_buffer_slice_t::append (uint8_t *buf, size_t sz)
+{
+    if (sz < 1) {
+        return 0;
+    }
+    ds3_buffer_slice_t sl;
+    sl.chunk = ds3_buffer_chunk_new (buf, sz);
+    sl.off = 0;
+    sl.sz = sz;
+    this->slicelist.push_back (sl);
+    this->szall += sz;
+    return sz;
+}
+
+bool
+ds3_packet_buffer_slice_t::erase (size_t begin_self, size_t end_self)
+{
+    if (end_self > this->szall) {
+        end_self = this->szall;
+    }
+    if (begin_self >= end_self) {
+        return true;
+    }
+    size_t idxb = this->split_at (begin_self);
+    size_t idxe = this->split_at (end_self);
+    assert (idxb <= idxe);
+    for (size_t i = idxb; i < idxe; i ++) {
+        ds3_buffer_chunk_unref (this->slicelist[i].chunk);
+    }
+    this->slicelist.erase (this->slicelist.begin() + idxb, this->slicelist.begin() + idxe);
+    this->szall -= (end_self - begin_self);
+    return true;
+}
+
+/**
+ * @brief copy the bytes at the position pos to nbsbuf
+ *
+ * @param pos : [in] the position of the content
+ * @param nbsbuf : [out] the buffer to be filled
+ * @param szbuf : [in] the size of the buffer
+ *
+ * @return the size of data copied
+ */
+ssize_t
+ds3_packet_buffer_slice_t::peek (size_t pos, uint8_t *nbsbuf, size_t szbuf)
+{
+    size_t idx = 0;
+    size_t off = 0;
+    size_t szcur = 0;
+    if (false == this->find_slice (pos, idx, off)) {
+        return 0;
+    }
+    for (; (szcur < szbuf) && (idx < this->slicelist.size()); idx ++) {
+        ds3_buffer_slice_t & sl = this->slicelist[idx];
+        size_t szcpy = sl.sz - off;
+        if (szcpy > szbuf - szcur) {
+            szcpy = szbuf - szcur;
+        }
+        memmove (nbsbuf + szcur, &(sl.chunk->data[sl.off + off]), szcpy);
+        szcur += szcpy;
+        off = 0;
+    }
+    return szcur;
+}
+
+/**
+ * @brief remove the content from the front
+ *
+ * @param sz : [in] the size to be removed
+ *
+ * @return the size removed
+ */
+ssize_t
+ds3_packet_buffer_slice_t::consume_front (size_t sz)
+{
+    if (sz > this->szall) {
+        sz = this->szall;
+    }
+    if (sz < 1) {
+        return 0;
+    }
+    this->erase (0, sz);
+    return sz;
+}
+
+/**
+ * @brief get the pointer to the bytes [pos, pos + len) if they are in one slice
+ *
+ * @param pos : [in] the position of the content
+ * @param len : [in] the number of the bytes
+ *
+ * @return the pointer to the bytes, NULL if the bytes cross the slices or out of range
+ */
+const uint8_t *
+ds3_packet_buffer_slice_t::contiguous_span (size_t pos, size_t len)
+{
+    size_t idx = 0;
+    size_t off = 0;
+    if (false == this->find_slice (pos, idx, off)) {
+        return NULL;
+    }
+    ds3_buffer_slice_t & sl = this->slicelist[idx];
+    if (off + len > sl.sz) {
+        return NULL;
+    }
+    return &(sl.chunk->data[sl.off + off]);
+}
+
+ssize_t
+ds3_packet_buffer_slice_t::to_iovec (struct iovec *iov, size_t numiov)
+{
+    if (0 == numiov) {
+        return this->slicelist.size();
+    }
+    if ((NULL == iov) || (numiov < this->slicelist.size())) {
+        return -1;
+    }
+    for (size_t i = 0; i < this->slicelist.size(); i ++) {
+        iov[i].iov_base = &(this->slicelist[i].chunk->data[this->slicelist[i].off]);
+        iov[i].iov_len = this->slicelist[i].sz;
+    }
+    return this->slicelist.size();
+}
+
+uint8_t &
+ds3_packet_buffer_slice_t::at(size_t i)
+{
+    size_t idx = 0;
+    size_t off = 0;
+    if (false == this->find_slice (i, idx, off)) {
+        DS3_WRONGFUNC_EXECEPTION();
+    }
+    ds3_buffer_slice_t & sl = this->slicelist[idx];
+    if (sl.chunk->refcnt > 1) {
+        /* the returned reference may be changed, so the shared chunk can't be used */
+        ds3_buffer_chunk_t * chunk = ds3_buffer_chunk_new (&(sl.chunk->data[sl.off]), sl.sz);
+        ds3_buffer_chunk_unref (sl.chunk);
+        sl.chunk = chunk;
+        sl.off = 0;
+    }
+    return sl.chunk->data[sl.off + off];
+}
+
+int
+ds3_packet_buffer_slice_t::resize (size_t sznew)
+{
+    if (sznew < this->szall) {
+        this->erase (sznew, this->szall);
+    } else if (sznew > this->szall) {
+        this->append (NULL, sznew - this->szall);
+    }
+    return 0;
+}
+
+ssize_t
+ds3_packet_buffer_slice_t::to_nbs (uint8_t *nbsbuf, size_t szbuf)
+{
+    if (0 == szbuf) {
+        return this->szall;
+    }
+    assert (szbuf >= this->szall);
+    return this->peek (0, nbsbuf, szbuf);
+}
+
+ssize_t
+ds3_packet_buffer_slice_t::from_nbs (uint8_t *nbsbuf, size_t szbuf)
+{
+    this->erase (0, this->szall);
+    return this->append (nbsbuf, szbuf);
+}
+
+ds3_packet_buffer_t *
+ds3_packet_buffer_slice_t::insert_to (size_t pos_peer, ds3_packet_buffer_t *arg_peer, size_t begin_self, size_t end_self)
+{
+    DS3_DYNCST_CHKRET_CONTENT_POINTER(ds3_packet_buffer_slice_t, arg_peer);
+    assert (NULL != peer);
+    if (begin_self >= end_self) {
+        return arg_peer;
+    }
+    std::vector<ds3_buffer_slice_t> reflist;
+    this->get_slices (begin_self, end_self, reflist);
+    peer->put_slices (pos_peer, reflist, end_self - begin_self);
+    return arg_peer;
+}
+
+ds3_packet_buffer_t *
+ds3_packet_buffer_slice_t::copy_to (size_t pos_peer, ds3_packet_buffer_t *arg_peer, size_t begin_self, size_t end_self)
+{
+    DS3_DYNCST_CHKRET_CONTENT_POINTER(ds3_packet_buffer_slice_t, arg_peer);
+    assert (NULL != peer);
+    if (begin_self >= end_self) {
+        return arg_peer;
+    }
+    // get the slices first, the peer may be this buffer
+    std::vector<ds3_buffer_slice_t> reflist;
+    this->get_slices (begin_self, end_self, reflist);
+    // overwrite the content of the peer from pos_peer
+    peer->erase (pos_peer, pos_peer + (end_self - begin_self));
+    peer->put_slices (pos_peer, reflist, end_self - begin_self);
+    return arg_peer;
+}
+
+#if CCFDEBUG
+void
+ds3_packet_buffer_slice_t::dump (void)
+{
+    std::cout << "   content(" << this->slicelist.size() << " slices): " ;// << std::endl;
+    std::vector<ds3_buffer_slice_t>::iterator it;
+    for (it = this->slicelist.begin(); it != this->slicelist.end(); it ++) {
+        for (size_t i = 0; i < it->sz; i ++) {
+            printf (" %02X", it->chunk->data[it->off + i]);
+        }
+    }
+    std::cout << std::endl;
+}
+
+int
+test_pktslc (void)
+{
+    uint8_t buf1[100];
+    uint8_t buf2[50];
+    uint8_t bufout[300];
+    size_t i;
+    for (i = 0; i < sizeof(buf1); i ++) {
+        buf1[i] = i;
+    }
+    memset (buf2, 0xEE, sizeof(buf2));
+
+    ds3_packet_buffer_slice_t cnt1;
+    REQUIRE (100 == cnt1.append (buf1, sizeof(buf1)));
+    REQUIRE (1 == cnt1.num_slices());
+
+    // insert: the new buffer shares the chunk of cnt1
+    ds3_packet_buffer_t cnt2;
+    REQUIRE (60 == cnt2.insert (0, &cnt1, 20, 80));
+    REQUIRE (60 == cnt2.size());
+    REQUIRE (20 == cnt2[0]);
+    REQUIRE (79 == cnt2[59]);
+
+    // insert into the middle of a slice
+    ds3_packet_buffer_slice_t cnt3;
+    REQUIRE (50 == cnt3.append (buf2, sizeof(buf2)));
+    REQUIRE (50 == cnt1.insert (10, &cnt3, 0, cnt3.size()));
+    REQUIRE (150 == cnt1.size());
+    REQUIRE (3 == cnt1.num_slices());
+    REQUIRE (150 == cnt1.to_nbs (bufout, sizeof(bufout)));
+    REQUIRE (0 == memcmp (bufout, buf1, 10));
+    REQUIRE (0 == memcmp (bufout + 10, buf2, 50));
+    REQUIRE (0 == memcmp (bufout + 60, buf1 + 10, 90));
+
+    // erase across the slices
+    REQUIRE (cnt1.erase (5, 65));
+    REQUIRE (90 == cnt1.size());
+    REQUIRE (90 == cnt1.peek (0, bufout, sizeof(bufout)));
+    REQUIRE (0 == memcmp (bufout, buf1, 5));
+    REQUIRE (0 == memcmp (bufout + 5, buf1 + 15, 85));
+
+    // the bytes in one slice are read without copying, the others are copied to the temporary buffer
+    uint8_t tmpbuf[10];
+    REQUIRE (NULL != cnt1.contiguous_span (5, 10));
+    REQUIRE (NULL == cnt1.contiguous_span (0, 10));
+    REQUIRE (NULL == cnt1.contiguous_span (85, 10));
+    REQUIRE (tmpbuf != cnt1.peek_span (5, 10, tmpbuf));
+    REQUIRE (tmpbuf == cnt1.peek_span (0, 10, tmpbuf));
+    REQUIRE (0 == memcmp (tmpbuf, bufout, 10));
+    REQUIRE (NULL == cnt1.peek_span (85, 10, tmpbuf));
+
+    // consume from the front
+    ds3_packet_buffer_slice_t cnt4;
+    REQUIRE (90 == cnt4.insert (0, &cnt1, 0, cnt1.size()));
+    REQUIRE (7 == cnt4.consume_front (7));
+    REQUIRE (83 == cnt4.size());
+    REQUIRE (cnt1[7] == cnt4[0]);
+    REQUIRE (83 == cnt4.consume_front (100));
+    REQUIRE (0 == cnt4.size());
+
+    // copy overwrites the content
+    REQUIRE (10 == cnt1.copy (0, &cnt3, 0, 10));
+    REQUIRE (90 == cnt1.size());
+    REQUIRE (90 == cnt1.to_nbs (bufout, sizeof(bufout)));
+    REQUIRE (0 == memcmp (bufout, buf2, 10));
+    REQUIRE (0 == memcmp (bufout + 10, buf1 + 20, 80));
+
+    // writing by at() doesn't change the other buffers sharing the chunk
+    cnt2[0] = 0xAA;
+    REQUIRE (0xAA == cnt2[0]);
+    REQUIRE (20 == cnt1[10]);
+
+    // resize
+    REQUIRE (0 == cnt1.resize (20));
+    REQUIRE (20 == cnt1.size());
+    REQUIRE (0 == cnt1.resize (30));
+    REQUIRE (30 == cnt1.size());
+    REQUIRE (0 == cnt1[29]);
+
+    // the slices are exported without copying
+    struct iovec iov[4];
+    REQUIRE (3 == cnt1.to_iovec (NULL, 0));
+    REQUIRE (0 > cnt1.to_iovec (iov, 2));
+    REQUIRE (3 == cnt1.to_iovec (iov, 4));
+    REQUIRE (10 == iov[0].iov_len);
+    REQUIRE (10 == iov[1].iov_len);
+    REQUIRE (10 == iov[2].iov_len);
+    REQUIRE (0 == memcmp (iov[0].iov_base, buf2, 10));
+    REQUIRE (0 == memcmp (iov[1].iov_base, buf1 + 20, 10));
+
+    cnt1.dump();
+    return 0;
+}
+#endif
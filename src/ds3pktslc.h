@@ -0,0 +1,76 @@
+/**
+ * @file    ds3pktslc.h
+ * @brief   reference counted slice buffer for ds3packet
+ * @author  agent (agent@local)
+ * @version 1.0
+ * @date    2026-10-17
+ * @copyright agent (2026)
+ */
+
+#ifndef _DS3PKTSLC_H
+#define _DS3PKTSLC_H
+
+#include "ds3pktbuf.h"
+
+/* The content is stored in immutable chunks, and a buffer is a list of (chunk, offset, length) slices.
+ * So the insert/copy/erase between the slice buffers only manipulate the slice list and the reference
+ * count of the chunks, the bytes are copied only when to_nbs()/peek() is called, or at() modifies a shared chunk.
+ */
+
+/** @brief the reference counted data chunk */
+typedef struct _ds3_buffer_chunk_t {
+    size_t refcnt; /**< the number of slices refer to this chunk */
+    std::vector<uint8_t> data; /**< the data, not changed after created */
+} ds3_buffer_chunk_t;
+
+ds3_buffer_chunk_t * ds3_buffer_chunk_new (uint8_t *nbsbuf, size_t szbuf);
+void ds3_buffer_chunk_ref (ds3_buffer_chunk_t * chunk);
+void ds3_buffer_chunk_unref (ds3_buffer_chunk_t * chunk);
+
+/** @brief a slice of the data chunk */
+typedef struct _ds3_buffer_slice_t {
+    ds3_buffer_chunk_t * chunk; /**< the chunk */
+    size_t off; /**< the start position in the chunk */
+    size_t sz;  /**< the size of the slice */
+} ds3_buffer_slice_t;
+
+/**
+ * @brief the packet content class for reference counted slices
+ */
+class ds3_packet_buffer_slice_t : public ds3_packet_buffer_t {
+private:
+    size_t szall; /**< the total size of the slices */
+    std::vector<ds3_buffer_slice_t> slicelist; /**< the slices of the content */
+
+    bool find_slice (size_t pos, size_t & ret_idx, size_t & ret_off); /**< get the slice at the position pos */
+    size_t split_at (size_t pos); /**< split the slice at the position pos, return the index of the slice start from pos */
+    void get_slices (size_t begin_self, size_t end_self, std::vector<ds3_buffer_slice_t> & retlist); /**< get the referenced slices of the content [begin_self, end_self) */
+    void put_slices (size_t pos_self, std::vector<ds3_buffer_slice_t> & reflist, size_t szlist); /**< insert the referenced slices at pos_self */
+
+    /* the slices are shared by reference count, don't copy the list directly */
+    ds3_packet_buffer_slice_t(const ds3_packet_buffer_slice_t &);
+    ds3_packet_buffer_slice_t & operator = (const ds3_packet_buffer_slice_t &);
+
+public:
+#if CCFDEBUG
+    virtual void dump (void);
+#endif
+    ds3_packet_buffer_slice_t() : szall(0) {}
+
+    ssize_t append (uint8_t *buf, size_t sz);
+    bool erase (size_t begin_self, size_t end_self); /**< erase the content */
+    virtual ssize_t consume_front (size_t sz); /**< remove the content from the front */
+    virtual ssize_t peek (size_t pos, uint8_t *nbsbuf, size_t szbuf); /**< copy the bytes at pos to nbsbuf */
+    virtual const uint8_t * contiguous_span (size_t pos, size_t len); /**< the pointer if the bytes are in one slice */
+    virtual ssize_t to_iovec (struct iovec *iov, size_t numiov); /**< one item for each slice */
+    size_t num_slices (void) const { return this->slicelist.size(); } /**< the number of the slices */
+
+    virtual uint8_t & at(size_t i);
+    DS3_PKTCNT_DECLARE_MEMBER_FUNCTIONS(ds3_packet_buffer_slice_t);
+};
+
+#if CCFDEBUG
+int test_pktslc (void);
+#endif
+
+#endif /* _DS3PKTSLC_H */
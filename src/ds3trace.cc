@@ -0,0 +1,346 @@
+/**
+ * @file    ds3trace.cc
+ * @brief   low overhead trace of the CCF data path
+ * @author  agent (agent@local)
+ * @version 1.0
+ * @date    2026-10-17
+ * @copyright agent (2026)
+ */
+
+#include <string.h>
+#include <assert.h>
+
+#include <vector>
+
+#include "ds3trace.h"
+
+#if CCFDEBUG
+#include "ds3pktbuf.h" // REQUIRE
+#endif
+
+#define DS3TRACE_FILE_MAGIC 0x54335344 /**< "DS3T", the magic of the saved records */
+
+/** @brief the description of the event */
+typedef struct _ds3trace_desc_t {
+    const char * name; /**< the name of the event */
+    const char * fmt;  /**< the format of the arguments, with 4 "long long" arguments */
+} ds3trace_desc_t;
+
+static const ds3trace_desc_t g_ds3trace_desc[DS3TRE_MAX] = {
+    /* DS3TRE_NONE */            { "none", "" },
+    /* DS3TRE_PKT_DESTROY */     { "destroy", "packet=0x%llx" },
+    /* DS3TRE_PACK_GRANT */      { "process grant", "time=%lldus, size=%lld, channel=%lld" },
+    /* DS3TRE_PACK_GRANT_LATE */ { "invalid grant", "current time=%lldus, time=%lldus, size=%lld, channel=%lld" },
+    /* DS3TRE_PACK_CANCEL */     { "cancel segments", "sequence=%lld, segments=%lld, bytes=%lld" },
+    /* DS3TRE_UNPACK_ERASE */    { "erase segment", "sequence=%lld, segments left=%lld" },
+    /* DS3TRE_UNPACK_NEXTOFF */  { "next offset", "sequence=%lld, offset %lld -> %lld" },
+    /* DS3TRE_UNPACK_REPLACE */  { "replace segment", "sequence=%lld, segments=%lld" },
+    /* DS3TRE_UNPACK_CORRUPT */  { "corrupted packet", "sequence=%lld, bytes=%lld, size=%lld" },
+    /* DS3TRE_UNPACK_EXPIRE */   { "reassembly timeout", "sequence=%lld, segments=%lld, bytes=%lld" },
+    /* DS3TRE_UNPACK_CLEAR */    { "clear segments", "segments=%lld" },
+    /* DS3TRE_NS2_SEND */        { "ns2 send", "curtime=%lldus, send packet tm=%lldus at channel %lld" },
+    /* DS3TRE_NS2_SNDTIMER */    { "ns2 start timer", "tm=%lldus, event=%lld, pkt.size=%lld, channelId=%lld" },
+    /* DS3TRE_NS2_RECV */        { "ns2 recv", "direction=%lld" },
+    /* DS3TRE_NS2_PIGGYBACK */   { "ns2 piggyback", "sc=%lld, request=%lld" },
+    /* DS3TRE_NS2_DROP */        { "ns2 drop", "sequence=%lld, size=%lld, drops=%lld" },
+};
+
+static const char * g_ds3trace_lvlname[] = { "NONE", "ERROR", "WARN", "INFO", "DEBUG" };
+
+int g_ds3trace_level = DS3TRACE_LVL_WARN;
+
+static ds3trace_rec_t g_ds3trace_ring[DS3TRACE_RING_SIZE]; /**< the records */
+static uint64_t g_ds3trace_widx = 0; /**< the number of the records written since the reset */
+static FILE * g_ds3trace_echo = NULL; /**< the records are also formatted to this file if it's not NULL */
+
+/**
+ * @brief write a record to the ring
+ *
+ * @param lvl : [in] the level of the trace point
+ * @param evt : [in] the event
+ * @param a0,a1,a2,a3 : [in] the arguments
+ *
+ * The slot is reserved by an atomic increase, so the threads don't block each other.
+ * The sequence # of the slot is set at last, the reader skips the slot if the sequence # doesn't match.
+ */
+void
+ds3trace_write (int lvl, int evt, int64_t a0, int64_t a1, int64_t a2, int64_t a3)
+{
+    uint64_t idx = __sync_fetch_and_add (&g_ds3trace_widx, 1);
+    ds3trace_rec_t * rec = &(g_ds3trace_ring[idx & (DS3TRACE_RING_SIZE - 1)]);
+    rec->seq = 0;
+    __sync_synchronize ();
+    rec->event = evt;
+    rec->level = lvl;
+    rec->rsv = 0;
+    rec->arg[0] = a0;
+    rec->arg[1] = a1;
+    rec->arg[2] = a2;
+    rec->arg[3] = a3;
+    __sync_synchronize ();
+    rec->seq = idx + 1;
+    if (NULL != g_ds3trace_echo) {
+        char buf[256];
+        ds3trace_rec_t reccpy = *rec;
+        reccpy.seq = idx + 1;
+        if (ds3trace_format (&reccpy, buf, sizeof(buf)) > 0) {
+            fprintf (g_ds3trace_echo, "%s\n", buf);
+        }
+    }
+}
+
+/** @brief set the runtime level, the trace points above the level are not recorded */
+void
+ds3trace_set_level (int lvl)
+{
+    g_ds3trace_level = lvl;
+}
+
+/** @brief also format the records to fp when they're written, NULL to stop; for debugging only */
+void
+ds3trace_set_echo (FILE *fp)
+{
+    g_ds3trace_echo = fp;
+}
+
+/** @brief clear the ring, it should not be called while the trace points are running */
+void
+ds3trace_reset (void)
+{
+    memset (g_ds3trace_ring, 0, sizeof(g_ds3trace_ring));
+    g_ds3trace_widx = 0;
+    __sync_synchronize ();
+}
+
+/**
+ * @brief copy the latest records in the ring
+ *
+ * @param recs : [out] the buffer of the records
+ * @param numrec : [in] the max number of the records
+ *
+ * @return the number of the records copied, the oldest one first;
+ *   if recs is NULL or numrec is 0, return the number of the records in the ring
+ *
+ * the records being written or overwritten while copying are skipped
+ */
+size_t
+ds3trace_snapshot (ds3trace_rec_t *recs, size_t numrec)
+{
+    uint64_t widx = __sync_fetch_and_add (&g_ds3trace_widx, 0);
+    uint64_t begin = 0;
+    uint64_t i;
+    size_t n = 0;
+    if (widx > DS3TRACE_RING_SIZE) {
+        begin = widx - DS3TRACE_RING_SIZE;
+    }
+    if ((NULL == recs) || (0 == numrec)) {
+        return (widx - begin);
+    }
+    if (widx - begin > numrec) {
+        begin = widx - numrec;
+    }
+    for (i = begin; i < widx; i ++) {
+        const ds3trace_rec_t * rec = &(g_ds3trace_ring[i & (DS3TRACE_RING_SIZE - 1)]);
+        if (rec->seq != i + 1) {
+            continue;
+        }
+        __sync_synchronize ();
+        recs[n] = *rec;
+        __sync_synchronize ();
+        if ((rec->seq != i + 1) || (recs[n].seq != i + 1)) {
+            continue;
+        }
+        n ++;
+    }
+    return n;
+}
+
+/**
+ * @brief format a record to text
+ *
+ * @param rec : [in] the record
+ * @param buf : [out] the buffer of the text
+ * @param szbuf : [in] the size of the buffer
+ *
+ * @return the length of the text on success, < 0 on error(unknown event)
+ */
+ssize_t
+ds3trace_format (const ds3trace_rec_t *rec, char *buf, size_t szbuf)
+{
+    int ret;
+    int ret2;
+    if ((NULL == rec) || (NULL == buf) || (szbuf < 1)) {
+        return -1;
+    }
+    if ((rec->event <= DS3TRE_NONE) || (rec->event >= DS3TRE_MAX)) {
+        return -1;
+    }
+    ret = snprintf (buf, szbuf, "[%llu] %s %s: ", (unsigned long long)(rec->seq)
+        , ((rec->level < sizeof(g_ds3trace_lvlname) / sizeof(g_ds3trace_lvlname[0])) ? g_ds3trace_lvlname[rec->level] : "?")
+        , g_ds3trace_desc[rec->event].name);
+    if (ret < 0) {
+        return -1;
+    }
+    if ((size_t)ret >= szbuf) {
+        return (szbuf - 1);
+    }
+    ret2 = snprintf (buf + ret, szbuf - ret, g_ds3trace_desc[rec->event].fmt
+        , (long long)(rec->arg[0]), (long long)(rec->arg[1]), (long long)(rec->arg[2]), (long long)(rec->arg[3]));
+    if (ret2 < 0) {
+        return -1;
+    }
+    if ((size_t)(ret + ret2) >= szbuf) {
+        return (szbuf - 1);
+    }
+    return (ret + ret2);
+}
+
+/**
+ * @brief format the records in the ring to the file
+ *
+ * @param fpout : [in] the file
+ *
+ * @return the number of the records, < 0 on error
+ */
+ssize_t
+ds3trace_dump (FILE *fpout)
+{
+    std::vector<ds3trace_rec_t> recs(DS3TRACE_RING_SIZE);
+    char buf[256];
+    size_t num;
+    size_t i;
+    if (NULL == fpout) {
+        return -1;
+    }
+    num = ds3trace_snapshot (&recs[0], recs.size());
+    for (i = 0; i < num; i ++) {
+        if (ds3trace_format (&recs[i], buf, sizeof(buf)) > 0) {
+            fprintf (fpout, "%s\n", buf);
+        }
+    }
+    return num;
+}
+
+/**
+ * @brief save the records in the ring to the file in binary, for ds3trace_decode()
+ *
+ * @param fpout : [in] the file
+ *
+ * @return the number of the records, < 0 on error
+ */
+ssize_t
+ds3trace_save (FILE *fpout)
+{
+    std::vector<ds3trace_rec_t> recs(DS3TRACE_RING_SIZE);
+    uint32_t hdr[2];
+    size_t num;
+    if (NULL == fpout) {
+        return -1;
+    }
+    num = ds3trace_snapshot (&recs[0], recs.size());
+    hdr[0] = DS3TRACE_FILE_MAGIC;
+    hdr[1] = sizeof(ds3trace_rec_t);
+    if (1 != fwrite (hdr, sizeof(hdr), 1, fpout)) {
+        return -1;
+    }
+    if ((num > 0) && (num != fwrite (&recs[0], sizeof(ds3trace_rec_t), num, fpout))) {
+        return -1;
+    }
+    return num;
+}
+
+/**
+ * @brief format the records saved by ds3trace_save()
+ *
+ * @param fpin : [in] the file of the records
+ * @param fpout : [in] the file of the text
+ *
+ * @return the number of the records, < 0 on error
+ */
+ssize_t
+ds3trace_decode (FILE *fpin, FILE *fpout)
+{
+    ds3trace_rec_t rec;
+    uint32_t hdr[2];
+    char buf[256];
+    ssize_t num = 0;
+    if ((NULL == fpin) || (NULL == fpout)) {
+        return -1;
+    }
+    if (1 != fread (hdr, sizeof(hdr), 1, fpin)) {
+        return -1;
+    }
+    if ((DS3TRACE_FILE_MAGIC != hdr[0]) || (sizeof(rec) != hdr[1])) {
+        return -1;
+    }
+    for (; 1 == fread (&rec, sizeof(rec), 1, fpin); num ++) {
+        if (ds3trace_format (&rec, buf, sizeof(buf)) > 0) {
+            fprintf (fpout, "%s\n", buf);
+        }
+    }
+    return num;
+}
+
+#if CCFDEBUG
+int
+test_trace (void)
+{
+    std::vector<ds3trace_rec_t> recs(DS3TRACE_RING_SIZE);
+    int lvlorig = g_ds3trace_level;
+    int numeval = 0;
+    char buf[256];
+    size_t i;
+
+    ds3trace_reset ();
+    REQUIRE (0 == ds3trace_snapshot (NULL, 0));
+
+    // the arguments of the disabled trace points are not evaluated
+    ds3trace_set_level (DS3TRACE_LVL_INFO);
+    DS3TRACE (DS3TRACE_LVL_DEBUG, DS3TRE_PKT_DESTROY, numeval ++, 0, 0, 0);
+    REQUIRE (0 == numeval);
+    REQUIRE (0 == ds3trace_snapshot (NULL, 0));
+    DS3TRACE (DS3TRACE_LVL_INFO, DS3TRE_PACK_GRANT, DS3TRACE_TIME_US(1.5), 1000 + (numeval ++), 2, 0);
+    REQUIRE (1 == numeval);
+    REQUIRE (1 == ds3trace_snapshot (&recs[0], recs.size()));
+    REQUIRE (1 == recs[0].seq);
+    REQUIRE (DS3TRE_PACK_GRANT == recs[0].event);
+    REQUIRE (DS3TRACE_LVL_INFO == recs[0].level);
+    REQUIRE (1500000 == recs[0].arg[0]);
+    REQUIRE (1000 == recs[0].arg[1]);
+    REQUIRE (2 == recs[0].arg[2]);
+    REQUIRE (0 < ds3trace_format (&recs[0], buf, sizeof(buf)));
+    REQUIRE (0 == strcmp (buf, "[1] INFO process grant: time=1500000us, size=1000, channel=2"));
+    // truncated text
+    REQUIRE (9 == ds3trace_format (&recs[0], buf, 10));
+    REQUIRE (9 == strlen (buf));
+    recs[0].event = DS3TRE_MAX;
+    REQUIRE (0 > ds3trace_format (&recs[0], buf, sizeof(buf)));
+
+    // the ring keeps the latest records
+    for (i = 0; i < DS3TRACE_RING_SIZE + 10; i ++) {
+        DS3TRACE (DS3TRACE_LVL_WARN, DS3TRE_UNPACK_ERASE, i, 0, 0, 0);
+    }
+    REQUIRE (DS3TRACE_RING_SIZE == ds3trace_snapshot (NULL, 0));
+    REQUIRE (DS3TRACE_RING_SIZE == ds3trace_snapshot (&recs[0], recs.size()));
+    REQUIRE (12 == recs[0].seq);
+    REQUIRE (10 == recs[0].arg[0]);
+    REQUIRE (DS3TRACE_RING_SIZE + 11 == recs[DS3TRACE_RING_SIZE - 1].seq);
+    REQUIRE (3 == ds3trace_snapshot (&recs[0], 3));
+    REQUIRE (DS3TRACE_RING_SIZE + 9 == recs[0].seq);
+
+    // save and decode offline
+    FILE * fp = tmpfile ();
+    REQUIRE (NULL != fp);
+    REQUIRE (DS3TRACE_RING_SIZE == ds3trace_save (fp));
+    rewind (fp);
+    FILE * fpnull = fopen ("/dev/null", "w");
+    REQUIRE (NULL != fpnull);
+    REQUIRE (DS3TRACE_RING_SIZE == ds3trace_decode (fp, fpnull));
+    fclose (fpnull);
+    fclose (fp);
+
+    ds3trace_set_level (lvlorig);
+    ds3trace_reset ();
+    return 0;
+}
+#endif
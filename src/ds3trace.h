@@ -0,0 +1,102 @@
+/**
+ * @file    ds3trace.h
+ * @brief   low overhead trace of the CCF data path
+ * @author  agent (agent@local)
+ * @version 1.0
+ * @date    2026-10-17
+ * @copyright agent (2026)
+ */
+
+#ifndef _DS3TRACE_H
+#define _DS3TRACE_H
+
+#include <stdint.h> // int64_t
+#include <stdio.h>  // FILE
+#include <sys/types.h> // ssize_t
+
+/* The trace points record the event id and the raw arguments to a ring in memory, the text is only
+ * formatted when the records are decoded, by ds3trace_dump() or offline by ds3trace_decode() from
+ * the records saved by ds3trace_save().
+ * A trace point above DS3TRACE_LEVEL is removed at compile time, a trace point above the runtime
+ * level costs one compare.
+ */
+
+#define DS3TRACE_LVL_NONE  0 /**< no trace */
+#define DS3TRACE_LVL_ERROR 1 /**< errors */
+#define DS3TRACE_LVL_WARN  2 /**< the data is dropped or ignored */
+#define DS3TRACE_LVL_INFO  3 /**< the events of the engines */
+#define DS3TRACE_LVL_DEBUG 4 /**< the events of each packet */
+
+#ifndef DS3TRACE_LEVEL
+#if CCFDEBUG
+#define DS3TRACE_LEVEL DS3TRACE_LVL_DEBUG /**< the max level compiled in */
+#else
+#define DS3TRACE_LEVEL DS3TRACE_LVL_INFO /**< the max level compiled in */
+#endif
+#endif
+
+#define DS3TRACE_RING_SIZE 4096 /**< the number of the records kept in the ring, has to be power of 2 */
+
+/** @brief the trace events, the arguments of each event are listed in the decode table of ds3trace.cc */
+typedef enum _ds3trace_event_t {
+    DS3TRE_NONE = 0,
+    DS3TRE_PKT_DESTROY,     /**< a packet is destroyed */
+    DS3TRE_PACK_GRANT,      /**< the pack engine processes a grant */
+    DS3TRE_PACK_GRANT_LATE, /**< the pack engine drops a grant passed */
+    DS3TRE_PACK_CANCEL,     /**< the bonded pack cancels the segments from the one failed to copy the content */
+    DS3TRE_UNPACK_ERASE,    /**< the unpack engine removes the processed segments */
+    DS3TRE_UNPACK_NEXTOFF,  /**< the unpack engine moves the offset of the next MAC header */
+    DS3TRE_UNPACK_REPLACE,  /**< the unpack engine drops a segment not processed, which has the same sequence # of a new one */
+    DS3TRE_UNPACK_CORRUPT,  /**< the unpack engine drops a corrupted MAC packet */
+    DS3TRE_UNPACK_EXPIRE,   /**< the unpack engine drops the segments waiting longer than the reassembly timeout */
+    DS3TRE_UNPACK_CLEAR,    /**< the unpack engine drops the segments of a flow removed */
+    DS3TRE_NS2_SEND,        /**< the NS2 timer sends a segment */
+    DS3TRE_NS2_SNDTIMER,    /**< the NS2 pack engine starts the timer for a segment */
+    DS3TRE_NS2_RECV,        /**< the NS2 unpack engine receives a segment */
+    DS3TRE_NS2_PIGGYBACK,   /**< the NS2 unpack engine gets a piggyback request */
+    DS3TRE_NS2_DROP,        /**< the NS2 unpack engine drops a segment not processed or corrupted */
+    DS3TRE_MAX
+} ds3trace_event_t;
+
+/** @brief the trace record */
+typedef struct _ds3trace_rec_t {
+    uint64_t seq;    /**< the sequence # of the record since the reset, starts from 1; 0 if the record is being written */
+    uint16_t event;  /**< ds3trace_event_t */
+    uint16_t level;  /**< the level of the trace point */
+    uint32_t rsv;    /**< reserved */
+    int64_t  arg[4]; /**< the arguments */
+} ds3trace_rec_t;
+
+extern int g_ds3trace_level; /**< the runtime level, use ds3trace_set_level() to change it */
+
+/** convert the time in seconds to the argument in micro seconds */
+#define DS3TRACE_TIME_US(tm) ((int64_t)((tm) * 1000000.0))
+
+/**
+ * @brief record a trace event
+ * @param lvl : [in] the level of the trace point, one of DS3TRACE_LVL_xxx
+ * @param evt : [in] the event, one of DS3TRE_xxx
+ * @param a0,a1,a2,a3 : [in] the arguments, they are evaluated only if the trace point is enabled
+ */
+#define DS3TRACE(lvl, evt, a0, a1, a2, a3) \
+    do { \
+        if (((lvl) <= DS3TRACE_LEVEL) && ((lvl) <= g_ds3trace_level)) { \
+            ds3trace_write ((lvl), (evt), (int64_t)(a0), (int64_t)(a1), (int64_t)(a2), (int64_t)(a3)); \
+        } \
+    } while (0)
+
+void ds3trace_write (int lvl, int evt, int64_t a0, int64_t a1, int64_t a2, int64_t a3);
+void ds3trace_set_level (int lvl);
+void ds3trace_set_echo (FILE *fp);
+void ds3trace_reset (void);
+size_t ds3trace_snapshot (ds3trace_rec_t *recs, size_t numrec);
+ssize_t ds3trace_format (const ds3trace_rec_t *rec, char *buf, size_t szbuf);
+ssize_t ds3trace_dump (FILE *fpout);
+ssize_t ds3trace_save (FILE *fpout);
+ssize_t ds3trace_decode (FILE *fpin, FILE *fpout);
+
+#if CCFDEBUG
+int test_trace (void);
+#endif
+
+#endif /* _DS3TRACE_H */
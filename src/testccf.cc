@@ -8,6 +8,7 @@
  */
 
 #include <stdio.h>
+#include <sched.h> // sched_yield()
 
 #include "ds3pktccf.h"
 #include "testccf.h"
@@ -23,6 +24,17 @@ ds3_ccf_pack_nbs_t::start_sndpkt_timer (double abs_time, ds3event_t evt, ds3pack
     return 0;
 }
 
+int
+ds3_ccf_pack_mgr_nbs_t::start_sndpkt_timer (size_t flow, double abs_time, ds3event_t evt, ds3packet_t * p, size_t channel_id)
+{
+    std::cout << "Got a packed CCF segment of flow " << flow << ": " << std::endl;
+    std::cout << "  -- start timer: tm=" << abs_time << ", event=" << ds3_event2desc(evt) << ", pkt.size=" << p->get_size() << ", channelId=" << channel_id << std::endl;
+    this->flowsent.push_back (flow);
+    this->tmsent.push_back (abs_time);
+    add_channel_packet (p);
+    return 0;
+}
+
 int
 ds3_ccf_unpack_nbs_t::signify_piggyback (int sc, size_t request)
 {
@@ -44,6 +56,21 @@ ds3_ccf_unpack_nbs_t::signify_packet (ds3_packet_buffer_t & macbuffer)
     return 0;
 }
 
+int
+ds3_ccf_unpack_svc_nbs_t::signify_packet (size_t shard, uint32_t flow, uint8_t sc, ds3_packet_buffer_t & macbuffer)
+{
+    // called by the worker threads, only the list of the shard is changed
+    ds3packet_nbsmac_t pkt;
+    ds3_unpack_rec_t rec;
+    assert (macbuffer.size() > 0);
+    pkt.from_nbs (&macbuffer, 0);
+    rec.flow = flow;
+    rec.sc = sc;
+    rec.sequence = pkt.gethdr_sequence();
+    this->macrecv[shard].push_back (rec);
+    return 0;
+}
+
 /*****************************************************************************/
 #if 1 // CCFDEBUG
 /* stub functions */
@@ -403,6 +430,1762 @@ test_pack_exceed_max (void)
 }
 
 
+/**
+ * @brief test the HCS of the segments
+ */
+int
+test_pack_hcs (void)
+{
+    ds3_ccf_pack_nbs_t pak;
+    ds3_ccf_unpack_nbs_t unpak;
+    ds3_grant_t gt;
+    ds3packet_nbsmac_t * pktmac = NULL;
+    ds3packet_ccf_t * pktccf = NULL;
+    ds3_packet_buffer_nbs_t nbscnt;
+    uint8_t pktcontent[20];
+    size_t nlast;
+
+    memset (pktcontent, 0xA5, sizeof(pktcontent));
+    my_set_time (0.0);
+    pak.set_pbmultiplier(5);
+    unpak.set_pbmultiplier(5);
+    pak.set_sc(0x3);
+
+    pktmac = new ds3packet_nbsmac_t ();
+    assert (NULL != pktmac);
+    nbscnt.append (pktcontent, sizeof(pktcontent));
+    pktmac->set_content (&nbscnt);
+    pktmac->sethdr_sequence(1);
+    pak.process_packet (pktmac);
+
+    nlast = get_channel_packet_length();
+    gt.set_size(DS3HDR_CCF_SIZE + pktmac->get_size());
+    gt.set_channel_id(1);
+    gt.set_time(1.0);
+    pak.add_grant (gt);
+    REQUIRE (nlast + 1 == (size_t)get_channel_packet_length());
+    pktccf = dynamic_cast<ds3packet_ccf_t *>(get_channel_packet(nlast));
+    REQUIRE (NULL != pktccf);
+    REQUIRE (pktccf->get_header().hcs == ds3hdr_ccf_calc_hcs (&(pktccf->get_header())));
+
+    // the segment with corrupted header should be dropped before it's put to the list
+    pktccf->get_header().offmac ^= 0x01;
+    REQUIRE (0 > unpak.process_packet (pktccf));
+    REQUIRE (nlast + 1 == (size_t)get_channel_packet_length());
+
+    pktccf->get_header().offmac ^= 0x01;
+    REQUIRE (0 == unpak.process_packet (pktccf));
+    // the MAC packet is extracted
+    REQUIRE (nlast + 2 == (size_t)get_channel_packet_length());
+
+    clean_all_packets ();
+    return 0;
+}
+
+/**
+ * @brief test the piggyback request patched to the last segment of the grants
+ */
+int
+test_pack_piggyback (void)
+{
+    ds3_ccf_pack_nbs_t pak;
+    ds3_ccf_unpack_nbs_t unpak;
+    std::vector<ds3_grant_t> grants;
+    ds3_grant_t gt;
+    ds3packet_nbsmac_t * pktmac = NULL;
+    ds3packet_ccf_t * pktccf1 = NULL;
+    ds3packet_ccf_t * pktccf2 = NULL;
+    ds3_packet_buffer_nbs_t nbscnt;
+    ds3hdr_ccf_view_t hdrview;
+    uint8_t pktcontent[20];
+    struct iovec iov[4];
+    size_t nlast;
+    int i;
+
+    memset (pktcontent, 0x5A, sizeof(pktcontent));
+    my_set_time (0.0);
+    pak.set_pbmultiplier(5);
+    unpak.set_pbmultiplier(5);
+    pak.set_sc(0x3);
+
+    nbscnt.append (pktcontent, sizeof(pktcontent));
+    for (i = 0; i < 2; i ++) {
+        pktmac = new ds3packet_nbsmac_t ();
+        assert (NULL != pktmac);
+        pktmac->set_content (&nbscnt);
+        pktmac->sethdr_sequence(i + 1);
+        pak.process_packet (pktmac);
+        gt.set_size(DS3HDR_CCF_SIZE + pktmac->get_size());
+        gt.set_channel_id(1);
+        gt.set_time(1.0 + i);
+        grants.push_back (gt);
+    }
+
+    nlast = get_channel_packet_length();
+    pak.add_piggyback (100);
+    pak.add_grants (grants);
+    REQUIRE (nlast + 2 == (size_t)get_channel_packet_length());
+    pktccf1 = dynamic_cast<ds3packet_ccf_t *>(get_channel_packet(nlast));
+    pktccf2 = dynamic_cast<ds3packet_ccf_t *>(get_channel_packet(nlast + 1));
+    REQUIRE (NULL != pktccf1);
+    REQUIRE (NULL != pktccf2);
+    // only the last segment carries the request
+    REQUIRE (0 == pktccf1->get_header().request);
+    REQUIRE (100 / 5 == pktccf2->get_header().request);
+    REQUIRE (pktccf1->get_header().sequence + 1 == pktccf2->get_header().sequence);
+    REQUIRE (pktccf2->get_header().hcs == ds3hdr_ccf_calc_hcs (&(pktccf2->get_header())));
+
+    // the header bytes exported are patched in place
+    REQUIRE (2 == pktccf2->to_iovec (iov, 4));
+    pktccf2->patch_header (7, pktccf2->get_header().sequence, pktccf2->get_header().sc);
+    REQUIRE (DS3HDR_CCF_SIZE == hdrview.attach ((uint8_t *)iov[0].iov_base, iov[0].iov_len));
+    REQUIRE (7 == hdrview.request());
+    REQUIRE (0x3 == hdrview.sc());
+    REQUIRE (hdrview.check_hcs());
+    REQUIRE (pktccf2->get_header().hcs == hdrview.hcs());
+
+    REQUIRE (0 == unpak.process_packet (pktccf1));
+    REQUIRE (0 == unpak.process_packet (pktccf2));
+    // the MAC packets are extracted
+    REQUIRE (nlast + 4 == (size_t)get_channel_packet_length());
+
+    clean_all_packets ();
+    return 0;
+}
+
+/**
+ * @brief test the pool of the CCF segments
+ */
+int
+test_pack_segpool (void)
+{
+    ds3_ccf_segpool_t pool(2);
+    ds3_ccf_pack_nbs_t pak;
+    ds3_ccf_unpack_pool_nbs_t unpak;
+    ds3_grant_t gt;
+    ds3packet_nbsmac_t * pktmac = NULL;
+    ds3packet_ccf_t * p1 = NULL;
+    ds3packet_ccf_t * p2 = NULL;
+    ds3packet_ccf_t * p3 = NULL;
+    ds3_packet_buffer_nbs_t nbscnt;
+    uint8_t pktcontent[20];
+    size_t nlast;
+    size_t nfree;
+
+    memset (pktcontent, 0x3C, sizeof(pktcontent));
+    nbscnt.append (pktcontent, sizeof(pktcontent));
+
+    p1 = pool.get();
+    p2 = pool.get();
+    p3 = pool.get();
+    REQUIRE ((NULL != p1) && (NULL != p2) && (NULL != p3));
+    REQUIRE (0 == pool.get_hits());
+    REQUIRE (3 == pool.get_misses());
+    p1->get_header().request = 5;
+    p1->set_content (&nbscnt);
+    p1->set_procpos_next (3);
+    pool.put (p1);
+    pool.put (p2);
+    // exceeds the capacity, deleted
+    pool.put (p3);
+    REQUIRE (2 == pool.size());
+    // the segments are reset and reused
+    REQUIRE (p2 == pool.get());
+    REQUIRE (p1 == pool.get());
+    REQUIRE (2 == pool.get_hits());
+    REQUIRE (0 == p1->get_header().request);
+    REQUIRE (0 == p1->get_content_ref().size());
+    REQUIRE (0 == p1->get_procpos_next());
+    pool.put (p1);
+    pool.put (p2);
+    pool.set_capacity (1);
+    REQUIRE (1 == pool.size());
+    // the reserved segments are limited by the capacity, and not counted as misses
+    pool.set_capacity (4);
+    pool.reserve (8);
+    REQUIRE (4 == pool.size());
+    REQUIRE (3 == pool.get_misses());
+
+    // the pack engine gets the segments from its pool
+    my_set_time (0.0);
+    pak.set_pbmultiplier(5);
+    pak.share_segpool (unpak);
+    REQUIRE (&(pak.get_segpool()) == &(unpak.get_segpool()));
+    pktmac = new ds3packet_nbsmac_t ();
+    assert (NULL != pktmac);
+    pktmac->set_content (&nbscnt);
+    pktmac->sethdr_sequence(1);
+    pak.process_packet (pktmac);
+    nlast = get_channel_packet_length();
+    gt.set_size(DS3HDR_CCF_SIZE + pktmac->get_size());
+    gt.set_channel_id(1);
+    gt.set_time(1.0);
+    pak.add_grant (gt);
+    REQUIRE (nlast + 1 == (size_t)get_channel_packet_length());
+    REQUIRE (1 == unpak.get_segpool().get_misses());
+
+    // the unpack engine owns the segment received, and returns it to the pool shared
+    p1 = dynamic_cast<ds3packet_ccf_t *>(get_channel_packet (nlast));
+    REQUIRE (NULL != p1);
+    set_channel_packet (nlast, NULL);
+    nfree = unpak.get_segpool().size();
+    REQUIRE (0 == unpak.process_packet (p1));
+    REQUIRE (nfree + 1 == unpak.get_segpool().size());
+    // the next segment packed reuses it
+    pktmac = new ds3packet_nbsmac_t ();
+    assert (NULL != pktmac);
+    pktmac->set_content (&nbscnt);
+    pktmac->sethdr_sequence(2);
+    pak.process_packet (pktmac);
+    nlast = get_channel_packet_length();
+    gt.set_time(2.0);
+    pak.add_grant (gt);
+    REQUIRE (nlast + 1 == (size_t)get_channel_packet_length());
+    REQUIRE (p1 == get_channel_packet (nlast));
+    REQUIRE (nfree == unpak.get_segpool().size());
+
+    clean_all_packets ();
+    return 0;
+}
+
+/**
+ * @brief test the bytes of the MAC packets queued in the pack engine
+ */
+int
+test_pack_queue (void)
+{
+    ds3_ccf_pack_nbs_t pak;
+    ds3_grant_t gt;
+    ds3packet_nbsmac_t * pktmac = NULL;
+    ds3_packet_buffer_nbs_t nbscnt;
+    uint8_t pktcontent[20];
+    size_t szpkt = 0;
+    size_t nlast;
+    int i;
+
+    memset (pktcontent, 0x69, sizeof(pktcontent));
+    nbscnt.append (pktcontent, sizeof(pktcontent));
+    my_set_time (0.0);
+    pak.set_pbmultiplier(5);
+    REQUIRE (0 == pak.get_pktlst_bytes());
+    for (i = 0; i < 3; i ++) {
+        pktmac = new ds3packet_nbsmac_t ();
+        assert (NULL != pktmac);
+        pktmac->set_content (&nbscnt);
+        pktmac->sethdr_sequence(i + 1);
+        szpkt = pktmac->get_size();
+        pak.process_packet (pktmac);
+    }
+    REQUIRE (3 * szpkt == pak.get_pktlst_bytes());
+
+    nlast = get_channel_packet_length();
+    // the 2nd packet is split
+    gt.set_size(DS3HDR_CCF_SIZE + szpkt + 5);
+    gt.set_channel_id(1);
+    gt.set_time(1.0);
+    pak.add_grant (gt);
+    REQUIRE (nlast + 1 == (size_t)get_channel_packet_length());
+    REQUIRE (2 * szpkt - 5 == pak.get_pktlst_bytes());
+
+    gt.set_size(DS3HDR_CCF_SIZE + 2 * szpkt);
+    gt.set_time(2.0);
+    pak.add_grant (gt);
+    REQUIRE (nlast + 2 == (size_t)get_channel_packet_length());
+    REQUIRE (0 == pak.get_pktlst_bytes());
+
+    clean_all_packets ();
+    return 0;
+}
+
+/**
+ * @brief test the queue of the grants
+ */
+int
+test_pack_grant_queue (void)
+{
+    ds3_grant_queue_t gq;
+    std::vector<ds3_grant_t> grants;
+    ds3_grant_t gt;
+    double tmlast;
+    int i;
+
+    REQUIRE (gq.empty());
+    gt.set_size (100);
+    gt.set_time (3.0);
+    gt.set_channel_id (1);
+    gq.push (gt);
+    gt.set_time (1.0);
+    gq.push (gt);
+    REQUIRE (2 == gq.size());
+    REQUIRE (1.0 == gq.top().get_time());
+
+    // a MAP with more grants than the queue, the heap is rebuilt
+    for (i = 0; i < 10; i ++) {
+        gt.set_time (2.0 + (i % 3));
+        gt.set_channel_id (10 + i);
+        grants.push_back (gt);
+    }
+    gq.push (grants);
+    REQUIRE (12 == gq.size());
+    // a MAP with less grants than the queue
+    grants.resize (2);
+    grants[0].set_time (0.5);
+    grants[1].set_time (5.0);
+    gq.push (grants);
+    REQUIRE (14 == gq.size());
+    REQUIRE (0.5 == gq.top().get_time());
+
+    // the grants before the time are removed
+    REQUIRE (2 == gq.expire (1.5));
+    REQUIRE (12 == gq.size());
+    REQUIRE (0 == gq.expire (2.0));
+
+    // the grants with the same time are in the order added
+    REQUIRE (2.0 == gq.top().get_time());
+    REQUIRE (10 == gq.top().get_channel_id());
+    gq.pop ();
+    REQUIRE (13 == gq.top().get_channel_id());
+    gq.pop ();
+    REQUIRE (16 == gq.top().get_channel_id());
+    for (tmlast = 0; ! gq.empty(); gq.pop ()) {
+        REQUIRE (tmlast <= gq.top().get_time());
+        tmlast = gq.top().get_time();
+    }
+    REQUIRE (5.0 == tmlast);
+    return 0;
+}
+
+/**
+ * @brief save the bytes of the segments in the channel from the position begin
+ */
+static int
+test_pack_save_segments (size_t begin, std::vector<std::vector<uint8_t> > & retsegs)
+{
+    size_t i;
+    retsegs.resize (0);
+    for (i = begin; i < (size_t)get_channel_packet_length(); i ++) {
+        ds3packet_ccf_t * pktccf = dynamic_cast<ds3packet_ccf_t *>(get_channel_packet (i));
+        REQUIRE (NULL != pktccf);
+        retsegs.push_back (std::vector<uint8_t>(pktccf->get_size()));
+        REQUIRE ((ssize_t)pktccf->get_size() == pktccf->to_nbs (&(retsegs.back()[0]), pktccf->get_size()));
+    }
+    return 0;
+}
+
+/**
+ * @brief fill the grants of the same size, one each second from the time tmbegin
+ */
+static void
+test_pack_fill_grants (std::vector<ds3_grant_t> & grants, size_t numgrant, size_t szgrant, double tmbegin = 1.0)
+{
+    ds3_grant_t gt;
+    size_t i;
+    grants.resize (0);
+    for (i = 0; i < numgrant; i ++) {
+        gt.set_size (DS3HDR_CCF_SIZE + szgrant);
+        gt.set_channel_id (0);
+        gt.set_time (tmbegin + i);
+        grants.push_back (gt);
+    }
+}
+
+/**
+ * @brief create the MAC packets of the sequence # from 0, the content of each one is szinc bytes longer than the previous one
+ */
+static void
+test_pack_new_macs (std::vector<ds3packet_t *> & retlst, size_t nummac, size_t szmac, size_t szinc = 0)
+{
+    std::vector<uint8_t> content (szmac + szinc * nummac + 1, 0x5A);
+    ds3_packet_buffer_nbs_t nbscnt;
+    ds3packet_nbsmac_t * pktmac;
+    size_t i;
+    retlst.resize (0);
+    for (i = 0; i < nummac; i ++) {
+        nbscnt.resize (0);
+        nbscnt.append (&content[0], szmac + i * szinc);
+        pktmac = new ds3packet_nbsmac_t ();
+        assert (NULL != pktmac);
+        pktmac->set_content (&nbscnt);
+        pktmac->sethdr_sequence (i);
+        retlst.push_back (pktmac);
+    }
+}
+
+/**
+ * @brief pack the MAC packets of the sequence # from 0 by the grants of the same size
+ *
+ * @param pak : [in,out] the pack engine
+ * @param nummac : [in] the number of the MAC packets
+ * @param szmac : [in] the size of the content of the first MAC packet
+ * @param szinc : [in] the content of each MAC packet is szinc bytes longer than the previous one
+ * @param numgrant : [in] the number of the grants
+ * @param szgrant : [in] the size of the grants, not including the CCF header
+ * @param retlast : [out] the position of the first segment in the channel
+ *
+ * @return the number of the segments sent
+ */
+static size_t
+test_pack_segments (ds3_ccf_pack_t & pak, size_t nummac, size_t szmac, size_t szinc, size_t numgrant, size_t szgrant, size_t * retlast)
+{
+    std::vector<ds3packet_t *> pktlst;
+    std::vector<ds3_grant_t> grants;
+    size_t i;
+    test_pack_new_macs (pktlst, nummac, szmac, szinc);
+    for (i = 0; i < pktlst.size(); i ++) {
+        pak.process_packet (pktlst[i]);
+    }
+    test_pack_fill_grants (grants, numgrant, szgrant);
+    *retlast = get_channel_packet_length();
+    pak.add_grants (grants);
+    return get_channel_packet_length() - *retlast;
+}
+
+/**
+ * @brief pack the MAC packets with the worker threads or not, save the segments sent
+ */
+static int
+test_pack_bonded_run (size_t numworkers, std::vector<std::vector<uint8_t> > & retsegs)
+{
+    ds3_ccf_pack_nbs_t pak;
+    std::vector<ds3_grant_t> grants;
+    ds3_grant_t gt;
+    ds3packet_nbsmac_t * pktmac = NULL;
+    ds3_packet_buffer_nbs_t nbscnt;
+    uint8_t pktcontent[300];
+    size_t nlast;
+    size_t i;
+    int j;
+
+    my_set_time (0.0);
+    pak.set_pbmultiplier(5);
+    REQUIRE (0 == pak.set_workers (numworkers));
+    REQUIRE (numworkers == pak.get_workers());
+    for (i = 0; i < 12; i ++) {
+        for (j = 0; j < (int)sizeof(pktcontent); j ++) {
+            pktcontent[j] = (uint8_t)(i * 31 + j);
+        }
+        nbscnt.resize (0);
+        nbscnt.append (pktcontent, 40 + (i * 23) % 250);
+        pktmac = new ds3packet_nbsmac_t ();
+        assert (NULL != pktmac);
+        pktmac->set_content (&nbscnt);
+        pktmac->sethdr_sequence(i + 1);
+        pak.process_packet (pktmac);
+    }
+    pak.add_piggyback (500);
+
+    nlast = get_channel_packet_length();
+    // the grants on the bonded channels, in any order
+    for (i = 0; i < 9; i ++) {
+        gt.set_size (DS3HDR_CCF_SIZE + 100 + (i * 57) % 300);
+        gt.set_channel_id (1 + (i % 3));
+        gt.set_time (1.0 + (double)((i * 5) % 9));
+        grants.push_back (gt);
+    }
+    pak.add_grants (grants);
+    REQUIRE ((size_t)get_channel_packet_length() > nlast);
+    REQUIRE (0 == test_pack_save_segments (nlast, retsegs));
+    clean_all_packets ();
+    return 0;
+}
+
+/** @brief the MAC packet fails to copy its content if flg_fail is set */
+class test_nbsmac_fail_t : public ds3packet_nbsmac_t {
+public:
+    test_nbsmac_fail_t () : flg_fail(false) {}
+    virtual ds3_packet_buffer_t * insert_to (size_t pos_peer, ds3_packet_buffer_t *peer, size_t begin_self, size_t end_self)
+        { if (this->flg_fail) { return NULL; } return ds3packet_nbsmac_t::insert_to (pos_peer, peer, begin_self, end_self); }
+    bool flg_fail; /**< fail insert_to() */
+};
+
+/**
+ * @brief the bonded pack puts back the bytes of the segments failed to copy, and packs them by the next grants
+ */
+static int
+test_pack_bonded_fail (void)
+{
+    ds3_ccf_pack_nbs_t pak;
+    std::vector<std::vector<uint8_t> > segs;
+    std::vector<ds3_grant_t> grants;
+    ds3_grant_t gt;
+    ds3packet_nbsmac_t * pktmac = NULL;
+    test_nbsmac_fail_t * pktfail = NULL;
+    ds3_packet_buffer_nbs_t nbscnt;
+    ds3hdr_ccf_t ccfhdr;
+    uint8_t pktcontent[100];
+    size_t szall = 0;
+    size_t szseg = 0;
+    size_t nlast;
+    size_t nseg;
+    size_t i;
+
+    memset (pktcontent, 0x3C, sizeof(pktcontent));
+    nbscnt.append (pktcontent, sizeof(pktcontent));
+    my_set_time (0.0);
+    pak.set_pbmultiplier(5);
+    REQUIRE (0 == pak.set_workers (2));
+    for (i = 0; i < 6; i ++) {
+        if (3 == i) {
+            pktfail = new test_nbsmac_fail_t ();
+            pktmac = pktfail;
+        } else {
+            pktmac = new ds3packet_nbsmac_t ();
+        }
+        assert (NULL != pktmac);
+        pktmac->set_content (&nbscnt);
+        pktmac->sethdr_sequence(i + 1);
+        szall += pktmac->get_size();
+        pak.process_packet (pktmac);
+    }
+    pktfail->flg_fail = true;
+    nlast = get_channel_packet_length();
+    for (i = 0; i < 10; i ++) {
+        gt.set_size (DS3HDR_CCF_SIZE + 70);
+        gt.set_channel_id (1 + (i % 2));
+        gt.set_time (1.0 + i);
+        grants.push_back (gt);
+    }
+    pak.add_grants (grants);
+    // the segments before the one of the packet 3 are sent, the rest bytes are kept
+    nseg = get_channel_packet_length() - nlast;
+    REQUIRE (nseg > 0);
+    REQUIRE (1 == pak.get_num_cancels());
+    REQUIRE (nseg * 70 + pak.get_pktlst_bytes() == szall);
+
+    // the next round packs the bytes in order
+    pktfail->flg_fail = false;
+    pak.process_packet (NULL);
+    REQUIRE (1 == pak.get_num_cancels());
+    REQUIRE (0 == pak.get_pktlst_bytes());
+    REQUIRE (0 == test_pack_save_segments (nlast, segs));
+    REQUIRE (segs.size() > nseg);
+    for (i = 0; i < segs.size(); i ++) {
+        REQUIRE (DS3HDR_CCF_SIZE == ds3hdr_ccf_from_nbs (&(segs[i][0]), segs[i].size(), &ccfhdr));
+        REQUIRE (i == ccfhdr.sequence);
+        szseg += segs[i].size() - DS3HDR_CCF_SIZE;
+    }
+    REQUIRE (szall == szseg);
+    clean_all_packets ();
+    return 0;
+}
+
+/**
+ * @brief test the bonded pack, the segments are the same as the serial pack
+ */
+int
+test_pack_bonded (void)
+{
+    std::vector<std::vector<uint8_t> > segserial;
+    std::vector<std::vector<uint8_t> > segbonded;
+    ds3hdr_ccf_t ccfhdr;
+    size_t i;
+
+    REQUIRE (0 == test_pack_bonded_fail ());
+
+    REQUIRE (0 == test_pack_bonded_run (0, segserial));
+    REQUIRE (0 == test_pack_bonded_run (3, segbonded));
+    REQUIRE (segserial.size() > 3);
+    REQUIRE (segserial.size() == segbonded.size());
+    for (i = 0; i < segserial.size(); i ++) {
+        REQUIRE (segserial[i] == segbonded[i]);
+        // the sequence numbers are in the sending order
+        REQUIRE (DS3HDR_CCF_SIZE == ds3hdr_ccf_from_nbs (&(segbonded[i][0]), segbonded[i].size(), &ccfhdr));
+        REQUIRE (i == ccfhdr.sequence);
+    }
+    return 0;
+}
+
+/**
+ * @brief test the pack manager of the flows, each flow packs the same segments as a pack engine
+ */
+int
+test_pack_flows (void)
+{
+    ds3_ccf_pack_nbs_t pak;
+    ds3_ccf_pack_mgr_nbs_t mgr(3, 5);
+    std::vector<std::vector<uint8_t> > segpak;
+    std::vector<std::vector<uint8_t> > segmgr;
+    std::vector<ds3_grant_t> grants;
+    ds3_grant_t gt;
+    ds3packet_nbsmac_t * pktmac = NULL;
+    ds3_packet_buffer_nbs_t nbscnt;
+    ds3hdr_ccf_t ccfhdr;
+    uint8_t pktcontent[100];
+    size_t szpkt = 0;
+    size_t nlast;
+    size_t i;
+    size_t j;
+
+    memset (pktcontent, 0x4B, sizeof(pktcontent));
+    nbscnt.append (pktcontent, sizeof(pktcontent));
+    my_set_time (0.0);
+    REQUIRE (3 == mgr.get_num_flows());
+    REQUIRE (0 > mgr.set_num_flows (2));
+    REQUIRE (0 == mgr.set_num_flows (4));
+    REQUIRE (0 > mgr.add_packet (4, NULL));
+    for (i = 0; i < 4; i ++) {
+        REQUIRE (0 == mgr.set_sc (i, i + 1));
+    }
+    for (i = 0; i < 3; i ++) {
+        gt.set_size (DS3HDR_CCF_SIZE + 70 + i * 40);
+        gt.set_channel_id (i);
+        gt.set_time (1.0 + i);
+        grants.push_back (gt);
+    }
+
+    // the reference: a pack engine for the flow 2
+    pak.set_pbmultiplier(5);
+    pak.set_sc (3);
+    for (i = 0; i < 3; i ++) {
+        pktmac = new ds3packet_nbsmac_t ();
+        assert (NULL != pktmac);
+        pktmac->set_content (&nbscnt);
+        pktmac->sethdr_sequence(i + 1);
+        szpkt = pktmac->get_size();
+        pak.process_packet (pktmac);
+    }
+    pak.add_piggyback (100);
+    nlast = get_channel_packet_length();
+    pak.add_grants (grants);
+    REQUIRE (0 == test_pack_save_segments (nlast, segpak));
+    REQUIRE (3 == segpak.size());
+    clean_all_packets ();
+
+    // the packets of all of the flows, the grants of the flows 1 and 2
+    for (i = 0; i < 3; i ++) {
+        for (j = 0; j < 4; j ++) {
+            pktmac = new ds3packet_nbsmac_t ();
+            assert (NULL != pktmac);
+            pktmac->set_content (&nbscnt);
+            pktmac->sethdr_sequence(i + 1);
+            REQUIRE (0 == mgr.add_packet (j, pktmac));
+        }
+    }
+    REQUIRE (0 == mgr.get_pending());
+    REQUIRE (3 * szpkt == mgr.get_pktlst_bytes (0));
+    for (i = 0; i < grants.size(); i ++) {
+        REQUIRE (0 == mgr.add_grant (2, grants[i]));
+    }
+    REQUIRE (0 == mgr.add_piggyback (2, 100));
+    gt.set_size (DS3HDR_CCF_SIZE + 20);
+    gt.set_time (5.0);
+    REQUIRE (0 == mgr.add_grant (1, gt));
+    REQUIRE (2 == mgr.get_pending());
+    nlast = get_channel_packet_length();
+    REQUIRE (4 == mgr.process ());
+    REQUIRE (0 == mgr.get_pending());
+    REQUIRE (nlast + 4 == (size_t)get_channel_packet_length());
+    // the flows are serviced in the order of their grants added
+    REQUIRE (2 == mgr.flowsent[0]);
+    REQUIRE (1 == mgr.flowsent[3]);
+    REQUIRE (0 == test_pack_save_segments (nlast, segmgr));
+    for (i = 0; i < segpak.size(); i ++) {
+        REQUIRE (segpak[i] == segmgr[i]);
+    }
+    REQUIRE (DS3HDR_CCF_SIZE == ds3hdr_ccf_from_nbs (&(segmgr[3][0]), segmgr[3].size(), &ccfhdr));
+    REQUIRE (0 == ccfhdr.sequence);
+    REQUIRE (2 == ccfhdr.sc);
+    REQUIRE (3 * szpkt - 20 == mgr.get_pktlst_bytes (1));
+    REQUIRE (0 == mgr.get_pktlst_bytes (2));
+    REQUIRE (3 * szpkt == mgr.get_pktlst_bytes (3));
+
+    // the grants added out of the time order are used in the time order
+    mgr.flowsent.resize (0);
+    mgr.tmsent.resize (0);
+    gt.set_size (DS3HDR_CCF_SIZE + 30);
+    gt.set_time (7.0);
+    REQUIRE (0 == mgr.add_grant (3, gt));
+    gt.set_time (6.0);
+    REQUIRE (0 == mgr.add_grant (3, gt));
+    gt.set_time (6.5);
+    REQUIRE (0 == mgr.add_grant (3, gt));
+    gt.set_time (8.0);
+    REQUIRE (0 == mgr.add_grant (3, gt));
+    // the grant passed is removed
+    my_set_time (6.2);
+    REQUIRE (3 == mgr.process ());
+    REQUIRE (3 == mgr.tmsent.size());
+    REQUIRE (6.5 == mgr.tmsent[0]);
+    REQUIRE (7.0 == mgr.tmsent[1]);
+    REQUIRE (8.0 == mgr.tmsent[2]);
+    REQUIRE (3 * szpkt - 3 * 30 == mgr.get_pktlst_bytes (3));
+
+    my_set_time (0.0);
+    clean_all_packets ();
+    return 0;
+}
+
+/**
+ * @brief test the reorder ring and the unpack of the segments received out of order
+ */
+int
+test_unpack_reorder (void)
+{
+    ds3_ccf_reorder_t ring;
+    ds3packet_ccf_t seg1;
+    ds3packet_ccf_t seg2;
+    ds3_ccf_pack_nbs_t pak;
+    ds3_ccf_unpack_nbs_t unpak;
+    ds3packet_nbsmac_t * pktmac = NULL;
+    size_t szmac = 100;
+    size_t seqbegin = 0;
+    size_t nlast;
+    size_t nseg;
+    size_t i;
+    static const size_t seqs[] = { 8190, 8191, 0, 1, 5 };
+
+    // the continual segments across the wrap of the sequence #
+    for (i = 0; i < NUMARRAY(seqs); i ++) {
+        seg1.get_header().sequence = seqs[i];
+        REQUIRE (NULL == ring.put (&seg1));
+    }
+    REQUIRE (5 == ring.size());
+    // the slots are allocated by the pages of 64 slots
+    REQUIRE (2 == ring.get_num_pages());
+    REQUIRE (ring.test (8191));
+    REQUIRE (! ring.test (2));
+    REQUIRE (4 == ring.find_run (0, seqbegin));
+    REQUIRE (8190 == seqbegin);
+    REQUIRE (4 == ring.find_run (8190, seqbegin));
+    REQUIRE (8190 == seqbegin);
+    REQUIRE (1 == ring.find_run (5, seqbegin));
+    REQUIRE (5 == seqbegin);
+    REQUIRE (0 == ring.find_run (4, seqbegin));
+    // the segment in the slot is replaced
+    seg2.get_header().sequence = 5;
+    REQUIRE (&seg1 == ring.put (&seg2));
+    REQUIRE (&seg2 == ring.get (5));
+    REQUIRE (5 == ring.size());
+    REQUIRE (&seg1 == ring.remove (0));
+    REQUIRE (NULL == ring.remove (0));
+    REQUIRE (2 == ring.find_run (8191, seqbegin));
+    REQUIRE (8190 == seqbegin);
+    // all of the slots are used
+    for (i = 0; i < DS3_CCF_SEQ_NUM; i ++) {
+        seg1.get_header().sequence = i;
+        ring.put (&seg1);
+    }
+    REQUIRE (DS3_CCF_SEQ_NUM == ring.size());
+    REQUIRE (DS3_CCF_SEQ_NUM / DS3_CCF_PAGE_SLOTS == ring.get_num_pages());
+    REQUIRE (DS3_CCF_SEQ_NUM == ring.find_run (100, seqbegin));
+    REQUIRE (101 == seqbegin);
+    for (i = 0; i < DS3_CCF_SEQ_NUM; i ++) {
+        ring.remove (i);
+    }
+    REQUIRE (0 == ring.size());
+    REQUIRE (0 == ring.get_num_pages());
+    REQUIRE (NULL == ring.get (100));
+    REQUIRE (NULL == ring.remove (100));
+    // the segments put and removed in order use one page
+    for (i = 0; i < 3 * DS3_CCF_PAGE_SLOTS; i ++) {
+        seg1.get_header().sequence = i;
+        REQUIRE (NULL == ring.put (&seg1));
+        REQUIRE (1 == ring.get_num_pages());
+        REQUIRE (&seg1 == ring.remove (i));
+    }
+    REQUIRE (0 == ring.get_num_pages());
+
+    // the MAC packets are split to several segments, the segments are received in the reverse order
+    my_set_time (0.0);
+    pak.set_pbmultiplier(5);
+    unpak.set_pbmultiplier(5);
+    nseg = test_pack_segments (pak, 6, szmac, 0, 20, 37, &nlast);
+    REQUIRE (nseg > 10);
+    REQUIRE (0 == pak.get_pktlst_bytes());
+    for (i = nseg; i > 0; i --) {
+        REQUIRE (0 == unpak.process_packet (get_channel_packet (nlast + i - 1)));
+    }
+    // all of the MAC packets are unpacked, and all of the segments are released
+    REQUIRE (nlast + nseg + 6 == (size_t)get_channel_packet_length());
+    REQUIRE (0 == unpak.get_num_segments());
+    for (i = 0; i < 6; i ++) {
+        pktmac = dynamic_cast<ds3packet_nbsmac_t *>(get_channel_packet (nlast + nseg + i));
+        REQUIRE (NULL != pktmac);
+        REQUIRE (5 - i == pktmac->gethdr_sequence());
+        REQUIRE ((ssize_t)szmac == pktmac->get_content_ref().size());
+    }
+
+    clean_all_packets ();
+    return 0;
+}
+
+/**
+ * @brief test the timing wheel and the reassembly timeout of the unpack engine
+ */
+int
+test_unpack_aging (void)
+{
+    ds3_timer_wheel_t wheel(8, 1.0);
+    std::vector<ds3_timer_entry_t> tmlst;
+    ds3_ccf_pack_nbs_t pak;
+    ds3_ccf_unpack_nbs_t unpak;
+    ds3packet_nbsmac_t * pktmac = NULL;
+    size_t szmac = 100;
+    size_t nlast;
+    size_t nseg;
+    size_t nmac;
+    size_t ilost;
+    size_t nwait;
+    size_t i;
+
+    // the timers of the later rounds of the wheel stay in the slots
+    wheel.add (1, 2.5);
+    wheel.add (2, 10.5);
+    wheel.add (3, 3.0);
+    REQUIRE (3 == wheel.size());
+    REQUIRE (0 == wheel.expire (2.0, tmlst));
+    REQUIRE (2 == wheel.expire (3.0, tmlst));
+    REQUIRE (2 == tmlst.size());
+    REQUIRE (1 == tmlst[0].id);
+    REQUIRE (3 == tmlst[1].id);
+    // the timer passed is expired by the next call
+    wheel.add (4, 1.0);
+    REQUIRE (1 == wheel.expire (3.0, tmlst));
+    REQUIRE (4 == tmlst[2].id);
+    REQUIRE (0 == wheel.expire (10.0, tmlst));
+    REQUIRE (1 == wheel.expire (100.0, tmlst));
+    REQUIRE (2 == tmlst[3].id);
+    REQUIRE (0 == wheel.size());
+
+    // the MAC packets are split to several segments, one of the segments is lost
+    my_set_time (0.0);
+    unpak.set_timeout (1.0);
+    REQUIRE (1.0 == unpak.get_timeout());
+    nseg = test_pack_segments (pak, 6, szmac, 0, 20, 50, &nlast);
+    REQUIRE (nseg > 10);
+    ilost = nseg / 2;
+    for (i = 0; i < nseg; i ++) {
+        if (i != ilost) {
+            REQUIRE (0 == unpak.process_packet (get_channel_packet (nlast + i)));
+        }
+    }
+    // the MAC packets not in the lost segment are unpacked, the segments around the lost one are kept
+    nmac = get_channel_packet_length() - nlast - nseg;
+    REQUIRE (nmac < 6);
+    REQUIRE (nmac >= 4);
+    REQUIRE (unpak.get_num_segments() > 0);
+    REQUIRE (0 == unpak.get_num_timeouts());
+    my_set_time (0.5);
+    REQUIRE (0 == unpak.expire());
+    REQUIRE (unpak.get_num_segments() > 0);
+
+    // the segments are dropped after the timeout, and no MAC packet is created from the partial data
+    my_set_time (1.5);
+    nwait = unpak.get_num_segments();
+    REQUIRE (nwait == unpak.expire());
+    REQUIRE (0 == unpak.get_num_segments());
+    REQUIRE (unpak.get_num_timeouts() > 0);
+    REQUIRE (unpak.get_num_dropped() > 0);
+    REQUIRE (unpak.get_bytes_dropped() > 0);
+    REQUIRE (nlast + nseg + nmac == (size_t)get_channel_packet_length());
+    for (i = 0; i < nmac; i ++) {
+        pktmac = dynamic_cast<ds3packet_nbsmac_t *>(get_channel_packet (nlast + nseg + i));
+        REQUIRE (NULL != pktmac);
+        REQUIRE ((ssize_t)szmac == pktmac->get_content_ref().size());
+    }
+
+    // the lost segment received late waits alone, and is dropped by the next timeout
+    nmac = unpak.get_num_dropped();
+    REQUIRE (0 == unpak.process_packet (get_channel_packet (nlast + ilost)));
+    REQUIRE (1 == unpak.get_num_segments());
+    my_set_time (3.0);
+    REQUIRE (1 == unpak.expire());
+    REQUIRE (0 == unpak.get_num_segments());
+    REQUIRE (nmac + 1 == unpak.get_num_dropped());
+
+    my_set_time (0.0);
+    clean_all_packets ();
+    return 0;
+}
+
+/** @brief the hash function of the test, the shard is selected by the flow id */
+static size_t
+test_unpack_hash_flow (uint32_t flow, uint8_t sc)
+{
+    return flow;
+}
+
+/**
+ * @brief test the unpack service of the flows, the shards are processed by the worker threads
+ */
+int
+test_unpack_shards (void)
+{
+    ds3_ccf_pack_mgr_nbs_t mgr(6, 5);
+    ds3_ccf_unpack_svc_nbs_t svc(4, 5);
+    ds3_grant_t gt;
+    ds3packet_nbsmac_t * pktmac = NULL;
+    ds3_packet_buffer_nbs_t nbscnt;
+    uint8_t pktcontent[100];
+    std::vector<size_t> nummac(6, 0);
+    size_t nbase;
+    size_t nwait;
+    size_t nlast;
+    size_t nseg;
+    size_t i;
+    size_t j;
+
+    memset (pktcontent, 0x69, sizeof(pktcontent));
+    nbscnt.append (pktcontent, sizeof(pktcontent));
+    my_set_time (0.0);
+    // the flows 0 and 3 use the same SID Cluster of the different CMs
+    for (i = 0; i < 6; i ++) {
+        REQUIRE (0 == mgr.set_sc (i, i % 3));
+        for (j = 0; j < 4; j ++) {
+            pktmac = new ds3packet_nbsmac_t ();
+            assert (NULL != pktmac);
+            pktmac->set_content (&nbscnt);
+            pktmac->sethdr_sequence(i * 10 + j);
+            REQUIRE (0 == mgr.add_packet (i, pktmac));
+        }
+        for (j = 0; j < 12; j ++) {
+            gt.set_size (DS3HDR_CCF_SIZE + 50);
+            gt.set_channel_id (i);
+            gt.set_time (1.0 + j);
+            REQUIRE (0 == mgr.add_grant (i, gt));
+        }
+    }
+    nlast = get_channel_packet_length();
+    nbase = nlast;
+    REQUIRE (mgr.process () > 0);
+    nseg = get_channel_packet_length() - nlast;
+    REQUIRE (nseg == mgr.flowsent.size());
+
+    REQUIRE (4 == svc.get_num_shards());
+    REQUIRE (0 == svc.set_workers (2));
+    REQUIRE (2 == svc.get_workers());
+    svc.macrecv.resize (svc.get_num_shards());
+    svc.numrecycle.resize (svc.get_num_shards(), 0);
+    // the segments of all of the flows are received in the reverse order
+    for (i = nseg; i > 0; i --) {
+        REQUIRE (0 == svc.add_packet (mgr.flowsent[i - 1], get_channel_packet (nlast + i - 1)));
+    }
+    REQUIRE (nseg == svc.get_pending());
+    REQUIRE (nseg == svc.process());
+    REQUIRE (0 == svc.get_pending());
+    REQUIRE (6 == svc.get_num_contexts());
+    REQUIRE (0 == svc.get_num_segments());
+    // the contexts can't be moved to the other shards
+    REQUIRE (0 > svc.set_shards (2));
+    for (i = 0; i < svc.get_num_shards(); i ++) {
+        for (j = 0; j < svc.macrecv[i].size(); j ++) {
+            ds3_unpack_rec_t & rec = svc.macrecv[i][j];
+            REQUIRE (rec.flow < 6);
+            REQUIRE (rec.sc == rec.flow % 3);
+            REQUIRE (i == svc.get_shard (rec.flow, rec.sc));
+            REQUIRE (rec.flow == rec.sequence / 10);
+            nummac[rec.flow] ++;
+        }
+    }
+    nlast = 0;
+    for (i = 0; i < 6; i ++) {
+        REQUIRE (4 == nummac[i]);
+    }
+    for (i = 0; i < svc.get_num_shards(); i ++) {
+        nlast += svc.numrecycle[i];
+    }
+    REQUIRE (nseg == nlast);
+
+    // the idle contexts are deleted by expire()
+    REQUIRE (0 == svc.expire());
+    REQUIRE (0 == svc.get_num_contexts());
+    REQUIRE (6 == svc.get_num_freed());
+    REQUIRE (0 > svc.remove_flow (1, 1));
+
+    // the first segment of the flows 1 and 2 is lost, the rest ones wait in the contexts
+    nummac.assign (6, 0);
+    for (i = 0; i < nseg; i ++) {
+        j = mgr.flowsent[i];
+        if ((j != 1) && (j != 2)) {
+            continue;
+        }
+        if (nummac[j] ++ > 0) {
+            REQUIRE (0 == svc.add_packet (j, get_channel_packet (nbase + i)));
+        }
+    }
+    REQUIRE (svc.process() > 0);
+    REQUIRE (2 == svc.get_num_contexts());
+    REQUIRE (svc.get_num_segments() > 0);
+    REQUIRE (0 == svc.expire());
+    REQUIRE (2 == svc.get_num_contexts());
+    // a segment not processed is dropped with the ones waiting
+    for (i = 0; i < nseg; i ++) {
+        if (1 == mgr.flowsent[i]) {
+            REQUIRE (0 == svc.add_packet (1, get_channel_packet (nbase + i)));
+            break;
+        }
+    }
+    REQUIRE (svc.remove_flow (1, 1) > 1);
+    REQUIRE (0 == svc.get_pending());
+    REQUIRE (1 == svc.get_num_contexts());
+    REQUIRE (0 > svc.remove_flow (1, 1));
+    nwait = svc.get_num_segments();
+    REQUIRE ((ssize_t)nwait == svc.remove_flow (2, 2));
+    REQUIRE (0 == svc.get_num_contexts());
+    REQUIRE (0 == svc.get_num_segments());
+
+    // the segments waiting in the contexts and the ones not processed are dropped by clear()
+    nlast = 0;
+    for (i = 0; i < nseg; i ++) {
+        if ((2 == mgr.flowsent[i]) && (nlast ++ > 0)) {
+            REQUIRE (0 == svc.add_packet (2, get_channel_packet (nbase + i)));
+        }
+    }
+    REQUIRE (nlast - 1 == svc.process());
+    nwait = svc.get_num_segments();
+    REQUIRE (nwait > 0);
+    for (i = 0; i < nseg; i ++) {
+        if (2 == mgr.flowsent[i]) {
+            REQUIRE (0 == svc.add_packet (2, get_channel_packet (nbase + i)));
+            break;
+        }
+    }
+    REQUIRE (nwait + 1 == svc.clear());
+    REQUIRE (0 == svc.get_pending());
+    REQUIRE (0 == svc.get_num_contexts());
+    REQUIRE (0 == svc.clear());
+
+    // the hash function selects the shards
+    ds3_ccf_unpack_svc_nbs_t svc2;
+    REQUIRE (0 > svc2.set_shards (0));
+    REQUIRE (0 == svc2.set_shards (3, test_unpack_hash_flow));
+    REQUIRE (3 == svc2.get_num_shards());
+    REQUIRE (1 == svc2.get_shard (4, 2));
+    REQUIRE (2 == svc2.get_shard (5, 0));
+
+    clean_all_packets ();
+    return 0;
+}
+
+/**
+ * @brief test the pipelined unpack, the segments are passed to the reassembly thread by the SPSC ring
+ */
+int
+test_unpack_pipe (void)
+{
+    ds3_spsc_ring_t ring;
+    void * items[8];
+    int vals[6];
+    ds3_ccf_pack_nbs_t pak;
+    ds3_ccf_unpack_nbs_t unpak;
+    ds3_ccf_unpack_pipe_t pipe(&unpak);
+    ds3_pipe_stats_t stats;
+    std::vector<ds3packet_t *> seglst;
+    ds3packet_nbsmac_t * pktmac = NULL;
+    size_t szmac = 100;
+    size_t nlast;
+    size_t nseg;
+    size_t i;
+
+    // the ring of 4 slots
+    REQUIRE (0 > ring.reset (0));
+    REQUIRE (0 == ring.reset (3));
+    REQUIRE (4 == ring.capacity());
+    for (i = 0; i < 4; i ++) {
+        REQUIRE (ring.push (&vals[i]));
+    }
+    REQUIRE (! ring.push (&vals[4]));
+    REQUIRE (4 == ring.size());
+    REQUIRE (2 == ring.pop (items, 2));
+    REQUIRE (&vals[0] == items[0]);
+    REQUIRE (&vals[1] == items[1]);
+    REQUIRE (ring.push (&vals[4]));
+    REQUIRE (ring.push (&vals[5]));
+    REQUIRE (4 == ring.pop (items, NUMARRAY(items)));
+    for (i = 0; i < 4; i ++) {
+        REQUIRE (&vals[i + 2] == items[i]);
+    }
+    REQUIRE (0 == ring.pop (items, NUMARRAY(items)));
+
+    // the MAC packets are split to several segments
+    my_set_time (0.0);
+    nseg = test_pack_segments (pak, 6, szmac, 0, 20, 37, &nlast);
+    REQUIRE (nseg > 10);
+    // the channel list is changed by the reassembly thread
+    for (i = 0; i < nseg; i ++) {
+        seglst.push_back (get_channel_packet (nlast + i));
+    }
+
+    REQUIRE (0 == pipe.start (4, 2, 10));
+    REQUIRE (pipe.is_running());
+    REQUIRE (0 > pipe.start ());
+    for (i = 0; i < nseg; i ++) {
+        // retry if the ring is full
+        for (; 0 != pipe.push (seglst[i]); ) {
+            sched_yield ();
+        }
+    }
+    pipe.stop ();
+    REQUIRE (! pipe.is_running());
+    pipe.get_stats (stats);
+    REQUIRE (nseg == stats.num_push);
+    REQUIRE (nseg == stats.num_pop);
+    REQUIRE (stats.num_batch >= nseg / 2);
+    REQUIRE (stats.max_depth > 0);
+    REQUIRE (stats.max_depth <= 4);
+
+    // all of the MAC packets are unpacked by the reassembly thread in order
+    REQUIRE (nlast + nseg + 6 == (size_t)get_channel_packet_length());
+    REQUIRE (0 == unpak.get_num_segments());
+    for (i = 0; i < 6; i ++) {
+        pktmac = dynamic_cast<ds3packet_nbsmac_t *>(get_channel_packet (nlast + nseg + i));
+        REQUIRE (NULL != pktmac);
+        REQUIRE (i == pktmac->gethdr_sequence());
+        REQUIRE ((ssize_t)szmac == pktmac->get_content_ref().size());
+    }
+
+    clean_all_packets ();
+    return 0;
+}
+
+/**
+ * @brief test the batch process of the pack and the unpack, the results are the same as the packets processed one by one
+ */
+int
+test_pack_batch (void)
+{
+    ds3_ccf_pack_nbs_t pak1;
+    ds3_ccf_pack_nbs_t pak2;
+    ds3_ccf_unpack_batch_nbs_t unpak;
+    std::vector<std::vector<uint8_t> > segs1;
+    std::vector<std::vector<uint8_t> > segs2;
+    std::vector<ds3_grant_t> grants;
+    std::vector<ds3packet_t *> pktlst;
+    ds3packet_nbsmac_t * pktmac = NULL;
+    size_t szmac = 100;
+    bool seen[6];
+    size_t nlast;
+    size_t nseg;
+    size_t i;
+
+    my_set_time (0.0);
+
+    // the reference: the packets are queued before the grants
+    test_pack_segments (pak1, 6, szmac, 0, 20, 37, &nlast);
+    REQUIRE (0 == test_pack_save_segments (nlast, segs1));
+    clean_all_packets ();
+
+    // the grants are processed once for the batch
+    test_pack_fill_grants (grants, 20, 37);
+    pak2.add_grants (grants);
+    REQUIRE (0 == get_channel_packet_length());
+    test_pack_new_macs (pktlst, 6, szmac);
+    REQUIRE ((int)segs1.size() == pak2.process_packets (&pktlst[0], pktlst.size()));
+    REQUIRE (0 == pak2.get_pktlst_bytes());
+    REQUIRE (0 == test_pack_save_segments (0, segs2));
+    REQUIRE (segs1.size() == segs2.size());
+    for (i = 0; i < segs1.size(); i ++) {
+        REQUIRE (segs1[i] == segs2[i]);
+    }
+
+    // the segments are unpacked in the batches of 4, in the reverse order
+    nseg = get_channel_packet_length();
+    REQUIRE (nseg > 10);
+    pktlst.resize (0);
+    for (i = nseg; i > 0; i --) {
+        pktlst.push_back (get_channel_packet (i - 1));
+    }
+    for (i = 0; i < nseg; i += 4) {
+        REQUIRE (0 == unpak.process_packets (&pktlst[i], std::min ((size_t)4, nseg - i)));
+    }
+    REQUIRE (0 == unpak.get_num_segments());
+    REQUIRE (6 == unpak.nummac);
+    REQUIRE (unpak.numcalls <= (nseg + 3) / 4);
+    REQUIRE (nseg + 6 == (size_t)get_channel_packet_length());
+    // the MAC packets of a batch are extracted from the first segment of the batch
+    memset (seen, 0, sizeof(seen));
+    for (i = 0; i < 6; i ++) {
+        pktmac = dynamic_cast<ds3packet_nbsmac_t *>(get_channel_packet (nseg + i));
+        REQUIRE (NULL != pktmac);
+        REQUIRE (pktmac->gethdr_sequence() < 6);
+        REQUIRE (! seen[pktmac->gethdr_sequence()]);
+        seen[pktmac->gethdr_sequence()] = true;
+        REQUIRE ((ssize_t)szmac == pktmac->get_content_ref().size());
+    }
+
+    clean_all_packets ();
+    return 0;
+}
+
+/**
+ * @brief the packet content class of the test MAC packets with a variable size header
+ *
+ * The header starts with the size of the header (2 bytes) and ends with the size of the data (2 bytes),
+ * both are in network byte sequence.
+ */
+class test_buffer_varhdr_t : public ds3_packet_buffer_nbs_t {
+public:
+    test_buffer_varhdr_t() {}
+    virtual ssize_t block_size_at (size_t pos);
+    DS3_PKTCNT_DECLARE_MEMBER_FUNCTIONS_MINI(test_buffer_varhdr_t);
+};
+
+inline test_buffer_varhdr_t::test_buffer_varhdr_t(ds3_packet_buffer_t *peer, size_t begin, size_t end)
+    : ds3_packet_buffer_nbs_t (peer, begin, end) { }
+
+inline test_buffer_varhdr_t::~test_buffer_varhdr_t() {}
+
+DS3_PKTCNT_IMPLEMENT_BUFTYPE(test_buffer_varhdr_t, ds3_packet_buffer_nbs_t);
+
+ssize_t
+test_buffer_varhdr_t::block_size_at (size_t pos)
+{
+    uint8_t tmpbuf[2];
+    const uint8_t * p = this->peek_span (pos, 2, tmpbuf);
+    if (NULL == p) {
+        return -1;
+    }
+    size_t szhdr = ((size_t)p[0] << 8) | p[1];
+    if (szhdr < 4) {
+        return -1;
+    }
+    p = this->peek_span (pos + szhdr - 2, 2, tmpbuf);
+    if (NULL == p) {
+        return -1;
+    }
+    return (ssize_t)(szhdr + (((size_t)p[0] << 8) | p[1]));
+}
+
+/** @brief the ccf unpack class records the sizes of the MAC packets, the segments are owned by the test */
+class test_unpack_varhdr_t : public ds3_ccf_unpack_nbs_t {
+public:
+    test_unpack_varhdr_t () : numdrop(0) {}
+    std::vector<ssize_t> szmac; /**< the size of the MAC packets signified */
+    std::vector<ssize_t> szblock; /**< the size of the MAC packets read from their headers */
+    size_t numdrop; /**< the number of the segments dropped */
+protected:
+    virtual void recycle_packet (ds3packet_t *p) {}
+    virtual void drop_packet (ds3packet_t *p) { this->numdrop ++; }
+    virtual int signify_packet (ds3_packet_buffer_t & macbuffer) { this->szmac.push_back (macbuffer.size()); this->szblock.push_back (macbuffer.block_size_at (0)); return 0; }
+};
+
+/** @brief fill a test MAC packet with the variable size header, return the size of the packet */
+static size_t
+test_fill_varhdr (uint8_t * buf, size_t szhdr, size_t szdata)
+{
+    memset (buf, 0xA5, szhdr + szdata);
+    buf[0] = (szhdr >> 8) & 0xFF;
+    buf[1] = szhdr & 0xFF;
+    buf[szhdr - 2] = (szdata >> 8) & 0xFF;
+    buf[szhdr - 1] = szdata & 0xFF;
+    return szhdr + szdata;
+}
+
+/**
+ * @brief the MAC headers split across the segments beyond the first 16 bytes are copied contiguously,
+ *   and the MAC packet without a header in DS3_MAC_HDR_MAX bytes is dropped as corrupted
+ */
+static int
+test_unpack_delin_hdr (void)
+{
+    test_unpack_varhdr_t unpak;
+    test_buffer_varhdr_t cnt;
+    std::vector<ds3packet_ccf_t *> seglst;
+    ds3packet_ccf_t * seg;
+    ds3hdr_ccf_t ccfhdr;
+    uint8_t stream[480];
+    // the 20 bytes header of F1 is split 18 + 2 bytes, the one of F2 is split 15 + 5 bytes
+    const size_t segbound[] = {0, 68, 75, 125, 140, 340, 450, 480};
+    const size_t segoffmac[] = {0, 0, 35, 0, 0, 0, 0};
+    const uint8_t segpfi[] = {1, 0, 1, 0, 1, 0, 1};
+    const ssize_t szexp[] = {50, 60, 30, 30};
+    size_t pos = 0;
+    size_t i;
+
+    // F0 [0,50), F1 [50,110), F2 [110,140), G [140,450) with a 300 bytes header, H [450,480)
+    pos += test_fill_varhdr (stream + pos, 20, 30);
+    pos += test_fill_varhdr (stream + pos, 20, 40);
+    pos += test_fill_varhdr (stream + pos, 20, 10);
+    pos += test_fill_varhdr (stream + pos, 300, 10);
+    pos += test_fill_varhdr (stream + pos, 4, 26);
+    REQUIRE (sizeof(stream) == pos);
+
+    my_set_time (0.0);
+    for (i = 0; i + 1 < NUMARRAY(segbound); i ++) {
+        cnt.resize (0);
+        cnt.append (stream + segbound[i], segbound[i + 1] - segbound[i]);
+        seg = new ds3packet_ccf_t ();
+        assert (NULL != seg);
+        seg->set_content (&cnt);
+        memset (&ccfhdr, 0, sizeof(ccfhdr));
+        ccfhdr.pfi = segpfi[i];
+        ccfhdr.offmac = segoffmac[i];
+        seg->set_header (&ccfhdr);
+        seg->patch_header (0, i, 0);
+        seglst.push_back (seg);
+    }
+    for (i = 0; i < seglst.size(); i ++) {
+        REQUIRE (0 == unpak.process_packet (seglst[i]));
+    }
+    REQUIRE (0 == unpak.get_num_segments());
+    // G is dropped with the segment of its header after DS3_MAC_HDR_MAX bytes
+    REQUIRE (NUMARRAY(szexp) == unpak.szmac.size());
+    REQUIRE (1 == unpak.numdrop);
+    for (i = 0; i < unpak.szmac.size(); i ++) {
+        REQUIRE (szexp[i] == unpak.szmac[i]);
+        REQUIRE (szexp[i] == unpak.szblock[i]);
+    }
+
+    for (i = 0; i < seglst.size(); i ++) {
+        delete seglst[i];
+    }
+    return 0;
+}
+
+/**
+ * @brief test the delineation of the MAC packets which headers are split across the small segments
+ */
+int
+test_unpack_delin (void)
+{
+    ds3_ccf_pack_nbs_t pak;
+    ds3_ccf_unpack_nbs_t unpak;
+    std::vector<ds3_grant_t> grants;
+    std::vector<ds3packet_t *> seglst;
+    ds3packet_nbsmac_t * pktmac = NULL;
+    bool seen[6];
+    size_t nlast;
+    size_t nseg;
+    size_t nmac;
+    size_t gap;
+    size_t round;
+    size_t i;
+
+    REQUIRE (0 == test_unpack_delin_hdr ());
+    my_set_time (0.0);
+    for (round = 0; round < 2; round ++) {
+        // 4 bytes of each segment, the 6 bytes MAC headers are split;
+        // the grants left by the first round are used by the MAC packets of the second round
+        nlast = get_channel_packet_length();
+        test_pack_new_macs (seglst, 6, 1, 19);
+        for (i = 0; i < seglst.size(); i ++) {
+            pak.process_packet (seglst[i]);
+        }
+        test_pack_fill_grants (grants, 100, 4, 1.0 + round * 100);
+        pak.add_grants (grants);
+        nseg = get_channel_packet_length() - nlast;
+        REQUIRE (nseg > 50);
+        REQUIRE (0 == pak.get_pktlst_bytes());
+        seglst.resize (0);
+        for (i = 0; i < nseg; i ++) {
+            seglst.push_back (get_channel_packet (nlast + i));
+        }
+        if (0 == round) {
+            // in order, each MAC packet is signified by its last segment
+            nmac = 0;
+            for (i = 0; i < nseg; i ++) {
+                REQUIRE (0 == unpak.process_packet (seglst[i]));
+                if ((size_t)get_channel_packet_length() > nlast + nseg + nmac) {
+                    pktmac = dynamic_cast<ds3packet_nbsmac_t *>(get_channel_packet (nlast + nseg + nmac));
+                    REQUIRE (NULL != pktmac);
+                    REQUIRE (nmac == pktmac->gethdr_sequence());
+                    REQUIRE (1 + nmac * 19 == (size_t)pktmac->get_content_ref().size());
+                    nmac ++;
+                }
+                REQUIRE (nlast + nseg + nmac == (size_t)get_channel_packet_length());
+            }
+            REQUIRE (6 == nmac);
+        } else {
+            // a segment in the middle is lost, the MAC packets after it wait in another run
+            gap = nseg / 3;
+            for (i = 0; i < nseg; i ++) {
+                if (i != gap) {
+                    REQUIRE (0 == unpak.process_packet (seglst[i]));
+                }
+            }
+            REQUIRE (0 < unpak.get_num_segments());
+            REQUIRE (0 == unpak.process_packet (seglst[gap]));
+            REQUIRE (nlast + nseg + 6 == (size_t)get_channel_packet_length());
+            memset (seen, 0, sizeof(seen));
+            for (i = 0; i < 6; i ++) {
+                pktmac = dynamic_cast<ds3packet_nbsmac_t *>(get_channel_packet (nlast + nseg + i));
+                REQUIRE (NULL != pktmac);
+                REQUIRE (pktmac->gethdr_sequence() < 6);
+                REQUIRE (! seen[pktmac->gethdr_sequence()]);
+                seen[pktmac->gethdr_sequence()] = true;
+                REQUIRE (1 + pktmac->gethdr_sequence() * 19 == (size_t)pktmac->get_content_ref().size());
+            }
+        }
+        REQUIRE (0 == unpak.get_num_segments());
+    }
+
+    clean_all_packets ();
+    return 0;
+}
+
+/**
+ * @brief test the frame views of the MAC packets, the segments are held until the views are released
+ */
+int
+test_unpack_view (void)
+{
+    ds3_ccf_pack_nbs_t pak;
+    ds3_ccf_unpack_view_nbs_t unpak;
+    ds3_ccf_unpack_nbs_t unpak2;
+    ds3_ccf_unpack_view_nbs_t unpak3;
+    std::vector<ds3_grant_t> grants;
+    ds3packet_nbsmac_t * pktmac = NULL;
+    ds3packet_ccf_t * pktccf = NULL;
+    ds3packet_ccf_t * pktwrap = NULL;
+    ds3_packet_buffer_t macbuf;
+    ds3hdr_mac_t machdr;
+    struct iovec iov[16];
+    uint8_t frame[120];
+    size_t nlast;
+    size_t nseg;
+    size_t szall;
+    ssize_t numiov;
+    size_t i;
+    size_t j;
+
+    // the MAC packets of 13, 32, ..., 108 bytes over the grants of 29 bytes
+    my_set_time (0.0);
+    nseg = test_pack_segments (pak, 6, 7, 19, 20, 29, &nlast);
+    REQUIRE (nseg > 10);
+
+    for (i = 0; i < nseg; i ++) {
+        REQUIRE (0 == unpak.process_packet (get_channel_packet (nlast + i)));
+    }
+    // no copy signified, the segments processed are held by the views
+    REQUIRE (nlast + nseg == (size_t)get_channel_packet_length());
+    REQUIRE (6 == unpak.views.size());
+    REQUIRE (6 == unpak.get_num_views());
+    REQUIRE (0 == unpak.get_num_segments());
+    REQUIRE (0 == unpak.numrecycle);
+    REQUIRE (nseg == unpak.get_num_held());
+    for (i = 0; i < 6; i ++) {
+        ds3_frame_view_t * view = unpak.views[i];
+        REQUIRE (6 + 7 + i * 19 == view->size());
+        REQUIRE ((ssize_t)view->size() == view->peek (0, frame, sizeof(frame)));
+        REQUIRE (0 < ds3hdr_mac_from_nbs (frame, view->size(), &machdr));
+        REQUIRE (i == machdr.sequence);
+        REQUIRE (7 + i * 19 == machdr.length);
+        // the pieces refer to the bytes of the segments
+        numiov = view->to_iovec (iov, NUMARRAY(iov));
+        REQUIRE (numiov == (ssize_t)view->num_pieces());
+        REQUIRE (numiov == view->to_iovec (NULL, 0));
+        szall = 0;
+        for (j = 0; j < (size_t)numiov; j ++) {
+            REQUIRE (0 == memcmp (iov[j].iov_base, frame + szall, iov[j].iov_len));
+            szall += iov[j].iov_len;
+        }
+        REQUIRE (szall == view->size());
+        REQUIRE ((ssize_t)view->size() == view->to_buffer (macbuf));
+        REQUIRE ((ssize_t)view->size() == macbuf.size());
+        REQUIRE (3 == view->peek (view->size() - 3, frame, 10));
+    }
+    REQUIRE (unpak.views[5]->num_pieces() > 2);
+
+    // the segments are recycled after the last view refers to them is released
+    unpak.release_frame (unpak.views[5]);
+    unpak.views.pop_back ();
+    REQUIRE (5 == unpak.get_num_views());
+    REQUIRE (0 < unpak.numrecycle);
+    REQUIRE (nseg == unpak.numrecycle + unpak.get_num_held());
+    unpak.release_views ();
+    REQUIRE (0 == unpak.get_num_views());
+    REQUIRE (0 == unpak.get_num_held());
+    REQUIRE (nseg == unpak.numrecycle);
+
+    // the segment replaced by the one of the next round of the sequence # is dropped after its view is released
+    pktccf = dynamic_cast<ds3packet_ccf_t *>(get_channel_packet (nlast));
+    REQUIRE (NULL != pktccf);
+    REQUIRE (0 == unpak3.process_packet (pktccf));
+    REQUIRE (1 == unpak3.views.size());
+    REQUIRE (1 == unpak3.get_num_segments());
+    REQUIRE (0 == unpak3.get_num_held());
+    pktwrap = new ds3packet_ccf_t ();
+    assert (NULL != pktwrap);
+    pktwrap->set_content (&(pktccf->get_content_ref()));
+    pktwrap->set_header (&(pktccf->get_header()));
+    pktwrap->patch_header (pktccf->get_header().request, pktccf->get_header().sequence + DS3_CCF_SEQ_MASK + 1, pktccf->get_header().sc);
+    REQUIRE (0 == unpak3.process_packet (pktwrap));
+    REQUIRE (2 == unpak3.views.size());
+    REQUIRE (1 == unpak3.get_num_segments());
+    REQUIRE (1 == unpak3.get_num_held());
+    REQUIRE (0 == unpak3.numdrop);
+    REQUIRE (6 + 7 == unpak3.views[0]->peek (0, frame, sizeof(frame)));
+    unpak3.release_frame (unpak3.views[0]);
+    REQUIRE (0 == unpak3.get_num_held());
+    REQUIRE (1 == unpak3.numdrop);
+    REQUIRE (1 == unpak3.clear ());
+    REQUIRE (1 == unpak3.get_num_held());
+    REQUIRE (1 == unpak3.numdrop);
+    unpak3.views.erase (unpak3.views.begin());
+    unpak3.release_views ();
+    REQUIRE (0 == unpak3.get_num_views());
+    REQUIRE (0 == unpak3.get_num_held());
+    REQUIRE (2 == unpak3.numdrop);
+    REQUIRE (0 == unpak3.numrecycle);
+    delete pktwrap;
+
+    // the fallback copies the MAC packets to signify_packet()
+    unpak2.set_frame_view (true);
+    for (i = 0; i < nseg; i ++) {
+        REQUIRE (0 == unpak2.process_packet (get_channel_packet (nlast + i)));
+    }
+    REQUIRE (0 == unpak2.get_num_views());
+    REQUIRE (0 == unpak2.get_num_held());
+    REQUIRE (nlast + nseg + 6 == (size_t)get_channel_packet_length());
+    for (i = 0; i < 6; i ++) {
+        pktmac = dynamic_cast<ds3packet_nbsmac_t *>(get_channel_packet (nlast + nseg + i));
+        REQUIRE (NULL != pktmac);
+        REQUIRE (i == pktmac->gethdr_sequence());
+        REQUIRE (7 + i * 19 == (size_t)pktmac->get_content_ref().size());
+    }
+
+    clean_all_packets ();
+    return 0;
+}
+
+/**
+ * @brief test the unpack of the segments which stay in the receive buffer
+ */
+int
+test_unpack_ref (void)
+{
+    ds3_ccf_pack_nbs_t pak;
+    ds3_ccf_unpack_nbs_t unpak;
+    ds3_grant_t gt;
+    ds3packet_nbsmac_t * pktmac = NULL;
+    ds3packet_nbsmac_t * pktmac2 = NULL;
+    ds3packet_ccf_t * pktccf = NULL;
+    ds3packet_ccf_t * pktref = NULL;
+    ds3_packet_buffer_nbs_t nbscnt;
+    ds3_packet_buffer_nbsmac_t refcnt;
+    uint8_t pktcontent[30];
+    std::vector<uint8_t> rxbuf;
+    size_t nlast;
+    size_t i;
+
+    for (i = 0; i < sizeof(pktcontent); i ++) {
+        pktcontent[i] = i;
+    }
+    my_set_time (0.0);
+    pak.set_pbmultiplier(5);
+    unpak.set_pbmultiplier(5);
+
+    pktmac = new ds3packet_nbsmac_t ();
+    assert (NULL != pktmac);
+    nbscnt.append (pktcontent, sizeof(pktcontent));
+    pktmac->set_content (&nbscnt);
+    pktmac->sethdr_sequence(7);
+    pak.process_packet (pktmac);
+
+    nlast = get_channel_packet_length();
+    gt.set_size(DS3HDR_CCF_SIZE + pktmac->get_size());
+    gt.set_channel_id(1);
+    gt.set_time(1.0);
+    pak.add_grant (gt);
+    REQUIRE (nlast + 1 == (size_t)get_channel_packet_length());
+    pktccf = dynamic_cast<ds3packet_ccf_t *>(get_channel_packet(nlast));
+    REQUIRE (NULL != pktccf);
+
+    // the received bytes of the segment
+    rxbuf.resize (pktccf->get_size());
+    REQUIRE ((ssize_t)pktccf->get_size() == pktccf->to_nbs (&rxbuf[0], rxbuf.size()));
+
+    pktref = new ds3packet_ccf_t ();
+    REQUIRE ((ssize_t)rxbuf.size() == pktref->from_nbs_ref (&rxbuf[0], rxbuf.size(), &refcnt));
+    REQUIRE (0 == memcmp (&(pktref->get_header()), &(pktccf->get_header()), sizeof(ds3hdr_ccf_t)));
+    // no copy of the content
+    REQUIRE (pktref->get_content_ref().contiguous_span (0, 1) == &rxbuf[DS3HDR_CCF_SIZE]);
+
+    REQUIRE (0 == unpak.process_packet (pktref));
+    REQUIRE (nlast + 2 == (size_t)get_channel_packet_length());
+    pktmac2 = dynamic_cast<ds3packet_nbsmac_t *>(get_channel_packet(nlast + 1));
+    REQUIRE (NULL != pktmac2);
+    REQUIRE (7 == pktmac2->gethdr_sequence());
+    REQUIRE (sizeof(pktcontent) == (size_t)pktmac2->get_content_ref().size());
+    for (i = 0; i < sizeof(pktcontent); i ++) {
+        REQUIRE (pktcontent[i] == pktmac2->get_content_ref().at(i));
+    }
+    // the MAC packet delivered has its own copy, the receive buffer can be reused
+    delete pktref;
+    memset (&rxbuf[0], 0xEE, rxbuf.size());
+    REQUIRE (7 == pktmac2->gethdr_sequence());
+    REQUIRE (sizeof(pktcontent) == (size_t)pktmac2->get_content_ref().size());
+    for (i = 0; i < sizeof(pktcontent); i ++) {
+        REQUIRE (pktcontent[i] == pktmac2->get_content_ref().at(i));
+    }
+
+    clean_all_packets ();
+    return 0;
+}
+
+/**
+ * @brief test the unpack of the segments which content are reference counted slices
+ */
+int
+test_unpack_slice (void)
+{
+    ds3_ccf_pack_nbs_t pak;
+    ds3_ccf_unpack_nbs_t unpak;
+    ds3_grant_t gt;
+    ds3packet_nbsmac_t * pktmac = NULL;
+    ds3packet_nbsmac_t * pktmac2 = NULL;
+    ds3packet_ccf_t * pktccf = NULL;
+    ds3packet_ccf_t * pktslc = NULL;
+    ds3_packet_buffer_nbs_t nbscnt;
+    ds3_packet_buffer_slicemac_t slccnt;
+    uint8_t pktcontent[40];
+    std::vector<uint8_t> rxbuf;
+    size_t nlast;
+    size_t i;
+
+    for (i = 0; i < sizeof(pktcontent); i ++) {
+        pktcontent[i] = 0xFF - i;
+    }
+    my_set_time (0.0);
+    pak.set_pbmultiplier(5);
+    unpak.set_pbmultiplier(5);
+
+    pktmac = new ds3packet_nbsmac_t ();
+    assert (NULL != pktmac);
+    nbscnt.append (pktcontent, sizeof(pktcontent));
+    pktmac->set_content (&nbscnt);
+    pktmac->sethdr_sequence(9);
+    pak.process_packet (pktmac);
+
+    nlast = get_channel_packet_length();
+    gt.set_size(DS3HDR_CCF_SIZE + pktmac->get_size());
+    gt.set_channel_id(1);
+    gt.set_time(1.0);
+    pak.add_grant (gt);
+    REQUIRE (nlast + 1 == (size_t)get_channel_packet_length());
+    pktccf = dynamic_cast<ds3packet_ccf_t *>(get_channel_packet(nlast));
+    REQUIRE (NULL != pktccf);
+
+    rxbuf.resize (pktccf->get_size());
+    REQUIRE ((ssize_t)pktccf->get_size() == pktccf->to_nbs (&rxbuf[0], rxbuf.size()));
+    REQUIRE ((ssize_t)(rxbuf.size() - DS3HDR_CCF_SIZE) == slccnt.append (&rxbuf[DS3HDR_CCF_SIZE], rxbuf.size() - DS3HDR_CCF_SIZE));
+
+    pktslc = new ds3packet_ccf_t ();
+    pktslc->set_header (&(pktccf->get_header()));
+    REQUIRE (0 == pktslc->set_content (&slccnt));
+    REQUIRE (NULL != dynamic_cast<ds3_packet_buffer_slice_t *>(pktslc->get_content_ref().get_buffer()));
+
+    REQUIRE (0 == unpak.process_packet (pktslc));
+    REQUIRE (nlast + 2 == (size_t)get_channel_packet_length());
+    pktmac2 = dynamic_cast<ds3packet_nbsmac_t *>(get_channel_packet(nlast + 1));
+    REQUIRE (NULL != pktmac2);
+    REQUIRE (9 == pktmac2->gethdr_sequence());
+    // the content of the MAC packet shares the chunk
+    REQUIRE (NULL != dynamic_cast<ds3_packet_buffer_slice_t *>(pktmac2->get_content_ref().get_buffer()));
+    REQUIRE (sizeof(pktcontent) == (size_t)pktmac2->get_content_ref().size());
+    for (i = 0; i < sizeof(pktcontent); i ++) {
+        REQUIRE (pktcontent[i] == pktmac2->get_content_ref().at(i));
+    }
+
+    delete pktslc;
+    clean_all_packets ();
+    return 0;
+}
+
+/**
+ * @brief test the scatter-gather export and the gather receive of the segments
+ */
+int
+test_pack_iovec (void)
+{
+    ds3_ccf_pack_nbs_t pak;
+    ds3_ccf_unpack_nbs_t unpak;
+    ds3_grant_t gt;
+    ds3packet_nbsmac_t * pktmac = NULL;
+    ds3packet_nbsmac_t * pktmac2 = NULL;
+    ds3packet_ccf_t * pktccf = NULL;
+    ds3packet_ccf_t pktrx1;
+    ds3packet_ccf_t pktrx2;
+    ds3_packet_buffer_nbs_t nbscnt;
+    ds3_packet_buffer_nbsmac_t rxcnt1;
+    ds3_packet_buffer_nbsmac_t rxcnt2;
+    uint8_t pktcontent[50];
+    std::vector<uint8_t> nbsbuf;
+    std::vector<uint8_t> gathered;
+    struct iovec iov[4];
+    ssize_t numiov;
+    ssize_t i;
+    size_t nlast;
+
+    for (i = 0; i < (ssize_t)sizeof(pktcontent); i ++) {
+        pktcontent[i] = 3 * i;
+    }
+    my_set_time (0.0);
+    pak.set_pbmultiplier(5);
+    unpak.set_pbmultiplier(5);
+
+    pktmac = new ds3packet_nbsmac_t ();
+    assert (NULL != pktmac);
+    nbscnt.append (pktcontent, sizeof(pktcontent));
+    pktmac->set_content (&nbscnt);
+    pktmac->sethdr_sequence(11);
+    pak.process_packet (pktmac);
+
+    nlast = get_channel_packet_length();
+    gt.set_size(DS3HDR_CCF_SIZE + pktmac->get_size());
+    gt.set_channel_id(1);
+    gt.set_time(1.0);
+    pak.add_grant (gt);
+    REQUIRE (nlast + 1 == (size_t)get_channel_packet_length());
+    pktccf = dynamic_cast<ds3packet_ccf_t *>(get_channel_packet(nlast));
+    REQUIRE (NULL != pktccf);
+
+    // the header and the content
+    REQUIRE (2 == pktccf->to_iovec (NULL, 0));
+    REQUIRE (0 > pktccf->to_iovec (iov, 1));
+    numiov = pktccf->to_iovec (iov, 4);
+    REQUIRE (2 == numiov);
+    REQUIRE (DS3HDR_CCF_SIZE == iov[0].iov_len);
+    REQUIRE (&(pktccf->get_content_ref().at(0)) == (uint8_t *)iov[1].iov_base);
+    for (i = 0; i < numiov; i ++) {
+        gathered.insert (gathered.end(), (uint8_t *)iov[i].iov_base, (uint8_t *)iov[i].iov_base + iov[i].iov_len);
+    }
+    nbsbuf.resize (pktccf->get_size());
+    REQUIRE ((ssize_t)pktccf->get_size() == pktccf->to_nbs (&nbsbuf[0], nbsbuf.size()));
+    REQUIRE (nbsbuf == gathered);
+
+    // the header is split, and the content is in one item
+    iov[0].iov_base = &nbsbuf[0];
+    iov[0].iov_len = 5;
+    iov[1].iov_base = &nbsbuf[5];
+    iov[1].iov_len = nbsbuf.size() - 5;
+    REQUIRE ((ssize_t)nbsbuf.size() == pktrx1.from_iovec (iov, 2, &rxcnt1));
+    REQUIRE (0 == memcmp (&(pktrx1.get_header()), &(pktccf->get_header()), sizeof(ds3hdr_ccf_t)));
+    REQUIRE (pktrx1.get_content_ref().contiguous_span (0, 1) == &nbsbuf[DS3HDR_CCF_SIZE]);
+
+    // the content is in several items
+    iov[0].iov_base = &nbsbuf[0];
+    iov[0].iov_len = 3;
+    iov[1].iov_base = &nbsbuf[3];
+    iov[1].iov_len = 8;
+    iov[2].iov_base = &nbsbuf[11];
+    iov[2].iov_len = 9;
+    iov[3].iov_base = &nbsbuf[20];
+    iov[3].iov_len = nbsbuf.size() - 20;
+    REQUIRE ((ssize_t)nbsbuf.size() == pktrx2.from_iovec (iov, 4, &rxcnt2));
+    REQUIRE (0 == memcmp (&(pktrx2.get_header()), &(pktccf->get_header()), sizeof(ds3hdr_ccf_t)));
+    REQUIRE (pktccf->get_content_ref().size() == pktrx2.get_content_ref().size());
+    // the items are gathered into the storage of the content, not referred
+    REQUIRE (0 == rxcnt2.size());
+    REQUIRE (pktrx2.get_content_ref().contiguous_span (0, 1) != &nbsbuf[DS3HDR_CCF_SIZE]);
+    gathered.resize (pktrx2.get_size());
+    REQUIRE ((ssize_t)pktrx2.get_size() == pktrx2.to_nbs (&gathered[0], gathered.size()));
+    REQUIRE (nbsbuf == gathered);
+
+    REQUIRE (0 == unpak.process_packet (&pktrx2));
+    REQUIRE (nlast + 2 == (size_t)get_channel_packet_length());
+    pktmac2 = dynamic_cast<ds3packet_nbsmac_t *>(get_channel_packet(nlast + 1));
+    REQUIRE (NULL != pktmac2);
+    REQUIRE (11 == pktmac2->gethdr_sequence());
+    REQUIRE (sizeof(pktcontent) == (size_t)pktmac2->get_content_ref().size());
+    for (i = 0; i < (ssize_t)sizeof(pktcontent); i ++) {
+        REQUIRE (pktcontent[i] == pktmac2->get_content_ref().at(i));
+    }
+
+    clean_all_packets ();
+    return 0;
+}
+
 int
 test_pack_random (void)
 {
@@ -416,6 +2199,23 @@ test_pack_random (void)
 int
 test_pack (void)
 {
+    REQUIRE (0 == test_pack_hcs());
+    REQUIRE (0 == test_pack_piggyback());
+    REQUIRE (0 == test_pack_segpool());
+    REQUIRE (0 == test_pack_queue());
+    REQUIRE (0 == test_pack_grant_queue());
+    REQUIRE (0 == test_pack_bonded());
+    REQUIRE (0 == test_pack_flows());
+    REQUIRE (0 == test_unpack_ref());
+    REQUIRE (0 == test_unpack_reorder());
+    REQUIRE (0 == test_unpack_aging());
+    REQUIRE (0 == test_unpack_shards());
+    REQUIRE (0 == test_unpack_pipe());
+    REQUIRE (0 == test_pack_batch());
+    REQUIRE (0 == test_unpack_delin());
+    REQUIRE (0 == test_unpack_view());
+    REQUIRE (0 == test_unpack_slice());
+    REQUIRE (0 == test_pack_iovec());
     REQUIRE (0 == test_pack_fix1());
     REQUIRE (0 == test_pack_fix2());
     REQUIRE (0 == test_pack_fix3());
@@ -507,7 +2307,13 @@ main1(void)
     REQUIRE (0 == test_pktclass());
     REQUIRE (0 == test_machdr());
     REQUIRE (0 == test_ccfhdr());
+    REQUIRE (0 == test_ccfhdr_batch());
+    REQUIRE (0 == test_ccfhdr_hcs());
+    REQUIRE (0 == test_ccfhdr_view());
+    REQUIRE (0 == test_pktslc());
     REQUIRE (0 == test_pktcnt());
+    REQUIRE (0 == test_pktgnc_index());
+    REQUIRE (0 == test_trace());
     REQUIRE (0 == test_pack());
     REQUIRE (0 == test_pktgnc());
     return 0;
@@ -26,6 +26,18 @@ protected:
     virtual double current_time (void) { return my_time(); }
 };
 
+/** @brief the ccf pack manager class for nbs */
+class ds3_ccf_pack_mgr_nbs_t : public ds3_ccf_pack_mgr_t {
+public:
+    ds3_ccf_pack_mgr_nbs_t (size_t numflows = 0, size_t pbmul = 0) : ds3_ccf_pack_mgr_t(numflows, pbmul) {}
+    std::vector<size_t> flowsent; /**< the flow ids of the segments sent */
+    std::vector<double> tmsent; /**< the time of the segments sent */
+protected:
+    virtual void recycle_packet (ds3packet_t *p) { my_recycle_packet (p); }
+    virtual int start_sndpkt_timer (size_t flow, double abs_time, ds3event_t evt, ds3packet_t * p, size_t channel_id);
+    virtual double current_time (void) { return my_time(); }
+};
+
 /** @brief the ccf unpack class for nbs */
 class ds3_ccf_unpack_nbs_t : public ds3_ccf_unpack_t {
 public:
@@ -34,6 +46,59 @@ protected:
     virtual void drop_packet (ds3packet_t *p) { std::cout << "Warning: CCF segment unprocessed/corrupted: " << std::endl; p->dump(); /*my_drop_packet (p);*/ }
     virtual int signify_packet (ds3_packet_buffer_t & macbuffer);
     virtual int signify_piggyback (int sc, size_t request);
+    virtual double current_time (void) { return my_time(); }
+};
+
+/** @brief the ccf unpack class for nbs, owns the segments and returns them to the segment pool */
+class ds3_ccf_unpack_pool_nbs_t : public ds3_ccf_unpack_nbs_t {
+protected:
+    virtual void recycle_packet (ds3packet_t *p) { this->recycle_segment (static_cast<ds3packet_ccf_t *>(p)); }
+    virtual void drop_packet (ds3packet_t *p) { this->recycle_segment (static_cast<ds3packet_ccf_t *>(p)); }
+};
+
+/** @brief the ccf unpack class for nbs, counts the calls of the batched event */
+class ds3_ccf_unpack_batch_nbs_t : public ds3_ccf_unpack_nbs_t {
+public:
+    ds3_ccf_unpack_batch_nbs_t () : numcalls(0), nummac(0) {}
+    size_t numcalls; /**< the number of the calls of signify_packets() */
+    size_t nummac; /**< the number of the MAC packets signified by signify_packets() */
+protected:
+    virtual int signify_packets (ds3_packet_buffer_t ** macbuffers, size_t num) { this->numcalls ++; this->nummac += num; return ds3_ccf_unpack_nbs_t::signify_packets (macbuffers, num); }
+};
+
+/** @brief the ccf unpack class for nbs, keeps the frame views until release_views() */
+class ds3_ccf_unpack_view_nbs_t : public ds3_ccf_unpack_nbs_t {
+public:
+    ds3_ccf_unpack_view_nbs_t () : numrecycle(0), numdrop(0) { this->set_frame_view (true); }
+    std::vector<ds3_frame_view_t *> views; /**< the frame views signified */
+    size_t numrecycle; /**< the number of the segments recycled */
+    size_t numdrop; /**< the number of the segments dropped */
+    void release_views (void) { size_t i; for (i = 0; i < this->views.size(); i ++) { this->release_frame (this->views[i]); } this->views.resize (0); } /**< release the frame views kept */
+protected:
+    virtual void recycle_packet (ds3packet_t *p) { this->numrecycle ++; }
+    virtual void drop_packet (ds3packet_t *p) { this->numdrop ++; }
+    virtual int signify_frame (ds3_frame_view_t * view) { this->views.push_back (view); return 0; }
+};
+
+/** @brief a MAC packet unpacked by the unpack service */
+typedef struct _ds3_unpack_rec_t {
+    uint32_t flow; /**< the flow id */
+    uint8_t sc; /**< SID Cluster ID */
+    uint16_t sequence; /**< the sequence # in the MAC header */
+} ds3_unpack_rec_t;
+
+/** @brief the ccf unpack service class for nbs, the MAC packets are recorded in the list of each shard */
+class ds3_ccf_unpack_svc_nbs_t : public ds3_ccf_unpack_svc_t {
+public:
+    ds3_ccf_unpack_svc_nbs_t (size_t numshards = 1, size_t pbmul = 0) : ds3_ccf_unpack_svc_t(numshards, pbmul) {}
+    std::vector<std::vector<ds3_unpack_rec_t> > macrecv; /**< the MAC packets of each shard */
+    std::vector<size_t> numrecycle; /**< the segments recycled by each shard */
+protected:
+    virtual void recycle_packet (size_t shard, ds3packet_t *p) { this->numrecycle[shard] ++; }
+    virtual void drop_packet (size_t shard, ds3packet_t *p) {}
+    virtual int signify_packet (size_t shard, uint32_t flow, uint8_t sc, ds3_packet_buffer_t & macbuffer);
+    virtual int signify_piggyback (size_t shard, uint32_t flow, int sc, size_t request) { return 0; }
+    virtual double current_time (void) { return my_time(); }
 };
 
 #if CCFDEBUG
@@ -11,6 +11,9 @@
 
 #include "testmac.h"
 
+DS3_PKTCNT_IMPLEMENT_BUFTYPE(ds3_packet_buffer_nbsmac_t, ds3_packet_buffer_nbs_t);
+DS3_PKTCNT_IMPLEMENT_BUFTYPE(ds3_packet_buffer_slicemac_t, ds3_packet_buffer_slice_t);
+
 #if 0
 /**
  * @brief The DOCSIS MAC header structure
@@ -108,17 +111,44 @@ ds3hdr_mac_from_nbs (uint8_t *nbsbuf, size_t szbuf, ds3hdr_mac_t * rethdr)
     return (ret);
 }
 
+/**
+ * @brief read the MAC header at position pos of the buffer
+ *
+ * @param buf : [in] the buffer
+ * @param pos : [in] the position of the MAC header
+ * @param rethdr : [out] the MAC header
+ *
+ * @return the byte size of the header, >0 on success, < 0 on error(no enough data)
+ */
+static ssize_t
+ds3hdr_mac_from_buffer (ds3_packet_buffer_t *buf, size_t pos, ds3hdr_mac_t * rethdr)
+{
+    uint8_t tmpbuf[sizeof(uint32_t) + sizeof(uint16_t)];
+    const uint8_t * p = buf->peek_span (pos, sizeof(tmpbuf), tmpbuf);
+    if (NULL == p) {
+        return -1;
+    }
+    return ds3hdr_mac_from_nbs ((uint8_t *)p, sizeof(tmpbuf), rethdr);
+}
+
 ssize_t
 ds3_packet_buffer_nbsmac_t::block_size_at (size_t pos)
 {
     // size of sub-block (including header+content)
     ds3hdr_mac_t machdr;
-    if (pos >= (this->buffer).size()) {
+    ssize_t szhdr = ds3hdr_mac_from_buffer (this, pos, &machdr);
+    if (szhdr < 0) {
         return -1;
     }
-    memset (&machdr, 0, sizeof(machdr));
-    assert ((this->buffer).size() > pos);
-    ssize_t szhdr = ds3hdr_mac_from_nbs (&(this->buffer[pos]), (this->buffer).size() - pos, &machdr);
+    return ( szhdr + (ssize_t)(machdr.length) );
+}
+
+ssize_t
+ds3_packet_buffer_slicemac_t::block_size_at (size_t pos)
+{
+    // size of sub-block (including header+content)
+    ds3hdr_mac_t machdr;
+    ssize_t szhdr = ds3hdr_mac_from_buffer (this, pos, &machdr);
     if (szhdr < 0) {
         return -1;
     }
@@ -208,18 +238,7 @@ ds3packet_nbsmac_t::from_nbs (ds3_packet_buffer_t *peer, size_t pos_peer)
     }
     // the ``MAC header''
     ds3hdr_mac_t tmphdr;
-    std::vector<uint8_t> buffer1;
-#if 0
-    peer->append_to (buffer1);
-#else
-    buffer1.resize(szret);
-    ssize_t i;
-    for (i = 0; i < szret; i ++) {
-        buffer1[i] = peer->at(pos_peer + i);
-    }
-#endif // 1
-    size_t szbuf = buffer1.size();
-    szret = ds3hdr_mac_from_nbs (&(buffer1[0]), szbuf, &tmphdr);
+    szret = ds3hdr_mac_from_buffer (peer, pos_peer, &tmphdr);
     if (szret < 0) {
         return -1;
     }
@@ -384,23 +403,14 @@ ds3packet_nbsmac_t::insert_to (size_t pos_peer, ds3_packet_buffer_t *arg_peer, s
         (arg_peer) = peer = new ds3_real_type ();
         flg_peer_is_new = true;
     } else {
-        peer = dynamic_cast<ds3_real_type *>(arg_peer);
-        if (NULL == peer) {
-            if (NULL != (arg_peer)->get_buffer()) {
-                /* it's a base class, and it stored the content from other ns2 content */
-                peer = dynamic_cast<ds3_real_type *>((arg_peer)->get_buffer());
-            }
-        }
+        peer = ds3_buffer_cast_content<ds3_real_type>(arg_peer);
         if (NULL == peer) {
             /* create a new one, and try to append to the current arg_peer */
             ds3_real_type p;
             assert (NULL != (arg_peer));
             (arg_peer)->insert(0, &p, 0, 0);
 
-            if (NULL != (arg_peer)->get_buffer()) {
-                /* it's a base class, and it stored the content from other ns2 content */
-                peer = dynamic_cast<ds3_real_type *>((arg_peer)->get_buffer());
-            }
+            peer = ds3_buffer_cast_content<ds3_real_type>(arg_peer);
         }
     }
     if (NULL == peer) {
@@ -433,26 +443,19 @@ ds3packet_nbsmac_t::insert_to (size_t pos_peer, ds3_packet_buffer_t *arg_peer, s
 
     if (pos < szhdr) {
         /* part of content is the header */
-        // create a new buffer
-        std::vector<uint8_t> buffer1;
-        buffer1.resize(szhdr * 2);
-        hdr_to_nbs (&buffer1[0], buffer1.size());
-        buffer1.resize(szhdr);
+        // the header is small, use the buffer in stack
+        uint8_t buffer1[sizeof(uint32_t) + sizeof(uint16_t)];
+        assert (szhdr <= sizeof(buffer1));
+        hdr_to_nbs (buffer1, sizeof(buffer1));
         assert (szhdr >= pos);
         szcpy = szhdr - pos;
         if (szcpy + szcur > szbuf) {
             szcpy = szbuf - szcur;
         }
-        if (szcpy + pos > buffer1.size()) {
-            szcpy = buffer1.size() - pos;
-        }
         assert (szcpy + szcur <= szbuf);
         //std::copy (buffer1.begin() + pos, buffer1.begin() + pos + szcpy, nbsbuf + szcur);
-        assert (pos < buffer1.size());
-        assert (pos + szcpy <= buffer1.size());
-        std::vector<uint8_t>::iterator it1b = buffer1.begin() + pos;
-        std::vector<uint8_t>::iterator it1e = buffer1.begin() + pos + szcpy;
-        peer->append (it1b, it1e);
+        assert (pos + szcpy <= szhdr);
+        peer->append (buffer1 + pos, szcpy);
         szcur += szcpy;
     }
     if (szcur < szbuf) {
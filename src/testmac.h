@@ -11,6 +11,7 @@
 
 #include "ds3pktbuf.h"
 #include "ds3pktccf.h"
+#include "ds3pktslc.h"
 
 #if 1
 /**
@@ -40,6 +41,21 @@ inline ds3_packet_buffer_nbsmac_t::ds3_packet_buffer_nbsmac_t(ds3_packet_buffer_
 
 inline ds3_packet_buffer_nbsmac_t::~ds3_packet_buffer_nbsmac_t() {}
 
+/**
+ * @brief the packet content class for reference counted slices of type DOCSIS MAC
+ */
+class ds3_packet_buffer_slicemac_t : public ds3_packet_buffer_slice_t {
+public:
+    ds3_packet_buffer_slicemac_t() {}
+    virtual ssize_t block_size_at (size_t pos);
+    DS3_PKTCNT_DECLARE_MEMBER_FUNCTIONS_MINI(ds3_packet_buffer_slicemac_t);
+};
+
+inline ds3_packet_buffer_slicemac_t::ds3_packet_buffer_slicemac_t(ds3_packet_buffer_t *peer, size_t begin, size_t end)
+    : ds3_packet_buffer_slice_t (peer, begin, end) { }
+
+inline ds3_packet_buffer_slicemac_t::~ds3_packet_buffer_slicemac_t() {}
+
 /** @brief packet class for testing fake mac */
 class ds3packet_nbsmac_t : public ds3packet_t {
 public:
@@ -48,7 +64,7 @@ public:
     virtual uint8_t & at(size_t i);
 #endif
     ds3packet_nbsmac_t() { memset (&(this->machdr), 0, sizeof (this->machdr)); }
-    virtual ~ds3packet_nbsmac_t() { std::cout << "Destroy " << __func__ << std::endl;}
+    virtual ~ds3packet_nbsmac_t() {}
 
     virtual ssize_t to_nbs (uint8_t *nbsbuf, size_t szbuf);
     virtual ssize_t from_nbs (uint8_t *nbsbuf, size_t szbuf);
@@ -69,7 +85,7 @@ public:
 
 private:
     int set_header (ds3hdr_mac_t * mhdr) { if (NULL == mhdr) {return -1;} memmove (&(this->machdr), mhdr, sizeof (*mhdr)); return 0; } /**< set the NS2 packet header */
-    ds3hdr_mac_t & get_header (void) { this->machdr.length = this->get_content_ref().size(); return machdr; } /**< get a reference of the MAC header */
+    ds3hdr_mac_t & get_header (void) { if (this->machdr.length != (uint16_t)this->get_content_ref().size()) { this->machdr.length = this->get_content_ref().size(); } return machdr; } /**< get a reference of the MAC header, the length is only written when the content is changed, so the concurrent readers (bonded pack) don't write */
 
     ssize_t hdr_to_nbs (uint8_t *nbsbuf, size_t szbuf) { this->get_header(); return ds3hdr_mac_to_nbs (nbsbuf, szbuf, &(this->machdr)); }
     ds3hdr_mac_t machdr; /**< the MAC packet header */
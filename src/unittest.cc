@@ -21,7 +21,13 @@ TEST_CASE( "Test ccfpack the DOCSIS CCF module", "[ccfpack]" ) {
     REQUIRE (0 == test_pktclass());
     REQUIRE (0 == test_machdr());
     REQUIRE (0 == test_ccfhdr());
+    REQUIRE (0 == test_ccfhdr_batch());
+    REQUIRE (0 == test_ccfhdr_hcs());
+    REQUIRE (0 == test_ccfhdr_view());
+    REQUIRE (0 == test_pktslc());
     REQUIRE (0 == test_pktcnt());
+    REQUIRE (0 == test_pktgnc_index());
+    REQUIRE (0 == test_trace());
     REQUIRE (0 == test_pack());
     REQUIRE (0 == test_pktgnc());
 